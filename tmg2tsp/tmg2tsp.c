@@ -10,70 +10,545 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <getopt.h>
 
 #include "tmggraph.h"
+#include "tmgmatrix.h"
+#include "tmgch.h"
+#include "tmgkdtree.h"
+#include "tmgselect.h"
+#include "tmghilbert.h"
+#include "tmgtravel.h"
+#include "tmgroute.h"
+#include "tmgshape.h"
+#include "tmgsnapshot.h"
+#include "tmgcache.h"
+#include "tmgbatch.h"
+#include "tmgwrite.h"
+#include "tspheuristic.h"
+#include "tsplowerbound.h"
 
-/* compute the distance between the graph vertex at index a and the
-   graph vertex at index b in tenths of a mile, rounded up to the next
-   tenth.
-*/
-int vertex_to_vertex_distance_in_tenths(tmg_graph *g, int a, int b) {
+// the selected points, for distances between them by point number
+typedef struct tour_points {
+  tmg_graph *g;
+  int *points;
+} tour_points;
 
-  double distance;
-  if (a == b) return 0;
+/* tsp_heur_distance: great circle distance in tenths of a mile */
+static int tour_distance(void *data, int a, int b) {
 
-  distance = tmg_distance_latlng(&(g->vertices[a]->w.coords),
-				 &(g->vertices[b]->w.coords));
+  tour_points *tp = (tour_points *)data;
+  return vertex_to_vertex_distance_in_tenths(tp->g, tp->points[a],
+					     tp->points[b]);
+}
 
-  distance = ceil(distance * 10);
+static void usage(char *progname) {
 
-  return (int)distance;  
+  fprintf(stderr, "Usage: %s [-j nthreads] [--metric great-circle|road] [--ch chfile]\n       [--output-format text|bin] [--packed] [-o outfile]\n       [--memory MB [--resume]] [--knn K] [--tour greedy|nearest] [--bound]\n       [--select first|random|farthest|grid|kmeans] [--seed N]\n       [--bbox minlat,minlng,maxlat,maxlng] [--order file|hilbert]\n       [--traveler NAME] [--min-travelers K] [--route NAME]\n       [--check-lengths]\n       [--simplify MILES] [--snapshot|--no-snapshot] [--cache DIR]\n       filename numpoints\n   or: %s [options] --batch manifest\n", progname, progname);
 }
 
 int main(int argc, char *argv[]) {
 
   int num_points;
-  
-  if (argc != 3) {
-    fprintf(stderr, "Usage: %s filename numpoints\n", argv[0]);
+  int nthreads = tmg_matrix_default_threads();
+  tmg_metric metric = GREAT_CIRCLE;
+  char *ch_filename = NULL;
+  tmg_write_options opts = { NULL, 0, TSP_LAYOUT_FULL, 0 };
+  size_t memory_budget = 0;
+  int resume = 0;
+  int knn = 0;
+  int tour = 0;
+  int bound = 0;
+  tsp_heur_start tour_start = TSP_HEUR_GREEDY;
+  tmg_select_options select = { SELECT_FIRST, 1, 0, 0.0, 0.0, 0.0, 0.0,
+				 -1, 0, -1 };
+  char *traveler = NULL;
+  char *route = NULL;
+  int hilbert = 0;
+  int check_lengths = 0;
+  double simplify = -1.0;
+  int snapshot = 0;  // 1 to save a snapshot, -1 to ignore one
+  char *cache_dir = NULL;
+  char *manifest = NULL;
+  int opt;
+
+  static struct option long_options[] = {
+    { "metric", required_argument, NULL, 'm' },
+    { "ch", required_argument, NULL, 'c' },
+    { "output-format", required_argument, NULL, 'f' },
+    { "packed", no_argument, NULL, 'p' },
+    { "memory", required_argument, NULL, 'M' },
+    { "resume", no_argument, NULL, 'r' },
+    { "knn", required_argument, NULL, 'k' },
+    { "tour", required_argument, NULL, 'U' },
+    { "bound", no_argument, NULL, 'W' },
+    { "select", required_argument, NULL, 's' },
+    { "seed", required_argument, NULL, 'S' },
+    { "bbox", required_argument, NULL, 'b' },
+    { "order", required_argument, NULL, 'O' },
+    { "traveler", required_argument, NULL, 't' },
+    { "min-travelers", required_argument, NULL, 'T' },
+    { "route", required_argument, NULL, 'R' },
+    { "check-lengths", no_argument, NULL, 'L' },
+    { "simplify", required_argument, NULL, 'D' },
+    { "snapshot", no_argument, NULL, 'B' },
+    { "no-snapshot", no_argument, NULL, 'N' },
+    { "cache", required_argument, NULL, 'C' },
+    { "batch", required_argument, NULL, 'A' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  while ((opt = getopt_long(argc, argv, "j:o:", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'j':
+      nthreads = atoi(optarg);
+      if (nthreads < 1 || nthreads > TMG_MAX_THREADS) {
+	fprintf(stderr, "Number of threads must be from 1 to %d\n",
+		TMG_MAX_THREADS);
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'm':
+      if (!tmg_metric_from_name(optarg, &metric)) {
+	fprintf(stderr, "Unknown metric %s\n", optarg);
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'c':
+      // road distances from a contraction hierarchy, loaded from this
+      // file or built and saved there
+      ch_filename = optarg;
+      metric = ROAD;
+      break;
+    case 'f':
+      if (strcmp(optarg, "bin") == 0) {
+	opts.binary = 1;
+      }
+      else if (strcmp(optarg, "text") == 0) {
+	opts.binary = 0;
+      }
+      else {
+	fprintf(stderr, "Unknown output format %s\n", optarg);
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'p':
+      // the matrix is symmetric, so the binary format can store only
+      // its upper triangle
+      opts.layout = TSP_LAYOUT_UPPER;
+      break;
+    case 'o':
+      opts.outfile = optarg;
+      break;
+    case 'M':
+      // compute and write the matrix in bands of rows taking about
+      // this many megabytes in all, rather than all at once
+      memory_budget = (size_t)(atof(optarg) * 1024 * 1024);
+      if (memory_budget == 0) {
+	fprintf(stderr, "Memory budget must be positive\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'r':
+      resume = 1;
+      break;
+    case 'k':
+      // write each point's K nearest neighbors instead of a matrix
+      knn = atoi(optarg);
+      if (knn < 1) {
+	fprintf(stderr, "Number of neighbors must be at least 1\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'U':
+      // write a heuristic tour of the points instead of a matrix,
+      // trying moves toward each point's --knn nearest neighbors
+      if (!tsp_heur_start_from_name(optarg, &tour_start)) {
+	fprintf(stderr, "Unknown starting tour %s\n", optarg);
+	usage(argv[0]);
+	exit(1);
+      }
+      tour = 1;
+      break;
+    case 'W':
+      // write a bound certificate for the points instead of a matrix,
+      // from trees over only the edges to their --knn nearest
+      // neighbors if given, otherwise over all pairs
+      bound = 1;
+      break;
+    case 's':
+      if (!tmg_select_from_name(optarg, &select.mode)) {
+	fprintf(stderr, "Unknown selection %s\n", optarg);
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'S':
+      select.seed = strtoull(optarg, NULL, 0);
+      break;
+    case 'b':
+      // only vertices inside this box are candidates
+      if (!tmg_select_parse_bbox(optarg, &select)) {
+	fprintf(stderr, "Invalid bounding box %s\n", optarg);
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'O':
+      // renumber the graph's vertices along a Hilbert curve, which
+      // also lists the points in that order
+      if (strcmp(optarg, "hilbert") == 0) {
+	hilbert = 1;
+      }
+      else if (strcmp(optarg, "file") == 0) {
+	hilbert = 0;
+      }
+      else {
+	fprintf(stderr, "Unknown vertex order %s\n", optarg);
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 't':
+      // only endpoints of segments this traveler has traveled are
+      // candidates, the name is looked up once the graph is loaded
+      traveler = optarg;
+      break;
+    case 'T':
+      select.min_travelers = atoi(optarg);
+      if (select.min_travelers < 1) {
+	fprintf(stderr, "Minimum number of travelers must be at least 1\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'R':
+      // only vertices on this route are candidates
+      route = optarg;
+      break;
+    case 'L':
+      // compare edge lengths to an independent computation
+      check_lengths = 1;
+      break;
+    case 'D':
+      // drop shaping points within this many miles of a simplified
+      // polyline; edge lengths are unaffected
+      simplify = atof(optarg);
+      if (simplify < 0.0) {
+	fprintf(stderr, "Simplification tolerance must not be negative\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'B':
+      // save a snapshot of the graph next to the .tmg file if there
+      // is no fresh one, so later runs load it instead
+      snapshot = 1;
+      break;
+    case 'N':
+      snapshot = -1;
+      break;
+    case 'C':
+      // reuse and save matrices in this directory
+      cache_dir = optarg;
+      break;
+    case 'A':
+      // compute the matrices listed in this manifest instead of one
+      manifest = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  if (resume && !memory_budget) {
+    fprintf(stderr, "--resume applies only with --memory\n");
+    usage(argv[0]);
+    exit(1);
+  }
+  if ((knn || tour || bound) &&
+      (metric != GREAT_CIRCLE || memory_budget || opts.binary)) {
+    fprintf(stderr, "--knn, --tour and --bound use great circle distances and write text, and do not combine with --metric road, --ch, --memory or --output-format bin\n");
+    usage(argv[0]);
+    exit(1);
+  }
+  if (tour && bound) {
+    fprintf(stderr, "Only one of --tour and --bound can be written\n");
+    usage(argv[0]);
+    exit(1);
+  }
+  if (cache_dir && (knn || tour || bound || memory_budget)) {
+    fprintf(stderr, "--cache applies only to matrices computed in memory, not with --knn, --tour, --bound or --memory\n");
+    usage(argv[0]);
+    exit(1);
+  }
+  opts.nthreads = nthreads;
+
+  if (manifest) {
+    if (argc - optind != 0 || opts.outfile || ch_filename || memory_budget ||
+	knn || tour || bound || cache_dir || check_lengths ||
+	simplify >= 0.0) {
+      fprintf(stderr, "--batch takes the files, numbers of points and output files from the manifest, and does not combine with -o, --ch, --memory, --knn, --tour, --bound, --cache, --check-lengths or --simplify\n");
+      usage(argv[0]);
+      exit(1);
+    }
+    tmg_batch_options batch = { metric, select, traveler, route, hilbert,
+				snapshot, opts.binary, opts.layout, nthreads };
+    return tmg_batch_run(manifest, &batch) ? 0 : 1;
+  }
+
+  if (argc - optind != 2) {
+    usage(argv[0]);
     exit(1);
   }
 
-  num_points = atoi(argv[2]);
+  char *filename = argv[optind];
+  num_points = atoi(argv[optind+1]);
   if (num_points < 2) {
     fprintf(stderr, "Number of points must be at least 2\n");
-    fprintf(stderr, "Usage: %s filename numpoints\n", argv[0]);
+    usage(argv[0]);
     exit(1);
   }
 
-  tmg_graph *g = tmg_load_graph(argv[1]);
+  // a fresh snapshot of the graph is used if there is one
+  tmg_graph *g = (snapshot < 0) ? tmg_load_graph_mmap(filename) :
+    tmg_load_graph_cached(filename, snapshot);
   if (g == NULL) {
-    fprintf(stderr, "Could not create graph from file %s\n", argv[1]);
+    fprintf(stderr, "Could not create graph from file %s\n", filename);
     exit(1);
   }
 
-  // start by printing the number of points
-  printf("%d\n", num_points);
+  if (num_points > g->num_vertices) {
+    fprintf(stderr, "Graph from file %s has only %d vertices\n", filename,
+	    g->num_vertices);
+    tmg_graph_destroy(g);
+    exit(1);
+  }
 
-  // compute the distances between all pairs of the first num_points in
-  // tenths of a mile, rounded up to the next tenth (to avoid any 0's)
-  for (int from = 0; from < num_points; from++) {
-    for (int to = 0; to < num_points; to++) {
-      printf("%d\t", vertex_to_vertex_distance_in_tenths(g, from, to));
+  if (check_lengths) {
+    double worst;
+    int bad = tmg_graph_check_lengths(g, TMG_LENGTH_TOLERANCE, &worst);
+    fprintf(stderr, "Checked %d edge lengths: %d differ from reference, largest difference %g miles\n",
+	    g->num_edges, bad, worst);
+    if (bad) {
+      tmg_graph_destroy(g);
+      exit(1);
+    }
+  }
+
+  if (simplify >= 0.0) {
+    int before = g->num_shaping_points;
+    int removed = tmg_graph_simplify_shaping(g, simplify);
+    if (removed < 0) {
+      tmg_graph_destroy(g);
+      exit(1);
+    }
+    fprintf(stderr, "Simplified shaping points from %d to %d\n", before,
+	    before - removed);
+  }
+
+  if (traveler) {
+    select.traveler = tmg_traveler_from_name(g, traveler);
+    if (select.traveler < 0) {
+      fprintf(stderr, "Graph from file %s has no traveler %s\n", filename,
+	      traveler);
+      tmg_graph_destroy(g);
+      exit(1);
+    }
+  }
+
+  if (route) {
+    select.route = tmg_route_from_name(g, route);
+    if (select.route < 0) {
+      fprintf(stderr, "Graph from file %s has no route %s\n", filename, route);
+      tmg_graph_destroy(g);
+      exit(1);
+    }
+  }
+
+  if (hilbert && !tmg_graph_reorder_hilbert(g)) {
+    tmg_graph_destroy(g);
+    exit(1);
+  }
+
+  // the vertices that become the points, in order
+  int *points = tmg_select_points(g, num_points, &select, nthreads);
+  if (points == NULL) {
+    tmg_graph_destroy(g);
+    exit(1);
+  }
+
+  // a bound needs a good tour to aim at, which is found the same way
+  if (tour || bound) {
+    int k = knn ? knn : TSP_HEUR_NEIGHBORS;
+    if (k >= num_points) {
+      if (knn) {
+	fprintf(stderr, "Number of neighbors must be less than number of points\n");
+	free(points);
+	tmg_graph_destroy(g);
+	exit(1);
+      }
+      k = num_points - 1;
+    }
+    int *neighbors = (int *)malloc((size_t)num_points * k * sizeof(int));
+    int *tenths = (int *)malloc((size_t)num_points * k * sizeof(int));
+    int *order = (int *)malloc(num_points * sizeof(int));
+    int ok = (neighbors && tenths && order);
+    if (!ok) {
+      fprintf(stderr, "Could not allocate a tour of %d points\n", num_points);
+    }
+    ok = ok && tmg_knn_compute(g, points, num_points, k, nthreads, neighbors,
+			       tenths);
+    tour_points tp = { g, points };
+    tsp_heur_instance inst = { num_points, tour_distance, &tp, k, neighbors };
+    tsp_heur_stats stats;
+    long length = ok ? tsp_heur_tour(&inst, tour_start, order, &stats) : -1;
+    if (length >= 0) {
+      fprintf(stderr, "%s tour %ld, %ld 2-opt and %ld Or-opt moves, improved to %ld\n",
+	      tsp_heur_start_names[tour_start], stats.start_length,
+	      stats.two_opt_moves, stats.or_opt_moves, length);
+    }
+    if (tour) {
+      ok = (length >= 0) && tmg_write_tour(g, points, num_points, order,
+					   length, filename, &opts);
+    }
+    else if (length >= 0) {
+      tsp_bound_instance binst = { num_points, tour_distance, &tp, k,
+				   knn ? neighbors : NULL };
+      tsp_bound *b = tsp_bound_compute(&binst, length, TSP_BOUND_ITERATIONS,
+				       nthreads);
+      ok = (b != NULL);
+      if (ok) {
+	long best = tsp_bound_best(b);
+	fprintf(stderr, "Spanning tree bound %ld, 1-tree bound %ld after %d iterations%s, tour is within %.2f%%\n",
+		b->mst, b->one_tree, b->iterations,
+		b->exact ? "" : " (estimated from nearest neighbors)",
+		best > 0 ? 100.0 * (length - best) / best : 0.0);
+	ok = tsp_bound_write(opts.outfile, b, filename);
+	tsp_bound_destroy(b);
+      }
+    }
+    else {
+      ok = 0;
+    }
+    free(neighbors);
+    free(tenths);
+    free(order);
+    free(points);
+    tmg_graph_destroy(g);
+    return ok ? 0 : 1;
+  }
+
+  if (knn) {
+    if (knn >= num_points) {
+      fprintf(stderr, "Number of neighbors must be less than number of points\n");
+      free(points);
+      tmg_graph_destroy(g);
+      exit(1);
+    }
+    int *neighbors = (int *)malloc((size_t)num_points * knn * sizeof(int));
+    int *tenths = (int *)malloc((size_t)num_points * knn * sizeof(int));
+    int ok = (neighbors && tenths);
+    if (!ok) {
+      fprintf(stderr, "Could not allocate %d neighbor lists\n", num_points);
+    }
+    ok = ok && tmg_knn_compute(g, points, num_points, knn, nthreads,
+			       neighbors, tenths);
+    ok = ok && tmg_write_knn(g, points, num_points, knn, neighbors, tenths,
+			     filename, &opts);
+    free(neighbors);
+    free(tenths);
+    free(points);
+    tmg_graph_destroy(g);
+    return ok ? 0 : 1;
+  }
+
+  // distances among a prefix of the points may already be cached,
+  // and if all of them are, nothing needs to be computed
+  int *matrix = NULL;
+  int known = 0;
+  int cached = 0;
+  tmg_cache_header cache;
+  if (cache_dir) {
+    tmg_cache_init(&cache, g, &select, metric, ch_filename != NULL);
+    matrix = (int *)malloc((size_t)num_points * num_points * sizeof(int));
+    if (matrix == NULL) {
+      fprintf(stderr, "Could not allocate %d x %d distance matrix\n",
+	      num_points, num_points);
+      free(points);
+      tmg_graph_destroy(g);
+      exit(1);
+    }
+    known = tmg_cache_lookup(cache_dir, &cache, g, points, num_points, matrix,
+			     &cached);
+    if (known > 0) {
+      fprintf(stderr, "Reusing cached distances among %d of %d points\n",
+	      known, num_points);
+    }
+  }
+
+  tmg_ch *ch = NULL;
+  if (ch_filename && known < num_points) {
+    ch = tmg_ch_load_or_build(ch_filename, g);
+    if (ch == NULL) {
+      free(points);
+      tmg_graph_destroy(g);
+      exit(1);
     }
-    printf("\n");
   }
 
-  printf("\n");
+  // for large matrices, compute and write a band of rows at a time
+  if (memory_budget) {
+    int ok = tmg_stream_matrix(g, points, num_points, filename, metric, ch,
+			       memory_budget, resume, &opts);
+    if (ch) tmg_ch_destroy(ch);
+    free(points);
+    tmg_graph_destroy(g);
+    return ok ? 0 : 1;
+  }
 
-  // print the places and coordinates
-  for (int i = 0; i < num_points; i++) {
-    tmg_waypoint_print(&(g->vertices[i]->w));
-    printf("\n");
+  // compute the distances between all pairs of the selected points in
+  // tenths of a mile, rounded up to the next tenth (to avoid any 0's)
+  if (cache_dir) {
+    // only the rows and columns of the points not in the cache
+    int computed = (known == num_points) ||
+      (ch ? tmg_ch_matrix_extend(ch, points, num_points, known, matrix,
+				 nthreads) :
+       tmg_matrix_extend(g, points, num_points, known, metric, nthreads,
+			 matrix));
+    if (ch) tmg_ch_destroy(ch);
+    if (!computed) {
+      free(matrix);
+      matrix = NULL;
+    }
+    // each key keeps its largest matrix
+    else if (cached < num_points) {
+      tmg_cache_save(cache_dir, &cache, g, points, num_points, matrix);
+    }
+  }
+  else if (ch) {
+    matrix = tmg_ch_matrix(ch, points, num_points, nthreads);
+    tmg_ch_destroy(ch);
+  }
+  else {
+    matrix = tmg_matrix_compute(g, points, num_points, metric, nthreads);
+  }
+  if (matrix == NULL) {
+    free(points);
+    tmg_graph_destroy(g);
+    exit(1);
   }
 
-  printf("\nComputed from METAL .tmg file %s\n", argv[1]);
+  int ok = tmg_write_matrix(g, points, matrix, num_points, filename, &opts);
+  free(matrix);
+  free(points);
   tmg_graph_destroy(g);
 
-  return 0;
+  return ok ? 0 : 1;
 }
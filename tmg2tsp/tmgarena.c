@@ -0,0 +1,102 @@
+/*
+  A simple arena (bump) allocator: memory is handed out sequentially
+  from large blocks and only ever released all at once.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tmgarena.h"
+
+/* initialize an empty arena */
+void tmg_arena_init(tmg_arena *a) {
+
+  a->blocks = NULL;
+  a->total = 0;
+}
+
+/*
+  Allocate a new block with room for at least size bytes and link it
+  into the arena.  Blocks for requests larger than a quarter of
+  TMG_ARENA_BLOCK_SIZE are sized exactly and linked in behind the
+  current block, so the space left in the current block is not
+  abandoned.  Returns NULL if the block could not be allocated.
+*/
+static tmg_arena_block *tmg_arena_add_block(tmg_arena *a, size_t size) {
+
+  size_t block_size = TMG_ARENA_BLOCK_SIZE;
+  int dedicated = (size > TMG_ARENA_BLOCK_SIZE/4);
+  if (dedicated) block_size = size;
+
+  tmg_arena_block *b =
+    (tmg_arena_block *)malloc(sizeof(tmg_arena_block) + block_size);
+  if (!b) return NULL;
+  b->size = block_size;
+  b->used = 0;
+  a->total += block_size;
+
+  if (dedicated && a->blocks) {
+    b->next = a->blocks->next;
+    a->blocks->next = b;
+  }
+  else {
+    b->next = a->blocks;
+    a->blocks = b;
+  }
+  return b;
+}
+
+/*
+  Allocate size bytes from the arena, NULL if no memory is available.
+*/
+void *tmg_arena_alloc(tmg_arena *a, size_t size) {
+
+  size = (size + TMG_ARENA_ALIGN - 1) & ~((size_t)TMG_ARENA_ALIGN - 1);
+  tmg_arena_block *b = a->blocks;
+  if (!b || b->size - b->used < size) {
+    b = tmg_arena_add_block(a, size);
+    if (!b) {
+      fprintf(stderr, "Could not allocate %zu bytes for arena\n", size);
+      return NULL;
+    }
+  }
+  void *p = b->data + b->used;
+  b->used += size;
+  return p;
+}
+
+/*
+  Allocate zeroed space for count items of the given size from the
+  arena.
+*/
+void *tmg_arena_calloc(tmg_arena *a, size_t count, size_t size) {
+
+  void *p = tmg_arena_alloc(a, count*size);
+  if (p) memset(p, 0, count*size);
+  return p;
+}
+
+/* copy a string into the arena */
+char *tmg_arena_strdup(tmg_arena *a, const char *s) {
+
+  size_t len = strlen(s) + 1;
+  char *copy = (char *)tmg_arena_alloc(a, len);
+  if (copy) memcpy(copy, s, len);
+  return copy;
+}
+
+/* release all memory held by the arena, one free per block */
+void tmg_arena_free(tmg_arena *a) {
+
+  tmg_arena_block *b = a->blocks;
+  while (b) {
+    tmg_arena_block *rmme = b;
+    b = b->next;
+    free(rmme);
+  }
+  a->blocks = NULL;
+  a->total = 0;
+}
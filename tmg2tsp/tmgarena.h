@@ -0,0 +1,46 @@
+/*
+  Structure definitions and function prototypes for a simple arena
+  (bump) allocator, used so that a tmg_graph owns a few large blocks
+  of memory instead of a separate allocation for every vertex, edge,
+  list node and string.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGARENA_H
+#define _TMGARENA_H
+
+#include <stddef.h>
+
+// size of the blocks used for small allocations, larger requests get
+// a block of their own
+#define TMG_ARENA_BLOCK_SIZE (1<<20)
+
+// all allocations are aligned to this many bytes
+#define TMG_ARENA_ALIGN 16
+
+// one block of memory, allocations come from data
+typedef struct tmg_arena_block {
+  struct tmg_arena_block *next;
+  size_t size;
+  size_t used;
+  // pad so data is TMG_ARENA_ALIGN-aligned
+  size_t pad;
+  char data[];
+} tmg_arena_block;
+
+// an arena is just its list of blocks, the current one at the head
+typedef struct tmg_arena {
+  tmg_arena_block *blocks;
+  size_t total;  // bytes of all blocks, for statistics
+} tmg_arena;
+
+// function prototypes
+extern void tmg_arena_init(tmg_arena *a);
+extern void *tmg_arena_alloc(tmg_arena *a, size_t size);
+extern void *tmg_arena_calloc(tmg_arena *a, size_t count, size_t size);
+extern char *tmg_arena_strdup(tmg_arena *a, const char *s);
+extern void tmg_arena_free(tmg_arena *a);
+
+#endif  // _TMGARENA_H
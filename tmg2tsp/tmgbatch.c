@@ -0,0 +1,411 @@
+/*
+  Compute the distance matrices listed in a manifest in one run.
+
+  Each distinct .tmg file is loaded once, by the first job that needs
+  it, while any other jobs needing it wait, and is destroyed when its
+  last job is done.  The jobs run on a work-stealing pool of threads
+  (see tmgpool.h), largest first, so the long jobs are not left for
+  the end.  Each job uses one thread for its own work unless there
+  are fewer jobs than threads.  Per-job timings are reported once all
+  jobs are done.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tmgbatch.h"
+#include "tmgpool.h"
+#include "tmghilbert.h"
+#include "tmgroute.h"
+#include "tmgsnapshot.h"
+#include "tmgtravel.h"
+
+// a distinct .tmg file named in a manifest
+typedef struct tmg_batch_graph {
+  char *filename;
+  pthread_mutex_t lock;  // held while loading
+  int loaded;  // 1 once loaded, -1 if that failed
+  tmg_graph *g;
+  // the batch's selection, with its traveler and route looked up
+  tmg_select_options select;
+  atomic_int jobs_left;
+  double load_time;
+} tmg_batch_graph;
+
+// one line of a manifest, and how it went
+typedef struct tmg_batch_job {
+  char *filename;
+  int num_points;
+  char *outfile;
+  int graph;  // index into the batch's graphs
+  int ok;
+  // seconds spent waiting for the graph to be loaded, choosing the
+  // points, computing the matrix and writing it
+  double wait_time;
+  double select_time;
+  double compute_time;
+  double write_time;
+} tmg_batch_job;
+
+// everything about one batch
+typedef struct tmg_batch {
+  tmg_batch_options *opts;
+  tmg_batch_job *jobs;
+  int num_jobs;
+  tmg_batch_graph *graphs;
+  int num_graphs;
+  int *order;  // job numbers, largest first
+  int job_threads;  // threads each job uses for its own work
+} tmg_batch;
+
+/* seconds on a clock that only moves forward */
+static double tmg_batch_now() {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+  Helper function for tmg_batch_read: the index of the graph for
+  filename in b, adding it if it is new, -1 if out of memory.
+*/
+static int tmg_batch_add_graph(tmg_batch *b, char *filename, int *capacity) {
+
+  int i;
+  for (i = 0; i < b->num_graphs; i++) {
+    if (strcmp(b->graphs[i].filename, filename) == 0) return i;
+  }
+  if (b->num_graphs == *capacity) {
+    int size = *capacity ? 2 * *capacity : 16;
+    tmg_batch_graph *graphs =
+      (tmg_batch_graph *)realloc(b->graphs, size * sizeof(tmg_batch_graph));
+    if (!graphs) return -1;
+    b->graphs = graphs;
+    *capacity = size;
+  }
+  tmg_batch_graph *bg = &(b->graphs[b->num_graphs]);
+  memset(bg, 0, sizeof(tmg_batch_graph));
+  bg->filename = strdup(filename);
+  if (!bg->filename) return -1;
+  return b->num_graphs++;
+}
+
+/*
+  Read the jobs of manifest into b.  Returns 1 on success, 0 if the
+  manifest could not be read or has a bad line, which is reported.
+*/
+static int tmg_batch_read(tmg_batch *b, char *manifest) {
+
+  FILE *fp = fopen(manifest, "r");
+  if (!fp) {
+    fprintf(stderr, "Could not open manifest %s\n", manifest);
+    return 0;
+  }
+
+  char line[TMG_BATCH_LINE];
+  char filename[TMG_BATCH_LINE];
+  char outfile[TMG_BATCH_LINE];
+  char extra;
+  int job_capacity = 0;
+  int graph_capacity = 0;
+  int line_num = 0;
+  int ok = 1;
+  while (ok && fgets(line, TMG_BATCH_LINE, fp)) {
+    line_num++;
+    char *p = line + strspn(line, " \t\r\n");
+    if (*p == '\0' || *p == '#') continue;
+
+    int num_points;
+    if (sscanf(p, "%s %d %s %c", filename, &num_points, outfile,
+	       &extra) != 3) {
+      fprintf(stderr, "%s:%d: expected filename numpoints outfile\n",
+	      manifest, line_num);
+      ok = 0;
+      break;
+    }
+    if (num_points < 2) {
+      fprintf(stderr, "%s:%d: number of points must be at least 2\n",
+	      manifest, line_num);
+      ok = 0;
+      break;
+    }
+
+    if (b->num_jobs == job_capacity) {
+      int size = job_capacity ? 2 * job_capacity : 64;
+      tmg_batch_job *jobs =
+	(tmg_batch_job *)realloc(b->jobs, size * sizeof(tmg_batch_job));
+      if (!jobs) {
+	fprintf(stderr, "Could not allocate %d jobs\n", size);
+	ok = 0;
+	break;
+      }
+      b->jobs = jobs;
+      job_capacity = size;
+    }
+    tmg_batch_job *job = &(b->jobs[b->num_jobs]);
+    memset(job, 0, sizeof(tmg_batch_job));
+    job->num_points = num_points;
+    job->graph = tmg_batch_add_graph(b, filename, &graph_capacity);
+    job->outfile = strdup(outfile);
+    if (job->graph < 0 || !job->outfile) {
+      fprintf(stderr, "Could not allocate memory for manifest %s\n",
+	      manifest);
+      free(job->outfile);
+      ok = 0;
+      break;
+    }
+    job->filename = b->graphs[job->graph].filename;
+    b->num_jobs++;
+  }
+  fclose(fp);
+  if (ok && b->num_jobs == 0) {
+    fprintf(stderr, "Manifest %s lists no jobs\n", manifest);
+    ok = 0;
+  }
+  return ok;
+}
+
+/*
+  Helper function for tmg_batch_graph_get: load the graph of bg and
+  prepare it as the options describe.  Returns the graph, NULL on
+  failure, which is reported.
+*/
+static tmg_graph *tmg_batch_load(tmg_batch *b, tmg_batch_graph *bg) {
+
+  tmg_batch_options *opts = b->opts;
+  tmg_graph *g = (opts->snapshot < 0) ? tmg_load_graph_mmap(bg->filename) :
+    tmg_load_graph_cached(bg->filename, opts->snapshot);
+  if (g == NULL) {
+    fprintf(stderr, "Could not create graph from file %s\n", bg->filename);
+    return NULL;
+  }
+
+  bg->select = opts->select;
+  if (opts->traveler) {
+    bg->select.traveler = tmg_traveler_from_name(g, opts->traveler);
+    if (bg->select.traveler < 0) {
+      fprintf(stderr, "Graph from file %s has no traveler %s\n",
+	      bg->filename, opts->traveler);
+      tmg_graph_destroy(g);
+      return NULL;
+    }
+  }
+  if (opts->route) {
+    bg->select.route = tmg_route_from_name(g, opts->route);
+    if (bg->select.route < 0) {
+      fprintf(stderr, "Graph from file %s has no route %s\n", bg->filename,
+	      opts->route);
+      tmg_graph_destroy(g);
+      return NULL;
+    }
+  }
+  if (opts->hilbert && !tmg_graph_reorder_hilbert(g)) {
+    tmg_graph_destroy(g);
+    return NULL;
+  }
+  return g;
+}
+
+/*
+  The graph of bg, loaded by the first job to ask for it while any
+  others wait.  NULL if it could not be loaded.
+*/
+static tmg_graph *tmg_batch_graph_get(tmg_batch *b, tmg_batch_graph *bg) {
+
+  pthread_mutex_lock(&(bg->lock));
+  if (!bg->loaded) {
+    double start = tmg_batch_now();
+    bg->g = tmg_batch_load(b, bg);
+    bg->loaded = bg->g ? 1 : -1;
+    bg->load_time = tmg_batch_now() - start;
+  }
+  pthread_mutex_unlock(&(bg->lock));
+  return bg->g;
+}
+
+/* a job is done with bg's graph, the last one destroys it */
+static void tmg_batch_graph_release(tmg_batch_graph *bg) {
+
+  if (atomic_fetch_sub(&(bg->jobs_left), 1) == 1 && bg->g) {
+    tmg_graph_destroy(bg->g);
+    bg->g = NULL;
+  }
+}
+
+/*
+  Run the job task places in the batch's order: choose its points,
+  compute its matrix and write it.  Called by the pool's workers.
+*/
+static void tmg_batch_run_job(void *data, int task, int worker) {
+
+  tmg_batch *b = (tmg_batch *)data;
+  tmg_batch_job *job = &(b->jobs[b->order[task]]);
+  tmg_batch_graph *bg = &(b->graphs[job->graph]);
+  int nthreads = b->job_threads;
+
+  double start = tmg_batch_now();
+  tmg_graph *g = tmg_batch_graph_get(b, bg);
+  double now = tmg_batch_now();
+  job->wait_time = now - start;
+  if (g == NULL) {
+    tmg_batch_graph_release(bg);
+    return;
+  }
+  if (job->num_points > g->num_vertices) {
+    fprintf(stderr, "Graph from file %s has only %d vertices, %d requested for %s\n",
+	    job->filename, g->num_vertices, job->num_points, job->outfile);
+    tmg_batch_graph_release(bg);
+    return;
+  }
+
+  int *points = tmg_select_points(g, job->num_points, &(bg->select),
+				  nthreads);
+  job->select_time = tmg_batch_now() - now;
+  now += job->select_time;
+  int *matrix = NULL;
+  if (points) {
+    matrix = tmg_matrix_compute(g, points, job->num_points, b->opts->metric,
+				nthreads);
+    job->compute_time = tmg_batch_now() - now;
+    now += job->compute_time;
+  }
+  if (matrix) {
+    tmg_write_options w = { job->outfile, b->opts->binary, b->opts->layout,
+			    nthreads };
+    job->ok = tmg_write_matrix(g, points, matrix, job->num_points,
+			       job->filename, &w);
+    job->write_time = tmg_batch_now() - now;
+  }
+  free(matrix);
+  free(points);
+  tmg_batch_graph_release(bg);
+}
+
+// a job's place in the order the jobs are started
+typedef struct tmg_batch_rank {
+  int num_points;
+  int job;
+} tmg_batch_rank;
+
+/* compare jobs for qsort: more points first, then manifest order */
+static int tmg_batch_compare(const void *a, const void *b) {
+
+  const tmg_batch_rank *x = (const tmg_batch_rank *)a;
+  const tmg_batch_rank *y = (const tmg_batch_rank *)b;
+  if (x->num_points != y->num_points) {
+    return (x->num_points < y->num_points) - (x->num_points > y->num_points);
+  }
+  return (x->job > y->job) - (x->job < y->job);
+}
+
+/* print the timings of the jobs of b, in manifest order */
+static void tmg_batch_report(tmg_batch *b, double elapsed, int steals) {
+
+  int i;
+  int succeeded = 0;
+  double job_time = 0.0;
+  for (i = 0; i < b->num_graphs; i++) {
+    tmg_batch_graph *bg = &(b->graphs[i]);
+    if (bg->loaded > 0) {
+      fprintf(stderr, "Loaded %s in %.3fs\n", bg->filename, bg->load_time);
+    }
+  }
+  fprintf(stderr, "%5s %8s %8s %8s %8s %8s %8s  %s\n", "job", "points",
+	  "wait", "select", "compute", "write", "total", "output");
+  for (i = 0; i < b->num_jobs; i++) {
+    tmg_batch_job *job = &(b->jobs[i]);
+    double total = job->wait_time + job->select_time + job->compute_time +
+      job->write_time;
+    fprintf(stderr, "%5d %8d %8.3f %8.3f %8.3f %8.3f %8.3f  %s%s\n", i + 1,
+	    job->num_points, job->wait_time, job->select_time,
+	    job->compute_time, job->write_time, total, job->outfile,
+	    job->ok ? "" : " FAILED");
+    succeeded += job->ok;
+    job_time += total;
+  }
+  fprintf(stderr, "%d of %d jobs on %d graphs succeeded, %.3fs of job time in %.3fs on %d threads, %d jobs stolen\n",
+	  succeeded, b->num_jobs, b->num_graphs, job_time, elapsed,
+	  b->opts->nthreads < b->num_jobs ? b->opts->nthreads : b->num_jobs,
+	  steals);
+}
+
+/*
+  Compute the matrices listed in manifest with the given options,
+  reporting how long each took.  Returns 1 if all succeeded, 0 if any
+  failed or the manifest could not be read.
+*/
+int tmg_batch_run(char *manifest, tmg_batch_options *opts) {
+
+  tmg_batch b;
+  int i;
+  memset(&b, 0, sizeof(tmg_batch));
+  b.opts = opts;
+
+  int ok = tmg_batch_read(&b, manifest);
+  tmg_batch_rank *ranks = NULL;
+  if (ok) {
+    b.order = (int *)malloc(b.num_jobs * sizeof(int));
+    ranks = (tmg_batch_rank *)malloc(b.num_jobs * sizeof(tmg_batch_rank));
+    if (!b.order || !ranks) {
+      fprintf(stderr, "Could not allocate %d jobs\n", b.num_jobs);
+      ok = 0;
+    }
+  }
+  if (ok) {
+    for (i = 0; i < b.num_graphs; i++) {
+      pthread_mutex_init(&(b.graphs[i].lock), NULL);
+      atomic_init(&(b.graphs[i].jobs_left), 0);
+    }
+    for (i = 0; i < b.num_jobs; i++) {
+      ranks[i].num_points = b.jobs[i].num_points;
+      ranks[i].job = i;
+      atomic_fetch_add(&(b.graphs[b.jobs[i].graph].jobs_left), 1);
+    }
+    qsort(ranks, b.num_jobs, sizeof(tmg_batch_rank), tmg_batch_compare);
+    for (i = 0; i < b.num_jobs; i++) {
+      b.order[i] = ranks[i].job;
+    }
+
+    // with fewer jobs than threads, the jobs share out the rest
+    b.job_threads = opts->nthreads / b.num_jobs;
+    if (b.job_threads < 1) b.job_threads = 1;
+
+    double start = tmg_batch_now();
+    int steals = tmg_pool_run(b.num_jobs, opts->nthreads, tmg_batch_run_job,
+			      &b);
+    if (steals < 0) {
+      ok = 0;
+    }
+    else {
+      tmg_batch_report(&b, tmg_batch_now() - start, steals);
+      for (i = 0; i < b.num_jobs; i++) {
+	ok = ok && b.jobs[i].ok;
+      }
+    }
+    for (i = 0; i < b.num_graphs; i++) {
+      pthread_mutex_destroy(&(b.graphs[i].lock));
+    }
+  }
+
+  for (i = 0; i < b.num_jobs; i++) {
+    free(b.jobs[i].outfile);
+  }
+  for (i = 0; i < b.num_graphs; i++) {
+    // graphs are destroyed by their last job, unless none ran
+    if (b.graphs[i].g) tmg_graph_destroy(b.graphs[i].g);
+    free(b.graphs[i].filename);
+  }
+  free(b.jobs);
+  free(b.graphs);
+  free(b.order);
+  free(ranks);
+  return ok;
+}
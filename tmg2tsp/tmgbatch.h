@@ -0,0 +1,40 @@
+/*
+  Structure definitions and function prototypes for computing many
+  TSP distance matrices in one run, as listed in a manifest.
+
+  A manifest is text, one job per line: a .tmg file name, a number of
+  points, and the file to write that matrix to, separated by white
+  space.  Blank lines and lines starting with # are ignored.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGBATCH_H
+#define _TMGBATCH_H
+
+#include "tmgmatrix.h"
+#include "tmgselect.h"
+#include "tmgwrite.h"
+
+// longest manifest line
+#define TMG_BATCH_LINE 4096
+
+// the options that apply to every job of a batch
+typedef struct tmg_batch_options {
+  tmg_metric metric;
+  tmg_select_options select;
+  // looked up in each graph as it is loaded, if not NULL
+  char *traveler;
+  char *route;
+  int hilbert;   // renumber each graph along a Hilbert curve?
+  int snapshot;  // as for tmg_load_graph_cached, -1 to ignore snapshots
+  int binary;
+  tsp_layout layout;
+  int nthreads;
+} tmg_batch_options;
+
+// function prototypes
+extern int tmg_batch_run(char *manifest, tmg_batch_options *opts);
+
+#endif  // _TMGBATCH_H
@@ -0,0 +1,200 @@
+/*
+  A directory of cached distance matrices.  See tmgcache.h for the
+  file layout.
+
+  The first N vertices, or the first N chosen at random or by farthest
+  point sampling from the same seed, are the first N points of any
+  larger selection, so a smaller matrix is the top-left block of a
+  larger one.  Rather than relying on that for each way of choosing
+  points, the cache records the points themselves, and reuses the
+  distances among the longest common prefix of the cached and
+  requested points.  Each key keeps the largest matrix computed for
+  it.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tmgcache.h"
+
+/*
+  Fill in h for matrices between points of g chosen as select
+  describes, measured by metric, from a contraction hierarchy if
+  uses_ch is set: the graph's content hash and the key naming the
+  cache file.
+*/
+void tmg_cache_init(tmg_cache_header *h, tmg_graph *g,
+		    tmg_select_options *select, tmg_metric metric,
+		    int uses_ch) {
+
+  memset(h, 0, sizeof(tmg_cache_header));
+  memcpy(h->magic, TMG_CACHE_MAGIC, sizeof(h->magic));
+  h->version = TMG_CACHE_VERSION;
+  h->metric = metric;
+  h->uses_ch = uses_ch;
+  h->graph_hash = tmg_graph_hash(g);
+
+  int32_t renumbered = (g->orig_vertex_num != NULL);
+  int32_t mode = select->mode;
+  uint64_t k = tmg_hash_bytes(TMG_HASH_OFFSET, &(h->graph_hash),
+			      sizeof(uint64_t));
+  k = tmg_hash_bytes(k, &(h->metric), sizeof(int32_t));
+  k = tmg_hash_bytes(k, &(h->uses_ch), sizeof(int32_t));
+  k = tmg_hash_bytes(k, &renumbered, sizeof(int32_t));
+  k = tmg_hash_bytes(k, &mode, sizeof(int32_t));
+  k = tmg_hash_bytes(k, &(select->seed), sizeof(uint64_t));
+  if (select->use_bbox) {
+    double box[4] = { select->min_lat, select->min_lng,
+		      select->max_lat, select->max_lng };
+    k = tmg_hash_bytes(k, box, sizeof(box));
+  }
+  k = tmg_hash_bytes(k, &(select->traveler), sizeof(int));
+  k = tmg_hash_bytes(k, &(select->min_travelers), sizeof(int));
+  k = tmg_hash_bytes(k, &(select->route), sizeof(int));
+  h->key = k;
+}
+
+/* the name of the cache file in dir for h's key, newly allocated */
+static char *tmg_cache_name(char *dir, tmg_cache_header *h) {
+
+  char *name = (char *)malloc(strlen(dir) + 32);
+  if (!name) return NULL;
+  sprintf(name, "%s/%016llx%s", dir, (unsigned long long)h->key,
+	  TMG_CACHE_SUFFIX);
+  return name;
+}
+
+/* a vertex's number in the .tmg file */
+static int tmg_cache_vertex(tmg_graph *g, int v) {
+
+  return g->orig_vertex_num ? g->orig_vertex_num[v] : v;
+}
+
+/*
+  Look in the cache directory dir for a matrix matching h between
+  points of g that start the same way as points.  The distances among
+  the common points are copied into the top-left block of matrix,
+  which is num_points x num_points.  Returns the number of common
+  points, 0 if nothing could be reused, and sets cached_points to the
+  number of points in the cached matrix (0 if there is none).
+*/
+int tmg_cache_lookup(char *dir, tmg_cache_header *h, tmg_graph *g,
+		     int *points, int num_points, int *matrix,
+		     int *cached_points) {
+
+  *cached_points = 0;
+  char *name = tmg_cache_name(dir, h);
+  if (!name) return 0;
+  FILE *fp = fopen(name, "rb");
+  if (!fp) {
+    free(name);
+    return 0;
+  }
+
+  tmg_cache_header c;
+  int ok = (fread(&c, sizeof(tmg_cache_header), 1, fp) == 1 &&
+	    memcmp(c.magic, TMG_CACHE_MAGIC, sizeof(c.magic)) == 0 &&
+	    c.version == TMG_CACHE_VERSION && c.num_points > 0 &&
+	    c.metric == h->metric && c.uses_ch == h->uses_ch &&
+	    c.graph_hash == h->graph_hash && c.key == h->key);
+  if (!ok) {
+    fprintf(stderr, "Ignoring invalid cache file %s\n", name);
+    fclose(fp);
+    free(name);
+    return 0;
+  }
+  *cached_points = c.num_points;
+
+  int common = (c.num_points < num_points) ? c.num_points : num_points;
+  int32_t *cached = (int32_t *)malloc(common * sizeof(int32_t));
+  int known = 0;
+  ok = (cached && fread(cached, sizeof(int32_t), common, fp) == common);
+  if (ok) {
+    while (known < common &&
+	   cached[known] == tmg_cache_vertex(g, points[known])) {
+      known++;
+    }
+  }
+  free(cached);
+
+  // the first known entries of each of the first known rows
+  int i;
+  off_t rows = sizeof(tmg_cache_header) + (off_t)c.num_points * sizeof(int32_t);
+  for (i = 0; ok && i < known; i++) {
+    off_t offset = rows + (off_t)i * c.num_points * sizeof(int32_t);
+    ok = (fseeko(fp, offset, SEEK_SET) == 0 &&
+	  fread(matrix + (size_t)i * num_points, sizeof(int32_t), known, fp) ==
+	  known);
+  }
+  fclose(fp);
+  if (!ok) {
+    fprintf(stderr, "Could not read cache file %s\n", name);
+    known = 0;
+  }
+  free(name);
+  return known;
+}
+
+/*
+  Save the num_points x num_points matrix between points of g to the
+  cache directory dir under h's key, creating the directory if
+  needed.  The file is written under a unique temporary name and
+  renamed into place, so concurrent runs never see a partial file.
+  Returns 1 on success, 0 on failure.
+*/
+int tmg_cache_save(char *dir, tmg_cache_header *h, tmg_graph *g,
+		   int *points, int num_points, int *matrix) {
+
+  if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Could not create cache directory %s\n", dir);
+    return 0;
+  }
+  char *name = tmg_cache_name(dir, h);
+  char *tmp = name ? (char *)malloc(strlen(name) + 8) : NULL;
+  int32_t *vertices = (int32_t *)malloc(num_points * sizeof(int32_t));
+  if (!name || !tmp || !vertices) {
+    fprintf(stderr, "Could not allocate memory to save matrix to cache\n");
+    free(name);
+    free(tmp);
+    free(vertices);
+    return 0;
+  }
+  int i;
+  for (i = 0; i < num_points; i++) {
+    vertices[i] = tmg_cache_vertex(g, points[i]);
+  }
+  h->num_points = num_points;
+
+  sprintf(tmp, "%s.XXXXXX", name);
+  int fd = mkstemp(tmp);
+  FILE *fp = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+  int ok = (fp != NULL);
+  if (ok) {
+    size_t entries = (size_t)num_points * num_points;
+    ok = (fwrite(h, sizeof(tmg_cache_header), 1, fp) == 1 &&
+	  fwrite(vertices, sizeof(int32_t), num_points, fp) == num_points &&
+	  fwrite(matrix, sizeof(int32_t), entries, fp) == entries);
+    ok = (fclose(fp) == 0) && ok;
+  }
+  else if (fd >= 0) {
+    close(fd);
+  }
+  // mkstemp creates the file readable only by its owner
+  if (ok) chmod(tmp, 0644);
+  if (ok && rename(tmp, name) != 0) ok = 0;
+  if (!ok) {
+    fprintf(stderr, "Could not save matrix to cache file %s\n", name);
+    if (fd >= 0) unlink(tmp);
+  }
+  free(vertices);
+  free(tmp);
+  free(name);
+  return ok;
+}
@@ -0,0 +1,56 @@
+/*
+  Structure definitions and function prototypes for a cache of
+  computed distance matrices, kept as files in a directory, each
+  named by a key hashed from the graph's content, the options that
+  chose the points, and how distances were measured.
+
+  Cache file layout:
+
+    offset 0: tmg_cache_header
+    then: num_points int32 vertex numbers of the points, numbered as
+      in the .tmg file even if the graph has been renumbered
+    then: the num_points x num_points int32 matrix, row-major
+
+  A later run with the same key whose points start with the cached
+  points, or are a prefix of them, reuses the distances among those
+  common points and computes only the rest.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGCACHE_H
+#define _TMGCACHE_H
+
+#include <stdint.h>
+#include "tmggraph.h"
+#include "tmgmatrix.h"
+#include "tmgselect.h"
+
+#define TMG_CACHE_MAGIC "TMGMCACH"
+#define TMG_CACHE_VERSION 1
+
+// appended to the hex key to name a cache file
+#define TMG_CACHE_SUFFIX ".tmgm"
+
+typedef struct tmg_cache_header {
+  char magic[8];
+  uint32_t version;
+  int32_t num_points;
+  int32_t metric;
+  int32_t uses_ch;  // road distances from a contraction hierarchy?
+  uint64_t graph_hash;
+  uint64_t key;  // everything above, plus the selection options
+} tmg_cache_header;
+
+// function prototypes
+extern void tmg_cache_init(tmg_cache_header *h, tmg_graph *g,
+			   tmg_select_options *select, tmg_metric metric,
+			   int uses_ch);
+extern int tmg_cache_lookup(char *dir, tmg_cache_header *h, tmg_graph *g,
+			    int *points, int num_points, int *matrix,
+			    int *cached_points);
+extern int tmg_cache_save(char *dir, tmg_cache_header *h, tmg_graph *g,
+			  int *points, int num_points, int *matrix);
+
+#endif  // _TMGCACHE_H
@@ -0,0 +1,839 @@
+/*
+  Contraction hierarchies over the edges of a METAL TMG graph, with
+  edge lengths in miles as weights, and a bucket-based many-to-many
+  query that uses them to compute road distance matrices.
+
+  Preprocessing contracts vertices one at a time in order of a lazily
+  updated priority (edge difference plus contracted neighbors),
+  adding a shortcut between two neighbors of the contracted vertex
+  whenever a bounded witness search finds no path at least as short
+  that avoids it.  Only the resulting "upward" edges are kept, and
+  they can be saved to a file so preprocessing is done once per
+  graph.
+
+  The many-to-many query runs an upward search from every point,
+  files each search space entry in a bucket at the vertex it reached,
+  then finds the distance between two points as the best sum over the
+  vertices where their search spaces meet.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tmgch.h"
+#include "tmgmatrix.h"
+
+// an edge of the graph being contracted
+typedef struct tmg_ch_arc {
+  int to;
+  double w;
+} tmg_ch_arc;
+
+// the growable list of arcs at one vertex
+typedef struct tmg_ch_arcs {
+  tmg_ch_arc *arcs;
+  int count;
+  int cap;
+} tmg_ch_arcs;
+
+// an entry in the binary heaps used here, which do not support
+// decrease-key: an improved entry is pushed again and stale entries
+// are skipped when popped
+typedef struct tmg_ch_heap_entry {
+  double key;
+  int v;
+} tmg_ch_heap_entry;
+
+typedef struct tmg_ch_heap {
+  tmg_ch_heap_entry *items;
+  int size;
+  int cap;
+} tmg_ch_heap;
+
+// the state of a search over a graph of n vertices, reusable across
+// searches: dist[v] is valid only when stamp[v] is the current epoch
+typedef struct tmg_ch_search {
+  double *dist;
+  int *stamp;
+  int epoch;
+  tmg_ch_heap heap;
+} tmg_ch_search;
+
+// everything needed during preprocessing
+typedef struct tmg_ch_builder {
+  int n;
+  tmg_ch_arcs *adj;
+  char *contracted;
+  int *deleted_neighbors;
+  tmg_ch_search search;
+  // scratch lists of the current vertex's uncontracted neighbors
+  int *nbr;
+  double *nbr_w;
+  int nbr_cap;
+} tmg_ch_builder;
+
+/* push an entry onto a heap, returns 0 if out of memory */
+static int tmg_ch_heap_push(tmg_ch_heap *h, double key, int v) {
+
+  if (h->size == h->cap) {
+    int cap = h->cap ? 2*h->cap : 64;
+    tmg_ch_heap_entry *items =
+      (tmg_ch_heap_entry *)realloc(h->items, cap*sizeof(tmg_ch_heap_entry));
+    if (!items) return 0;
+    h->items = items;
+    h->cap = cap;
+  }
+  int pos = h->size++;
+  while (pos > 0) {
+    int parent = (pos - 1) / 2;
+    if (h->items[parent].key <= key) break;
+    h->items[pos] = h->items[parent];
+    pos = parent;
+  }
+  h->items[pos].key = key;
+  h->items[pos].v = v;
+  return 1;
+}
+
+/* remove the smallest entry from a non-empty heap */
+static tmg_ch_heap_entry tmg_ch_heap_pop(tmg_ch_heap *h) {
+
+  tmg_ch_heap_entry top = h->items[0];
+  tmg_ch_heap_entry last = h->items[--h->size];
+  int pos = 0;
+  for (;;) {
+    int child = 2*pos + 1;
+    if (child >= h->size) break;
+    if (child + 1 < h->size && h->items[child+1].key < h->items[child].key) {
+      child++;
+    }
+    if (h->items[child].key >= last.key) break;
+    h->items[pos] = h->items[child];
+    pos = child;
+  }
+  if (h->size > 0) h->items[pos] = last;
+  return top;
+}
+
+/* allocate search state for n vertices, returns 0 on failure */
+static int tmg_ch_search_init(tmg_ch_search *s, int n) {
+
+  s->dist = (double *)malloc(n*sizeof(double));
+  s->stamp = (int *)calloc(n, sizeof(int));
+  s->epoch = 0;
+  memset(&(s->heap), 0, sizeof(tmg_ch_heap));
+  return s->dist && s->stamp;
+}
+
+static void tmg_ch_search_free(tmg_ch_search *s) {
+
+  free(s->dist);
+  free(s->stamp);
+  free(s->heap.items);
+}
+
+/* distance found to v by the most recent search, INFINITY if none */
+static double tmg_ch_search_dist(tmg_ch_search *s, int v) {
+
+  return (s->stamp[v] == s->epoch) ? s->dist[v] : INFINITY;
+}
+
+/*
+  Add an arc from u to v with weight w, or lower the weight of an
+  existing one.  Returns 0 if out of memory.
+*/
+static int tmg_ch_arc_add(tmg_ch_builder *b, int u, int v, double w) {
+
+  tmg_ch_arcs *a = &(b->adj[u]);
+  int i;
+  for (i = 0; i < a->count; i++) {
+    if (a->arcs[i].to == v) {
+      if (w < a->arcs[i].w) a->arcs[i].w = w;
+      return 1;
+    }
+  }
+  if (a->count == a->cap) {
+    int cap = a->cap ? 2*a->cap : 4;
+    tmg_ch_arc *arcs = (tmg_ch_arc *)realloc(a->arcs, cap*sizeof(tmg_ch_arc));
+    if (!arcs) return 0;
+    a->arcs = arcs;
+    a->cap = cap;
+  }
+  a->arcs[a->count].to = v;
+  a->arcs[a->count].w = w;
+  a->count++;
+  return 1;
+}
+
+/*
+  Witness search: Dijkstra from source over uncontracted vertices
+  other than exclude, stopping beyond distance max_dist or after
+  TMG_CH_WITNESS_LIMIT vertices are settled.
+*/
+static void tmg_ch_witness(tmg_ch_builder *b, int source, int exclude,
+			   double max_dist) {
+
+  tmg_ch_search *s = &(b->search);
+  s->epoch++;
+  s->heap.size = 0;
+  s->dist[source] = 0.0;
+  s->stamp[source] = s->epoch;
+  tmg_ch_heap_push(&(s->heap), 0.0, source);
+
+  int settled = 0;
+  while (s->heap.size > 0) {
+    tmg_ch_heap_entry e = tmg_ch_heap_pop(&(s->heap));
+    if (e.key > s->dist[e.v]) continue;  // stale
+    if (e.key > max_dist || ++settled > TMG_CH_WITNESS_LIMIT) break;
+    tmg_ch_arcs *a = &(b->adj[e.v]);
+    int i;
+    for (i = 0; i < a->count; i++) {
+      int y = a->arcs[i].to;
+      if (y == exclude || b->contracted[y]) continue;
+      double d = e.key + a->arcs[i].w;
+      if (s->stamp[y] != s->epoch || d < s->dist[y]) {
+	s->stamp[y] = s->epoch;
+	s->dist[y] = d;
+	tmg_ch_heap_push(&(s->heap), d, y);
+      }
+    }
+  }
+}
+
+/*
+  Find the shortcuts needed to contract vertex v, adding them to the
+  graph if add is set.  Returns the number of shortcuts, -1 if out of
+  memory.
+*/
+static int tmg_ch_contract(tmg_ch_builder *b, int v, int add) {
+
+  tmg_ch_arcs *a = &(b->adj[v]);
+  int i, j, count = 0;
+
+  // gather the uncontracted neighbors
+  if (a->count > b->nbr_cap) {
+    b->nbr_cap = a->count;
+    b->nbr = (int *)realloc(b->nbr, b->nbr_cap*sizeof(int));
+    b->nbr_w = (double *)realloc(b->nbr_w, b->nbr_cap*sizeof(double));
+    if (!b->nbr || !b->nbr_w) return -1;
+  }
+  int num = 0;
+  for (i = 0; i < a->count; i++) {
+    if (!b->contracted[a->arcs[i].to]) {
+      b->nbr[num] = a->arcs[i].to;
+      b->nbr_w[num] = a->arcs[i].w;
+      num++;
+    }
+  }
+
+  // for each pair of neighbors, a shortcut is needed unless a witness
+  // path avoiding v is at least as short as the path through v
+  for (i = 0; i < num - 1; i++) {
+    double max_dist = 0.0;
+    for (j = i + 1; j < num; j++) {
+      if (b->nbr_w[i] + b->nbr_w[j] > max_dist) {
+	max_dist = b->nbr_w[i] + b->nbr_w[j];
+      }
+    }
+    tmg_ch_witness(b, b->nbr[i], v, max_dist);
+    for (j = i + 1; j < num; j++) {
+      double through = b->nbr_w[i] + b->nbr_w[j];
+      if (tmg_ch_search_dist(&(b->search), b->nbr[j]) <= through) continue;
+      count++;
+      if (add && (!tmg_ch_arc_add(b, b->nbr[i], b->nbr[j], through) ||
+		  !tmg_ch_arc_add(b, b->nbr[j], b->nbr[i], through))) {
+	return -1;
+      }
+    }
+  }
+  return count;
+}
+
+/*
+  Priority of contracting v next: shortcuts added minus arcs removed,
+  plus the number of neighbors already contracted, which spreads the
+  contraction evenly over the graph.
+*/
+static int tmg_ch_priority(tmg_ch_builder *b, int v) {
+
+  int shortcuts = tmg_ch_contract(b, v, 0);
+  int degree = 0;
+  int i;
+  for (i = 0; i < b->adj[v].count; i++) {
+    if (!b->contracted[b->adj[v].arcs[i].to]) degree++;
+  }
+  return shortcuts - degree + b->deleted_neighbors[v];
+}
+
+/* free the preprocessing state */
+static void tmg_ch_builder_free(tmg_ch_builder *b) {
+
+  int v;
+  if (b->adj) {
+    for (v = 0; v < b->n; v++) {
+      free(b->adj[v].arcs);
+    }
+    free(b->adj);
+  }
+  free(b->contracted);
+  free(b->deleted_neighbors);
+  free(b->nbr);
+  free(b->nbr_w);
+  tmg_ch_search_free(&(b->search));
+}
+
+/*
+  Build a contraction hierarchy for graph g, NULL if it could not be
+  built.
+*/
+tmg_ch *tmg_ch_build(tmg_graph *g) {
+
+  tmg_ch_builder b;
+  tmg_ch_heap queue;
+  tmg_ch *ch = NULL;
+  int v, i, ednum;
+
+  memset(&b, 0, sizeof(tmg_ch_builder));
+  memset(&queue, 0, sizeof(tmg_ch_heap));
+  b.n = g->num_vertices;
+  b.adj = (tmg_ch_arcs *)calloc(b.n, sizeof(tmg_ch_arcs));
+  b.contracted = (char *)calloc(b.n, sizeof(char));
+  b.deleted_neighbors = (int *)calloc(b.n, sizeof(int));
+  if (!b.adj || !b.contracted || !b.deleted_neighbors ||
+      !tmg_ch_search_init(&(b.search), b.n)) {
+    goto fail;
+  }
+
+  // the initial graph is the TMG graph's edges, keeping only the
+  // shortest of any parallel edges
+  for (ednum = 0; ednum < g->num_edges; ednum++) {
+    int v1 = g->edges[ednum].end1->vertex_num;
+    int v2 = g->edges[ednum].end2->vertex_num;
+    double w = g->edges[ednum].conn.length_in_miles;
+    if (v1 == v2) continue;
+    if (!tmg_ch_arc_add(&b, v1, v2, w) || !tmg_ch_arc_add(&b, v2, v1, w)) {
+      goto fail;
+    }
+  }
+
+  for (v = 0; v < b.n; v++) {
+    if (!tmg_ch_heap_push(&queue, tmg_ch_priority(&b, v), v)) goto fail;
+  }
+
+  // contract in priority order, rechecking each vertex's priority as
+  // it comes off the queue since contracting its neighbors changes it
+  while (queue.size > 0) {
+    tmg_ch_heap_entry e = tmg_ch_heap_pop(&queue);
+    v = e.v;
+    if (b.contracted[v]) continue;
+    int priority = tmg_ch_priority(&b, v);
+    if (queue.size > 0 && priority > queue.items[0].key) {
+      if (!tmg_ch_heap_push(&queue, priority, v)) goto fail;
+      continue;
+    }
+    if (tmg_ch_contract(&b, v, 1) < 0) goto fail;
+    b.contracted[v] = 1;
+
+    // v's uncontracted neighbors are exactly those above it in the
+    // hierarchy, so its arc list is trimmed to its upward edges
+    tmg_ch_arcs *a = &(b.adj[v]);
+    int up = 0;
+    for (i = 0; i < a->count; i++) {
+      if (!b.contracted[a->arcs[i].to]) {
+	b.deleted_neighbors[a->arcs[i].to]++;
+	a->arcs[up++] = a->arcs[i];
+      }
+    }
+    a->count = up;
+  }
+
+  // pack the upward edges into compressed sparse row form
+  ch = (tmg_ch *)calloc(1, sizeof(tmg_ch));
+  if (!ch) goto fail;
+  ch->num_vertices = b.n;
+  ch->graph_hash = tmg_graph_hash(g);
+  ch->up_offsets = (int *)malloc((b.n+1)*sizeof(int));
+  if (!ch->up_offsets) goto fail;
+  ch->up_offsets[0] = 0;
+  for (v = 0; v < b.n; v++) {
+    ch->up_offsets[v+1] = ch->up_offsets[v] + b.adj[v].count;
+  }
+  ch->num_up_edges = ch->up_offsets[b.n];
+  ch->up_targets = (int *)malloc((ch->num_up_edges+1)*sizeof(int));
+  ch->up_weights = (double *)malloc((ch->num_up_edges+1)*sizeof(double));
+  if (!ch->up_targets || !ch->up_weights) goto fail;
+  for (v = 0; v < b.n; v++) {
+    for (i = 0; i < b.adj[v].count; i++) {
+      ch->up_targets[ch->up_offsets[v]+i] = b.adj[v].arcs[i].to;
+      ch->up_weights[ch->up_offsets[v]+i] = b.adj[v].arcs[i].w;
+    }
+  }
+
+  free(queue.items);
+  tmg_ch_builder_free(&b);
+  return ch;
+
+ fail:
+  fprintf(stderr, "Could not allocate memory for contraction hierarchy\n");
+  free(queue.items);
+  tmg_ch_builder_free(&b);
+  if (ch) tmg_ch_destroy(ch);
+  return NULL;
+}
+
+/* free a contraction hierarchy */
+void tmg_ch_destroy(tmg_ch *ch) {
+
+  free(ch->up_offsets);
+  free(ch->up_targets);
+  free(ch->up_weights);
+  free(ch);
+}
+
+/*
+  Save a contraction hierarchy to the given file.  Returns 1 on
+  success, 0 on failure.
+*/
+int tmg_ch_save(tmg_ch *ch, char *filename) {
+
+  FILE *fp = fopen(filename, "wb");
+  if (!fp) {
+    fprintf(stderr, "Could not open file %s for writing\n", filename);
+    return 0;
+  }
+
+  tmg_ch_file_header h;
+  memset(&h, 0, sizeof(tmg_ch_file_header));
+  memcpy(h.magic, TMG_CH_MAGIC, sizeof(h.magic));
+  h.version = TMG_CH_VERSION;
+  h.num_vertices = ch->num_vertices;
+  h.num_up_edges = ch->num_up_edges;
+  h.graph_hash = ch->graph_hash;
+
+  int ok =
+    fwrite(&h, sizeof(h), 1, fp) == 1 &&
+    fwrite(ch->up_offsets, sizeof(int), ch->num_vertices+1, fp) ==
+    (size_t)ch->num_vertices+1 &&
+    fwrite(ch->up_targets, sizeof(int), ch->num_up_edges, fp) ==
+    (size_t)ch->num_up_edges &&
+    fwrite(ch->up_weights, sizeof(double), ch->num_up_edges, fp) ==
+    (size_t)ch->num_up_edges;
+  if (fclose(fp) != 0) ok = 0;
+  if (!ok) {
+    fprintf(stderr, "Could not write contraction hierarchy to %s\n",
+	    filename);
+  }
+  return ok;
+}
+
+/*
+  Load a contraction hierarchy from the given file.  If g is not
+  NULL, the hierarchy must have been built from a graph with the same
+  content.  Returns NULL if the file does not exist, is not a valid
+  hierarchy file, or does not match g.
+*/
+tmg_ch *tmg_ch_load(char *filename, tmg_graph *g) {
+
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) return NULL;
+
+  tmg_ch_file_header h;
+  if (fread(&h, sizeof(h), 1, fp) != 1 ||
+      memcmp(h.magic, TMG_CH_MAGIC, sizeof(h.magic)) != 0 ||
+      h.version != TMG_CH_VERSION || h.num_vertices < 0 ||
+      h.num_up_edges < 0) {
+    fprintf(stderr, "File %s is not a contraction hierarchy file\n",
+	    filename);
+    fclose(fp);
+    return NULL;
+  }
+  if (g && (h.num_vertices != g->num_vertices ||
+	    h.graph_hash != tmg_graph_hash(g))) {
+    fprintf(stderr, "Contraction hierarchy in %s was built from a different graph\n",
+	    filename);
+    fclose(fp);
+    return NULL;
+  }
+
+  tmg_ch *ch = (tmg_ch *)calloc(1, sizeof(tmg_ch));
+  ch->num_vertices = h.num_vertices;
+  ch->num_up_edges = h.num_up_edges;
+  ch->graph_hash = h.graph_hash;
+  ch->up_offsets = (int *)malloc((h.num_vertices+1)*sizeof(int));
+  ch->up_targets = (int *)malloc((h.num_up_edges+1)*sizeof(int));
+  ch->up_weights = (double *)malloc((h.num_up_edges+1)*sizeof(double));
+  if (!ch->up_offsets || !ch->up_targets || !ch->up_weights ||
+      fread(ch->up_offsets, sizeof(int), h.num_vertices+1, fp) !=
+      (size_t)h.num_vertices+1 ||
+      fread(ch->up_targets, sizeof(int), h.num_up_edges, fp) !=
+      (size_t)h.num_up_edges ||
+      fread(ch->up_weights, sizeof(double), h.num_up_edges, fp) !=
+      (size_t)h.num_up_edges) {
+    fprintf(stderr, "Could not read contraction hierarchy from %s\n",
+	    filename);
+    fclose(fp);
+    tmg_ch_destroy(ch);
+    return NULL;
+  }
+  fclose(fp);
+  return ch;
+}
+
+/*
+  Load the contraction hierarchy for g from filename if one that
+  matches g is there, otherwise build one and save it there for next
+  time.  Returns NULL only if no hierarchy could be built.
+*/
+tmg_ch *tmg_ch_load_or_build(char *filename, tmg_graph *g) {
+
+  tmg_ch *ch = tmg_ch_load(filename, g);
+  if (ch) return ch;
+
+  ch = tmg_ch_build(g);
+  if (ch) tmg_ch_save(ch, filename);
+  return ch;
+}
+
+// the search space of one upward search: the vertices it reached and
+// their distances from the point it started at
+typedef struct tmg_ch_space {
+  int count;
+  int *vertices;
+  double *dist;
+} tmg_ch_space;
+
+// the state shared by the threads computing a many-to-many matrix
+struct tmg_ch_query {
+  tmg_ch *ch;
+  int *points;
+  int n;
+  tmg_ch_space *spaces;
+  // buckets: the search space entries that reached vertex v are
+  // bucket_point/bucket_dist[bucket_offsets[v]..bucket_offsets[v+1]-1]
+  int *bucket_offsets;
+  int *bucket_point;
+  double *bucket_dist;
+  // the rows being computed, first_row up to end_row, and where
+  int first_row;
+  int end_row;
+  int *m;
+  atomic_int next;
+  atomic_int unreachable;
+  atomic_int failed;
+};
+
+/*
+  Upward search from the vertex v, recording every vertex reached in
+  the hierarchy and its distance in space.  Returns 0 if out of
+  memory.
+*/
+static int tmg_ch_upward(tmg_ch *ch, tmg_ch_search *s, int v,
+			 tmg_ch_space *space) {
+
+  int cap = 64;
+  space->count = 0;
+  space->vertices = (int *)malloc(cap*sizeof(int));
+  space->dist = (double *)malloc(cap*sizeof(double));
+  if (!space->vertices || !space->dist) return 0;
+
+  s->epoch++;
+  s->heap.size = 0;
+  s->dist[v] = 0.0;
+  s->stamp[v] = s->epoch;
+  if (!tmg_ch_heap_push(&(s->heap), 0.0, v)) return 0;
+
+  while (s->heap.size > 0) {
+    tmg_ch_heap_entry e = tmg_ch_heap_pop(&(s->heap));
+    if (e.key > s->dist[e.v]) continue;  // stale
+    s->dist[e.v] = e.key;
+    if (space->count == cap) {
+      cap *= 2;
+      space->vertices = (int *)realloc(space->vertices, cap*sizeof(int));
+      space->dist = (double *)realloc(space->dist, cap*sizeof(double));
+      if (!space->vertices || !space->dist) return 0;
+    }
+    space->vertices[space->count] = e.v;
+    space->dist[space->count] = e.key;
+    space->count++;
+    // make sure a later, equal-key duplicate is seen as stale
+    s->dist[e.v] = -1.0;
+
+    int i;
+    for (i = ch->up_offsets[e.v]; i < ch->up_offsets[e.v+1]; i++) {
+      int y = ch->up_targets[i];
+      double d = e.key + ch->up_weights[i];
+      if (s->stamp[y] != s->epoch || (s->dist[y] >= 0.0 && d < s->dist[y])) {
+	s->stamp[y] = s->epoch;
+	s->dist[y] = d;
+	if (!tmg_ch_heap_push(&(s->heap), d, y)) return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/* thread function: compute upward search spaces for claimed points */
+static void *tmg_ch_space_worker(void *arg) {
+
+  tmg_ch_query *q = (tmg_ch_query *)arg;
+  tmg_ch_search s;
+  if (!tmg_ch_search_init(&s, q->ch->num_vertices)) {
+    atomic_store(&(q->failed), 1);
+    tmg_ch_search_free(&s);
+    return NULL;
+  }
+  int p;
+  while ((p = atomic_fetch_add(&(q->next), 1)) < q->n) {
+    if (!tmg_ch_upward(q->ch, &s, q->points[p], &(q->spaces[p]))) {
+      atomic_store(&(q->failed), 1);
+      break;
+    }
+  }
+  tmg_ch_search_free(&s);
+  return NULL;
+}
+
+/*
+  Thread function: compute the claimed rows of the matrix by scanning
+  the buckets at every vertex in the row's point's search space.
+*/
+static void *tmg_ch_row_worker(void *arg) {
+
+  tmg_ch_query *q = (tmg_ch_query *)arg;
+  double *best = (double *)malloc(q->n*sizeof(double));
+  if (!best) {
+    atomic_store(&(q->failed), 1);
+    return NULL;
+  }
+  int from;
+  while ((from = atomic_fetch_add(&(q->next), 1)) < q->end_row) {
+    int to, i, k;
+    for (to = 0; to < q->n; to++) best[to] = INFINITY;
+    tmg_ch_space *space = &(q->spaces[from]);
+    for (i = 0; i < space->count; i++) {
+      int v = space->vertices[i];
+      double d = space->dist[i];
+      for (k = q->bucket_offsets[v]; k < q->bucket_offsets[v+1]; k++) {
+	double total = d + q->bucket_dist[k];
+	if (total < best[q->bucket_point[k]]) {
+	  best[q->bucket_point[k]] = total;
+	}
+      }
+    }
+    int *row = q->m + (size_t)(from - q->first_row) * q->n;
+    int unreachable = 0;
+    for (to = 0; to < q->n; to++) {
+      if (to == from) {
+	row[to] = 0;
+      }
+      else if (best[to] == INFINITY) {
+	row[to] = TMG_MATRIX_UNREACHABLE;
+	unreachable++;
+      }
+      else {
+	row[to] = (int)ceil(best[to] * 10);
+      }
+    }
+    if (unreachable) atomic_fetch_add(&(q->unreachable), unreachable);
+  }
+  free(best);
+  return NULL;
+}
+
+/*
+  Run nthreads copies of a thread function, including the caller, with
+  work claimed from q->next starting at first.  The caller claims
+  whatever the threads that could not be started would have.
+*/
+static void tmg_ch_run_threads(void *(*worker)(void *), tmg_ch_query *q,
+			       int first, int nthreads) {
+
+  pthread_t *threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+  int i;
+  atomic_store(&(q->next), first);
+  int started = 1;
+  while (threads && started < nthreads &&
+	 pthread_create(&threads[started], NULL, worker, q) == 0) {
+    started++;
+  }
+  worker(q);
+  for (i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+/*
+  Prepare to compute rows of the num_points x num_points matrix of
+  road distances between the given graph vertices: the upward search
+  space of every point, filed into buckets by vertex, using nthreads
+  threads.  This takes memory in proportion to the total size of the
+  search spaces, not to the size of the matrix.  NULL if out of memory.
+*/
+tmg_ch_query *tmg_ch_query_create(tmg_ch *ch, int *points, int num_points,
+				  int nthreads) {
+
+  int p, i, v;
+
+  tmg_ch_query *q = (tmg_ch_query *)calloc(1, sizeof(tmg_ch_query));
+  if (!q) {
+    fprintf(stderr, "Could not allocate memory for many-to-many query\n");
+    return NULL;
+  }
+  q->ch = ch;
+  q->points = points;
+  q->n = num_points;
+  atomic_init(&(q->unreachable), 0);
+  atomic_init(&(q->failed), 0);
+  if (nthreads < 1) nthreads = 1;
+
+  q->spaces = (tmg_ch_space *)calloc(num_points, sizeof(tmg_ch_space));
+  q->bucket_offsets = (int *)calloc(ch->num_vertices+1, sizeof(int));
+  if (!q->spaces || !q->bucket_offsets) goto fail;
+
+  // upward searches from every point
+  tmg_ch_run_threads(tmg_ch_space_worker, q, 0, nthreads);
+  if (atomic_load(&(q->failed))) goto fail;
+
+  // file the search space entries into buckets by vertex
+  size_t total = 0;
+  for (p = 0; p < num_points; p++) {
+    for (i = 0; i < q->spaces[p].count; i++) {
+      q->bucket_offsets[q->spaces[p].vertices[i]+1]++;
+    }
+    total += q->spaces[p].count;
+  }
+  for (v = 0; v < ch->num_vertices; v++) {
+    q->bucket_offsets[v+1] += q->bucket_offsets[v];
+  }
+  q->bucket_point = (int *)malloc((total+1)*sizeof(int));
+  q->bucket_dist = (double *)malloc((total+1)*sizeof(double));
+  int *next = (int *)malloc(ch->num_vertices*sizeof(int));
+  if (!q->bucket_point || !q->bucket_dist || !next) {
+    free(next);
+    goto fail;
+  }
+  memcpy(next, q->bucket_offsets, ch->num_vertices*sizeof(int));
+  for (p = 0; p < num_points; p++) {
+    for (i = 0; i < q->spaces[p].count; i++) {
+      int pos = next[q->spaces[p].vertices[i]]++;
+      q->bucket_point[pos] = p;
+      q->bucket_dist[pos] = q->spaces[p].dist[i];
+    }
+  }
+  free(next);
+  return q;
+
+ fail:
+  fprintf(stderr, "Could not allocate memory for many-to-many query\n");
+  atomic_store(&(q->unreachable), 0);
+  tmg_ch_query_destroy(q);
+  return NULL;
+}
+
+/*
+  Compute count rows of the matrix starting at row first into rows,
+  which has room for count full rows, using nthreads threads.  The
+  distance between two points is the minimum over the same set of
+  sums either way, so the rows are exactly symmetric with any others
+  computed from the same query.  Returns 1 on success, 0 if out of
+  memory.
+*/
+int tmg_ch_query_rows(tmg_ch_query *q, int first, int count, int *rows,
+		      int nthreads) {
+
+  if (nthreads < 1) nthreads = 1;
+  q->first_row = first;
+  q->end_row = first + count;
+  q->m = rows;
+  tmg_ch_run_threads(tmg_ch_row_worker, q, first, nthreads);
+  if (atomic_load(&(q->failed))) {
+    fprintf(stderr, "Could not allocate memory for many-to-many query\n");
+    return 0;
+  }
+  return 1;
+}
+
+/*
+  Release a query, warning about any pairs of points among the rows
+  computed that had no road connection.
+*/
+void tmg_ch_query_destroy(tmg_ch_query *q) {
+
+  int p;
+  if (q->spaces) {
+    for (p = 0; p < q->n; p++) {
+      free(q->spaces[p].vertices);
+      free(q->spaces[p].dist);
+    }
+    free(q->spaces);
+  }
+  free(q->bucket_offsets);
+  free(q->bucket_point);
+  free(q->bucket_dist);
+
+  // each unconnected pair is seen from both ends once all rows are done
+  if (atomic_load(&(q->unreachable))) {
+    fprintf(stderr, "Warning: %d pairs of points have no road connection, "
+	    "using distance %d\n", (atomic_load(&(q->unreachable))+1)/2,
+	    TMG_MATRIX_UNREACHABLE);
+  }
+  free(q);
+}
+
+/*
+  Compute the num_points x num_points matrix of road distances in
+  tenths of a mile, rounded up, between the given graph vertices,
+  using the contraction hierarchy and nthreads threads.  Returns a
+  newly allocated row-major array, NULL if it could not be computed.
+*/
+int *tmg_ch_matrix(tmg_ch *ch, int *points, int num_points, int nthreads) {
+
+  int *m = (int *)malloc((size_t)num_points * num_points * sizeof(int));
+  if (!m) {
+    fprintf(stderr, "Could not allocate %d x %d distance matrix\n",
+	    num_points, num_points);
+    return NULL;
+  }
+  tmg_ch_query *q = tmg_ch_query_create(ch, points, num_points, nthreads);
+  if (!q) {
+    free(m);
+    return NULL;
+  }
+  int ok = tmg_ch_query_rows(q, 0, num_points, m, nthreads);
+  tmg_ch_query_destroy(q);
+  if (!ok) {
+    free(m);
+    return NULL;
+  }
+  return m;
+}
+
+/*
+  Extend matrix, a num_points x num_points row-major matrix of road
+  distances between the given graph vertices whose first known_points
+  rows and columns are already filled in, by computing the new rows
+  with the contraction hierarchy and mirroring them into the new
+  columns, which gives exactly the entries tmg_ch_matrix would, since
+  its rows are symmetric.
+  Returns 1 on success, 0 on failure.
+*/
+int tmg_ch_matrix_extend(tmg_ch *ch, int *points, int num_points,
+			 int known_points, int *matrix, int nthreads) {
+
+  tmg_ch_query *q = tmg_ch_query_create(ch, points, num_points, nthreads);
+  if (!q) return 0;
+  int ok = tmg_ch_query_rows(q, known_points, num_points - known_points,
+			     matrix + (size_t)known_points * num_points,
+			     nthreads);
+  tmg_ch_query_destroy(q);
+  if (!ok) return 0;
+  tmg_matrix_mirror_rows(matrix, num_points, known_points);
+  return 1;
+}
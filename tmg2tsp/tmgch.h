@@ -0,0 +1,68 @@
+/*
+  Structure definitions and function prototypes for contraction
+  hierarchies over the edges of a METAL TMG graph, used to compute
+  many-to-many road distances for large point sets.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGCH_H
+#define _TMGCH_H
+
+#include <stdint.h>
+#include "tmggraph.h"
+
+// witness searches during contraction give up after settling this many
+// vertices, which may add a few unneeded shortcuts but never a wrong
+// distance
+#define TMG_CH_WITNESS_LIMIT 500
+
+// identifies a saved hierarchy file, and its layout version
+#define TMG_CH_MAGIC "TMGCH\n\032"
+#define TMG_CH_VERSION 1
+
+// a contraction hierarchy, reduced to what queries need: for each
+// vertex, the edges (original or shortcut) to vertices contracted
+// after it, in compressed sparse row form
+typedef struct tmg_ch {
+  int num_vertices;
+  int num_up_edges;
+  int *up_offsets;  // num_vertices+1 entries
+  int *up_targets;
+  double *up_weights;  // in miles
+  uint64_t graph_hash;  // tmg_graph_hash of the graph it was built from
+} tmg_ch;
+
+// the header at the start of a saved hierarchy file, followed by the
+// up_offsets, up_targets and up_weights arrays
+typedef struct tmg_ch_file_header {
+  char magic[8];
+  uint32_t version;
+  int32_t num_vertices;
+  int32_t num_up_edges;
+  int32_t pad;
+  uint64_t graph_hash;
+} tmg_ch_file_header;
+
+// the precomputed search spaces for computing rows of a many-to-many
+// matrix a band at a time
+typedef struct tmg_ch_query tmg_ch_query;
+
+// function prototypes
+extern tmg_ch *tmg_ch_build(tmg_graph *g);
+extern int tmg_ch_save(tmg_ch *ch, char *filename);
+extern tmg_ch *tmg_ch_load(char *filename, tmg_graph *g);
+extern tmg_ch *tmg_ch_load_or_build(char *filename, tmg_graph *g);
+extern void tmg_ch_destroy(tmg_ch *ch);
+extern int *tmg_ch_matrix(tmg_ch *ch, int *points, int num_points,
+			  int nthreads);
+extern int tmg_ch_matrix_extend(tmg_ch *ch, int *points, int num_points,
+				int known_points, int *matrix, int nthreads);
+extern tmg_ch_query *tmg_ch_query_create(tmg_ch *ch, int *points,
+					 int num_points, int nthreads);
+extern int tmg_ch_query_rows(tmg_ch_query *q, int first, int count,
+			     int *rows, int nthreads);
+extern void tmg_ch_query_destroy(tmg_ch_query *q);
+
+#endif  // _TMGCH_H
@@ -9,70 +9,52 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "tmggraph.h"
+#include "tmgroute.h"
 #include "sll.h"
 
 // define the array that's externed in the header file
 char *tmg_format_names[] = { "simple", "collapsed", "traveled" };
 
 /*
-  Helper function to convert a string from a traveled format graph
-  connection hex code into a tmg_conn_travelers structure.
-
-  Note: this function modifies the string passed as code.
+  Helper function to convert a traveled format graph connection hex
+  code into the traveler bits and count of edge e.  Hex digit i holds
+  travelers 4i through 4i+3, lowest bit first, so digit i is simply
+  bits 4i..4i+3 of the row.  Bits for travelers past num_travelers are
+  ignored.  Returns 1 on success, 0 if code is not a hex string.
 */
-void tmg_fill_conn_travelers(tmg_conn_travelers *t, char *code) {
-
-  short i;
-  // remember the length of code, since we'll likely be putting some '\0'
-  // char values into it
-  int len = strlen(code);
-  
-  // convert all chars in the code string to 8-bit numbers in the 0-15 range
-  // based on the hex code stored
-  char *c = code;
-  while (*c) {
-    if (*c >= 'A') *c = *c - 'A' + 10;  // 'A' -> 10, 'B' -> 11, etc
-    else *c -= '0';
-    c++;
-  }
+int tmg_fill_conn_travelers(tmg_graph *g, tmg_edge *e, char *code) {
 
-  // count number of 1 bits
+  tmg_conn_travelers *t = &(e->conn.trav);
+  int words = g->traveler_words;
+  uint64_t *bits = g->traveler_bits + (size_t)(e - g->edges) * words;
+  int i;
+  t->bits = bits;
   t->count = 0;
-  for (i=0; i<len; i++) {
-    if (code[i] & 0x01) t->count++;
-    if (code[i] & 0x02) t->count++;
-    if (code[i] & 0x04) t->count++;
-    if (code[i] & 0x08) t->count++;
-  }
-
-  // if non-zero, allocate the array
-  if (t->count > 0) {
-    t->numbers = (short *)malloc(t->count*sizeof(short));
-    short tnum = 0;
-    for (i=0; i<len; i++) {
-      if (code[i] & 0x01) {
-	t->numbers[tnum] = i*4;
-	tnum++;
-      }
-      if (code[i] & 0x02) {
-	t->numbers[tnum] = i*4+1;
-	tnum++;
-      }
-      if (code[i] & 0x04) {
-	t->numbers[tnum] = i*4+2;
-	tnum++;
-      }
-      if (code[i] & 0x08) {
-	t->numbers[tnum] = i*4+3;
-	tnum++;
-      }
-    }
-    for (i=0; i<t->count; i++) {
-      printf("%d ", t->numbers[i]);
+  for (i = 0; code[i]; i++) {
+    uint64_t digit;
+    char c = code[i];
+    if (c >= '0' && c <= '9') digit = c - '0';
+    else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+    else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+    else return 0;
+    if (i / 16 < words) {
+      bits[i / 16] |= digit << (4 * (i % 16));
     }
-    printf("\n");
   }
+  if (words > 0 && g->num_travelers % 64) {
+    bits[words - 1] &= (1ULL << (g->num_travelers % 64)) - 1;
+  }
+  for (i = 0; i < words; i++) {
+    t->count += __builtin_popcountll(bits[i]);
+  }
+  return 1;
 }
 
 /*
@@ -80,8 +62,8 @@ void tmg_fill_conn_travelers(tmg_conn_travelers *t, char *code) {
 */
 void tmg_waypoint_print_by_index(int vnum, void *call_data) {
 
-  tmg_vertex **v = (tmg_vertex **)call_data;
-  tmg_waypoint_print(&(v[vnum]->w));
+  tmg_vertex *v = (tmg_vertex *)call_data;
+  tmg_waypoint_print(&(v[vnum].w));
   printf(" ");
 }
 
@@ -106,15 +88,522 @@ double tmg_distance_latlng(tmg_latlng *p1, tmg_latlng *p2) {
 		   sin(rlat1)*sin(rlat2)) * TMG_EARTH_RADIUS;
 }
 
+/*
+  Compute the table of unit vectors for the vertices of g, so that
+  the distance between two vertices is just an acos of the dot product
+  of their vectors.  Returns 1 on success, 0 if the table could not be
+  allocated.
+*/
+int tmg_graph_build_vertex_table(tmg_graph *g) {
+
+  tmg_vertex_table *t = &(g->table);
+  size_t size = g->num_vertices*sizeof(double);
+  t->x = (double *)tmg_arena_alloc(&(g->arena), size);
+  t->y = (double *)tmg_arena_alloc(&(g->arena), size);
+  t->z = (double *)tmg_arena_alloc(&(g->arena), size);
+  t->lat = (double *)tmg_arena_alloc(&(g->arena), size);
+  t->lng = (double *)tmg_arena_alloc(&(g->arena), size);
+  if (!t->x || !t->y || !t->z || !t->lat || !t->lng) {
+    fprintf(stderr, "Could not allocate vertex table for %d vertices\n",
+	    g->num_vertices);
+    return 0;
+  }
+
+  int vnum;
+  for (vnum = 0; vnum < g->num_vertices; vnum++) {
+    double rlat = M_PI * g->vertices[vnum].w.coords.lat / 180.0;
+    double rlng = M_PI * g->vertices[vnum].w.coords.lng / 180.0;
+    t->x[vnum] = cos(rlat)*cos(rlng);
+    t->y[vnum] = cos(rlat)*sin(rlng);
+    t->z[vnum] = sin(rlat);
+    t->lat[vnum] = g->vertices[vnum].w.coords.lat;
+    t->lng[vnum] = g->vertices[vnum].w.coords.lng;
+  }
+  return 1;
+}
+
+// stored in place of a dot product to mark a pair of points that are
+// equal within TMG_EQUAL_POINT_TOLERANCE, as no real dot product of
+// unit vectors can exceed 1
+#define TMG_EQUAL_POINT_DOT 2.0
+
+/*
+  Helper function to turn a unit vector dot product (or
+  TMG_EQUAL_POINT_DOT) into a distance in miles.  The dot product is
+  clamped to [-1,1] so rounding can never send acos a value out of
+  range.
+*/
+static double tmg_dot_to_miles(double dot) {
+
+  if (dot > 1.5) return 0.0;
+  if (dot > 1.0) dot = 1.0;
+  if (dot < -1.0) dot = -1.0;
+  return acos(dot) * TMG_EARTH_RADIUS;
+}
+
+/*
+  Helper function computing the dot product of the unit vectors of
+  vertices a and b, exactly as the vector loops in tmg_distance_row
+  do.
+*/
+static double tmg_vertex_dot(tmg_vertex_table *t, int a, int b) {
+
+  if ((fabs(t->lat[a]-t->lat[b]) < TMG_EQUAL_POINT_TOLERANCE) &&
+      (fabs(t->lng[a]-t->lng[b]) < TMG_EQUAL_POINT_TOLERANCE)) {
+    return TMG_EQUAL_POINT_DOT;
+  }
+  return t->x[a]*t->x[b] + t->y[a]*t->y[b] + t->z[a]*t->z[b];
+}
+
+/*
+  Distance in miles between vertices a and b of g, using the vertex
+  table.  Always agrees exactly with tmg_distance_row.
+*/
+double tmg_distance_vertices(tmg_graph *g, int a, int b) {
+
+  return tmg_dot_to_miles(tmg_vertex_dot(&(g->table), a, b));
+}
+
+/*
+  Compute the distances in miles from vertex from to each of the count
+  vertices starting at vertex number first, storing them in dist.
+*/
+void tmg_distance_row(tmg_graph *g, int from, int first, int count,
+		      double *dist) {
+
+  tmg_table_distance_row(&(g->table), from, first, count, dist);
+}
+
+/*
+  Fill in t with copies of the vertex table entries of the num_points
+  graph vertices in points, so entry i of t is vertex points[i], for
+  distance rows over any set of vertices.  Returns 1 on success, 0 if
+  out of memory.  Free with tmg_vertex_table_free.
+*/
+int tmg_vertex_table_gather(tmg_graph *g, int *points, int num_points,
+			    tmg_vertex_table *t) {
+
+  // one block holds all five arrays
+  double *block = (double *)malloc(5 * (size_t)num_points * sizeof(double));
+  if (!block) {
+    fprintf(stderr, "Could not allocate vertex table for %d points\n",
+	    num_points);
+    return 0;
+  }
+  t->x = block;
+  t->y = block + num_points;
+  t->z = block + 2 * (size_t)num_points;
+  t->lat = block + 3 * (size_t)num_points;
+  t->lng = block + 4 * (size_t)num_points;
+  for (int i = 0; i < num_points; i++) {
+    int v = points[i];
+    t->x[i] = g->table.x[v];
+    t->y[i] = g->table.y[v];
+    t->z[i] = g->table.z[v];
+    t->lat[i] = g->table.lat[v];
+    t->lng[i] = g->table.lng[v];
+  }
+  return 1;
+}
+
+/* free a table filled in by tmg_vertex_table_gather */
+void tmg_vertex_table_free(tmg_vertex_table *t) {
+
+  free(t->x);
+  t->x = t->y = t->z = t->lat = t->lng = NULL;
+}
+
+/*
+  Compute the distances in miles from entry from of vertex table t to
+  each of the count entries starting at entry first, storing them in
+  dist.
+
+  The dot products are computed 4 (AVX) or 2 (SSE2) at a time, falling
+  back to scalar code for the remainder or when neither is available,
+  then a second pass turns them into distances.
+*/
+void tmg_table_distance_row(tmg_vertex_table *t, int from, int first,
+			    int count, double *dist) {
+
+  const double *x = t->x + first;
+  const double *y = t->y + first;
+  const double *z = t->z + first;
+  const double *lat = t->lat + first;
+  const double *lng = t->lng + first;
+  int i = 0;
+
+#if defined(__AVX__)
+  __m256d fx = _mm256_set1_pd(t->x[from]);
+  __m256d fy = _mm256_set1_pd(t->y[from]);
+  __m256d fz = _mm256_set1_pd(t->z[from]);
+  __m256d flat = _mm256_set1_pd(t->lat[from]);
+  __m256d flng = _mm256_set1_pd(t->lng[from]);
+  __m256d tol = _mm256_set1_pd(TMG_EQUAL_POINT_TOLERANCE);
+  __m256d equal = _mm256_set1_pd(TMG_EQUAL_POINT_DOT);
+  __m256d signbit = _mm256_set1_pd(-0.0);
+  for (; i + 4 <= count; i += 4) {
+    __m256d dot = _mm256_mul_pd(fx, _mm256_loadu_pd(x+i));
+    dot = _mm256_add_pd(dot, _mm256_mul_pd(fy, _mm256_loadu_pd(y+i)));
+    dot = _mm256_add_pd(dot, _mm256_mul_pd(fz, _mm256_loadu_pd(z+i)));
+    __m256d dlat = _mm256_andnot_pd(signbit,
+				    _mm256_sub_pd(flat, _mm256_loadu_pd(lat+i)));
+    __m256d dlng = _mm256_andnot_pd(signbit,
+				    _mm256_sub_pd(flng, _mm256_loadu_pd(lng+i)));
+    __m256d same = _mm256_and_pd(_mm256_cmp_pd(dlat, tol, _CMP_LT_OQ),
+				 _mm256_cmp_pd(dlng, tol, _CMP_LT_OQ));
+    _mm256_storeu_pd(dist+i, _mm256_blendv_pd(dot, equal, same));
+  }
+#elif defined(__SSE2__)
+  __m128d fx = _mm_set1_pd(t->x[from]);
+  __m128d fy = _mm_set1_pd(t->y[from]);
+  __m128d fz = _mm_set1_pd(t->z[from]);
+  __m128d flat = _mm_set1_pd(t->lat[from]);
+  __m128d flng = _mm_set1_pd(t->lng[from]);
+  __m128d tol = _mm_set1_pd(TMG_EQUAL_POINT_TOLERANCE);
+  __m128d equal = _mm_set1_pd(TMG_EQUAL_POINT_DOT);
+  __m128d signbit = _mm_set1_pd(-0.0);
+  for (; i + 2 <= count; i += 2) {
+    __m128d dot = _mm_mul_pd(fx, _mm_loadu_pd(x+i));
+    dot = _mm_add_pd(dot, _mm_mul_pd(fy, _mm_loadu_pd(y+i)));
+    dot = _mm_add_pd(dot, _mm_mul_pd(fz, _mm_loadu_pd(z+i)));
+    __m128d dlat = _mm_andnot_pd(signbit,
+				 _mm_sub_pd(flat, _mm_loadu_pd(lat+i)));
+    __m128d dlng = _mm_andnot_pd(signbit,
+				 _mm_sub_pd(flng, _mm_loadu_pd(lng+i)));
+    __m128d same = _mm_and_pd(_mm_cmplt_pd(dlat, tol),
+			      _mm_cmplt_pd(dlng, tol));
+    _mm_storeu_pd(dist+i, _mm_or_pd(_mm_and_pd(same, equal),
+				    _mm_andnot_pd(same, dot)));
+  }
+#endif
+  for (; i < count; i++) {
+    dist[i] = tmg_vertex_dot(t, from, first+i);
+  }
+
+  for (i = 0; i < count; i++) {
+    dist[i] = tmg_dot_to_miles(dist[i]);
+  }
+}
+
 /* helper function to add to an edgelist */
-tmg_edgelist *tmg_edgelist_add(tmg_edge *edge, tmg_edgelist *next) {
+tmg_edgelist *tmg_edgelist_add(tmg_graph *g, tmg_edge *edge,
+			       tmg_edgelist *next) {
 
-  tmg_edgelist *newnode = (tmg_edgelist *)malloc(sizeof(tmg_edgelist));
+  tmg_edgelist *newnode =
+    (tmg_edgelist *)tmg_arena_alloc(&(g->arena), sizeof(tmg_edgelist));
   newnode->edge = edge;
   newnode->next = next;
   return newnode;
 }
 
+/*
+  Build the compressed sparse row adjacency arrays of g from its
+  edge array.  Each vertex's neighbors are listed in the order of the
+  edges that reach them.  Arrays from an earlier build are reused, so
+  adjacency can be rebuilt after vertices are renumbered.  Returns 1
+  on success, 0 on failure.
+*/
+int tmg_graph_build_adjacency(tmg_graph *g) {
+
+  int v, ednum;
+  if (!g->adj_offsets) {
+    g->adj_offsets = (int *)tmg_arena_alloc(&(g->arena),
+					    (g->num_vertices+1)*sizeof(int));
+    g->adj_vertices = (int *)tmg_arena_alloc(&(g->arena),
+					     2*g->num_edges*sizeof(int));
+    g->adj_edges = (int *)tmg_arena_alloc(&(g->arena),
+					  2*g->num_edges*sizeof(int));
+    if (!g->adj_offsets ||
+	(g->num_edges && (!g->adj_vertices || !g->adj_edges))) {
+      return 0;
+    }
+  }
+  memset(g->adj_offsets, 0, (g->num_vertices+1)*sizeof(int));
+
+  // count degrees in adj_offsets[v+1], then a prefix sum turns them
+  // into the starting positions
+  for (ednum = 0; ednum < g->num_edges; ednum++) {
+    g->adj_offsets[g->edges[ednum].end1->vertex_num+1]++;
+    g->adj_offsets[g->edges[ednum].end2->vertex_num+1]++;
+  }
+  for (v = 0; v < g->num_vertices; v++) {
+    g->adj_offsets[v+1] += g->adj_offsets[v];
+  }
+
+  // fill, using a copy of the starting positions as insertion points
+  int *next = (int *)malloc(g->num_vertices*sizeof(int));
+  if (!next) return 0;
+  memcpy(next, g->adj_offsets, g->num_vertices*sizeof(int));
+  for (ednum = 0; ednum < g->num_edges; ednum++) {
+    int v1 = g->edges[ednum].end1->vertex_num;
+    int v2 = g->edges[ednum].end2->vertex_num;
+    g->adj_vertices[next[v1]] = v2;
+    g->adj_edges[next[v1]++] = ednum;
+    g->adj_vertices[next[v2]] = v1;
+    g->adj_edges[next[v2]++] = ednum;
+  }
+  free(next);
+  return 1;
+}
+
+/*
+  Populate the tmg_edgelist of each vertex, for code that still walks
+  adjacency as linked lists.  Lists are in the order the loaders used
+  to build them: most recently read edge first.  Returns 1 on
+  success, 0 on failure.
+*/
+int tmg_graph_build_edgelists(tmg_graph *g) {
+
+  int v;
+  for (v = 0; v < g->num_vertices; v++) {
+    tmg_adj_iter it;
+    tmg_adj_begin(g, v, &it);
+    g->vertices[v].edges = NULL;
+    while (tmg_adj_next(&it)) {
+      g->vertices[v].edges =
+	tmg_edgelist_add(g, &(g->edges[it.edge]), g->vertices[v].edges);
+      if (!g->vertices[v].edges) return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+  Compute the derived structures every loaded graph has: the edge
+  lengths, the vertex table for distance computations and the
+  adjacency arrays.  Called by the loaders once all vertices and
+  edges have been read.  Returns 1 on success, 0 on failure.
+*/
+int tmg_graph_finish_load(tmg_graph *g) {
+
+  if (!tmg_graph_finish_shaping(g)) return 0;
+  if (!tmg_route_finish_load(g)) return 0;
+  if (!tmg_graph_build_vertex_table(g)) return 0;
+  if (!tmg_graph_build_adjacency(g)) {
+    fprintf(stderr, "Could not allocate adjacency for %d vertices, %d edges\n",
+	    g->num_vertices, g->num_edges);
+    return 0;
+  }
+  return 1;
+}
+
+/* add len bytes of data to the FNV-1a hash h */
+uint64_t tmg_hash_bytes(uint64_t h, const void *data, size_t len) {
+
+  const unsigned char *p = (const unsigned char *)data;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= TMG_HASH_PRIME;
+  }
+  return h;
+}
+
+/*
+  Compute a 64-bit hash of the content of a graph: its vertex labels
+  and coordinates and its edge endpoints and lengths.  Files saved
+  from computations over a graph record this so they are never reused
+  with a different graph.
+*/
+uint64_t tmg_graph_hash(tmg_graph *g) {
+
+  uint64_t h = TMG_HASH_OFFSET;
+  int i;
+  h = tmg_hash_bytes(h, &(g->num_vertices), sizeof(int));
+  h = tmg_hash_bytes(h, &(g->num_edges), sizeof(int));
+  for (i = 0; i < g->num_vertices; i++) {
+    h = tmg_hash_bytes(h, g->vertices[i].w.label,
+		       strlen(g->vertices[i].w.label) + 1);
+    h = tmg_hash_bytes(h, &(g->vertices[i].w.coords), sizeof(tmg_latlng));
+  }
+  for (i = 0; i < g->num_edges; i++) {
+    h = tmg_hash_bytes(h, &(g->edges[i].end1->vertex_num), sizeof(int));
+    h = tmg_hash_bytes(h, &(g->edges[i].end2->vertex_num), sizeof(int));
+    h = tmg_hash_bytes(h, &(g->edges[i].conn.length_in_miles),
+		       sizeof(double));
+  }
+  return h;
+}
+
+/*
+  A 64-bit FNV-1a hash of a list of vertex numbers, so saved results
+  can be matched to the points they were computed for.
+*/
+uint64_t tmg_points_hash(int *points, int num_points) {
+
+  uint64_t h = TMG_HASH_OFFSET;
+  h = tmg_hash_bytes(h, &num_points, sizeof(int));
+  return tmg_hash_bytes(h, points, num_points * sizeof(int));
+}
+
+/*
+  Compute the length_in_miles of an edge whose endpoints and shaping
+  points (for collapsed and traveled format graphs) are populated,
+  recording the distance along the way to each shaping point in its
+  shaping_miles.  The length runs from end1 through the shaping points
+  in order to end2.
+*/
+void tmg_edge_compute_length(tmg_graph *g, tmg_edge *e) {
+
+  tmg_connection *c = &(e->conn);
+  double miles = 0.0;
+  tmg_latlng *prev_point = &(c->end1->coords);
+  int i;
+  for (i = 0; i < c->num_shaping_points; i++) {
+    // add the distance from the previous to this point
+    miles += tmg_distance_latlng(prev_point, &(c->shaping_points[i]));
+    c->shaping_miles[i] = miles;
+    prev_point = &(c->shaping_points[i]);
+  }
+  // add in last distance (or all, if there were no shaping points)
+  c->length_in_miles = miles + tmg_distance_latlng(prev_point,
+						   &(c->end2->coords));
+}
+
+/*
+  Make room for count more shaping points at the end of the graph's
+  pool, growing it as needed, and return a pointer to the first of
+  them, NULL if out of memory.  Loaders reserve each edge's points as
+  they parse them, in edge order, after recording the edge's start in
+  shaping_offsets.  The pointer is only good until the next call.
+*/
+tmg_latlng *tmg_graph_reserve_shaping(tmg_graph *g, int count) {
+
+  if (g->num_shaping_points + count > g->shaping_capacity) {
+    int capacity = g->shaping_capacity ? 2*g->shaping_capacity : 1024;
+    while (capacity < g->num_shaping_points + count) capacity *= 2;
+    tmg_latlng *points =
+      (tmg_latlng *)realloc(g->shaping_points, capacity*sizeof(tmg_latlng));
+    if (!points) {
+      fprintf(stderr, "Could not allocate %d shaping points\n", capacity);
+      return NULL;
+    }
+    g->shaping_points = points;
+    g->shaping_capacity = capacity;
+  }
+  tmg_latlng *p = g->shaping_points + g->num_shaping_points;
+  g->num_shaping_points += count;
+  return p;
+}
+
+/*
+  Make sure the graph's shaping point pool is malloc'd memory it can
+  resize, copying it out of a snapshot mapping if that is where it
+  is.  Returns 1 on success, 0 if out of memory.
+*/
+int tmg_graph_own_shaping(tmg_graph *g) {
+
+  if (!g->shaping_mapped) return 1;
+  int n = g->num_shaping_points;
+  tmg_latlng *points = (tmg_latlng *)malloc((n ? n : 1)*sizeof(tmg_latlng));
+  double *miles = (double *)malloc((n ? n : 1)*sizeof(double));
+  if (!points || !miles) {
+    fprintf(stderr, "Could not allocate %d shaping points\n", n);
+    free(points);
+    free(miles);
+    return 0;
+  }
+  memcpy(points, g->shaping_points, n*sizeof(tmg_latlng));
+  memcpy(miles, g->shaping_miles, n*sizeof(double));
+  int ednum;
+  for (ednum = 0; ednum < g->num_edges; ednum++) {
+    tmg_connection *c = &(g->edges[ednum].conn);
+    if (c->num_shaping_points) {
+      c->shaping_points = points + (c->shaping_points - g->shaping_points);
+      c->shaping_miles = miles + (c->shaping_miles - g->shaping_miles);
+    }
+  }
+  g->shaping_points = points;
+  g->shaping_miles = miles;
+  g->shaping_capacity = n;
+  g->shaping_mapped = 0;
+  return 1;
+}
+
+/*
+  Once all edges are loaded, trim the shaping point pool to size,
+  point each connection at its part of it, and compute every edge's
+  length and cumulative shaping point distances.  Returns 1 on
+  success, 0 on failure.
+*/
+int tmg_graph_finish_shaping(tmg_graph *g) {
+
+  int n = g->num_shaping_points;
+  g->shaping_offsets[g->num_edges] = n;
+  if (n > 0) {
+    if (n < g->shaping_capacity) {
+      tmg_latlng *points =
+	(tmg_latlng *)realloc(g->shaping_points, n*sizeof(tmg_latlng));
+      if (points) g->shaping_points = points;
+      g->shaping_capacity = n;
+    }
+    g->shaping_miles = (double *)malloc(n*sizeof(double));
+    if (!g->shaping_miles) {
+      fprintf(stderr, "Could not allocate %d shaping point distances\n", n);
+      return 0;
+    }
+  }
+
+  int ednum;
+  for (ednum = 0; ednum < g->num_edges; ednum++) {
+    tmg_connection *c = &(g->edges[ednum].conn);
+    int first = g->shaping_offsets[ednum];
+    c->num_shaping_points = g->shaping_offsets[ednum+1] - first;
+    c->shaping_points = c->num_shaping_points ? g->shaping_points + first : NULL;
+    c->shaping_miles = c->num_shaping_points ? g->shaping_miles + first : NULL;
+    tmg_edge_compute_length(g, &(g->edges[ednum]));
+  }
+  return 1;
+}
+
+/*
+  Allocate the vertex and edge arrays of a graph whose num_vertices
+  and num_edges (and for traveled graphs, num_travelers) are known,
+  each as a single zeroed block in the graph's arena, along with the
+  shaping point offsets and the traveler bits of traveled graphs.
+  Returns 1 on success, 0 on failure.
+*/
+int tmg_graph_allocate(tmg_graph *g) {
+
+  if (g->num_vertices < 1 || g->num_edges < 0) {
+    fprintf(stderr, "Invalid graph size: %d vertices, %d edges\n",
+	    g->num_vertices, g->num_edges);
+    return 0;
+  }
+  g->vertices = (tmg_vertex *)tmg_arena_calloc(&(g->arena), g->num_vertices,
+					       sizeof(tmg_vertex));
+  g->edges = (tmg_edge *)tmg_arena_calloc(&(g->arena), g->num_edges,
+					  sizeof(tmg_edge));
+  g->shaping_offsets = (int *)tmg_arena_calloc(&(g->arena), g->num_edges+1,
+					       sizeof(int));
+  if (!g->vertices || (g->num_edges && !g->edges) || !g->shaping_offsets) {
+    return 0;
+  }
+
+  if (g->format == TRAVELED) {
+    if (g->num_travelers < 0) {
+      fprintf(stderr, "Invalid number of travelers: %d\n", g->num_travelers);
+      return 0;
+    }
+    g->traveler_words = (g->num_travelers + 63) / 64;
+    g->traveler_bits =
+      (uint64_t *)tmg_arena_calloc(&(g->arena),
+				   (size_t)g->num_edges * g->traveler_words,
+				   sizeof(uint64_t));
+    if (g->num_edges && g->traveler_words && !g->traveler_bits) {
+      fprintf(stderr, "Could not allocate traveler bits for %d edges\n",
+	      g->num_edges);
+      return 0;
+    }
+  }
+
+  int vnum;
+  for (vnum = 0; vnum < g->num_vertices; vnum++) {
+    g->vertices[vnum].vertex_num = vnum;
+  }
+  return 1;
+}
+
 /*
   Load a graph from the given file, return a new graph pointer, NULL if 
   any problems are encountered on load.
@@ -132,6 +621,7 @@ tmg_graph *tmg_load_graph(char *filename) {
   }
   
   tmg_graph *g = (tmg_graph *)calloc(1,sizeof(tmg_graph));
+  tmg_arena_init(&(g->arena));
   
   // first line of the file is the TMG header
   retval = fscanf(f, "TMG %d.%d %s", &(g->major_version), &(g->minor_version),
@@ -139,7 +629,7 @@ tmg_graph *tmg_load_graph(char *filename) {
   if (retval != 3) {
     fprintf(stderr, "Unknown TMG header format.\n");
     fclose(f);
-    free(g);
+    tmg_graph_destroy(g);
     return NULL;
   }
 
@@ -148,7 +638,7 @@ tmg_graph *tmg_load_graph(char *filename) {
     fprintf(stderr, "Unknown TMG file version %d.%d.\n", g->major_version,
 	    g->minor_version);
     fclose(f);
-    free(g);
+    tmg_graph_destroy(g);
     return NULL;
   }
 
@@ -164,7 +654,7 @@ tmg_graph *tmg_load_graph(char *filename) {
   else {
     fprintf(stderr, "Unknown TMG file format specifier %s.\n", buf);
     fclose(f);
-    free(g);
+    tmg_graph_destroy(g);
     return NULL;
   }
 
@@ -173,7 +663,7 @@ tmg_graph *tmg_load_graph(char *filename) {
   if (retval != 2) {
     fprintf(stderr, "Could not read number of waypoints and connections from TMG file.\n");
     fclose(f);
-    free(g);
+    tmg_graph_destroy(g);
     return NULL;
   }
 
@@ -183,193 +673,160 @@ tmg_graph *tmg_load_graph(char *filename) {
     if (retval != 1) {
       fprintf(stderr, "Could not read number of travelers from TMG file.\n");
       fclose(f);
-      free(g);
+      tmg_graph_destroy(g);
       return NULL;
     }
   }
 
+  // allocate the vertex and edge arrays
+  if (!tmg_graph_allocate(g)) {
+    fclose(f);
+    tmg_graph_destroy(g);
+    return NULL;
+  }
+
   // next g->num_vertices lines are waypoint specifications
   // label lat lng
-  // allocate our array of these
-  g->vertices = (tmg_vertex **)calloc(g->num_vertices,sizeof(tmg_vertex *));
   int vnum;
   for (vnum = 0; vnum < g->num_vertices; vnum++) {
-    g->vertices[vnum] = (tmg_vertex *)malloc(sizeof(tmg_vertex));
-    g->vertices[vnum]->vertex_num = vnum;
-    g->vertices[vnum]->edges = NULL;
     retval = fscanf(f, "%s %lf %lf", buf,
-		    &(g->vertices[vnum]->w.coords.lat),
-		    &(g->vertices[vnum]->w.coords.lng));
+		    &(g->vertices[vnum].w.coords.lat),
+		    &(g->vertices[vnum].w.coords.lng));
     if (retval != 3) {
       fprintf(stderr, "Could not read waypoint %d from TMG\n", vnum);
       tmg_graph_destroy(g);
       fclose(f);
-      free(g);
       return NULL;
     }
-    g->vertices[vnum]->w.label = strdup(buf);
+    g->vertices[vnum].w.label = tmg_arena_strdup(&(g->arena), buf);
   }
 
   // next group of lines are the edges
-  g->edges = (tmg_edge **)calloc(g->num_edges,sizeof(tmg_edge *));
   int ednum;
   int v1, v2;
-  
+  // the rest of each edge line, which can be any length: long edges
+  // have many shaping points
+  char *line = NULL;
+  size_t line_size = 0;
+
   for (ednum = 0; ednum < g->num_edges; ednum++) {
-    g->edges[ednum] = (tmg_edge *)calloc(1,sizeof(tmg_edge));
+    tmg_edge *e = &(g->edges[ednum]);
     // all edge lines have two vertex numbers and a label to start
     retval = fscanf(f, "%d %d %s", &v1, &v2, buf);
     if (retval != 3) {
       fprintf(stderr, "Could not read edge %d from TMG\n", ednum);
+      free(line);
+      tmg_graph_destroy(g);
+      fclose(f);
+      return NULL;
+    }
+    if (v1 < 0 || v1 >= g->num_vertices || v2 < 0 || v2 >= g->num_vertices) {
+      fprintf(stderr, "Invalid vertex number in edge %d from TMG\n", ednum);
+      free(line);
       tmg_graph_destroy(g);
       fclose(f);
-      free(g);
       return NULL;
     }
     // populate the fields we have so far
-    g->edges[ednum]->end1 = g->vertices[v1];
-    g->edges[ednum]->end2 = g->vertices[v2];
-    g->edges[ednum]->conn.end1 = &(g->vertices[v1]->w);
-    g->edges[ednum]->conn.end2 = &(g->vertices[v2]->w);
-    g->edges[ednum]->conn.routes = strdup(buf);
-
-    // add to edge lists
-    g->vertices[v1]->edges =
-      tmg_edgelist_add(g->edges[ednum], g->vertices[v1]->edges);
-    g->vertices[v2]->edges =
-      tmg_edgelist_add(g->edges[ednum], g->vertices[v2]->edges);
+    g->shaping_offsets[ednum] = g->num_shaping_points;
+    e->end1 = &(g->vertices[v1]);
+    e->end2 = &(g->vertices[v2]);
+    e->conn.end1 = &(g->vertices[v1].w);
+    e->conn.end2 = &(g->vertices[v2].w);
+    // only the first edge with each route string copies it
+    e->conn.route_id = tmg_route_intern(g, buf, 1);
+    if (e->conn.route_id < 0) {
+      free(line);
+      tmg_graph_destroy(g);
+      fclose(f);
+      return NULL;
+    }
+
     // traveled format graphs will next have the string representing a
     // hex number representing a bit field of who has traveled this
     // segment
     if (g->format == TRAVELED) {
       retval = fscanf(f, "%s", buf);
-      tmg_fill_conn_travelers(&(g->edges[ednum]->conn.trav), buf);
+      if (retval != 1 || !tmg_fill_conn_travelers(g, e, buf)) {
+	fprintf(stderr, "Could not read travelers for edge %d from TMG\n",
+		ednum);
+	free(line);
+	tmg_graph_destroy(g);
+	fclose(f);
+	return NULL;
+      }
     }
 
     // next any remaining text on the line will be lat/lng pairs for
     // the shaping points along this edge, but only for collapsed and
     // traveled format graphs
-    // this section will also complete the connection length field
     if (g->format != SIMPLE) {
 
-      // get started on length computation
-      g->edges[ednum]->conn.length_in_miles = 0.0;
-      tmg_latlng *prev_point = &(g->edges[ednum]->conn.end1->coords);
-      
-      // read the rest of the line, which, if not empty, will start
-      // with a space and end with a \n
-      fgets(buf, 2000, f);
-      if (strlen(buf) > 1) {
-	// any shaping points will be two space-separated floating
-	// point values, so get a pointer that skips over the leading
-	// space
-	char *nextpiece = buf+1;
-	nextpiece[strlen(nextpiece)-1] = '\0';
-	// count the number of decimal points, which is double the
-	// number of shaping points
-	int count = 0;
-	char *c = nextpiece;
-	while (*c) {
-	  if (*c == '.') count++;
-	  c++;
-	}
-	// allocate our array of latlng structures
-	g->edges[ednum]->conn.num_shaping_points = count/2;
-	g->edges[ednum]->conn.shaping_points =
-	  (tmg_latlng *)malloc(g->edges[ednum]->conn.num_shaping_points*sizeof(tmg_latlng));
-	// now read them in
-	int i;
-	for (i=0; i<g->edges[ednum]->conn.num_shaping_points; i++) {
-	  sscanf(nextpiece, "%lf %lf",
-		 &(g->edges[ednum]->conn.shaping_points[i].lat),
-		 &(g->edges[ednum]->conn.shaping_points[i].lng));
-	  // add the distance from the previous to this point
-	  g->edges[ednum]->conn.length_in_miles +=
-	    tmg_distance_latlng(prev_point, &(g->edges[ednum]->conn.shaping_points[i]));
-	  prev_point = &(g->edges[ednum]->conn.shaping_points[i]);
-	  // advance over two spaces so nextpiece will point at the next
-	  // pair of numbers (or the end of the string)
-	  strsep(&nextpiece, " ");
-	  strsep(&nextpiece, " ");
+      // read the rest of the line: any lat/lng pairs, separated by
+      // spaces, through the end of the line, which the last line of a
+      // file might not have
+      char *next = (getline(&line, &line_size, f) < 0) ? "" : line;
+      for (;;) {
+	char *after_lat, *after_lng;
+	double lat = strtod(next, &after_lat);
+	if (after_lat == next) break;
+	double lng = strtod(after_lat, &after_lng);
+	if (after_lng == after_lat) break;
+	tmg_latlng *p = tmg_graph_reserve_shaping(g, 1);
+	if (!p) {
+	  free(line);
+	  tmg_graph_destroy(g);
+	  fclose(f);
+	  return NULL;
 	}
+	p->lat = lat;
+	p->lng = lng;
+	next = after_lng;
       }
-      // add in last distance (or all, if there were no shaping points)
-      g->edges[ednum]->conn.length_in_miles +=
-	tmg_distance_latlng(prev_point, &(g->edges[ednum]->conn.end1->coords));
-      
-    }
-    else {
-      // simple format, just need to compute the edge length from the
-      // two latlng endpoints
-      g->edges[ednum]->conn.length_in_miles =
-	tmg_distance_latlng(&(g->edges[ednum]->end1->w.coords),
-			    &(g->edges[ednum]->end2->w.coords));
     }
   }
+  free(line);
 
   // traveled format graphs then have the list of traveler names
   if (g->format == TRAVELED) {
-    g->traveler_list = (char **)malloc(g->num_travelers*sizeof(char *));
+    g->traveler_list =
+      (char **)tmg_arena_calloc(&(g->arena), g->num_travelers, sizeof(char *));
     int tnum;
     for (tnum = 0; tnum < g->num_travelers; tnum++) {
       fscanf(f, "%s", buf);
-      g->traveler_list[tnum] = strdup(buf);
+      g->traveler_list[tnum] = tmg_arena_strdup(&(g->arena), buf);
     }
   }
   
   fclose(f);
+
+  if (!tmg_graph_finish_load(g)) {
+    tmg_graph_destroy(g);
+    return NULL;
+  }
   return g;
 }
 
 /*
-  Destroy a tmg_graph, freeing all memory.
+  Destroy a tmg_graph, freeing all memory.  Everything the graph owns
+  is in its arena, its file mapping and its shaping point pool, so
+  this does not depend on the size of the graph.
 */
 void tmg_graph_destroy(tmg_graph *g) {
 
-  int i;
-  // if the vertices array is allocated, free it
-  if (g->vertices) {
-    for (i=0; i<g->num_vertices; i++) {
-      if (g->vertices[i]) {
-	tmg_edgelist *list = g->vertices[i]->edges;
-	while (list) {
-	  tmg_edgelist *rmme = list;
-	  list = list->next;
-	  free(rmme);
-	}
-	free(g->vertices[i]);
-      }
-    }
-    free(g->vertices);
+  tmg_arena_free(&(g->arena));
+  // the route dictionary is malloc'd only while loading
+  if (g->route_dict.hash) {
+    free(g->route_dict.hash);
+    free(g->route_dict.strings);
   }
-  
-  // if the edges array is allocated, free it
-  if (g->edges) {
-    for (i=0; i<g->num_edges; i++) {
-      if (g->edges[i]) {
-	if (g->edges[i]->conn.routes) {
-	  free(g->edges[i]->conn.routes);
-	}
-	if (g->edges[i]->conn.trav.numbers) {
-	  free(g->edges[i]->conn.trav.numbers);
-	}
-	if (g->edges[i]->conn.shaping_points) {
-	  free(g->edges[i]->conn.shaping_points);
-	}
-	free(g->edges[i]);
-      }
-    }
-    free(g->edges);
+  if (!g->shaping_mapped) {
+    free(g->shaping_points);
+    free(g->shaping_miles);
   }
-  
-  // if a traveler list is allocated, free it
-  if (g->traveler_list) {
-    for (i=0; i<g->num_travelers; i++) {
-      if (g->traveler_list[i]) {
-	free(g->traveler_list[i]);
-      }
-    }
-    free(g->traveler_list);
+
+  if (g->file_map) {
+    munmap(g->file_map, g->file_map_size);
   }
 
   // free the tmg_graph itself
@@ -399,35 +856,35 @@ void tmg_graph_print_stats(tmg_graph *g, FILE *fp) {
   sll_add_to_head(shortest, 0);
   sll *longest = create_sll();
   sll_add_to_head(longest, 0);
-  int shortest_len = strlen(g->vertices[0]->w.label);
+  int shortest_len = strlen(g->vertices[0].w.label);
   int longest_len = shortest_len;
   
   int vnum;
   for (vnum = 1; vnum < g->num_vertices; vnum++) {
     // extreme coordinates
-    if (g->vertices[vnum]->w.coords.lat > g->vertices[north]->w.coords.lat) {
+    if (g->vertices[vnum].w.coords.lat > g->vertices[north].w.coords.lat) {
       north = vnum;
     }
-    if (g->vertices[vnum]->w.coords.lat < g->vertices[south]->w.coords.lat) {
+    if (g->vertices[vnum].w.coords.lat < g->vertices[south].w.coords.lat) {
       south = vnum;
     }
-    if (g->vertices[vnum]->w.coords.lng < g->vertices[east]->w.coords.lng) {
+    if (g->vertices[vnum].w.coords.lng < g->vertices[east].w.coords.lng) {
       east = vnum;
     }
-    if (g->vertices[vnum]->w.coords.lng > g->vertices[west]->w.coords.lng) {
+    if (g->vertices[vnum].w.coords.lng > g->vertices[west].w.coords.lng) {
       west = vnum;
     }
 
     // alphabetical
-    if (strcmp(g->vertices[vnum]->w.label, g->vertices[first]->w.label) < 0) {
+    if (strcmp(g->vertices[vnum].w.label, g->vertices[first].w.label) < 0) {
       first = vnum;
     }
-    if (strcmp(g->vertices[vnum]->w.label, g->vertices[last]->w.label) > 0) {
+    if (strcmp(g->vertices[vnum].w.label, g->vertices[last].w.label) > 0) {
       last = vnum;
     }
 
     // shortest and longest labels
-    int len = strlen(g->vertices[vnum]->w.label);
+    int len = strlen(g->vertices[vnum].w.label);
     if (len < shortest_len) {
       shortest_len = len;
       sll_clear(shortest);
@@ -448,22 +905,22 @@ void tmg_graph_print_stats(tmg_graph *g, FILE *fp) {
   }
 
   printf("Northernmost waypoint: #%d ", north);
-  tmg_waypoint_print(&(g->vertices[north]->w));
+  tmg_waypoint_print(&(g->vertices[north].w));
   printf("\n");
   printf("Southernmost waypoint: #%d ", south);
-  tmg_waypoint_print(&(g->vertices[south]->w));
+  tmg_waypoint_print(&(g->vertices[south].w));
   printf("\n");
   printf("Easternmost waypoint: #%d ", east);
-  tmg_waypoint_print(&(g->vertices[east]->w));
+  tmg_waypoint_print(&(g->vertices[east].w));
   printf("\n");
   printf("Westernmost waypoint: #%d ", west);
-  tmg_waypoint_print(&(g->vertices[west]->w));
+  tmg_waypoint_print(&(g->vertices[west].w));
   printf("\n");
   printf("First alphabetical waypoint: #%d ", first);
-  tmg_waypoint_print(&(g->vertices[first]->w));
+  tmg_waypoint_print(&(g->vertices[first].w));
   printf("\n");
   printf("Last alphabetical waypoint: #%d ", last);
-  tmg_waypoint_print(&(g->vertices[last]->w));
+  tmg_waypoint_print(&(g->vertices[last].w));
   printf("\n");
   printf("Shortest waypoint labels: (len %d)\n", shortest_len);
   sll_visit_all(shortest, tmg_waypoint_print_by_index, g->vertices);
@@ -480,3 +937,14 @@ void tmg_waypoint_print(tmg_waypoint *w) {
 
   printf("%s (%.6f,%.6f)", w->label, w->coords.lat, w->coords.lng);
 }
+
+/*
+  Format a waypoint the way tmg_waypoint_print does into buf, which
+  holds size bytes.  Returns the length of the full string, which may
+  be size or more if it was truncated, as snprintf does.
+*/
+int tmg_waypoint_format(tmg_waypoint *w, char *buf, size_t size) {
+
+  return snprintf(buf, size, "%s (%.6f,%.6f)", w->label, w->coords.lat,
+		  w->coords.lng);
+}
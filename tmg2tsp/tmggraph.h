@@ -9,7 +9,9 @@
 #ifndef _TMGGRAPH_H
 #define _TMGGRAPH_H
 
+#include <stdint.h>
 #include <stdio.h>
+#include "tmgarena.h"
 
 // upper bound on vertex label length
 #define TMG_MAX_LABEL 100
@@ -43,10 +45,12 @@ typedef struct tmg_waypoint {
   char *label;
 } tmg_waypoint;
 
-// info about the travelers on a segment
+// info about the travelers on a segment: traveler t has traveled it
+// if bit t%64 of bits[t/64] is set, where bits is this edge's row of
+// the graph's traveler_bits
 typedef struct tmg_conn_travelers {
   int count;
-  short *numbers; // numbers easily fit in 16 bits at this time
+  uint64_t *bits;
 } tmg_conn_travelers;
 
 // a connection is the information attached to a graph edge
@@ -55,8 +59,12 @@ typedef struct tmg_connection {
   tmg_waypoint *end1;  // waypoint endpoints of this connection
   tmg_waypoint *end2;
   tmg_conn_travelers trav;  // for traveled graphs
-  tmg_latlng *shaping_points;  // array of shaping points
+  // this connection's part of the graph's shaping point pool, and
+  // the distance along the connection from end1 to each point
+  tmg_latlng *shaping_points;
+  double *shaping_miles;
   int num_shaping_points;
+  int route_id;  // number of its routes string in the graph's route dictionary
   double length_in_miles;
   
 } tmg_connection;
@@ -77,34 +85,177 @@ typedef struct tmg_edgelist {
 // graph vertex is a waypoint plus adjacency list and a number
 typedef struct tmg_vertex {
   tmg_waypoint w;
-  tmg_edgelist *edges;  // edges incident on this vertex
+  // edges incident on this vertex, only populated by
+  // tmg_graph_build_edgelists, adjacency is normally taken from the
+  // graph's compressed sparse row arrays
+  tmg_edgelist *edges;
   int vertex_num;
 } tmg_vertex;
 
+// per-vertex values precomputed once after a graph is loaded so that
+// distances between vertices need no trig beyond a single acos, stored
+// as a structure of arrays so whole rows of distances can be computed
+// with vector instructions
+typedef struct tmg_vertex_table {
+  double *x;  // 3D unit vector components of each vertex
+  double *y;
+  double *z;
+  double *lat;  // coordinates in degrees, for the equal point test
+  double *lng;
+} tmg_vertex_table;
+
+// the route strings of a graph's edges, each distinct one stored
+// once, with edge e's at strings[e->conn.route_id], and the routes
+// they name (a string like "NY2,I-87" names two), with the edges that
+// carry each route
+typedef struct tmg_route_dict {
+  int num_strings;
+  char **strings;
+  // the routes named by string s are string_routes[string_offsets[s]]
+  // through string_routes[string_offsets[s+1]-1]
+  int *string_offsets;
+  int *string_routes;
+  int num_routes;
+  char **names;
+  // the edges carrying route r, in increasing order, are
+  // edges[edge_offsets[r]] through edges[edge_offsets[r+1]-1]
+  int *edge_offsets;
+  int *edges;
+  // while loading, a hash table of string numbers (-1 where empty),
+  // growing with strings, which is malloc'd to hold half as many
+  int *hash;
+  int hash_size;
+} tmg_route_dict;
+
 // the whole graph structure
 typedef struct tmg_graph {
   int major_version;
   int minor_version;
   tmg_format format;
   int num_vertices;
-  tmg_vertex **vertices;
+  tmg_vertex *vertices;  // contiguous array of all vertices
   int num_edges;
-  tmg_edge **edges;  // a single list of all edges
+  tmg_edge *edges;  // a single contiguous array of all edges
   int num_travelers;
   char **traveler_list;  
+  // for traveled graphs, every edge's traveler bits in one block, a
+  // row of traveler_words 64-bit words per edge in edge order
+  int traveler_words;
+  uint64_t *traveler_bits;
+  // the shaping points of all edges in one block, edge e's are
+  // shaping_points[shaping_offsets[e]] through
+  // shaping_points[shaping_offsets[e+1]-1], and shaping_miles holds
+  // each one's distance along its edge from the edge's end1; both
+  // arrays are malloc'd so they can grow while loading and shrink
+  // when simplified, unless shaping_mapped says they are in a
+  // snapshot's mapping (tmg_graph_own_shaping then copies them out)
+  int num_shaping_points;
+  int shaping_capacity;
+  int *shaping_offsets;
+  tmg_latlng *shaping_points;
+  double *shaping_miles;
+  int shaping_mapped;
+  tmg_vertex_table table;
+  tmg_route_dict route_dict;
+  // compressed sparse row adjacency: the neighbors of vertex v are
+  // adj_vertices[adj_offsets[v]] through
+  // adj_vertices[adj_offsets[v+1]-1], each reached by the edge whose
+  // index is at the same position of adj_edges
+  int *adj_offsets;
+  int *adj_vertices;
+  int *adj_edges;
+  // when the vertices have been reordered after loading (see
+  // tmghilbert.h), orig_vertex_num[v] is the number in the file of
+  // what is now vertex v and vertex_renumber is its inverse, both NULL
+  // while vertices are numbered as in the file
+  int *orig_vertex_num;
+  int *vertex_renumber;
+  // when loaded by tmg_load_graph_mmap, the file mapping that labels,
+  // route strings and traveler names point into, or when loaded from
+  // a snapshot, the snapshot's mapping that holds nearly everything
+  char *file_map;
+  size_t file_map_size;
+  // all other memory held by the graph comes from this arena, so
+  // destroying a graph is a handful of frees
+  tmg_arena arena;
 } tmg_graph;
 
+// iterator over the neighbors of a vertex using the graph's
+// compressed sparse row adjacency, for example:
+//   tmg_adj_iter it;
+//   tmg_adj_begin(g, v, &it);
+//   while (tmg_adj_next(&it)) { ...it.vertex, it.edge... }
+typedef struct tmg_adj_iter {
+  tmg_graph *g;
+  int pos;  // position in the adjacency arrays of the next neighbor
+  int end;
+  int vertex;  // current neighbor's vertex number
+  int edge;  // index into g->edges of the edge that reaches it
+} tmg_adj_iter;
+
+// the iterator functions are small enough to be worth inlining into
+// the inner loops of graph searches
+static inline void tmg_adj_begin(tmg_graph *g, int v, tmg_adj_iter *it) {
+
+  it->g = g;
+  it->pos = g->adj_offsets[v];
+  it->end = g->adj_offsets[v+1];
+}
+
+static inline int tmg_adj_next(tmg_adj_iter *it) {
+
+  if (it->pos >= it->end) return 0;
+  it->vertex = it->g->adj_vertices[it->pos];
+  it->edge = it->g->adj_edges[it->pos];
+  it->pos++;
+  return 1;
+}
+
+static inline int tmg_vertex_degree(tmg_graph *g, int v) {
+
+  return g->adj_offsets[v+1] - g->adj_offsets[v];
+}
+
+// FNV-1a 64-bit hash parameters
+#define TMG_HASH_OFFSET 14695981039346656037ULL
+#define TMG_HASH_PRIME 1099511628211ULL
+
 // function prototypes
 extern tmg_latlng *tmg_latlng_create(double, double);
 extern tmg_waypoint *tmg_waypoint_create(char *, double, double);
 extern void tmg_waypoint_print(tmg_waypoint *w);
+extern int tmg_waypoint_format(tmg_waypoint *w, char *buf, size_t size);
 extern tmg_connection *tmg_connection_create(char *label, tmg_waypoint *e1,
 					     tmg_waypoint *e2,
 					     char *traveler_info,
 					     char *shaping_text);
 extern tmg_graph *tmg_load_graph(char *filename);
+extern tmg_graph *tmg_load_graph_mmap(char *filename);
+extern int tmg_graph_allocate(tmg_graph *g);
+extern int tmg_graph_finish_load(tmg_graph *g);
+extern int tmg_graph_build_adjacency(tmg_graph *g);
+extern int tmg_graph_build_edgelists(tmg_graph *g);
+extern uint64_t tmg_hash_bytes(uint64_t h, const void *data, size_t len);
+extern uint64_t tmg_graph_hash(tmg_graph *g);
+extern uint64_t tmg_points_hash(int *points, int num_points);
+extern int tmg_fill_conn_travelers(tmg_graph *g, tmg_edge *e, char *code);
+extern tmg_edgelist *tmg_edgelist_add(tmg_graph *g, tmg_edge *edge,
+				      tmg_edgelist *next);
+extern tmg_latlng *tmg_graph_reserve_shaping(tmg_graph *g, int count);
+extern int tmg_graph_finish_shaping(tmg_graph *g);
+extern int tmg_graph_own_shaping(tmg_graph *g);
+extern void tmg_edge_compute_length(tmg_graph *g, tmg_edge *e);
 extern void tmg_graph_print_stats(tmg_graph *, FILE *);
 extern void tmg_graph_destroy(tmg_graph *);
 extern double tmg_distance_latlng(tmg_latlng *p1, tmg_latlng *p2);
+extern int tmg_graph_build_vertex_table(tmg_graph *g);
+extern double tmg_distance_vertices(tmg_graph *g, int a, int b);
+extern int tmg_vertex_table_gather(tmg_graph *g, int *points, int num_points,
+				   tmg_vertex_table *t);
+extern void tmg_vertex_table_free(tmg_vertex_table *t);
+extern void tmg_table_distance_row(tmg_vertex_table *t, int from, int first,
+				   int count, double *dist);
+extern void tmg_distance_row(tmg_graph *g, int from, int first, int count,
+			     double *dist);
 
 #endif  // _TMGGRAPH_H
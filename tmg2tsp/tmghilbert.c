@@ -0,0 +1,290 @@
+/*
+  Functions to renumber the vertices of a METAL TMG graph along a
+  Hilbert space-filling curve.  The file's order is whatever order
+  the waypoints were written in, which scatters neighboring places
+  across the vertex array; in curve order, searches touch fewer cache
+  lines and pages, matrix tiles cover compact regions, and nearby rows
+  and columns of a matrix hold similar values.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmghilbert.h"
+#include "tmgroute.h"
+
+/*
+  Position along the Hilbert curve of the grid cell (x,y), where both
+  are less than 2^TMG_HILBERT_ORDER.
+*/
+uint32_t tmg_hilbert_key(uint32_t x, uint32_t y) {
+
+  uint32_t key = 0;
+  uint32_t s;
+  for (s = 1u << (TMG_HILBERT_ORDER - 1); s > 0; s >>= 1) {
+    uint32_t rx = (x & s) ? 1 : 0;
+    uint32_t ry = (y & s) ? 1 : 0;
+    key += s * s * ((3 * rx) ^ ry);
+    // rotate the quadrant so the curve within it has the standard
+    // orientation
+    if (ry == 0) {
+      if (rx == 1) {
+	x = s - 1 - x;
+	y = s - 1 - y;
+      }
+      uint32_t tmp = x;
+      x = y;
+      y = tmp;
+    }
+  }
+  return key;
+}
+
+/*
+  Renumber the vertices of g so that vertex order[i] becomes vertex
+  i, updating everything that refers to vertices by number or by
+  address: the edges' endpoints, the vertex table, the adjacency
+  arrays and any edge lists.  The edges (and their traveler bits and
+  shaping points) are also put in order of their lower numbered
+  endpoint, so a search reading the lengths of the edges at nearby
+  vertices reads nearby edges.  The permutation back to the file's
+  numbering is kept in the graph, composed with any earlier
+  renumbering.  Returns 1 on success, 0 if memory ran out.
+*/
+int tmg_graph_renumber(tmg_graph *g, int *order) {
+
+  int n = g->num_vertices;
+  int v, ednum;
+  int m = g->num_edges;
+  int *new_num = (int *)malloc(n * sizeof(int));
+  int *orig = (int *)tmg_arena_alloc(&(g->arena), n * sizeof(int));
+  int *renumber = (int *)tmg_arena_alloc(&(g->arena), n * sizeof(int));
+  tmg_vertex *old_vertices = (tmg_vertex *)malloc(n * sizeof(tmg_vertex));
+  double *old_values = (double *)malloc(n * sizeof(double));
+  tmg_edge *old_edges = (tmg_edge *)malloc(m * sizeof(tmg_edge));
+  int *start = (int *)calloc(n + 1, sizeof(int));
+  size_t words = g->traveler_words;
+  int move_bits = (g->traveler_bits && m && words);
+  uint64_t *old_bits = NULL;
+  if (move_bits) {
+    old_bits = (uint64_t *)malloc(m * words * sizeof(uint64_t));
+  }
+  int num_shaping = g->num_shaping_points;
+  tmg_latlng *shaping = NULL;
+  double *shaping_miles = NULL;
+  if (num_shaping) {
+    shaping = (tmg_latlng *)malloc(num_shaping * sizeof(tmg_latlng));
+    shaping_miles = (double *)malloc(num_shaping * sizeof(double));
+  }
+  if (!new_num || !orig || !renumber || !old_vertices || !old_values ||
+      (m && !old_edges) || !start || (move_bits && !old_bits) ||
+      (num_shaping && (!shaping || !shaping_miles))) {
+    fprintf(stderr, "Could not allocate memory to renumber %d vertices\n", n);
+    free(new_num);
+    free(old_vertices);
+    free(old_values);
+    free(old_edges);
+    free(start);
+    free(old_bits);
+    free(shaping);
+    free(shaping_miles);
+    return 0;
+  }
+  for (v = 0; v < n; v++) {
+    new_num[order[v]] = v;
+  }
+
+  // the vertex array is permuted in place, so the edges' endpoint
+  // pointers keep the same base address and only their positions
+  // change
+  int had_edgelists = 0;
+  memcpy(old_vertices, g->vertices, n * sizeof(tmg_vertex));
+  for (v = 0; v < n; v++) {
+    g->vertices[v] = old_vertices[order[v]];
+    g->vertices[v].vertex_num = v;
+    if (g->vertices[v].edges) had_edgelists = 1;
+    g->vertices[v].edges = NULL;
+  }
+  for (ednum = 0; ednum < m; ednum++) {
+    tmg_edge *e = &(g->edges[ednum]);
+    e->end1 = &(g->vertices[new_num[e->end1 - g->vertices]]);
+    e->end2 = &(g->vertices[new_num[e->end2 - g->vertices]]);
+    e->conn.end1 = &(e->end1->w);
+    e->conn.end2 = &(e->end2->w);
+  }
+
+  // a stable counting sort of the edges by lower endpoint
+  memcpy(old_edges, g->edges, m * sizeof(tmg_edge));
+  for (ednum = 0; ednum < m; ednum++) {
+    tmg_edge *e = &(old_edges[ednum]);
+    int low = e->end1->vertex_num < e->end2->vertex_num ?
+      e->end1->vertex_num : e->end2->vertex_num;
+    start[low + 1]++;
+  }
+  for (v = 0; v < n; v++) {
+    start[v + 1] += start[v];
+  }
+  for (ednum = 0; ednum < m; ednum++) {
+    tmg_edge *e = &(old_edges[ednum]);
+    int low = e->end1->vertex_num < e->end2->vertex_num ?
+      e->end1->vertex_num : e->end2->vertex_num;
+    g->edges[start[low]++] = *e;
+  }
+
+  // the route index lists edges by number
+  tmg_route_build_index(g);
+
+  // traveler bit rows follow their edges
+  if (move_bits) {
+    memcpy(old_bits, g->traveler_bits, m * words * sizeof(uint64_t));
+    for (ednum = 0; ednum < m; ednum++) {
+      tmg_conn_travelers *t = &(g->edges[ednum].conn.trav);
+      uint64_t *row = g->traveler_bits + ednum * words;
+      memcpy(row, old_bits + (t->bits - g->traveler_bits),
+	     words * sizeof(uint64_t));
+      t->bits = row;
+    }
+  }
+
+  // and so does each edge's run of the shaping point pool
+  int pos = 0;
+  for (ednum = 0; ednum < m; ednum++) {
+    tmg_connection *conn = &(g->edges[ednum].conn);
+    g->shaping_offsets[ednum] = pos;
+    if (conn->num_shaping_points) {
+      memcpy(shaping + pos, conn->shaping_points,
+	     conn->num_shaping_points * sizeof(tmg_latlng));
+      memcpy(shaping_miles + pos, conn->shaping_miles,
+	     conn->num_shaping_points * sizeof(double));
+      conn->shaping_points = shaping + pos;
+      conn->shaping_miles = shaping_miles + pos;
+      pos += conn->num_shaping_points;
+    }
+  }
+  g->shaping_offsets[m] = pos;
+  if (!g->shaping_mapped) {
+    free(g->shaping_points);
+    free(g->shaping_miles);
+  }
+  g->shaping_points = shaping;
+  g->shaping_miles = shaping_miles;
+  g->shaping_capacity = num_shaping;
+  g->shaping_mapped = 0;
+
+  double *columns[5] = { g->table.x, g->table.y, g->table.z,
+			 g->table.lat, g->table.lng };
+  int c;
+  for (c = 0; c < 5; c++) {
+    memcpy(old_values, columns[c], n * sizeof(double));
+    for (v = 0; v < n; v++) {
+      columns[c][v] = old_values[order[v]];
+    }
+  }
+
+  // compose with the existing permutation, if any
+  for (v = 0; v < n; v++) {
+    orig[v] = g->orig_vertex_num ? g->orig_vertex_num[order[v]] : order[v];
+  }
+  for (v = 0; v < n; v++) {
+    renumber[orig[v]] = v;
+  }
+  g->orig_vertex_num = orig;
+  g->vertex_renumber = renumber;
+
+  free(new_num);
+  free(old_vertices);
+  free(old_values);
+  free(old_edges);
+  free(start);
+  free(old_bits);
+
+  // the adjacency arrays are rebuilt in place, and are the same size
+  if (!tmg_graph_build_adjacency(g)) return 0;
+  if (had_edgelists && !tmg_graph_build_edgelists(g)) return 0;
+  return 1;
+}
+
+/*
+  Renumber the vertices of g in the order the Hilbert curve over its
+  bounding box visits them, with vertices in the same grid cell kept
+  in their existing order.  Returns 1 on success, 0 on failure.
+*/
+int tmg_graph_reorder_hilbert(tmg_graph *g) {
+
+  int n = g->num_vertices;
+  double *lat = g->table.lat;
+  double *lng = g->table.lng;
+  double min_lat = lat[0], max_lat = lat[0];
+  double min_lng = lng[0], max_lng = lng[0];
+  int v;
+  for (v = 1; v < n; v++) {
+    if (lat[v] < min_lat) min_lat = lat[v];
+    if (lat[v] > max_lat) max_lat = lat[v];
+    if (lng[v] < min_lng) min_lng = lng[v];
+    if (lng[v] > max_lng) max_lng = lng[v];
+  }
+
+  // one scale for both axes, so the curve's cells are square in degrees
+  double extent = max_lat - min_lat;
+  if (max_lng - min_lng > extent) extent = max_lng - min_lng;
+  double scale = (extent > 0.0) ?
+    ((1u << TMG_HILBERT_ORDER) - 1) / extent : 0.0;
+
+  uint32_t *keys = (uint32_t *)malloc(n * sizeof(uint32_t));
+  int *order = (int *)malloc(n * sizeof(int));
+  int *tmp = (int *)malloc(n * sizeof(int));
+  int *count = (int *)malloc((1 << 16) * sizeof(int));
+  if (!keys || !order || !tmp || !count) {
+    fprintf(stderr, "Could not allocate memory to reorder %d vertices\n", n);
+    free(keys);
+    free(order);
+    free(tmp);
+    free(count);
+    return 0;
+  }
+  for (v = 0; v < n; v++) {
+    keys[v] = tmg_hilbert_key((uint32_t)((lng[v] - min_lng) * scale),
+			      (uint32_t)((lat[v] - min_lat) * scale));
+    tmp[v] = v;
+  }
+
+  // two stable counting sort passes on 16 bits of the key each
+  int pass;
+  for (pass = 0; pass < 2; pass++) {
+    int shift = 16 * pass;
+    int *from = (pass == 0) ? tmp : order;
+    int *to = (pass == 0) ? order : tmp;
+    memset(count, 0, (1 << 16) * sizeof(int));
+    for (v = 0; v < n; v++) {
+      count[(keys[from[v]] >> shift) & 0xffff]++;
+    }
+    int sum = 0;
+    for (int d = 0; d < (1 << 16); d++) {
+      int c = count[d];
+      count[d] = sum;
+      sum += c;
+    }
+    for (v = 0; v < n; v++) {
+      to[count[(keys[from[v]] >> shift) & 0xffff]++] = from[v];
+    }
+  }
+
+  int ok = tmg_graph_renumber(g, tmp);
+  free(keys);
+  free(order);
+  free(tmp);
+  free(count);
+  return ok;
+}
+
+/*
+  The number vertex v had in the file g was loaded from.
+*/
+int tmg_graph_original_vertex(tmg_graph *g, int v) {
+
+  return g->orig_vertex_num ? g->orig_vertex_num[v] : v;
+}
@@ -0,0 +1,27 @@
+/*
+  Function prototypes for renumbering the vertices of a METAL TMG
+  graph along a Hilbert space-filling curve, so vertices that are
+  near each other on the map are near each other in memory and in
+  generated matrices.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGHILBERT_H
+#define _TMGHILBERT_H
+
+#include <stdint.h>
+#include "tmggraph.h"
+
+// the curve visits a 2^TMG_HILBERT_ORDER by 2^TMG_HILBERT_ORDER grid
+// over the graph's bounding box, so keys fit in 32 bits
+#define TMG_HILBERT_ORDER 16
+
+// function prototypes
+extern uint32_t tmg_hilbert_key(uint32_t x, uint32_t y);
+extern int tmg_graph_reorder_hilbert(tmg_graph *g);
+extern int tmg_graph_renumber(tmg_graph *g, int *order);
+extern int tmg_graph_original_vertex(tmg_graph *g, int v);
+
+#endif  // _TMGHILBERT_H
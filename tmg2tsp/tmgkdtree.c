@@ -0,0 +1,405 @@
+/*
+  A k-d tree over the unit vectors of METAL TMG graph vertices, and a
+  parallel all-points k-nearest-neighbor search built on it.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmgkdtree.h"
+
+// queries are claimed by threads this many tree positions at a time,
+// so each thread's queries are near each other
+#define TMG_KNN_CHUNK 256
+
+/* swap the points at tree positions a and b */
+static void tmg_kdtree_swap(tmg_kdtree *t, int a, int b) {
+
+  int i = t->index[a];
+  t->index[a] = t->index[b];
+  t->index[b] = i;
+  for (int d = 0; d < 3; d++) {
+    double c = t->xyz[3*a+d];
+    t->xyz[3*a+d] = t->xyz[3*b+d];
+    t->xyz[3*b+d] = c;
+  }
+}
+
+/* does position a come before position b along axis? ties by point */
+static int tmg_kdtree_less(tmg_kdtree *t, int a, int b, int axis) {
+
+  double ca = t->xyz[3*a+axis];
+  double cb = t->xyz[3*b+axis];
+  return ca < cb || (ca == cb && t->index[a] < t->index[b]);
+}
+
+/*
+  Rearrange positions lo..hi-1 so position nth holds the point that
+  belongs there in order along axis, with no later point before it and
+  no earlier one after it (quickselect).
+*/
+static void tmg_kdtree_select(tmg_kdtree *t, int lo, int hi, int nth,
+			      int axis) {
+
+  while (hi - lo > 1) {
+    // median of three pivot, moved to the end
+    int mid = lo + (hi - lo) / 2;
+    if (tmg_kdtree_less(t, mid, lo, axis)) tmg_kdtree_swap(t, mid, lo);
+    if (tmg_kdtree_less(t, hi-1, lo, axis)) tmg_kdtree_swap(t, hi-1, lo);
+    if (tmg_kdtree_less(t, mid, hi-1, axis)) tmg_kdtree_swap(t, mid, hi-1);
+    int store = lo;
+    for (int i = lo; i < hi-1; i++) {
+      if (tmg_kdtree_less(t, i, hi-1, axis)) {
+	tmg_kdtree_swap(t, i, store);
+	store++;
+      }
+    }
+    tmg_kdtree_swap(t, store, hi-1);
+    if (store == nth) return;
+    if (nth < store) hi = store;
+    else lo = store + 1;
+  }
+}
+
+/* build the subtree over positions lo..hi-1, splitting the widest axis */
+static void tmg_kdtree_build_range(tmg_kdtree *t, int lo, int hi) {
+
+  while (hi - lo > TMG_KDTREE_LEAF) {
+    double min[3], max[3];
+    int i, d;
+    for (d = 0; d < 3; d++) {
+      min[d] = max[d] = t->xyz[3*lo+d];
+    }
+    for (i = lo + 1; i < hi; i++) {
+      for (d = 0; d < 3; d++) {
+	double c = t->xyz[3*i+d];
+	if (c < min[d]) min[d] = c;
+	if (c > max[d]) max[d] = c;
+      }
+    }
+    int axis = 0;
+    for (d = 1; d < 3; d++) {
+      if (max[d] - min[d] > max[axis] - min[axis]) axis = d;
+    }
+    int mid = (lo + hi) / 2;
+    tmg_kdtree_select(t, lo, hi, mid, axis);
+    t->split[mid] = axis;
+    tmg_kdtree_build_range(t, lo, mid);
+    lo = mid + 1;
+  }
+}
+
+/*
+  Allocate a k-d tree of num_points points, with their coordinates
+  still to be filled in, NULL if out of memory.
+*/
+static tmg_kdtree *tmg_kdtree_allocate(int num_points) {
+
+  tmg_kdtree *t = (tmg_kdtree *)calloc(1, sizeof(tmg_kdtree));
+  if (!t) return NULL;
+  t->n = num_points;
+  t->index = (int *)malloc(num_points * sizeof(int));
+  t->xyz = (double *)malloc(3 * (size_t)num_points * sizeof(double));
+  t->split = (unsigned char *)calloc(num_points, 1);
+  if (!t->index || !t->xyz || !t->split) {
+    fprintf(stderr, "Could not allocate k-d tree of %d points\n", num_points);
+    tmg_kdtree_destroy(t);
+    return NULL;
+  }
+  for (int i = 0; i < num_points; i++) {
+    t->index[i] = i;
+  }
+  return t;
+}
+
+/*
+  Build a k-d tree over the unit vectors of the num_points graph
+  vertices in points.  NULL if out of memory.
+*/
+tmg_kdtree *tmg_kdtree_build(tmg_graph *g, int *points, int num_points) {
+
+  tmg_kdtree *t = tmg_kdtree_allocate(num_points);
+  if (!t) return NULL;
+  for (int i = 0; i < num_points; i++) {
+    int v = points[i];
+    t->xyz[3*i] = g->table.x[v];
+    t->xyz[3*i+1] = g->table.y[v];
+    t->xyz[3*i+2] = g->table.z[v];
+  }
+  tmg_kdtree_build_range(t, 0, num_points);
+  return t;
+}
+
+/*
+  Build a k-d tree over num_points arbitrary points in space, given as
+  3 coordinates each in xyz, such as cluster centers.  NULL if out of
+  memory.
+*/
+tmg_kdtree *tmg_kdtree_build_xyz(const double *xyz, int num_points) {
+
+  tmg_kdtree *t = tmg_kdtree_allocate(num_points);
+  if (!t) return NULL;
+  memcpy(t->xyz, xyz, 3 * (size_t)num_points * sizeof(double));
+  tmg_kdtree_build_range(t, 0, num_points);
+  return t;
+}
+
+/* free all memory of a k-d tree */
+void tmg_kdtree_destroy(tmg_kdtree *t) {
+
+  free(t->index);
+  free(t->xyz);
+  free(t->split);
+  free(t);
+}
+
+// the best points found so far by a nearest neighbor search: a max-heap
+// on (chord2, point), so the worst one is at the top
+typedef struct tmg_kdtree_best {
+  int k;
+  int size;
+  int *point;
+  double *chord2;
+} tmg_kdtree_best;
+
+/* is candidate (c, p) worse than (d, q)? */
+static int tmg_kdtree_worse(double c, int p, double d, int q) {
+
+  return c > d || (c == d && p > q);
+}
+
+/* place (c, p) in the heap at position i or below */
+static void tmg_kdtree_sift_down(tmg_kdtree_best *b, int i, double c, int p) {
+
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= b->size) break;
+    if (child + 1 < b->size &&
+	tmg_kdtree_worse(b->chord2[child+1], b->point[child+1],
+			 b->chord2[child], b->point[child])) {
+      child++;
+    }
+    if (!tmg_kdtree_worse(b->chord2[child], b->point[child], c, p)) break;
+    b->chord2[i] = b->chord2[child];
+    b->point[i] = b->point[child];
+    i = child;
+  }
+  b->chord2[i] = c;
+  b->point[i] = p;
+}
+
+/* offer a point to the best k so far */
+static void tmg_kdtree_offer(tmg_kdtree_best *b, double c, int p) {
+
+  if (b->size < b->k) {
+    // sift up from the new last entry
+    int i = b->size++;
+    while (i > 0) {
+      int parent = (i - 1) / 2;
+      if (!tmg_kdtree_worse(c, p, b->chord2[parent], b->point[parent])) break;
+      b->chord2[i] = b->chord2[parent];
+      b->point[i] = b->point[parent];
+      i = parent;
+    }
+    b->chord2[i] = c;
+    b->point[i] = p;
+  }
+  else if (tmg_kdtree_worse(b->chord2[0], b->point[0], c, p)) {
+    // replace the worst
+    tmg_kdtree_sift_down(b, 0, c, p);
+  }
+}
+
+/* offer the point at tree position pos, unless it is excluded */
+static void tmg_kdtree_visit(tmg_kdtree *t, int pos, const double *q,
+			     int exclude, tmg_kdtree_best *b) {
+
+  if (t->index[pos] == exclude) return;
+  double dx = t->xyz[3*pos] - q[0];
+  double dy = t->xyz[3*pos+1] - q[1];
+  double dz = t->xyz[3*pos+2] - q[2];
+  tmg_kdtree_offer(b, dx*dx + dy*dy + dz*dz, t->index[pos]);
+}
+
+/* search the subtree over positions lo..hi-1 */
+static void tmg_kdtree_search(tmg_kdtree *t, int lo, int hi, const double *q,
+			      int exclude, tmg_kdtree_best *b) {
+
+  if (hi - lo <= TMG_KDTREE_LEAF) {
+    for (int pos = lo; pos < hi; pos++) {
+      tmg_kdtree_visit(t, pos, q, exclude, b);
+    }
+    return;
+  }
+  int mid = (lo + hi) / 2;
+  int axis = t->split[mid];
+  double diff = q[axis] - t->xyz[3*mid+axis];
+
+  // the side holding q first, then the other only if it could hold
+  // something at least as close as the worst so far
+  if (diff < 0.0) {
+    tmg_kdtree_search(t, lo, mid, q, exclude, b);
+  }
+  else {
+    tmg_kdtree_search(t, mid + 1, hi, q, exclude, b);
+  }
+  tmg_kdtree_visit(t, mid, q, exclude, b);
+  if (b->size == b->k && diff * diff > b->chord2[0]) return;
+  if (diff < 0.0) {
+    tmg_kdtree_search(t, mid + 1, hi, q, exclude, b);
+  }
+  else {
+    tmg_kdtree_search(t, lo, mid, q, exclude, b);
+  }
+}
+
+/*
+  Find the k points closest to the unit vector q, other than point
+  exclude (-1 to exclude none), storing their point numbers in nearest
+  and squared chord distances in chord2, closest first, with ties in
+  point order.  Returns how many were found, less than k only if the
+  tree has fewer points.
+*/
+int tmg_kdtree_nearest(tmg_kdtree *t, const double *q, int exclude, int k,
+		       int *nearest, double *chord2) {
+
+  tmg_kdtree_best b;
+  b.k = k;
+  b.size = 0;
+  b.point = nearest;
+  b.chord2 = chord2;
+  if (k > 0 && t->n > 0) {
+    tmg_kdtree_search(t, 0, t->n, q, exclude, &b);
+  }
+
+  // move the worst to the end repeatedly to sort the results
+  int found = b.size;
+  while (b.size > 1) {
+    double c = b.chord2[0];
+    int p = b.point[0];
+    int last = --b.size;
+    tmg_kdtree_sift_down(&b, 0, b.chord2[last], b.point[last]);
+    b.chord2[last] = c;
+    b.point[last] = p;
+  }
+  return found;
+}
+
+// the state shared by the threads of an all-points neighbor search
+typedef struct tmg_knn_work {
+  tmg_graph *g;
+  int *points;
+  tmg_kdtree *t;
+  int k;
+  int *neighbors;
+  int *tenths;
+  atomic_int next;
+  atomic_int failed;
+} tmg_knn_work;
+
+/*
+  Thread function: claim chunks of tree positions and find the
+  neighbors of the points there, then order them by great circle
+  distance in miles, as the matrix measures it.
+*/
+static void *tmg_knn_worker(void *arg) {
+
+  tmg_knn_work *w = (tmg_knn_work *)arg;
+  tmg_kdtree *t = w->t;
+  double *chord2 = (double *)malloc(w->k * sizeof(double));
+  double *miles = (double *)malloc(w->k * sizeof(double));
+  if (!chord2 || !miles) {
+    atomic_store(&(w->failed), 1);
+    free(chord2);
+    free(miles);
+    return NULL;
+  }
+
+  int first;
+  while ((first = atomic_fetch_add(&(w->next), TMG_KNN_CHUNK)) < t->n) {
+    int last = first + TMG_KNN_CHUNK;
+    if (last > t->n) last = t->n;
+    for (int pos = first; pos < last; pos++) {
+      int p = t->index[pos];
+      int *nbr = w->neighbors + (size_t)p * w->k;
+      int found = tmg_kdtree_nearest(t, t->xyz + 3*pos, p, w->k, nbr, chord2);
+
+      // insertion sort by miles then point number, since rounding can
+      // order near ties differently than the chords did
+      for (int i = 0; i < found; i++) {
+	double m = tmg_distance_vertices(w->g, w->points[p],
+					 w->points[nbr[i]]);
+	int q = nbr[i];
+	int j = i;
+	while (j > 0 && (miles[j-1] > m ||
+			 (miles[j-1] == m && nbr[j-1] > q))) {
+	  miles[j] = miles[j-1];
+	  nbr[j] = nbr[j-1];
+	  j--;
+	}
+	miles[j] = m;
+	nbr[j] = q;
+      }
+      int *d = w->tenths + (size_t)p * w->k;
+      for (int i = 0; i < found; i++) {
+	d[i] = (int)ceil(miles[i] * 10);
+      }
+    }
+  }
+  free(chord2);
+  free(miles);
+  return NULL;
+}
+
+/*
+  Find the k nearest of the num_points graph vertices in points to each
+  of them, using nthreads threads.  Point p's neighbors, closest first,
+  go in neighbors[p*k..p*k+k-1] and their great circle distances in
+  tenths of a mile, rounded up as in the distance matrix, in the same
+  entries of tenths.  k must be less than num_points.  Returns 1 on
+  success, 0 if out of memory.
+*/
+int tmg_knn_compute(tmg_graph *g, int *points, int num_points, int k,
+		    int nthreads, int *neighbors, int *tenths) {
+
+  tmg_knn_work w;
+  w.g = g;
+  w.points = points;
+  w.t = tmg_kdtree_build(g, points, num_points);
+  if (!w.t) return 0;
+  w.k = k;
+  w.neighbors = neighbors;
+  w.tenths = tenths;
+  atomic_init(&(w.next), 0);
+  atomic_init(&(w.failed), 0);
+
+  // the calling thread is worker 0
+  if (nthreads < 1) nthreads = 1;
+  // points are claimed from a shared counter, so the calling thread
+  // takes up the work of any threads that could not be started
+  pthread_t *threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+  int started = 1;
+  while (threads && started < nthreads &&
+	 pthread_create(&threads[started], NULL, tmg_knn_worker, &w) == 0) {
+    started++;
+  }
+  tmg_knn_worker(&w);
+  for (int i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  tmg_kdtree_destroy(w.t);
+
+  if (atomic_load(&(w.failed))) {
+    fprintf(stderr, "Could not allocate neighbor search space\n");
+    return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,41 @@
+/*
+  Structure definitions and function prototypes for a k-d tree over
+  the unit vectors of a set of METAL TMG graph vertices, used to find
+  each point's nearest neighbors without computing all pairs of
+  distances.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGKDTREE_H
+#define _TMGKDTREE_H
+
+#include "tmggraph.h"
+
+// ranges of at most this many points are scanned rather than split
+#define TMG_KDTREE_LEAF 16
+
+// a k-d tree stored implicitly: the points of the subtree over
+// positions lo..hi-1 are split at mid = (lo+hi)/2 along axis
+// split[mid], with the smaller coordinates before mid.  Straight-line
+// (chord) distance between unit vectors grows with great circle
+// distance, so nearest by one is nearest by the other.
+typedef struct tmg_kdtree {
+  int n;
+  int *index;  // the point number (position in points) at each position
+  double *xyz;  // its unit vector, 3 coordinates per position
+  unsigned char *split;
+} tmg_kdtree;
+
+// function prototypes
+extern tmg_kdtree *tmg_kdtree_build(tmg_graph *g, int *points,
+				    int num_points);
+extern tmg_kdtree *tmg_kdtree_build_xyz(const double *xyz, int num_points);
+extern int tmg_kdtree_nearest(tmg_kdtree *t, const double *q, int exclude,
+			      int k, int *nearest, double *chord2);
+extern void tmg_kdtree_destroy(tmg_kdtree *t);
+extern int tmg_knn_compute(tmg_graph *g, int *points, int num_points, int k,
+			   int nthreads, int *neighbors, int *tenths);
+
+#endif  // _TMGKDTREE_H
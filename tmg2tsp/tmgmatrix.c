@@ -0,0 +1,502 @@
+/*
+  Functions to compute TSP distance matrices from the vertices of a
+  METAL TMG graph, in parallel with pthreads.
+
+  The matrix is symmetric, so only the upper triangle is computed.
+  For great circle distances, it is split into TMG_MATRIX_TILE x
+  TMG_MATRIX_TILE tiles, which threads claim one at a time from a
+  shared counter so faster threads simply take more tiles.  For road
+  distances, threads instead claim rows, each computed by a shortest
+  path search from that row's point that stops once all points to
+  the right of the diagonal are settled.  Once all rows or tiles are
+  done, the threads mirror the upper triangle into the lower one, by
+  tiles.
+
+  A band of complete rows can also be computed on its own, for
+  matrices too large to hold in memory.  Great circle entries left of
+  the diagonal are then computed from the column's point, so they are
+  exactly what mirroring would give.  A matrix whose first rows and
+  columns are already known is extended the same way: its remaining
+  rows are computed as a band and copied into the remaining columns.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tmgmatrix.h"
+#include "tmgpath.h"
+
+// define the array that's externed in the header file
+char *tmg_metric_names[] = { "great-circle", "road" };
+
+/*
+  Look up a metric by its name, returns 1 and sets metric if found,
+  0 if not.
+*/
+int tmg_metric_from_name(char *name, tmg_metric *metric) {
+
+  if (strcmp(name, tmg_metric_names[GREAT_CIRCLE]) == 0) {
+    *metric = GREAT_CIRCLE;
+    return 1;
+  }
+  if (strcmp(name, tmg_metric_names[ROAD]) == 0) {
+    *metric = ROAD;
+    return 1;
+  }
+  return 0;
+}
+
+/* compute the distance between the graph vertex at index a and the
+   graph vertex at index b in tenths of a mile, rounded up to the next
+   tenth.
+*/
+int vertex_to_vertex_distance_in_tenths(tmg_graph *g, int a, int b) {
+
+  double distance;
+  if (a == b) return 0;
+
+  distance = tmg_distance_vertices(g, a, b);
+
+  distance = ceil(distance * 10);
+
+  return (int)distance;
+}
+
+/*
+  Number of threads to use when none is specified: one per online
+  processor.
+*/
+int tmg_matrix_default_threads() {
+
+  long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nprocs < 1) return 1;
+  return (int)nprocs;
+}
+
+// the state shared by all threads working on one matrix
+typedef struct tmg_matrix_work {
+  tmg_graph *g;
+  tmg_metric metric;
+  int n;
+  int *points;  // vertex numbers of the points, for road searches
+  // entry i is point i, for great circle distances: the graph's own
+  // table when the points are its first vertices in order, otherwise
+  // gathered into gathered
+  tmg_vertex_table *table;
+  tmg_vertex_table gathered;
+  int *m;
+  int tiles_per_side;
+  // for a band of rows, its first row and size, and m holds just it
+  int first_row;
+  int num_rows;
+  atomic_int next_tile;    // next tile (or road row) to claim
+  atomic_int next_mirror;  // next tile to claim in the mirror phase
+  atomic_int unreachable;  // road pairs with no connection
+  atomic_int failed;  // set if any thread could not allocate memory
+  // held while threads are started, so none reaches the barrier
+  // before it is set up for the number that actually started
+  pthread_mutex_t start;
+  pthread_barrier_t barrier;
+} tmg_matrix_work;
+
+/*
+  Compute the distances in the upper triangle of one tile, tile
+  row bi, tile column bj, bj >= bi.
+*/
+static void tmg_matrix_compute_tile(tmg_matrix_work *w, int bi, int bj) {
+
+  int rstart = bi * TMG_MATRIX_TILE;
+  int rend = rstart + TMG_MATRIX_TILE;
+  if (rend > w->n) rend = w->n;
+  int cstart = bj * TMG_MATRIX_TILE;
+  int cend = cstart + TMG_MATRIX_TILE;
+  if (cend > w->n) cend = w->n;
+
+  double miles[TMG_MATRIX_TILE];
+
+  for (int from = rstart; from < rend; from++) {
+    int *row = w->m + (size_t)from * w->n;
+    // on diagonal tiles, start just right of the diagonal
+    int first = (cstart > from) ? cstart : from + 1;
+    if (first >= cend) continue;
+    tmg_table_distance_row(w->table, from, first, cend - first, miles);
+    for (int to = first; to < cend; to++) {
+      row[to] = (int)ceil(miles[to - first] * 10);
+    }
+  }
+}
+
+/*
+  Claim rows and compute the road distances right of the diagonal in
+  each by a shortest path search from the row's point, until no rows
+  remain.  Each thread has its own search state.
+*/
+static void tmg_matrix_road_rows(tmg_matrix_work *w) {
+
+  tmg_sssp *s = tmg_sssp_create(w->g);
+  double *miles = (double *)malloc(w->n * sizeof(double));
+  if (!s || !miles) {
+    atomic_store(&(w->failed), 1);
+    if (s) tmg_sssp_destroy(s);
+    free(miles);
+    return;
+  }
+
+  int from;
+  // the last row has nothing right of the diagonal
+  while ((from = atomic_fetch_add(&(w->next_tile), 1)) < w->n - 1) {
+    int count = w->n - 1 - from;
+    int unreachable = tmg_sssp_to_targets(s, w->points[from],
+					  w->points + from + 1, count, miles);
+    if (unreachable) atomic_fetch_add(&(w->unreachable), unreachable);
+    int *row = w->m + (size_t)from * w->n + from + 1;
+    for (int i = 0; i < count; i++) {
+      row[i] = (miles[i] < 0.0) ? TMG_MATRIX_UNREACHABLE :
+	(int)ceil(miles[i] * 10);
+    }
+  }
+
+  free(miles);
+  tmg_sssp_destroy(s);
+}
+
+/*
+  Copy the upper triangle entries of tile bi, bj into the lower
+  triangle.  Each tile writes only its own transposed block, so no
+  two threads ever write the same entries.
+*/
+static void tmg_matrix_mirror_tile(tmg_matrix_work *w, int bi, int bj) {
+
+  int rstart = bi * TMG_MATRIX_TILE;
+  int rend = rstart + TMG_MATRIX_TILE;
+  if (rend > w->n) rend = w->n;
+  int cstart = bj * TMG_MATRIX_TILE;
+  int cend = cstart + TMG_MATRIX_TILE;
+  if (cend > w->n) cend = w->n;
+
+  for (int to = cstart; to < cend; to++) {
+    int *row = w->m + (size_t)to * w->n;
+    int from = rstart;
+    for (; from < rend && from < to; from++) {
+      row[from] = w->m[(size_t)from * w->n + to];
+    }
+  }
+}
+
+/*
+  Thread function: claim and compute upper triangle tiles (or road
+  rows) until none remain, wait for everyone to finish, then claim and
+  mirror tiles.  Tile numbers cover the whole tiles_per_side x
+  tiles_per_side grid, and those below the diagonal are skipped.
+*/
+static void *tmg_matrix_worker(void *arg) {
+
+  tmg_matrix_work *w = (tmg_matrix_work *)arg;
+  int num_tiles = w->tiles_per_side * w->tiles_per_side;
+  int tile;
+
+  pthread_mutex_lock(&(w->start));
+  pthread_mutex_unlock(&(w->start));
+
+  if (w->metric == ROAD) {
+    tmg_matrix_road_rows(w);
+  }
+  else {
+    while ((tile = atomic_fetch_add(&(w->next_tile), 1)) < num_tiles) {
+      int bi = tile / w->tiles_per_side;
+      int bj = tile % w->tiles_per_side;
+      if (bj >= bi) tmg_matrix_compute_tile(w, bi, bj);
+    }
+  }
+
+  pthread_barrier_wait(&(w->barrier));
+
+  while ((tile = atomic_fetch_add(&(w->next_mirror), 1)) < num_tiles) {
+    int bi = tile / w->tiles_per_side;
+    int bj = tile % w->tiles_per_side;
+    if (bj >= bi) tmg_matrix_mirror_tile(w, bi, bj);
+  }
+
+  return NULL;
+}
+
+/*
+  Set up the parts of w common to whole matrices and bands: the points
+  and, for great circle distances, a vertex table indexed by point.
+  Returns 1 on success, 0 if out of memory.
+*/
+static int tmg_matrix_work_init(tmg_matrix_work *w, tmg_graph *g, int *points,
+				int num_points, tmg_metric metric) {
+
+  w->g = g;
+  w->metric = metric;
+  w->n = num_points;
+  w->points = points;
+  w->table = &(g->table);
+  w->gathered.x = NULL;
+  w->tiles_per_side = (num_points + TMG_MATRIX_TILE - 1) / TMG_MATRIX_TILE;
+  atomic_init(&(w->next_tile), 0);
+  atomic_init(&(w->next_mirror), 0);
+  atomic_init(&(w->unreachable), 0);
+  atomic_init(&(w->failed), 0);
+  if (metric == ROAD) return 1;
+
+  int i;
+  for (i = 0; i < num_points && points[i] == i; i++);
+  if (i == num_points) return 1;
+  if (!tmg_vertex_table_gather(g, points, num_points, &(w->gathered))) {
+    return 0;
+  }
+  w->table = &(w->gathered);
+  return 1;
+}
+
+/*
+  Compute the entries of one tile of a band of complete rows: tile row
+  bi counted from the band's first row, tile column bj.
+*/
+static void tmg_matrix_band_tile(tmg_matrix_work *w, int bi, int bj) {
+
+  int rstart = w->first_row + bi * TMG_MATRIX_TILE;
+  int rend = rstart + TMG_MATRIX_TILE;
+  if (rend > w->first_row + w->num_rows) rend = w->first_row + w->num_rows;
+  int cstart = bj * TMG_MATRIX_TILE;
+  int cend = cstart + TMG_MATRIX_TILE;
+  if (cend > w->n) cend = w->n;
+
+  double miles[TMG_MATRIX_TILE];
+
+  // right of the diagonal, along the rows
+  for (int from = rstart; from < rend; from++) {
+    int *row = w->m + (size_t)(from - w->first_row) * w->n;
+    if (from >= cstart && from < cend) row[from] = 0;
+    int first = (cstart > from) ? cstart : from + 1;
+    if (first >= cend) continue;
+    tmg_table_distance_row(w->table, from, first, cend - first, miles);
+    for (int to = first; to < cend; to++) {
+      row[to] = (int)ceil(miles[to - first] * 10);
+    }
+  }
+
+  // left of the diagonal, along the columns
+  for (int to = cstart; to < cend; to++) {
+    int first = (rstart > to) ? rstart : to + 1;
+    if (first >= rend) continue;
+    tmg_table_distance_row(w->table, to, first, rend - first, miles);
+    for (int from = first; from < rend; from++) {
+      w->m[(size_t)(from - w->first_row) * w->n + to] =
+	(int)ceil(miles[from - first] * 10);
+    }
+  }
+}
+
+/*
+  Thread function for a band of complete rows: claim and compute tiles
+  of great circle distances, or whole rows of road distances, each by
+  a search from the row's point to all points.
+*/
+static void *tmg_matrix_band_worker(void *arg) {
+
+  tmg_matrix_work *w = (tmg_matrix_work *)arg;
+
+  if (w->metric == ROAD) {
+    tmg_sssp *s = tmg_sssp_create(w->g);
+    double *miles = (double *)malloc(w->n * sizeof(double));
+    if (!s || !miles) {
+      atomic_store(&(w->failed), 1);
+      if (s) tmg_sssp_destroy(s);
+      free(miles);
+      return NULL;
+    }
+    int r;
+    while ((r = atomic_fetch_add(&(w->next_tile), 1)) < w->num_rows) {
+      int from = w->first_row + r;
+      int unreachable = tmg_sssp_to_targets(s, w->points[from], w->points,
+					    w->n, miles);
+      if (unreachable) atomic_fetch_add(&(w->unreachable), unreachable);
+      int *row = w->m + (size_t)r * w->n;
+      for (int to = 0; to < w->n; to++) {
+	if (to == from) {
+	  row[to] = 0;
+	}
+	else {
+	  row[to] = (miles[to] < 0.0) ? TMG_MATRIX_UNREACHABLE :
+	    (int)ceil(miles[to] * 10);
+	}
+      }
+    }
+    free(miles);
+    tmg_sssp_destroy(s);
+    return NULL;
+  }
+
+  int row_tiles = (w->num_rows + TMG_MATRIX_TILE - 1) / TMG_MATRIX_TILE;
+  int tile;
+  while ((tile = atomic_fetch_add(&(w->next_tile), 1)) <
+	 row_tiles * w->tiles_per_side) {
+    tmg_matrix_band_tile(w, tile / w->tiles_per_side,
+			 tile % w->tiles_per_side);
+  }
+  return NULL;
+}
+
+/*
+  Compute num_rows complete rows, starting at row first_row, of the
+  num_points x num_points matrix of distances between the graph
+  vertices in points, into rows, which has room for them, using
+  nthreads threads.  Great circle rows are identical to those of
+  tmg_matrix_compute.  Each road row comes from a search from its own
+  point, so an entry left of the diagonal sums its path from the other
+  end than tmg_matrix_compute does, and in rare cases can round to a
+  different tenth.  Returns the number of unreachable pairs seen in
+  the band, or -1 if out of memory.
+*/
+int tmg_matrix_compute_rows(tmg_graph *g, int *points, int num_points,
+			    int first_row, int num_rows, tmg_metric metric,
+			    int nthreads, int *rows) {
+
+  tmg_matrix_work w;
+  int i;
+
+  if (!tmg_matrix_work_init(&w, g, points, num_points, metric)) return -1;
+  w.m = rows;
+  w.first_row = first_row;
+  w.num_rows = num_rows;
+
+  // the calling thread is worker 0, and does all of the work if no
+  // others can be started
+  if (nthreads < 1) nthreads = 1;
+  pthread_t *threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+  int started = 1;
+  while (threads && started < nthreads &&
+	 pthread_create(&threads[started], NULL, tmg_matrix_band_worker,
+			&w) == 0) {
+    started++;
+  }
+  tmg_matrix_band_worker(&w);
+  for (i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  free(threads);
+  tmg_vertex_table_free(&(w.gathered));
+
+  if (atomic_load(&(w.failed))) {
+    fprintf(stderr, "Could not allocate shortest path search state\n");
+    return -1;
+  }
+  return atomic_load(&(w.unreachable));
+}
+
+/*
+  Compute the num_points x num_points matrix of distances in tenths of
+  a mile, rounded up, between the graph vertices in points, measured
+  by the given metric, using nthreads threads.  Returns a newly
+  allocated row-major array, NULL if it could not be computed.
+*/
+int *tmg_matrix_compute(tmg_graph *g, int *points, int num_points,
+			tmg_metric metric, int nthreads) {
+
+  tmg_matrix_work w;
+  int i;
+
+  if (!tmg_matrix_work_init(&w, g, points, num_points, metric)) return NULL;
+  w.m = (int *)malloc((size_t)num_points * num_points * sizeof(int));
+  if (!w.m) {
+    fprintf(stderr, "Could not allocate %d x %d distance matrix\n",
+	    num_points, num_points);
+    tmg_vertex_table_free(&(w.gathered));
+    return NULL;
+  }
+  for (i = 0; i < num_points; i++) {
+    w.m[(size_t)i * num_points + i] = 0;
+  }
+  w.first_row = 0;
+  w.num_rows = num_points;
+
+  // the calling thread is worker 0, and does all of the work if no
+  // others can be started; the barrier waits for those that were
+  if (nthreads < 1) nthreads = 1;
+  pthread_t *threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+  pthread_mutex_init(&(w.start), NULL);
+  pthread_mutex_lock(&(w.start));
+  int started = 1;
+  while (threads && started < nthreads &&
+	 pthread_create(&threads[started], NULL, tmg_matrix_worker, &w) == 0) {
+    started++;
+  }
+  pthread_barrier_init(&(w.barrier), NULL, started);
+  pthread_mutex_unlock(&(w.start));
+  tmg_matrix_worker(&w);
+  for (i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  free(threads);
+  tmg_vertex_table_free(&(w.gathered));
+  pthread_barrier_destroy(&(w.barrier));
+  pthread_mutex_destroy(&(w.start));
+
+  if (atomic_load(&(w.failed))) {
+    fprintf(stderr, "Could not allocate shortest path search state\n");
+    free(w.m);
+    return NULL;
+  }
+  if (atomic_load(&(w.unreachable))) {
+    fprintf(stderr, "Warning: %d pairs of points have no road connection, "
+	    "using distance %d\n", atomic_load(&(w.unreachable)),
+	    TMG_MATRIX_UNREACHABLE);
+  }
+  return w.m;
+}
+
+/*
+  Copy rows known_points and beyond of the num_points x num_points
+  matrix into the columns known_points and beyond of the rows before
+  them.
+*/
+void tmg_matrix_mirror_rows(int *matrix, int num_points, int known_points) {
+
+  for (int i = 0; i < known_points; i++) {
+    int *row = matrix + (size_t)i * num_points;
+    for (int j = known_points; j < num_points; j++) {
+      row[j] = matrix[(size_t)j * num_points + i];
+    }
+  }
+}
+
+/*
+  Extend matrix, a num_points x num_points row-major matrix of
+  distances between the graph vertices in points whose first
+  known_points rows and columns are already filled in, by computing
+  the rest using nthreads threads.  Only searches from the new points
+  are needed, so as with tmg_matrix_compute_rows, great circle entries
+  are identical to tmg_matrix_compute's, and road entries between old
+  and new points can in rare cases round to a different tenth.
+  Returns 1 on success, 0 if out of memory.
+*/
+int tmg_matrix_extend(tmg_graph *g, int *points, int num_points,
+		      int known_points, tmg_metric metric, int nthreads,
+		      int *matrix) {
+
+  int unreachable = tmg_matrix_compute_rows(g, points, num_points,
+					    known_points,
+					    num_points - known_points, metric,
+					    nthreads, matrix +
+					    (size_t)known_points * num_points);
+  if (unreachable < 0) return 0;
+  if (unreachable) {
+    fprintf(stderr, "Warning: %d pairs of points have no road connection, "
+	    "using distance %d\n", unreachable, TMG_MATRIX_UNREACHABLE);
+  }
+  tmg_matrix_mirror_rows(matrix, num_points, known_points);
+  return 1;
+}
@@ -0,0 +1,45 @@
+/*
+  Structure definitions and function prototypes for computing TSP
+  distance matrices from the vertices of a METAL TMG graph.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGMATRIX_H
+#define _TMGMATRIX_H
+
+#include "tmggraph.h"
+
+// rows and columns in each square tile of the matrix handed to a
+// thread at a time: 64x64 ints is 16K, which keeps a tile plus the
+// coordinates it needs in cache
+#define TMG_MATRIX_TILE 64
+
+// matrix entry for a pair of points with no road connection: 100,000
+// miles is longer than any real route between two places on Earth
+#define TMG_MATRIX_UNREACHABLE 1000000
+
+// the most threads -j may ask for
+#define TMG_MAX_THREADS 1024
+
+// how distances between points are measured
+typedef enum tmg_metric { GREAT_CIRCLE, ROAD } tmg_metric;
+extern char *tmg_metric_names[];
+
+// function prototypes
+extern int tmg_matrix_default_threads();
+extern int tmg_metric_from_name(char *name, tmg_metric *metric);
+extern int vertex_to_vertex_distance_in_tenths(tmg_graph *g, int a, int b);
+extern int *tmg_matrix_compute(tmg_graph *g, int *points, int num_points,
+			       tmg_metric metric, int nthreads);
+extern void tmg_matrix_mirror_rows(int *matrix, int num_points,
+				   int known_points);
+extern int tmg_matrix_extend(tmg_graph *g, int *points, int num_points,
+			     int known_points, tmg_metric metric, int nthreads,
+			     int *matrix);
+extern int tmg_matrix_compute_rows(tmg_graph *g, int *points, int num_points,
+				   int first_row, int num_rows,
+				   tmg_metric metric, int nthreads, int *rows);
+
+#endif  // _TMGMATRIX_H
@@ -0,0 +1,369 @@
+/*
+  A faster METAL TMG graph loader that maps the whole file into
+  memory and parses it in a single pass with its own number
+  scanners, rather than going through stdio.
+
+  The file is mapped privately and writable, so tokens can be
+  terminated in place: vertex labels, route strings and traveler
+  names all point directly into the mapped file, which stays mapped
+  for the life of the graph.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tmggraph.h"
+#include "tmgroute.h"
+
+// current position in the mapped file, plus its end
+typedef struct tmg_scanner {
+  char *p;
+  char *end;
+} tmg_scanner;
+
+// exact powers of 10 as doubles, for the fast path of tmg_scan_double
+static const double tmg_pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* skip spaces and tabs, but not newlines */
+static void tmg_skip_blanks(tmg_scanner *s) {
+
+  while (s->p < s->end && (*s->p == ' ' || *s->p == '\t' || *s->p == '\r')) {
+    s->p++;
+  }
+}
+
+/* skip all whitespace, including newlines */
+static void tmg_skip_space(tmg_scanner *s) {
+
+  while (s->p < s->end && (*s->p == ' ' || *s->p == '\t' ||
+			   *s->p == '\r' || *s->p == '\n')) {
+    s->p++;
+  }
+}
+
+/* is the scanner at a newline or the end of the file? */
+static int tmg_at_eol(tmg_scanner *s) {
+
+  tmg_skip_blanks(s);
+  return s->p >= s->end || *s->p == '\n';
+}
+
+/*
+  Return the next whitespace-delimited token, terminated in place, as
+  fscanf's %s would read it, or NULL at the end of the file.  Since
+  the terminator overwrites the delimiter, ended_line is set to tell
+  the caller whether that delimiter was the end of the line.
+*/
+static char *tmg_scan_token(tmg_scanner *s, int *ended_line) {
+
+  tmg_skip_space(s);
+  if (s->p >= s->end) return NULL;
+  char *start = s->p;
+  while (s->p < s->end && *s->p != ' ' && *s->p != '\t' &&
+	 *s->p != '\r' && *s->p != '\n') {
+    s->p++;
+  }
+  *ended_line = (s->p >= s->end || *s->p == '\n');
+  // the byte just past the end of the file is always a writable '\0'
+  *s->p = '\0';
+  if (s->p < s->end) s->p++;
+  return start;
+}
+
+/*
+  Scan an optionally signed decimal integer.  Returns 1 on success,
+  0 if there is no integer at the current position.
+*/
+static int tmg_scan_int(tmg_scanner *s, int *value) {
+
+  tmg_skip_space(s);
+  char *p = s->p;
+  int neg = 0;
+  if (p < s->end && (*p == '-' || *p == '+')) {
+    neg = (*p == '-');
+    p++;
+  }
+  if (p >= s->end || *p < '0' || *p > '9') return 0;
+  long v = 0;
+  while (p < s->end && *p >= '0' && *p <= '9') {
+    v = v*10 + (*p - '0');
+    p++;
+  }
+  *value = (int)(neg ? -v : v);
+  s->p = p;
+  return 1;
+}
+
+/*
+  Scan a floating point value.  Plain decimals with at most 15
+  significant digits and 22 fractional digits, which covers every
+  coordinate in METAL data, are computed as one exact integer divided
+  by an exact power of 10, which IEEE arithmetic rounds correctly and
+  so matches strtod bit for bit.  Anything else (exponents, very long
+  digit strings) is handed to strtod.  Returns 1 on success, 0 if
+  there is no number at the current position.
+*/
+static int tmg_scan_double(tmg_scanner *s, double *value) {
+
+  tmg_skip_space(s);
+  char *start = s->p;
+  char *p = start;
+  int neg = 0;
+  if (p < s->end && (*p == '-' || *p == '+')) {
+    neg = (*p == '-');
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int frac_digits = 0;
+  int any = 0;
+  while (p < s->end && *p >= '0' && *p <= '9') {
+    if (mantissa || *p != '0') digits++;
+    mantissa = mantissa*10 + (*p - '0');
+    p++;
+    any = 1;
+    if (digits > 15) break;
+  }
+  if (p < s->end && *p == '.' && digits <= 15) {
+    p++;
+    while (p < s->end && *p >= '0' && *p <= '9') {
+      if (mantissa || *p != '0') digits++;
+      mantissa = mantissa*10 + (*p - '0');
+      frac_digits++;
+      p++;
+      any = 1;
+      if (digits > 15) break;
+    }
+  }
+  if (!any) return 0;
+
+  if (digits <= 15 && frac_digits <= 22 &&
+      (p >= s->end || (*p != 'e' && *p != 'E' && *p != '.' &&
+		       (*p < '0' || *p > '9')))) {
+    double v = (double)mantissa / tmg_pow10[frac_digits];
+    *value = neg ? -v : v;
+    s->p = p;
+    return 1;
+  }
+
+  // slow path: the scanner only ever stops on whitespace or the
+  // '\0' past the end of the file, so strtod sees a terminated token
+  char *after;
+  *value = strtod(start, &after);
+  if (after == start) return 0;
+  s->p = after;
+  return 1;
+}
+
+/*
+  Map the file, writable and private, with a guaranteed zero byte just
+  past its end so the last token can be terminated in place.  An
+  anonymous mapping one byte longer than the file is made first and
+  the file is mapped over its start.  Returns NULL on failure.
+*/
+static char *tmg_map_file(char *filename, size_t *size) {
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr,"Could not open file %s for reading\n", filename);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    fprintf(stderr,"Could not determine size of file %s\n", filename);
+    close(fd);
+    return NULL;
+  }
+  *size = st.st_size + 1;
+  char *base = mmap(NULL, *size, PROT_READ|PROT_WRITE,
+		    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    fprintf(stderr,"Could not map file %s\n", filename);
+    close(fd);
+    return NULL;
+  }
+  if (mmap(base, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED,
+	   fd, 0) == MAP_FAILED) {
+    fprintf(stderr,"Could not map file %s\n", filename);
+    munmap(base, *size);
+    close(fd);
+    return NULL;
+  }
+  close(fd);
+  madvise(base, st.st_size, MADV_SEQUENTIAL);
+  return base;
+}
+
+/*
+  Helper to report a load error and clean up a partially loaded graph.
+*/
+static tmg_graph *tmg_mmap_fail(tmg_graph *g, char *message, int num) {
+
+  fprintf(stderr, message, num);
+  tmg_graph_destroy(g);
+  return NULL;
+}
+
+/*
+  Load a graph from the given file by mapping it into memory, return a
+  new graph pointer, NULL if any problems are encountered on load.
+  Produces the same graph as tmg_load_graph.
+*/
+tmg_graph *tmg_load_graph_mmap(char *filename) {
+
+  size_t size;
+  char *map = tmg_map_file(filename, &size);
+  if (!map) return NULL;
+
+  tmg_graph *g = (tmg_graph *)calloc(1,sizeof(tmg_graph));
+  tmg_arena_init(&(g->arena));
+  g->file_map = map;
+  g->file_map_size = size;
+
+  tmg_scanner s;
+  s.p = map;
+  s.end = map + size - 1;
+  int eol;
+
+  // first line of the file is the TMG header
+  char *tok = tmg_scan_token(&s, &eol);
+  if (!tok || strcmp(tok, "TMG") != 0 ||
+      !tmg_scan_int(&s, &(g->major_version)) || *s.p != '.') {
+    return tmg_mmap_fail(g, "Unknown TMG header format.\n", 0);
+  }
+  s.p++;
+  if (!tmg_scan_int(&s, &(g->minor_version)) ||
+      !(tok = tmg_scan_token(&s, &eol))) {
+    return tmg_mmap_fail(g, "Unknown TMG header format.\n", 0);
+  }
+
+  // version check
+  if (g->major_version != 1 && g->major_version != 2) {
+    fprintf(stderr, "Unknown TMG file version %d.%d.\n", g->major_version,
+	    g->minor_version);
+    tmg_graph_destroy(g);
+    return NULL;
+  }
+
+  if (strcmp(tok, "simple") == 0) {
+    g->format = SIMPLE;
+  }
+  else if (strcmp(tok, "collapsed") == 0) {
+    g->format = COLLAPSED;
+  }
+  else if (strcmp(tok, "traveled") == 0) {
+    g->format = TRAVELED;
+  }
+  else {
+    fprintf(stderr, "Unknown TMG file format specifier %s.\n", tok);
+    tmg_graph_destroy(g);
+    return NULL;
+  }
+
+  // next line is number of waypoints and connections, plus the
+  // traveler count for traveled graphs
+  if (!tmg_scan_int(&s, &(g->num_vertices)) ||
+      !tmg_scan_int(&s, &(g->num_edges))) {
+    return tmg_mmap_fail(g, "Could not read number of waypoints and connections from TMG file.\n", 0);
+  }
+  if (g->format == TRAVELED && !tmg_scan_int(&s, &(g->num_travelers))) {
+    return tmg_mmap_fail(g, "Could not read number of travelers from TMG file.\n", 0);
+  }
+
+  if (!tmg_graph_allocate(g)) {
+    tmg_graph_destroy(g);
+    return NULL;
+  }
+
+  // waypoints: label lat lng
+  int vnum;
+  for (vnum = 0; vnum < g->num_vertices; vnum++) {
+    tmg_vertex *v = &(g->vertices[vnum]);
+    v->w.label = tmg_scan_token(&s, &eol);
+    if (!v->w.label || !tmg_scan_double(&s, &(v->w.coords.lat)) ||
+	!tmg_scan_double(&s, &(v->w.coords.lng))) {
+      return tmg_mmap_fail(g, "Could not read waypoint %d from TMG\n", vnum);
+    }
+  }
+
+  // edges: two vertex numbers, a route label, then for traveled
+  // graphs the traveler hex code, then for collapsed and traveled
+  // graphs any shaping points through the end of the line
+  int ednum;
+  int v1, v2;
+  for (ednum = 0; ednum < g->num_edges; ednum++) {
+    tmg_edge *e = &(g->edges[ednum]);
+    if (!tmg_scan_int(&s, &v1) || !tmg_scan_int(&s, &v2) ||
+	v1 < 0 || v1 >= g->num_vertices || v2 < 0 || v2 >= g->num_vertices ||
+	!(e->conn.routes = tmg_scan_token(&s, &eol))) {
+      return tmg_mmap_fail(g, "Could not read edge %d from TMG\n", ednum);
+    }
+    g->shaping_offsets[ednum] = g->num_shaping_points;
+    e->end1 = &(g->vertices[v1]);
+    e->end2 = &(g->vertices[v2]);
+    e->conn.end1 = &(e->end1->w);
+    e->conn.end2 = &(e->end2->w);
+    // the strings stay in the file mapping
+    e->conn.route_id = tmg_route_intern(g, e->conn.routes, 0);
+    if (e->conn.route_id < 0) {
+      return tmg_mmap_fail(g, "Could not store route of edge %d\n", ednum);
+    }
+
+    if (g->format == TRAVELED) {
+      if (eol || !(tok = tmg_scan_token(&s, &eol))) {
+	return tmg_mmap_fail(g, "Could not read travelers for edge %d from TMG\n", ednum);
+      }
+      if (!tmg_fill_conn_travelers(g, e, tok)) {
+	return tmg_mmap_fail(g, "Invalid travelers for edge %d in TMG\n", ednum);
+      }
+    }
+
+    // shaping points go straight into the graph's pool
+    if (g->format != SIMPLE && !eol) {
+      for (;;) {
+	tmg_scanner pair = s;
+	double lat, lng;
+	if (tmg_at_eol(&pair) || !tmg_scan_double(&pair, &lat) ||
+	    tmg_at_eol(&pair) || !tmg_scan_double(&pair, &lng)) {
+	  break;
+	}
+	tmg_latlng *p = tmg_graph_reserve_shaping(g, 1);
+	if (!p) {
+	  return tmg_mmap_fail(g, "Could not store shaping points of edge %d\n",
+			       ednum);
+	}
+	p->lat = lat;
+	p->lng = lng;
+	s = pair;
+      }
+    }
+  }
+
+  // traveled format graphs then have the list of traveler names
+  if (g->format == TRAVELED) {
+    g->traveler_list =
+      (char **)tmg_arena_calloc(&(g->arena), g->num_travelers, sizeof(char *));
+    int tnum;
+    for (tnum = 0; tnum < g->num_travelers; tnum++) {
+      g->traveler_list[tnum] = tmg_scan_token(&s, &eol);
+    }
+  }
+
+  if (!tmg_graph_finish_load(g)) {
+    tmg_graph_destroy(g);
+    return NULL;
+  }
+  return g;
+}
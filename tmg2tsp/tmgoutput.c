@@ -0,0 +1,280 @@
+/*
+  Buffered text output for tmg2tsp: integers are formatted two digits
+  at a time from a table, text collects in large buffers, and the
+  buffers go out in big write calls.  Matrix rows are formatted by
+  several threads, each into its own buffer, and written in order.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tmgoutput.h"
+
+// the two-character text of each number 0-99
+static const char tmg_digit_pairs[201] =
+  "00010203040506070809101112131415161718192021222324"
+  "25262728293031323334353637383940414243444546474849"
+  "50515253545556575859606162636465666768697071727374"
+  "75767778798081828384858687888990919293949596979899";
+
+/*
+  Write the decimal text of value, exactly as printf's %d would, at p,
+  which must have room for TMG_OUTPUT_INT_CHARS characters.  Returns
+  a pointer just past the last character written.
+*/
+char *tmg_format_int(char *p, int value) {
+
+  char tmp[TMG_OUTPUT_INT_CHARS];
+  char *t = tmp + sizeof(tmp);
+  unsigned int u = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+
+  // digits are produced from the right, two at a time
+  while (u >= 100) {
+    unsigned int q = u / 100;
+    unsigned int r = u - q * 100;
+    t -= 2;
+    memcpy(t, tmg_digit_pairs + 2 * r, 2);
+    u = q;
+  }
+  if (u >= 10) {
+    t -= 2;
+    memcpy(t, tmg_digit_pairs + 2 * u, 2);
+  }
+  else {
+    *--t = '0' + u;
+  }
+  if (value < 0) {
+    *--t = '-';
+  }
+
+  size_t len = tmp + sizeof(tmp) - t;
+  memcpy(p, t, len);
+  return p + len;
+}
+
+/*
+  Write all len bytes of buf to fd, continuing after partial writes
+  and interruptions.  Returns 1 on success, 0 on failure.
+*/
+int tmg_write_all(int fd, const char *buf, size_t len) {
+
+  while (len > 0) {
+    ssize_t written = write(fd, buf, len);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      perror("write");
+      return 0;
+    }
+    buf += written;
+    len -= written;
+  }
+  return 1;
+}
+
+/* set up out to collect up to size bytes at a time for fd */
+void tmg_output_init(tmg_output *out, int fd, size_t size) {
+
+  out->fd = fd;
+  out->buf = (char *)malloc(size);
+  out->len = 0;
+  out->size = size;
+  out->failed = (out->buf == NULL);
+}
+
+/* write everything collected so far */
+void tmg_output_flush(tmg_output *out) {
+
+  if (out->len > 0 && !out->failed &&
+      !tmg_write_all(out->fd, out->buf, out->len)) {
+    out->failed = 1;
+  }
+  out->len = 0;
+}
+
+/* make sure there is room for len more bytes */
+static void tmg_output_reserve(tmg_output *out, size_t len) {
+
+  if (out->len + len > out->size) {
+    tmg_output_flush(out);
+  }
+}
+
+void tmg_output_char(tmg_output *out, char c) {
+
+  tmg_output_reserve(out, 1);
+  if (out->failed) return;
+  out->buf[out->len++] = c;
+}
+
+void tmg_output_str(tmg_output *out, const char *s) {
+
+  size_t len = strlen(s);
+  tmg_output_reserve(out, len);
+  if (out->failed) return;
+  if (len > out->size) {
+    // too big to buffer, so send it along directly
+    if (!tmg_write_all(out->fd, s, len)) out->failed = 1;
+    return;
+  }
+  memcpy(out->buf + out->len, s, len);
+  out->len += len;
+}
+
+void tmg_output_int(tmg_output *out, int value) {
+
+  tmg_output_reserve(out, TMG_OUTPUT_INT_CHARS);
+  if (out->failed) return;
+  out->len = tmg_format_int(out->buf + out->len, value) - out->buf;
+}
+
+/*
+  Write anything left and release the buffer.  Returns 1 if all of the
+  output was written successfully.
+*/
+int tmg_output_close(tmg_output *out) {
+
+  tmg_output_flush(out);
+  free(out->buf);
+  out->buf = NULL;
+  return !out->failed;
+}
+
+// shared by the threads writing a matrix: bands of rows are formatted
+// in parallel and written strictly in order
+typedef struct tmg_output_work {
+  int fd;
+  const int *matrix;
+  int num_rows;
+  int n;  // entries per row
+  int rows_per_band;
+  int num_bands;
+  int nthreads;
+  int next_band;  // the next band to be written
+  int failed;
+  pthread_mutex_t lock;
+  pthread_cond_t turn;
+} tmg_output_work;
+
+typedef struct tmg_output_thread {
+  tmg_output_work *work;
+  int id;
+} tmg_output_thread;
+
+/*
+  Thread function: format bands id, id+nthreads, ... into this
+  thread's buffer, each written when its turn comes.
+*/
+static void *tmg_output_worker(void *arg) {
+
+  tmg_output_thread *t = (tmg_output_thread *)arg;
+  tmg_output_work *w = t->work;
+  int n = w->n;
+  tmg_output out;
+
+  // bands are dealt out by the number of threads, which is settled
+  // once all that can be started have been
+  pthread_mutex_lock(&w->lock);
+  pthread_mutex_unlock(&w->lock);
+
+  // each row is at most n ints, each followed by a tab, and a newline
+  tmg_output_init(&out, w->fd,
+		  (size_t)w->rows_per_band * ((size_t)n * (TMG_OUTPUT_INT_CHARS + 1) + 1));
+  for (int band = t->id; band < w->num_bands; band += w->nthreads) {
+    int first = band * w->rows_per_band;
+    int last = first + w->rows_per_band;
+    if (last > w->num_rows) last = w->num_rows;
+    if (!out.failed) {
+      char *p = out.buf;
+      for (int from = first; from < last; from++) {
+	const int *row = w->matrix + (size_t)from * n;
+	for (int to = 0; to < n; to++) {
+	  p = tmg_format_int(p, row[to]);
+	  *p++ = '\t';
+	}
+	*p++ = '\n';
+      }
+      out.len = p - out.buf;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    while (w->next_band != band) {
+      pthread_cond_wait(&w->turn, &w->lock);
+    }
+    if (out.failed) w->failed = 1;
+    if (!w->failed) {
+      tmg_output_flush(&out);
+      if (out.failed) w->failed = 1;
+    }
+    out.len = 0;
+    w->next_band++;
+    pthread_cond_broadcast(&w->turn);
+    pthread_mutex_unlock(&w->lock);
+  }
+  tmg_output_close(&out);
+  return NULL;
+}
+
+/*
+  Write num_rows rows of num_cols matrix entries each to fd as text,
+  each entry followed by a tab and each row by a newline, exactly as
+  printf("%d\t") would.  Returns 1 on success, 0 on failure.
+*/
+int tmg_output_matrix_text(int fd, const int *rows, int num_rows,
+			   int num_cols, int nthreads) {
+
+  tmg_output_work w;
+  size_t row_bytes = (size_t)num_cols * (TMG_OUTPUT_INT_CHARS + 1) + 1;
+
+  w.fd = fd;
+  w.matrix = rows;
+  w.num_rows = num_rows;
+  w.n = num_cols;
+  w.rows_per_band = TMG_OUTPUT_BUFFER_SIZE / row_bytes;
+  if (w.rows_per_band < 1) w.rows_per_band = 1;
+  w.num_bands = (num_rows + w.rows_per_band - 1) / w.rows_per_band;
+  w.nthreads = nthreads;
+  if (w.nthreads > w.num_bands) w.nthreads = w.num_bands;
+  if (w.nthreads < 1) w.nthreads = 1;
+  w.next_band = 0;
+  w.failed = 0;
+  pthread_mutex_init(&w.lock, NULL);
+  pthread_cond_init(&w.turn, NULL);
+
+  // the calling thread is worker 0, and writes everything if no
+  // others can be started
+  tmg_output_thread *threads =
+    (tmg_output_thread *)malloc(w.nthreads * sizeof(tmg_output_thread));
+  pthread_t *tids = (pthread_t *)malloc(w.nthreads * sizeof(pthread_t));
+  tmg_output_thread self = { &w, 0 };
+  int started = 1;
+  pthread_mutex_lock(&w.lock);
+  if (threads && tids) {
+    for (int i = 0; i < w.nthreads; i++) {
+      threads[i].work = &w;
+      threads[i].id = i;
+    }
+    while (started < w.nthreads &&
+	   pthread_create(&tids[started], NULL, tmg_output_worker,
+			  &threads[started]) == 0) {
+      started++;
+    }
+  }
+  w.nthreads = started;
+  pthread_mutex_unlock(&w.lock);
+  tmg_output_worker(&self);
+  for (int i = 1; i < started; i++) {
+    pthread_join(tids[i], NULL);
+  }
+
+  pthread_mutex_destroy(&w.lock);
+  pthread_cond_destroy(&w.turn);
+  free(threads);
+  free(tids);
+  return !w.failed;
+}
@@ -0,0 +1,43 @@
+/*
+  Structure definitions and function prototypes for buffered text
+  output written straight to a file descriptor, used to print large
+  distance matrices without going through printf for every entry.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGOUTPUT_H
+#define _TMGOUTPUT_H
+
+#include <stddef.h>
+
+// size of an output buffer, and about how many bytes of matrix rows
+// each thread formats before they are written
+#define TMG_OUTPUT_BUFFER_SIZE (1<<20)
+
+// longest text of one int, including its sign
+#define TMG_OUTPUT_INT_CHARS 11
+
+// text accumulated in a buffer and written to fd in large chunks
+typedef struct tmg_output {
+  int fd;
+  char *buf;
+  size_t len;
+  size_t size;
+  int failed;  // has any write failed?
+} tmg_output;
+
+// function prototypes
+extern char *tmg_format_int(char *p, int value);
+extern int tmg_write_all(int fd, const char *buf, size_t len);
+extern void tmg_output_init(tmg_output *out, int fd, size_t size);
+extern void tmg_output_flush(tmg_output *out);
+extern void tmg_output_char(tmg_output *out, char c);
+extern void tmg_output_str(tmg_output *out, const char *s);
+extern void tmg_output_int(tmg_output *out, int value);
+extern int tmg_output_close(tmg_output *out);
+extern int tmg_output_matrix_text(int fd, const int *rows, int num_rows,
+				  int num_cols, int nthreads);
+
+#endif  // _TMGOUTPUT_H
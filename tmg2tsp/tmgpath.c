@@ -0,0 +1,175 @@
+/*
+  Single-source shortest path searches (Dijkstra's algorithm) over
+  the edges of a METAL TMG graph, stopping as soon as a given set of
+  target vertices have all been settled.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tmgpath.h"
+
+/*
+  Create the state for searches over graph g, NULL if it could not be
+  allocated.
+*/
+tmg_sssp *tmg_sssp_create(tmg_graph *g) {
+
+  tmg_sssp *s = (tmg_sssp *)calloc(1, sizeof(tmg_sssp));
+  if (!s) return NULL;
+  s->g = g;
+  s->dist = (double *)malloc(g->num_vertices*sizeof(double));
+  s->stamp = (int *)calloc(g->num_vertices, sizeof(int));
+  s->heap_pos = (int *)malloc(g->num_vertices*sizeof(int));
+  s->target = (int *)calloc(g->num_vertices, sizeof(int));
+  s->heap = (int *)malloc(g->num_vertices*sizeof(int));
+  if (!s->dist || !s->stamp || !s->heap_pos || !s->target || !s->heap) {
+    fprintf(stderr, "Could not allocate search state for %d vertices\n",
+	    g->num_vertices);
+    tmg_sssp_destroy(s);
+    return NULL;
+  }
+  return s;
+}
+
+/* free all memory of a search state */
+void tmg_sssp_destroy(tmg_sssp *s) {
+
+  free(s->dist);
+  free(s->stamp);
+  free(s->heap_pos);
+  free(s->target);
+  free(s->heap);
+  free(s);
+}
+
+/* move the heap entry at position pos up until its parent is no larger */
+static void tmg_heap_sift_up(tmg_sssp *s, int pos) {
+
+  int v = s->heap[pos];
+  double d = s->dist[v];
+  while (pos > 0) {
+    int parent = (pos - 1) / TMG_HEAP_ARITY;
+    int pv = s->heap[parent];
+    if (s->dist[pv] <= d) break;
+    s->heap[pos] = pv;
+    s->heap_pos[pv] = pos;
+    pos = parent;
+  }
+  s->heap[pos] = v;
+  s->heap_pos[v] = pos;
+}
+
+/* move the heap entry at position pos down until no child is smaller */
+static void tmg_heap_sift_down(tmg_sssp *s, int pos) {
+
+  int v = s->heap[pos];
+  double d = s->dist[v];
+  for (;;) {
+    int first = pos * TMG_HEAP_ARITY + 1;
+    if (first >= s->heap_size) break;
+    int last = first + TMG_HEAP_ARITY;
+    if (last > s->heap_size) last = s->heap_size;
+    int best = first;
+    double bestd = s->dist[s->heap[first]];
+    int c;
+    for (c = first + 1; c < last; c++) {
+      double cd = s->dist[s->heap[c]];
+      if (cd < bestd) {
+	best = c;
+	bestd = cd;
+      }
+    }
+    if (bestd >= d) break;
+    s->heap[pos] = s->heap[best];
+    s->heap_pos[s->heap[pos]] = pos;
+    pos = best;
+  }
+  s->heap[pos] = v;
+  s->heap_pos[v] = pos;
+}
+
+/* remove and return the vertex with the smallest distance */
+static int tmg_heap_pop(tmg_sssp *s) {
+
+  int v = s->heap[0];
+  s->heap_size--;
+  if (s->heap_size > 0) {
+    s->heap[0] = s->heap[s->heap_size];
+    tmg_heap_sift_down(s, 0);
+  }
+  s->heap_pos[v] = -1;
+  return v;
+}
+
+/*
+  Run Dijkstra's algorithm from vertex source until every vertex in
+  targets has been settled, or the source's connected component has
+  been exhausted.  dist[i] is set to the distance in miles to
+  targets[i], or -1.0 if it is not reachable.  Returns the number of
+  targets that were not reachable.
+*/
+int tmg_sssp_to_targets(tmg_sssp *s, int source, int *targets,
+			int num_targets, double *dist) {
+
+  tmg_graph *g = s->g;
+  int i;
+
+  // a new epoch invalidates everything from the previous search
+  s->epoch++;
+  int epoch = s->epoch;
+
+  int remaining = 0;
+  for (i = 0; i < num_targets; i++) {
+    if (s->target[targets[i]] != epoch) {
+      s->target[targets[i]] = epoch;
+      remaining++;
+    }
+  }
+
+  s->dist[source] = 0.0;
+  s->stamp[source] = epoch;
+  s->heap[0] = source;
+  s->heap_pos[source] = 0;
+  s->heap_size = 1;
+
+  while (remaining > 0 && s->heap_size > 0) {
+    int v = tmg_heap_pop(s);
+    if (s->target[v] == epoch) remaining--;
+    double dv = s->dist[v];
+
+    tmg_adj_iter it;
+    tmg_adj_begin(g, v, &it);
+    while (tmg_adj_next(&it)) {
+      int w = it.vertex;
+      double dw = dv + g->edges[it.edge].conn.length_in_miles;
+      if (s->stamp[w] != epoch) {
+	// first time w is seen in this search
+	s->stamp[w] = epoch;
+	s->dist[w] = dw;
+	s->heap[s->heap_size] = w;
+	s->heap_size++;
+	tmg_heap_sift_up(s, s->heap_size - 1);
+      }
+      else if (s->heap_pos[w] >= 0 && dw < s->dist[w]) {
+	s->dist[w] = dw;
+	tmg_heap_sift_up(s, s->heap_pos[w]);
+      }
+    }
+  }
+
+  int unreachable = 0;
+  for (i = 0; i < num_targets; i++) {
+    int t = targets[i];
+    if (s->stamp[t] == epoch && s->heap_pos[t] == -1) {
+      dist[i] = s->dist[t];
+    }
+    else {
+      dist[i] = -1.0;
+      unreachable++;
+    }
+  }
+  return unreachable;
+}
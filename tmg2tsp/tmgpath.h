@@ -0,0 +1,40 @@
+/*
+  Structure definitions and function prototypes for shortest path
+  searches over the edges of a METAL TMG graph, using edge lengths in
+  miles as weights.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGPATH_H
+#define _TMGPATH_H
+
+#include "tmggraph.h"
+
+// the priority queue is a d-ary heap with this d: a 4-ary heap is
+// shallower than a binary heap and its children share a cache line
+#define TMG_HEAP_ARITY 4
+
+// the reusable state of a single-source shortest path search, one per
+// thread.  Per-vertex arrays are only valid for a vertex whose stamp
+// matches the current search's epoch, so nothing needs to be cleared
+// between searches.
+typedef struct tmg_sssp {
+  tmg_graph *g;
+  double *dist;  // best known distance from the source
+  int *stamp;  // epoch in which dist and heap_pos were last set
+  int *heap_pos;  // position in heap, -1 once settled
+  int *target;  // epoch in which the vertex was marked a target
+  int *heap;  // vertex numbers, a TMG_HEAP_ARITY-ary min-heap on dist
+  int heap_size;
+  int epoch;
+} tmg_sssp;
+
+// function prototypes
+extern tmg_sssp *tmg_sssp_create(tmg_graph *g);
+extern void tmg_sssp_destroy(tmg_sssp *s);
+extern int tmg_sssp_to_targets(tmg_sssp *s, int source, int *targets,
+			       int num_targets, double *dist);
+
+#endif  // _TMGPATH_H
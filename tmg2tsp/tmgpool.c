@@ -0,0 +1,167 @@
+/*
+  A pool of threads running a fixed set of independent tasks.
+
+  The tasks are dealt out round-robin, in the order given, to a deque
+  for each worker, so each worker starts with an even share of them.
+  A worker runs the tasks from its own deque first, and when it runs
+  out, steals from whichever other worker has the most tasks still
+  waiting.  Callers list their tasks largest first, so the tasks left
+  waiting are the smaller ones, and a thief takes the largest of those
+  from its victim's head, the one that would otherwise finish last.
+
+  Each deque has its own lock, which is taken once per task run or
+  stolen, so workers contend only when one steals.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tmgpool.h"
+
+// the state shared by all workers of one run
+typedef struct tmg_pool {
+  int nthreads;
+  tmg_pool_deque *deques;
+  tmg_pool_func func;
+  void *data;
+  atomic_int steals;
+} tmg_pool;
+
+// what each worker thread is given
+typedef struct tmg_pool_worker {
+  tmg_pool *pool;
+  int id;
+} tmg_pool_worker;
+
+/* take the task at the head of d, -1 if it is empty */
+static int tmg_pool_take(tmg_pool_deque *d) {
+
+  int task = -1;
+  pthread_mutex_lock(&(d->lock));
+  if (d->head < d->tail) {
+    task = d->tasks[d->head++];
+  }
+  pthread_mutex_unlock(&(d->lock));
+  return task;
+}
+
+/*
+  Steal a task for worker self from the worker with the most tasks
+  waiting, -1 if there are none anywhere.  No task adds others, so
+  once every deque is empty the worker is done.
+*/
+static int tmg_pool_steal(tmg_pool *p, int self) {
+
+  for (;;) {
+    int victim = -1;
+    int most = 0;
+    for (int i = 1; i < p->nthreads; i++) {
+      int v = (self + i) % p->nthreads;
+      tmg_pool_deque *d = &(p->deques[v]);
+      pthread_mutex_lock(&(d->lock));
+      int waiting = d->tail - d->head;
+      pthread_mutex_unlock(&(d->lock));
+      if (waiting > most) {
+	most = waiting;
+	victim = v;
+      }
+    }
+    if (victim < 0) return -1;
+    int task = tmg_pool_take(&(p->deques[victim]));
+    if (task >= 0) {
+      atomic_fetch_add(&(p->steals), 1);
+      return task;
+    }
+    // another thief emptied it first, so look again
+  }
+}
+
+/* run tasks, the worker's own and then stolen ones, until none are left */
+static void *tmg_pool_worker_run(void *arg) {
+
+  tmg_pool_worker *w = (tmg_pool_worker *)arg;
+  tmg_pool *p = w->pool;
+  int task;
+  while ((task = tmg_pool_take(&(p->deques[w->id]))) >= 0 ||
+	 (task = tmg_pool_steal(p, w->id)) >= 0) {
+    p->func(p->data, task, w->id);
+  }
+  return NULL;
+}
+
+/*
+  Run func on tasks 0 through num_tasks-1 using nthreads threads (no
+  more than there are tasks), the calling thread among them, starting
+  them in about the order of their numbers.  Each call is given the
+  task number and the number of the worker running it, from 0 to
+  nthreads-1.  Returns the number of tasks that were stolen, or -1 if
+  out of memory, in which case no task has been run.
+*/
+int tmg_pool_run(int num_tasks, int nthreads, tmg_pool_func func,
+		 void *data) {
+
+  int i;
+  if (num_tasks < 1) return 0;
+  if (nthreads > num_tasks) nthreads = num_tasks;
+  if (nthreads < 1) nthreads = 1;
+
+  tmg_pool p;
+  p.nthreads = nthreads;
+  p.func = func;
+  p.data = data;
+  atomic_init(&(p.steals), 0);
+
+  int per_worker = (num_tasks + nthreads - 1) / nthreads;
+  p.deques = (tmg_pool_deque *)malloc(nthreads * sizeof(tmg_pool_deque));
+  int *tasks = (int *)malloc((size_t)nthreads * per_worker * sizeof(int));
+  tmg_pool_worker *workers =
+    (tmg_pool_worker *)malloc(nthreads * sizeof(tmg_pool_worker));
+  pthread_t *threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+  if (!p.deques || !tasks || !workers || !threads) {
+    fprintf(stderr, "Could not allocate pool of %d threads\n", nthreads);
+    free(p.deques);
+    free(tasks);
+    free(workers);
+    free(threads);
+    return -1;
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    pthread_mutex_init(&(p.deques[i].lock), NULL);
+    p.deques[i].tasks = tasks + (size_t)i * per_worker;
+    p.deques[i].head = 0;
+    p.deques[i].tail = 0;
+    workers[i].pool = &p;
+    workers[i].id = i;
+  }
+  for (i = 0; i < num_tasks; i++) {
+    tmg_pool_deque *d = &(p.deques[i % nthreads]);
+    d->tasks[d->tail++] = i;
+  }
+
+  // the calling thread is worker 0, and the tasks dealt to any
+  // threads that could not be started are stolen by the others
+  int started = 1;
+  while (started < nthreads &&
+	 pthread_create(&threads[started], NULL, tmg_pool_worker_run,
+			&workers[started]) == 0) {
+    started++;
+  }
+  tmg_pool_worker_run(&workers[0]);
+  for (i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    pthread_mutex_destroy(&(p.deques[i].lock));
+  }
+  free(p.deques);
+  free(tasks);
+  free(workers);
+  free(threads);
+  return atomic_load(&(p.steals));
+}
@@ -0,0 +1,32 @@
+/*
+  Structure definitions and function prototypes for a pool of threads
+  that run a fixed set of independent tasks, balancing the load by
+  work stealing.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGPOOL_H
+#define _TMGPOOL_H
+
+#include <pthread.h>
+
+// runs task number task of a pool's work on behalf of worker number
+// worker, with the data given to tmg_pool_run
+typedef void (*tmg_pool_func)(void *data, int task, int worker);
+
+// the tasks dealt to one worker, still to be run: tasks[head] through
+// tasks[tail-1], taken from the head by the worker itself or a thief
+typedef struct tmg_pool_deque {
+  pthread_mutex_t lock;
+  int *tasks;
+  int head;
+  int tail;
+} tmg_pool_deque;
+
+// function prototypes
+extern int tmg_pool_run(int num_tasks, int nthreads, tmg_pool_func func,
+			void *data);
+
+#endif  // _TMGPOOL_H
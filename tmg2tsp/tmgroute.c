@@ -0,0 +1,347 @@
+/*
+  The route dictionary of METAL TMG graphs.
+
+  Loaders intern each edge's route string as they read it: a hash
+  table finds the number of a string seen before, so only one copy of
+  each distinct string is kept and every edge records a small
+  route_id.  Once loading is done, the distinct strings are split at
+  commas into route names, interned the same way, and the edges are
+  grouped by route with a counting sort, so the edges or vertices of
+  one route are found in time proportional to their number rather
+  than by comparing the strings of every edge.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmgroute.h"
+
+/*
+  Helper function: the size of a hash table for count entries, a
+  power of 2 at most half full.
+*/
+static int tmg_route_table_size(int count) {
+
+  int size = 16;
+  while (size < 2*count) size *= 2;
+  return size;
+}
+
+/*
+  Helper function for tmg_route_intern: make the loading hash table
+  size entries, with room for half that many strings, rehashing the
+  strings already there.  Returns 1 on success, 0 if out of memory.
+*/
+static int tmg_route_grow(tmg_route_dict *d, int size) {
+
+  int *hash = (int *)malloc(size * sizeof(int));
+  char **strings = (char **)realloc(d->strings, (size/2) * sizeof(char *));
+  if (!hash || !strings) {
+    fprintf(stderr, "Could not allocate route dictionary of %d strings\n",
+	    size/2);
+    free(hash);
+    if (strings) d->strings = strings;
+    // nothing frees the strings until there is a table
+    if (!d->hash) {
+      free(d->strings);
+      d->strings = NULL;
+    }
+    return 0;
+  }
+  d->strings = strings;
+  memset(hash, 0xff, size * sizeof(int));
+  int mask = size - 1;
+  for (int i = 0; i < d->num_strings; i++) {
+    int slot = tmg_hash_bytes(TMG_HASH_OFFSET, strings[i], strlen(strings[i])) &
+      mask;
+    while (hash[slot] >= 0) {
+      slot = (slot + 1) & mask;
+    }
+    hash[slot] = i;
+  }
+  free(d->hash);
+  d->hash = hash;
+  d->hash_size = size;
+  return 1;
+}
+
+/*
+  Intern the route string of an edge being loaded into g, copying it
+  into the graph's arena if copy is set (otherwise it must stay valid
+  as long as the graph, as strings in a file mapping do).  Returns
+  the string's number in the route dictionary, -1 if out of memory.
+*/
+int tmg_route_intern(tmg_graph *g, char *routes, int copy) {
+
+  tmg_route_dict *d = &(g->route_dict);
+  if (!d->hash && !tmg_route_grow(d, tmg_route_table_size(0))) return -1;
+
+  int mask = d->hash_size - 1;
+  int slot = tmg_hash_bytes(TMG_HASH_OFFSET, routes, strlen(routes)) & mask;
+  while (d->hash[slot] >= 0) {
+    if (strcmp(d->strings[d->hash[slot]], routes) == 0) {
+      return d->hash[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+  // a new string: there are few, so keeping the table small enough to
+  // stay in cache matters more than never rehashing
+  if (2*(d->num_strings + 1) > d->hash_size) {
+    if (!tmg_route_grow(d, 2*d->hash_size)) return -1;
+    mask = d->hash_size - 1;
+    slot = tmg_hash_bytes(TMG_HASH_OFFSET, routes, strlen(routes)) & mask;
+    while (d->hash[slot] >= 0) {
+      slot = (slot + 1) & mask;
+    }
+  }
+  char *s = copy ? tmg_arena_strdup(&(g->arena), routes) : routes;
+  if (!s) return -1;
+  d->hash[slot] = d->num_strings;
+  d->strings[d->num_strings] = s;
+  return d->num_strings++;
+}
+
+/*
+  Helper function for tmg_route_finish_load: the number of the route
+  named by the len characters at name in the table of size entries,
+  adding it to names if it is new.  A name that is a whole route
+  string is shared with it, others are copied into the arena.
+  Returns -1 if out of memory.
+*/
+static int tmg_route_intern_name(tmg_graph *g, int *table, int size,
+				 char *name, size_t len, int whole) {
+
+  tmg_route_dict *d = &(g->route_dict);
+  int mask = size - 1;
+  int slot = tmg_hash_bytes(TMG_HASH_OFFSET, name, len) & mask;
+  while (table[slot] >= 0) {
+    char *other = d->names[table[slot]];
+    if (strncmp(other, name, len) == 0 && other[len] == '\0') {
+      return table[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+  char *s = name;
+  if (!whole) {
+    s = (char *)tmg_arena_alloc(&(g->arena), len + 1);
+    if (!s) return -1;
+    memcpy(s, name, len);
+    s[len] = '\0';
+  }
+  table[slot] = d->num_routes;
+  d->names[d->num_routes] = s;
+  return d->num_routes++;
+}
+
+/*
+  Once all edges of g are loaded with their route_ids, point each at
+  its interned string, move the dictionary into the graph's arena,
+  find the routes each string names, and build the index from routes
+  to edges.  Returns 1 on success, 0 if out of memory.
+*/
+int tmg_route_finish_load(tmg_graph *g) {
+
+  tmg_route_dict *d = &(g->route_dict);
+  int ns = d->num_strings;
+  int s, i;
+
+  char **strings = (char **)tmg_arena_calloc(&(g->arena), ns + 1,
+					     sizeof(char *));
+  if (!strings) return 0;
+  if (ns) memcpy(strings, d->strings, ns * sizeof(char *));
+  free(d->strings);
+  free(d->hash);
+  d->strings = strings;
+  d->hash = NULL;
+  d->hash_size = 0;
+  for (i = 0; i < g->num_edges; i++) {
+    g->edges[i].conn.routes = strings[g->edges[i].conn.route_id];
+  }
+
+  // at most one name per comma-separated piece of each string
+  int pieces = 0;
+  for (s = 0; s < ns; s++) {
+    char *p;
+    pieces++;
+    for (p = strings[s]; *p; p++) {
+      if (*p == ',') pieces++;
+    }
+  }
+  d->string_offsets = (int *)tmg_arena_calloc(&(g->arena), ns + 1,
+					      sizeof(int));
+  d->string_routes = (int *)tmg_arena_calloc(&(g->arena), pieces + 1,
+					     sizeof(int));
+  d->names = (char **)malloc((pieces + 1) * sizeof(char *));
+  int size = tmg_route_table_size(pieces);
+  int *table = (int *)malloc(size * sizeof(int));
+  if (!d->string_offsets || !d->string_routes || !d->names || !table) {
+    fprintf(stderr, "Could not allocate %d route names\n", pieces);
+    free(d->names);
+    free(table);
+    d->names = NULL;
+    return 0;
+  }
+  memset(table, 0xff, size * sizeof(int));
+
+  int count = 0;
+  d->num_routes = 0;
+  for (s = 0; s < ns; s++) {
+    d->string_offsets[s] = count;
+    char *start = strings[s];
+    for (;;) {
+      char *end = strchr(start, ',');
+      size_t len = end ? (size_t)(end - start) : strlen(start);
+      if (len > 0) {
+	int r = tmg_route_intern_name(g, table, size, start, len,
+				      start == strings[s] && !end);
+	if (r < 0) {
+	  free(d->names);
+	  free(table);
+	  d->names = NULL;
+	  return 0;
+	}
+	// a route named twice in one string is listed once
+	for (i = d->string_offsets[s]; i < count; i++) {
+	  if (d->string_routes[i] == r) break;
+	}
+	if (i == count) d->string_routes[count++] = r;
+      }
+      if (!end) break;
+      start = end + 1;
+    }
+  }
+  d->string_offsets[ns] = count;
+  free(table);
+
+  char **names = (char **)tmg_arena_calloc(&(g->arena), d->num_routes + 1,
+					   sizeof(char *));
+  if (!names) return 0;
+  memcpy(names, d->names, d->num_routes * sizeof(char *));
+  free(d->names);
+  d->names = names;
+
+  // every edge appears once for each route its string names
+  size_t entries = 0;
+  for (i = 0; i < g->num_edges; i++) {
+    int id = g->edges[i].conn.route_id;
+    entries += d->string_offsets[id + 1] - d->string_offsets[id];
+  }
+  d->edge_offsets = (int *)tmg_arena_calloc(&(g->arena), d->num_routes + 1,
+					    sizeof(int));
+  d->edges = (int *)tmg_arena_calloc(&(g->arena), entries + 1, sizeof(int));
+  if (!d->edge_offsets || !d->edges) {
+    fprintf(stderr, "Could not allocate route index of %zu entries\n",
+	    entries);
+    return 0;
+  }
+  tmg_route_build_index(g);
+  return 1;
+}
+
+/*
+  Fill the index from routes to the edges carrying them, whose arrays
+  must already be allocated: used after loading and again whenever
+  the edges of g are renumbered.
+*/
+void tmg_route_build_index(tmg_graph *g) {
+
+  tmg_route_dict *d = &(g->route_dict);
+  int *offsets = d->edge_offsets;
+  int r, i, k;
+
+  // a counting sort by route, visiting the edges in order so each
+  // route's list comes out sorted
+  memset(offsets, 0, (d->num_routes + 1) * sizeof(int));
+  for (i = 0; i < g->num_edges; i++) {
+    int id = g->edges[i].conn.route_id;
+    for (k = d->string_offsets[id]; k < d->string_offsets[id + 1]; k++) {
+      offsets[d->string_routes[k] + 1]++;
+    }
+  }
+  for (r = 0; r < d->num_routes; r++) {
+    offsets[r + 1] += offsets[r];
+  }
+  for (i = 0; i < g->num_edges; i++) {
+    int id = g->edges[i].conn.route_id;
+    for (k = d->string_offsets[id]; k < d->string_offsets[id + 1]; k++) {
+      d->edges[offsets[d->string_routes[k]]++] = i;
+    }
+  }
+  // placing the edges advanced each route's offset to the start of
+  // the next route, so shift them back
+  for (r = d->num_routes; r > 0; r--) {
+    offsets[r] = offsets[r - 1];
+  }
+  offsets[0] = 0;
+}
+
+/*
+  The number of the route with the given name, or -1 if no edge of g
+  carries it.
+*/
+int tmg_route_from_name(tmg_graph *g, char *name) {
+
+  for (int r = 0; r < g->route_dict.num_routes; r++) {
+    if (strcmp(g->route_dict.names[r], name) == 0) return r;
+  }
+  return -1;
+}
+
+/*
+  The edges carrying route, in increasing order: returns a pointer to
+  the first of count edge numbers, which belong to the graph.
+*/
+int *tmg_route_edges(tmg_graph *g, int route, int *count) {
+
+  tmg_route_dict *d = &(g->route_dict);
+  *count = d->edge_offsets[route + 1] - d->edge_offsets[route];
+  return d->edges + d->edge_offsets[route];
+}
+
+/* helper function to compare vertex numbers for qsort */
+static int tmg_route_compare(const void *a, const void *b) {
+
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+  Fill vertices, which must have room for two per edge of route,
+  with the vertices of the edges carrying route in increasing order.
+  Returns the number of vertices.
+*/
+int tmg_route_vertices(tmg_graph *g, int route, int *vertices) {
+
+  int count, i;
+  int *edges = tmg_route_edges(g, route, &count);
+  for (i = 0; i < count; i++) {
+    vertices[2*i] = g->edges[edges[i]].end1->vertex_num;
+    vertices[2*i + 1] = g->edges[edges[i]].end2->vertex_num;
+  }
+  qsort(vertices, 2*count, sizeof(int), tmg_route_compare);
+  int num = 0;
+  for (i = 0; i < 2*count; i++) {
+    if (num == 0 || vertices[num - 1] != vertices[i]) {
+      vertices[num++] = vertices[i];
+    }
+  }
+  return num;
+}
+
+/*
+  Add the edges carrying route to the edge set set (see tmgtravel.h),
+  leaving the others as they are.
+*/
+void tmg_edges_on_route(tmg_graph *g, int route, uint64_t *set) {
+
+  int count, i;
+  int *edges = tmg_route_edges(g, route, &count);
+  for (i = 0; i < count; i++) {
+    set[edges[i] / 64] |= 1ULL << (edges[i] % 64);
+  }
+}
@@ -0,0 +1,25 @@
+/*
+  Function prototypes for the route dictionary of METAL TMG graphs:
+  the interned route strings of the edges, the individual route names
+  in them, and the index from each route to the edges carrying it.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGROUTE_H
+#define _TMGROUTE_H
+
+#include <stdint.h>
+#include "tmggraph.h"
+
+// function prototypes
+extern int tmg_route_intern(tmg_graph *g, char *routes, int copy);
+extern int tmg_route_finish_load(tmg_graph *g);
+extern void tmg_route_build_index(tmg_graph *g);
+extern int tmg_route_from_name(tmg_graph *g, char *name);
+extern int *tmg_route_edges(tmg_graph *g, int route, int *count);
+extern int tmg_route_vertices(tmg_graph *g, int route, int *vertices);
+extern void tmg_edges_on_route(tmg_graph *g, int route, uint64_t *set);
+
+#endif  // _TMGROUTE_H
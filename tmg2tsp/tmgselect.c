@@ -0,0 +1,800 @@
+/*
+  Functions to choose which vertices of a METAL TMG graph become the
+  points of a TSP instance.
+
+  The candidates are all vertices, or those in a bounding box, found
+  with one pass over the vertex table's latitude and longitude arrays,
+  optionally limited to the endpoints of traveled segments or to the
+  vertices of one route.
+  Farthest point sampling keeps each candidate's distance to the
+  nearest chosen point in a grid of cubes over their unit vectors, so
+  choosing a point only updates the cubes it can get closer to, and
+  the farthest candidate comes from a heap of per-cube maximums.
+  k-means clustering finds nearest centers with a k-d tree.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmgselect.h"
+#include "tmgkdtree.h"
+#include "tmgroute.h"
+#include "tmgtravel.h"
+
+// define the array that's externed in the header file
+char *tmg_select_names[] = { "first", "random", "farthest", "grid", "kmeans" };
+
+/*
+  Look up a selection mode by its name, returns 1 and sets mode if
+  found, 0 if not.
+*/
+int tmg_select_from_name(char *name, tmg_select_mode *mode) {
+
+  int i;
+  for (i = SELECT_FIRST; i <= SELECT_KMEANS; i++) {
+    if (strcmp(name, tmg_select_names[i]) == 0) {
+      *mode = (tmg_select_mode)i;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+  Parse a bounding box given as minlat,minlng,maxlat,maxlng into opts,
+  returns 1 if valid, 0 if not.
+*/
+int tmg_select_parse_bbox(char *text, tmg_select_options *opts) {
+
+  if (sscanf(text, "%lf,%lf,%lf,%lf", &(opts->min_lat), &(opts->min_lng),
+	     &(opts->max_lat), &(opts->max_lng)) != 4 ||
+      opts->min_lat > opts->max_lat || opts->min_lng > opts->max_lng) {
+    return 0;
+  }
+  opts->use_bbox = 1;
+  return 1;
+}
+
+/* next value of a splitmix64 random number generator */
+static uint64_t tmg_select_random(uint64_t *state) {
+
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* a random number from 0 to n-1 */
+static int tmg_select_below(uint64_t *state, int n) {
+
+  return (int)(((tmg_select_random(state) >> 32) * (uint64_t)n) >> 32);
+}
+
+/*
+  Move count randomly chosen entries of a[0..size-1] to its front, in
+  the order chosen (a partial Fisher-Yates shuffle).
+*/
+static void tmg_select_shuffle(int *a, int size, int count, uint64_t *state) {
+
+  for (int i = 0; i < count; i++) {
+    int j = i + tmg_select_below(state, size - i);
+    int tmp = a[i];
+    a[i] = a[j];
+    a[j] = tmp;
+  }
+}
+
+/*
+  One from each cell of a grid over the candidates' latitudes and
+  longitudes with about num_points cells, cells chosen at random if
+  more are occupied, topped up at random from the rest if fewer.
+  Returns 1 on success, 0 if out of memory.
+*/
+static int tmg_select_grid(tmg_graph *g, const int *pool, int pool_size,
+			    int num_points, int *points, uint64_t *state) {
+
+  double *lat = g->table.lat;
+  double *lng = g->table.lng;
+  double min_lat = lat[pool[0]], max_lat = min_lat;
+  double min_lng = lng[pool[0]], max_lng = min_lng;
+  int i, c;
+  for (i = 1; i < pool_size; i++) {
+    int v = pool[i];
+    if (lat[v] < min_lat) min_lat = lat[v];
+    if (lat[v] > max_lat) max_lat = lat[v];
+    if (lng[v] < min_lng) min_lng = lng[v];
+    if (lng[v] > max_lng) max_lng = lng[v];
+  }
+
+  // rows and columns in proportion to the box's height and width
+  double height = max_lat - min_lat;
+  double width = (max_lng - min_lng) * cos(M_PI * (min_lat + max_lat) / 360.0);
+  int rows, cols;
+  if (height <= 0.0 || width <= 0.0) {
+    rows = (height > 0.0) ? num_points : 1;
+    cols = (height > 0.0) ? 1 : num_points;
+  }
+  else {
+    rows = (int)round(sqrt(num_points * height / width));
+    if (rows < 1) rows = 1;
+    if (rows > num_points) rows = num_points;
+    cols = (num_points + rows - 1) / rows;
+  }
+  double lat_step = (height > 0.0) ? (max_lat - min_lat) / rows : 1.0;
+  double lng_step = (max_lng > min_lng) ? (max_lng - min_lng) / cols : 1.0;
+
+  // bucket the candidates by cell
+  int num_cells = rows * cols;
+  int *cell_of = (int *)malloc(pool_size * sizeof(int));
+  int *start = (int *)calloc(num_cells + 1, sizeof(int));
+  int *members = (int *)malloc(pool_size * sizeof(int));
+  int *next = (int *)malloc(num_cells * sizeof(int));
+  if (!cell_of || !start || !members || !next) {
+    free(cell_of);
+    free(start);
+    free(members);
+    free(next);
+    return 0;
+  }
+  for (i = 0; i < pool_size; i++) {
+    int v = pool[i];
+    int r = (int)((lat[v] - min_lat) / lat_step);
+    int k = (int)((lng[v] - min_lng) / lng_step);
+    if (r >= rows) r = rows - 1;
+    if (k >= cols) k = cols - 1;
+    cell_of[i] = r * cols + k;
+    start[cell_of[i] + 1]++;
+  }
+  for (c = 0; c < num_cells; c++) {
+    start[c + 1] += start[c];
+  }
+  memcpy(next, start, num_cells * sizeof(int));
+  for (i = 0; i < pool_size; i++) {
+    members[next[cell_of[i]]++] = pool[i];
+  }
+
+  // the occupied cells, a random num_points of them if there are more
+  int num_occupied = 0;
+  for (c = 0; c < num_cells; c++) {
+    if (start[c + 1] > start[c]) next[num_occupied++] = c;
+  }
+  int take = num_occupied;
+  if (take > num_points) {
+    tmg_select_shuffle(next, num_occupied, num_points, state);
+    take = num_points;
+  }
+
+  // pick a random member of each, marking it taken by moving it to the
+  // front of its cell, so the rest are after it
+  int count = 0;
+  for (i = 0; i < take; i++) {
+    c = next[i];
+    int j = start[c] + tmg_select_below(state, start[c + 1] - start[c]);
+    int tmp = members[start[c]];
+    members[start[c]] = members[j];
+    members[j] = tmp;
+    points[count++] = members[start[c]];
+  }
+
+  // then top up from everything not taken
+  if (count < num_points) {
+    int rest = 0;
+    for (i = 0; i < take; i++) {
+      members[start[next[i]]] = -1;
+    }
+    for (i = 0; i < pool_size; i++) {
+      if (members[i] >= 0) members[rest++] = members[i];
+    }
+    tmg_select_shuffle(members, rest, num_points - count, state);
+    memcpy(points + count, members, (num_points - count) * sizeof(int));
+  }
+
+  free(cell_of);
+  free(start);
+  free(members);
+  free(next);
+  return 1;
+}
+
+// a max-heap entry for farthest point sampling: the largest distance
+// to a chosen point of any candidate in a cube when it was pushed
+typedef struct tmg_fps_entry {
+  double key;
+  int cell;
+} tmg_fps_entry;
+
+typedef struct tmg_fps_heap {
+  tmg_fps_entry *e;
+  int size;
+  int cap;
+} tmg_fps_heap;
+
+static int tmg_fps_before(tmg_fps_entry a, tmg_fps_entry b) {
+
+  return a.key > b.key || (a.key == b.key && a.cell < b.cell);
+}
+
+static int tmg_fps_push(tmg_fps_heap *h, double key, int cell) {
+
+  if (h->size == h->cap) {
+    h->cap = h->cap ? 2 * h->cap : 1024;
+    h->e = (tmg_fps_entry *)realloc(h->e, h->cap * sizeof(tmg_fps_entry));
+    if (!h->e) return 0;
+  }
+  tmg_fps_entry x = { key, cell };
+  int i = h->size++;
+  while (i > 0 && tmg_fps_before(x, h->e[(i - 1) / 2])) {
+    h->e[i] = h->e[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  h->e[i] = x;
+  return 1;
+}
+
+static tmg_fps_entry tmg_fps_pop(tmg_fps_heap *h) {
+
+  tmg_fps_entry top = h->e[0];
+  tmg_fps_entry x = h->e[--h->size];
+  int i = 0;
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= h->size) break;
+    if (child + 1 < h->size && tmg_fps_before(h->e[child + 1], h->e[child])) {
+      child++;
+    }
+    if (!tmg_fps_before(h->e[child], x)) break;
+    h->e[i] = h->e[child];
+    i = child;
+  }
+  if (h->size > 0) h->e[i] = x;
+  return top;
+}
+
+/*
+  Farthest point sampling: a random first point, then repeatedly the
+  candidate farthest from all points chosen so far.  Distances are
+  squared chords between unit vectors, which order pairs as great
+  circle distances do.  Returns 1 on success, 0 if out of memory.
+*/
+static int tmg_select_farthest(tmg_graph *g, int *pool, int pool_size,
+			       int num_points, int *points, uint64_t *state) {
+
+  double lo[3], hi[3];
+  double *coords[3] = { g->table.x, g->table.y, g->table.z };
+  int i, d;
+  for (d = 0; d < 3; d++) {
+    lo[d] = hi[d] = coords[d][pool[0]];
+  }
+  for (i = 1; i < pool_size; i++) {
+    for (d = 0; d < 3; d++) {
+      double c = coords[d][pool[i]];
+      if (c < lo[d]) lo[d] = c;
+      if (c > hi[d]) hi[d] = c;
+    }
+  }
+
+  // the candidates lie on a patch of the sphere's surface, so size the
+  // cubes by the two largest extents, then grow them if needed to keep
+  // the number of cubes in proportion to the number of candidates
+  double ext[3];
+  for (d = 0; d < 3; d++) {
+    ext[d] = hi[d] - lo[d];
+  }
+  double e1 = fmax(ext[0], fmax(ext[1], ext[2]));
+  double e2 = ext[0] + ext[1] + ext[2] - e1 - fmin(ext[0], fmin(ext[1], ext[2]));
+  double side = sqrt(fmax(e1 * e2, 1e-18) * TMG_SELECT_CELL_POINTS / pool_size);
+  int dim[3];
+  double cells;
+  for (;;) {
+    cells = 1.0;
+    for (d = 0; d < 3; d++) {
+      cells *= floor(ext[d] / side) + 1.0;
+    }
+    if (cells <= 4.0 * pool_size + 64) break;
+    side *= 1.25;
+  }
+  for (d = 0; d < 3; d++) {
+    dim[d] = (int)(ext[d] / side) + 1;
+  }
+  int num_cells = (int)cells;
+
+  // candidates in cube order, with their coordinates and squared
+  // distance to the nearest chosen point (-1 once chosen)
+  int *start = (int *)calloc(num_cells + 1, sizeof(int));
+  int *cell_of = (int *)malloc(pool_size * sizeof(int));
+  int *vertex = (int *)malloc(pool_size * sizeof(int));
+  double *xyz = (double *)malloc(3 * (size_t)pool_size * sizeof(double));
+  double *mind = (double *)malloc(pool_size * sizeof(double));
+  double *cellmax = (double *)malloc(num_cells * sizeof(double));
+  tmg_fps_heap heap = { NULL, 0, 0 };
+  int ok = (start && cell_of && vertex && xyz && mind && cellmax);
+  if (!ok) goto done;
+
+  for (i = 0; i < pool_size; i++) {
+    int c = 0;
+    for (d = 0; d < 3; d++) {
+      int k = (int)((coords[d][pool[i]] - lo[d]) / side);
+      if (k >= dim[d]) k = dim[d] - 1;
+      c = c * dim[d] + k;
+    }
+    cell_of[i] = c;
+    start[c + 1]++;
+  }
+  for (int c = 0; c < num_cells; c++) {
+    start[c + 1] += start[c];
+  }
+  for (i = 0; i < pool_size; i++) {
+    int pos = start[cell_of[i]]++;
+    vertex[pos] = pool[i];
+    for (d = 0; d < 3; d++) {
+      xyz[3*pos+d] = coords[d][pool[i]];
+    }
+    mind[pos] = INFINITY;
+  }
+  // the placement above advanced each start to the next cube's start
+  for (int c = num_cells; c > 0; c--) {
+    start[c] = start[c - 1];
+  }
+  start[0] = 0;
+  for (int c = 0; c < num_cells; c++) {
+    cellmax[c] = (start[c + 1] > start[c]) ? INFINITY : -1.0;
+    if (cellmax[c] >= 0.0 && !tmg_fps_push(&heap, INFINITY, c)) {
+      ok = 0;
+      goto done;
+    }
+  }
+
+  // the first point is random, and could affect every cube
+  int chosen = tmg_select_below(state, pool_size);
+  for (i = 0; i < pool_size && vertex[i] != pool[chosen]; i++);
+  chosen = i;
+  double radius2 = INFINITY;
+
+  for (int count = 0; ; ) {
+    points[count++] = vertex[chosen];
+    mind[chosen] = -1.0;
+    if (count == num_points) break;
+
+    // update the cubes within reach: only candidates closer to the new
+    // point than the farthest candidate can get closer to the chosen set
+    double *s = xyz + 3*chosen;
+    int from[3], to[3];
+    for (d = 0; d < 3; d++) {
+      if (radius2 == INFINITY) {
+	from[d] = 0;
+	to[d] = dim[d] - 1;
+      }
+      else {
+	double r = sqrt(radius2);
+	from[d] = (int)floor((s[d] - r - lo[d]) / side);
+	to[d] = (int)floor((s[d] + r - lo[d]) / side);
+	if (from[d] < 0) from[d] = 0;
+	if (to[d] >= dim[d]) to[d] = dim[d] - 1;
+      }
+    }
+    for (int a = from[0]; a <= to[0]; a++) {
+      for (int b = from[1]; b <= to[1]; b++) {
+	for (int k = from[2]; k <= to[2]; k++) {
+	  int c = (a * dim[1] + b) * dim[2] + k;
+	  if (cellmax[c] < 0.0) continue;
+
+	  // nothing in the cube can be closer to s than its nearest side
+	  int idx[3] = { a, b, k };
+	  double lb2 = 0.0;
+	  for (d = 0; d < 3; d++) {
+	    double clo = lo[d] + idx[d] * side;
+	    double gap = (s[d] < clo) ? clo - s[d] :
+	      (s[d] > clo + side) ? s[d] - clo - side : 0.0;
+	    lb2 += gap * gap;
+	  }
+	  if (lb2 >= cellmax[c]) continue;
+
+	  double newmax = -1.0;
+	  for (int pos = start[c]; pos < start[c + 1]; pos++) {
+	    if (mind[pos] < 0.0) continue;
+	    double dx = xyz[3*pos] - s[0];
+	    double dy = xyz[3*pos+1] - s[1];
+	    double dz = xyz[3*pos+2] - s[2];
+	    double d2 = dx*dx + dy*dy + dz*dz;
+	    if (d2 < mind[pos]) mind[pos] = d2;
+	    if (mind[pos] > newmax) newmax = mind[pos];
+	  }
+	  if (newmax != cellmax[c]) {
+	    cellmax[c] = newmax;
+	    if (newmax >= 0.0 && !tmg_fps_push(&heap, newmax, c)) {
+	      ok = 0;
+	      goto done;
+	    }
+	  }
+	}
+      }
+    }
+
+    // the farthest candidate is in the cube with the largest current
+    // maximum; entries whose key is out of date are skipped
+    chosen = -1;
+    while (chosen < 0 && heap.size > 0) {
+      tmg_fps_entry top = tmg_fps_pop(&heap);
+      if (top.key != cellmax[top.cell]) continue;
+      int c = top.cell;
+      for (int pos = start[c]; pos < start[c + 1]; pos++) {
+	if (mind[pos] < 0.0) continue;
+	if (chosen < 0 || mind[pos] > mind[chosen] ||
+	    (mind[pos] == mind[chosen] && vertex[pos] < vertex[chosen])) {
+	  chosen = pos;
+	}
+      }
+      if (chosen < 0) cellmax[c] = -1.0;
+      else radius2 = mind[chosen];
+    }
+    if (chosen < 0) break;  // cannot happen with enough candidates
+  }
+
+ done:
+  free(start);
+  free(cell_of);
+  free(vertex);
+  free(xyz);
+  free(mind);
+  free(cellmax);
+  free(heap.e);
+  return ok;
+}
+
+// the state shared by the threads assigning candidates to clusters
+typedef struct tmg_kmeans_work {
+  tmg_graph *g;
+  int *pool;
+  int pool_size;
+  tmg_kdtree *t;
+  int nthreads;
+  int *assign;  // nearest center of each candidate
+  double *chord2;  // and its squared distance
+} tmg_kmeans_work;
+
+typedef struct tmg_kmeans_thread {
+  tmg_kmeans_work *work;
+  int id;
+} tmg_kmeans_thread;
+
+/* thread function: assign this thread's share of the candidates */
+static void *tmg_kmeans_worker(void *arg) {
+
+  tmg_kmeans_thread *th = (tmg_kmeans_thread *)arg;
+  tmg_kmeans_work *w = th->work;
+  int first = (int)((long)w->pool_size * th->id / w->nthreads);
+  int last = (int)((long)w->pool_size * (th->id + 1) / w->nthreads);
+  for (int i = first; i < last; i++) {
+    int v = w->pool[i];
+    double q[3] = { w->g->table.x[v], w->g->table.y[v], w->g->table.z[v] };
+    tmg_kdtree_nearest(w->t, q, -1, 1, &(w->assign[i]), &(w->chord2[i]));
+  }
+  return NULL;
+}
+
+/* assign every candidate to its nearest center with nthreads threads */
+static void tmg_kmeans_assign(tmg_kmeans_work *w) {
+
+  tmg_kmeans_thread *threads =
+    (tmg_kmeans_thread *)malloc(w->nthreads * sizeof(tmg_kmeans_thread));
+  pthread_t *tids = (pthread_t *)malloc(w->nthreads * sizeof(pthread_t));
+  int i;
+  int started = 1;
+  if (threads && tids) {
+    for (i = 0; i < w->nthreads; i++) {
+      threads[i].work = w;
+      threads[i].id = i;
+    }
+    while (started < w->nthreads &&
+	   pthread_create(&tids[started], NULL, tmg_kmeans_worker,
+			  &threads[started]) == 0) {
+      started++;
+    }
+  }
+  // the calling thread is worker 0, and also takes the share of any
+  // worker that could not be started
+  tmg_kmeans_thread self;
+  self.work = w;
+  for (i = 0; i < w->nthreads; i++) {
+    if (i > 0 && i < started) continue;
+    self.id = i;
+    tmg_kmeans_worker(&self);
+  }
+  for (i = 1; i < started; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  free(threads);
+  free(tids);
+}
+
+/*
+  k-means stratified selection: num_points clusters, started from a
+  grid selection and refined by TMG_KMEANS_ITERATIONS rounds of
+  Lloyd's algorithm, then the candidate closest to each center.  Any
+  empty clusters are made up at random.  Rearranges pool, and fills in
+  points.  Returns 1 on success, 0 if out of memory.
+*/
+static int tmg_select_kmeans(tmg_graph *g, int *pool, int pool_size,
+			     int num_points, int *points, uint64_t *state,
+			     int nthreads) {
+
+  tmg_kmeans_work w;
+  int i, c, iter;
+  double *centers = (double *)malloc(3 * (size_t)num_points * sizeof(double));
+  double *sums = (double *)malloc(3 * (size_t)num_points * sizeof(double));
+  int *counts = (int *)malloc(num_points * sizeof(int));
+  w.g = g;
+  w.pool = pool;
+  w.pool_size = pool_size;
+  w.nthreads = (nthreads < 1) ? 1 : nthreads;
+  w.assign = (int *)malloc(pool_size * sizeof(int));
+  w.chord2 = (double *)malloc(pool_size * sizeof(double));
+  int ok = (centers && sums && counts && w.assign && w.chord2);
+  if (!ok) goto done;
+
+  ok = tmg_select_grid(g, pool, pool_size, num_points, points, state);
+  if (!ok) goto done;
+  for (c = 0; c < num_points; c++) {
+    centers[3*c] = g->table.x[points[c]];
+    centers[3*c+1] = g->table.y[points[c]];
+    centers[3*c+2] = g->table.z[points[c]];
+  }
+
+  for (iter = 0; ; iter++) {
+    w.t = tmg_kdtree_build_xyz(centers, num_points);
+    if (!w.t) {
+      ok = 0;
+      goto done;
+    }
+    tmg_kmeans_assign(&w);
+    tmg_kdtree_destroy(w.t);
+    if (iter == TMG_KMEANS_ITERATIONS) break;
+
+    // move each center to the mean of its cluster
+    memset(sums, 0, 3 * (size_t)num_points * sizeof(double));
+    memset(counts, 0, num_points * sizeof(int));
+    for (i = 0; i < pool_size; i++) {
+      int v = pool[i];
+      c = w.assign[i];
+      sums[3*c] += g->table.x[v];
+      sums[3*c+1] += g->table.y[v];
+      sums[3*c+2] += g->table.z[v];
+      counts[c]++;
+    }
+    for (c = 0; c < num_points; c++) {
+      if (counts[c] == 0) continue;
+      for (int d = 0; d < 3; d++) {
+	centers[3*c+d] = sums[3*c+d] / counts[c];
+      }
+    }
+  }
+
+  // the member closest to each center, lowest vertex number on ties
+  for (c = 0; c < num_points; c++) {
+    points[c] = -1;
+    sums[c] = INFINITY;
+  }
+  for (i = 0; i < pool_size; i++) {
+    c = w.assign[i];
+    if (w.chord2[i] < sums[c] ||
+	(w.chord2[i] == sums[c] && pool[i] < points[c])) {
+      sums[c] = w.chord2[i];
+      points[c] = pool[i];
+    }
+  }
+
+  // empty clusters are filled with random candidates not chosen,
+  // keeping the clusters' order
+  int missing = 0;
+  for (c = 0; c < num_points; c++) {
+    if (points[c] < 0) missing++;
+  }
+  if (missing > 0) {
+    int rest = 0;
+    for (i = 0; i < pool_size; i++) {
+      c = w.assign[i];
+      if (points[c] != pool[i]) pool[rest++] = pool[i];
+    }
+    tmg_select_shuffle(pool, rest, missing, state);
+    for (c = 0, i = 0; c < num_points; c++) {
+      if (points[c] < 0) points[c] = pool[i++];
+    }
+  }
+
+ done:
+  free(centers);
+  free(sums);
+  free(counts);
+  free(w.assign);
+  free(w.chord2);
+  return ok;
+}
+
+/*
+  Helper function to mark the vertices that are endpoints of segments
+  traveled as opts requires.  Returns a newly allocated array with
+  one entry per vertex, NULL if none is required (marked is then set
+  to 1) or on failure (marked is then set to 0).
+*/
+static unsigned char *tmg_select_traveled(tmg_graph *g,
+					  tmg_select_options *opts,
+					  int *ok) {
+
+  *ok = 1;
+  if (opts->traveler < 0 && opts->min_travelers <= 0) return NULL;
+  *ok = 0;
+  if (g->format != TRAVELED) {
+    fprintf(stderr, "Traveler restrictions need a traveled format graph\n");
+    return NULL;
+  }
+  if (opts->traveler >= g->num_travelers) {
+    fprintf(stderr, "Graph has no traveler %d\n", opts->traveler);
+    return NULL;
+  }
+
+  uint64_t *set = tmg_edge_set_create(g);
+  uint64_t *also = tmg_edge_set_create(g);
+  unsigned char *marked = (unsigned char *)calloc(g->num_vertices, 1);
+  if (!set || !also || !marked) {
+    free(set);
+    free(also);
+    free(marked);
+    return NULL;
+  }
+  int words = tmg_edge_set_words(g);
+  for (int i = 0; i < words; i++) {
+    set[i] = ~0ULL;
+  }
+  if (opts->traveler >= 0) {
+    tmg_edges_traveled_by(g, opts->traveler, also);
+    for (int i = 0; i < words; i++) {
+      set[i] &= also[i];
+    }
+  }
+  if (opts->min_travelers > 0) {
+    tmg_edges_with_travelers(g, opts->min_travelers, also);
+    for (int i = 0; i < words; i++) {
+      set[i] &= also[i];
+    }
+  }
+  tmg_edge_set_mark_vertices(g, set, marked);
+  free(set);
+  free(also);
+  *ok = 1;
+  return marked;
+}
+
+/*
+  Helper function to mark the vertices on the route opts requires,
+  found from the route index without looking at any other edges.
+  Returns a newly allocated array with one entry per vertex, NULL if
+  no route is required (ok is then set to 1) or on failure (ok is
+  then set to 0).
+*/
+static unsigned char *tmg_select_on_route(tmg_graph *g,
+					  tmg_select_options *opts,
+					  int *ok) {
+
+  *ok = 1;
+  if (opts->route < 0) return NULL;
+  *ok = 0;
+  int count;
+  tmg_route_edges(g, opts->route, &count);
+  int *vertices = (int *)malloc((2*count + 1) * sizeof(int));
+  unsigned char *marked = (unsigned char *)calloc(g->num_vertices, 1);
+  if (!vertices || !marked) {
+    free(vertices);
+    free(marked);
+    return NULL;
+  }
+  int num = tmg_route_vertices(g, opts->route, vertices);
+  for (int i = 0; i < num; i++) {
+    marked[vertices[i]] = 1;
+  }
+  free(vertices);
+  *ok = 1;
+  return marked;
+}
+
+/*
+  Choose num_points of the vertices of g as opts describes, using up
+  to nthreads threads.  Returns a newly allocated array of their
+  vertex numbers, in the order chosen (or in vertex order if g has
+  been renumbered), or NULL if there are not enough candidates or
+  memory ran out.
+*/
+int *tmg_select_points(tmg_graph *g, int num_points,
+		       tmg_select_options *opts, int nthreads) {
+
+  int *pool = (int *)malloc(g->num_vertices * sizeof(int));
+  int *points = (int *)malloc(num_points * sizeof(int));
+  if (!pool || !points) {
+    fprintf(stderr, "Could not allocate list of %d vertices\n",
+	    g->num_vertices);
+    free(pool);
+    free(points);
+    return NULL;
+  }
+
+  int ok;
+  unsigned char *traveled = tmg_select_traveled(g, opts, &ok);
+  unsigned char *on_route = ok ? tmg_select_on_route(g, opts, &ok) : NULL;
+  if (!ok) {
+    free(traveled);
+    free(pool);
+    free(points);
+    return NULL;
+  }
+
+  // the candidates, in file order even if the graph has been
+  // renumbered, so the same points are chosen either way
+  int pool_size = 0;
+  double *lat = g->table.lat;
+  double *lng = g->table.lng;
+  for (int o = 0; o < g->num_vertices; o++) {
+    int v = g->vertex_renumber ? g->vertex_renumber[o] : o;
+    if ((!opts->use_bbox ||
+	 (lat[v] >= opts->min_lat && lat[v] <= opts->max_lat &&
+	  lng[v] >= opts->min_lng && lng[v] <= opts->max_lng)) &&
+	(!traveled || traveled[v]) && (!on_route || on_route[v])) {
+      pool[pool_size++] = v;
+    }
+  }
+  free(traveled);
+  free(on_route);
+  if (pool_size < num_points) {
+    fprintf(stderr, "Only %d vertices are candidates for %d points\n",
+	    pool_size, num_points);
+    free(pool);
+    free(points);
+    return NULL;
+  }
+
+  uint64_t state = opts->seed;
+  switch (opts->mode) {
+  case SELECT_FIRST:
+    memcpy(points, pool, num_points * sizeof(int));
+    break;
+  case SELECT_RANDOM:
+    tmg_select_shuffle(pool, pool_size, num_points, &state);
+    memcpy(points, pool, num_points * sizeof(int));
+    break;
+  case SELECT_FARTHEST:
+    ok = tmg_select_farthest(g, pool, pool_size, num_points, points, &state);
+    break;
+  case SELECT_GRID:
+    ok = tmg_select_grid(g, pool, pool_size, num_points, points, &state);
+    break;
+  case SELECT_KMEANS:
+    ok = tmg_select_kmeans(g, pool, pool_size, num_points, points, &state,
+			   nthreads);
+    break;
+  }
+  if (!ok) {
+    fprintf(stderr, "Could not allocate memory to select points\n");
+    free(pool);
+    free(points);
+    return NULL;
+  }
+
+  // in a renumbered graph the points are listed in its order, so
+  // points near each other in the graph's order are near each other
+  // in the matrix
+  if (g->vertex_renumber) {
+    memset(pool, 0, g->num_vertices * sizeof(int));
+    for (int i = 0; i < num_points; i++) {
+      pool[points[i]] = 1;
+    }
+    for (int v = 0, i = 0; v < g->num_vertices; v++) {
+      if (pool[v]) points[i++] = v;
+    }
+  }
+  free(pool);
+  return points;
+}
@@ -0,0 +1,54 @@
+/*
+  Structure definitions and function prototypes for choosing which
+  vertices of a METAL TMG graph become the points of a TSP instance.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGSELECT_H
+#define _TMGSELECT_H
+
+#include <stdint.h>
+#include "tmggraph.h"
+
+// farthest point sampling groups candidates into cubes averaging
+// about this many of them
+#define TMG_SELECT_CELL_POINTS 8
+
+// rounds of k-means refinement for stratified selection
+#define TMG_KMEANS_ITERATIONS 5
+
+// how the points are chosen from the candidate vertices: the first in
+// file order, uniformly at random, each as far as possible from those
+// already chosen, one from each cell of a latitude/longitude grid, or
+// the one closest to the center of each k-means cluster
+typedef enum tmg_select_mode {
+  SELECT_FIRST, SELECT_RANDOM, SELECT_FARTHEST, SELECT_GRID, SELECT_KMEANS
+} tmg_select_mode;
+extern char *tmg_select_names[];
+
+typedef struct tmg_select_options {
+  tmg_select_mode mode;
+  uint64_t seed;  // for every random choice made
+  // if use_bbox is set, only vertices in this box are candidates
+  int use_bbox;
+  double min_lat, min_lng, max_lat, max_lng;
+  // for traveled graphs, if traveler is not -1, only endpoints of
+  // segments that traveler has traveled are candidates, and if
+  // min_travelers is positive, only endpoints of segments traveled by
+  // at least that many travelers
+  int traveler;
+  int min_travelers;
+  // if route is not -1, only vertices on that route (see tmgroute.h)
+  // are candidates
+  int route;
+} tmg_select_options;
+
+// function prototypes
+extern int tmg_select_from_name(char *name, tmg_select_mode *mode);
+extern int tmg_select_parse_bbox(char *text, tmg_select_options *opts);
+extern int *tmg_select_points(tmg_graph *g, int num_points,
+			      tmg_select_options *opts, int nthreads);
+
+#endif  // _TMGSELECT_H
@@ -0,0 +1,235 @@
+/*
+  Functions for the shaping points of METAL TMG graph edges.
+
+  Edge lengths are checked against an independent computation: the
+  haversine formula, summed in long double, rather than the law of
+  cosines the loaders use.
+
+  Polylines are simplified with the Douglas-Peucker algorithm: keep
+  the endpoints, find the shaping point farthest from the segment
+  between them, and if it is farther than the tolerance keep it and
+  repeat on both halves, otherwise drop everything in between.  Edge
+  lengths and the distances along the edge recorded for the shaping
+  points that are kept still describe the original road, so road
+  distances are unchanged by simplification.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmgshape.h"
+
+// miles per degree of latitude
+#define TMG_MILES_PER_DEGREE (TMG_EARTH_RADIUS * M_PI / 180.0)
+
+/*
+  Distance in miles between two points by the haversine formula,
+  which stays accurate for the very short segments between shaping
+  points.
+*/
+double tmg_reference_distance(tmg_latlng *p1, tmg_latlng *p2) {
+
+  long double rlat1 = M_PI * (long double)p1->lat / 180.0L;
+  long double rlat2 = M_PI * (long double)p2->lat / 180.0L;
+  long double dlat = rlat2 - rlat1;
+  long double dlng = M_PI * ((long double)p2->lng - p1->lng) / 180.0L;
+  long double a = sinl(dlat/2)*sinl(dlat/2) +
+    cosl(rlat1)*cosl(rlat2)*sinl(dlng/2)*sinl(dlng/2);
+  return (double)(2.0L * atan2l(sqrtl(a), sqrtl(1.0L - a)) * TMG_EARTH_RADIUS);
+}
+
+/*
+  Check every edge's length, and the distances recorded along it to
+  its shaping points, against the reference computation.  Returns the
+  number of edges off by more than tolerance miles, and sets worst to
+  the largest difference found.  Reports the first few bad edges.
+*/
+int tmg_graph_check_lengths(tmg_graph *g, double tolerance, double *worst) {
+
+  int bad = 0;
+  int ednum, i;
+  *worst = 0.0;
+  for (ednum = 0; ednum < g->num_edges; ednum++) {
+    tmg_connection *c = &(g->edges[ednum].conn);
+    long double miles = 0.0L;
+    double diff = 0.0;
+    tmg_latlng *prev = &(c->end1->coords);
+    for (i = 0; i < c->num_shaping_points; i++) {
+      miles += tmg_reference_distance(prev, &(c->shaping_points[i]));
+      double d = fabs((double)miles - c->shaping_miles[i]);
+      if (!(d <= diff)) diff = d;
+      prev = &(c->shaping_points[i]);
+    }
+    miles += tmg_reference_distance(prev, &(c->end2->coords));
+    double d = fabs((double)miles - c->length_in_miles);
+    // comparisons written so a NaN counts as a difference
+    if (!(d <= diff)) diff = d;
+    if (!(diff <= *worst)) *worst = diff;
+    if (!(diff <= tolerance)) {
+      if (bad < 10) {
+	fprintf(stderr, "Edge %d (%s) has length %.6f, reference %.6f\n",
+		ednum, c->routes, c->length_in_miles, (double)miles);
+      }
+      bad++;
+    }
+  }
+  return bad;
+}
+
+/*
+  Helper function for tmg_graph_simplify_shaping: the distance in
+  miles from point p to the segment from a to b, all given in miles
+  east and north of some nearby origin.
+*/
+static double tmg_segment_distance(double px, double py, double ax,
+				   double ay, double bx, double by) {
+
+  double dx = bx - ax;
+  double dy = by - ay;
+  double len2 = dx*dx + dy*dy;
+  double t = 0.0;
+  if (len2 > 0.0) {
+    t = ((px - ax)*dx + (py - ay)*dy) / len2;
+    if (t < 0.0) t = 0.0;
+    if (t > 1.0) t = 1.0;
+  }
+  double ex = ax + t*dx - px;
+  double ey = ay + t*dy - py;
+  return sqrt(ex*ex + ey*ey);
+}
+
+/*
+  Simplify the shaping points of every edge of g with the
+  Douglas-Peucker algorithm, dropping points that are within
+  tolerance miles of the simplified line, and shrink the graph's pool
+  to fit.  Distances are measured in a flat projection centered on
+  each edge's end1, which is accurate over the length of any one
+  edge.  Returns the number of shaping points removed, or -1 if out
+  of memory.
+*/
+int tmg_graph_simplify_shaping(tmg_graph *g, double tolerance) {
+
+  int ednum, i;
+  int longest = 0;
+  for (ednum = 0; ednum < g->num_edges; ednum++) {
+    if (g->edges[ednum].conn.num_shaping_points > longest) {
+      longest = g->edges[ednum].conn.num_shaping_points;
+    }
+  }
+  if (longest == 0) return 0;
+  if (!tmg_graph_own_shaping(g)) return -1;
+
+  // the polyline of one edge, endpoints included, projected, with
+  // which of its points to keep and a stack of ranges still to check
+  int size = longest + 2;
+  double *x = (double *)malloc(size*sizeof(double));
+  double *y = (double *)malloc(size*sizeof(double));
+  unsigned char *keep = (unsigned char *)malloc(size);
+  int *stack = (int *)malloc(2*size*sizeof(int));
+  if (!x || !y || !keep || !stack) {
+    fprintf(stderr, "Could not allocate memory to simplify %d points\n",
+	    size);
+    free(x);
+    free(y);
+    free(keep);
+    free(stack);
+    return -1;
+  }
+
+  // kept points move toward the front of the pool, which the edges
+  // occupy in order, so compacting in place never overwrites a point
+  // not yet read
+  int kept = 0;
+  int removed = 0;
+  for (ednum = 0; ednum < g->num_edges; ednum++) {
+    tmg_connection *c = &(g->edges[ednum].conn);
+    int first = g->shaping_offsets[ednum];
+    int k = c->num_shaping_points;
+    g->shaping_offsets[ednum] = kept;
+    if (k == 0) continue;
+
+    tmg_latlng *origin = &(c->end1->coords);
+    double xscale = TMG_MILES_PER_DEGREE * cos(M_PI * origin->lat / 180.0);
+    for (i = 0; i < k + 2; i++) {
+      tmg_latlng *p = (i == 0) ? origin :
+	(i == k + 1) ? &(c->end2->coords) : &(g->shaping_points[first + i - 1]);
+      double dlng = p->lng - origin->lng;
+      if (dlng > 180.0) dlng -= 360.0;
+      if (dlng < -180.0) dlng += 360.0;
+      x[i] = dlng * xscale;
+      y[i] = (p->lat - origin->lat) * TMG_MILES_PER_DEGREE;
+      keep[i] = 0;
+    }
+    keep[0] = keep[k + 1] = 1;
+
+    int top = 0;
+    stack[top++] = 0;
+    stack[top++] = k + 1;
+    while (top > 0) {
+      int b = stack[--top];
+      int a = stack[--top];
+      int farthest = -1;
+      double farthest_dist = tolerance;
+      for (i = a + 1; i < b; i++) {
+	double d = tmg_segment_distance(x[i], y[i], x[a], y[a], x[b], y[b]);
+	if (d > farthest_dist) {
+	  farthest = i;
+	  farthest_dist = d;
+	}
+      }
+      if (farthest >= 0) {
+	keep[farthest] = 1;
+	stack[top++] = a;
+	stack[top++] = farthest;
+	stack[top++] = farthest;
+	stack[top++] = b;
+      }
+    }
+
+    for (i = 1; i <= k; i++) {
+      if (keep[i]) {
+	g->shaping_points[kept] = g->shaping_points[first + i - 1];
+	g->shaping_miles[kept] = g->shaping_miles[first + i - 1];
+	kept++;
+      }
+      else {
+	removed++;
+      }
+    }
+  }
+  g->shaping_offsets[g->num_edges] = kept;
+  g->num_shaping_points = kept;
+  free(x);
+  free(y);
+  free(keep);
+  free(stack);
+
+  // give back the memory, and point each edge at its new run
+  if (kept > 0) {
+    tmg_latlng *points =
+      (tmg_latlng *)realloc(g->shaping_points, kept*sizeof(tmg_latlng));
+    double *miles = (double *)realloc(g->shaping_miles, kept*sizeof(double));
+    if (points) g->shaping_points = points;
+    if (miles) g->shaping_miles = miles;
+  }
+  else {
+    free(g->shaping_points);
+    free(g->shaping_miles);
+    g->shaping_points = NULL;
+    g->shaping_miles = NULL;
+  }
+  g->shaping_capacity = kept;
+  for (ednum = 0; ednum < g->num_edges; ednum++) {
+    tmg_connection *c = &(g->edges[ednum].conn);
+    int first = g->shaping_offsets[ednum];
+    c->num_shaping_points = g->shaping_offsets[ednum+1] - first;
+    c->shaping_points = c->num_shaping_points ? g->shaping_points + first : NULL;
+    c->shaping_miles = c->num_shaping_points ? g->shaping_miles + first : NULL;
+  }
+  return removed;
+}
@@ -0,0 +1,24 @@
+/*
+  Function prototypes for working with the shaping points of METAL
+  TMG graph edges: checking edge lengths and simplifying polylines.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGSHAPE_H
+#define _TMGSHAPE_H
+
+#include "tmggraph.h"
+
+// largest difference, in miles, allowed between an edge's length and
+// the reference computation of it: about half a foot
+#define TMG_LENGTH_TOLERANCE 0.0001
+
+// function prototypes
+extern double tmg_reference_distance(tmg_latlng *p1, tmg_latlng *p2);
+extern int tmg_graph_check_lengths(tmg_graph *g, double tolerance,
+				   double *worst);
+extern int tmg_graph_simplify_shaping(tmg_graph *g, double tolerance);
+
+#endif  // _TMGSHAPE_H
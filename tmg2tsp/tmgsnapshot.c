@@ -0,0 +1,555 @@
+/*
+  Save and load binary snapshots of METAL TMG graphs.  See
+  tmgsnapshot.h for the file layout.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tmgsnapshot.h"
+
+// where each part of a graph goes in a snapshot file
+typedef struct tmg_snapshot_layout {
+  uint64_t end;  // bytes placed so far
+  uint64_t graph;
+  uint64_t vertices;
+  uint64_t edges;
+  uint64_t table[5];
+  uint64_t adj_offsets;
+  uint64_t adj_vertices;
+  uint64_t adj_edges;
+  uint64_t orig_vertex_num;
+  uint64_t vertex_renumber;
+  uint64_t shaping_offsets;
+  uint64_t shaping_points;
+  uint64_t shaping_miles;
+  uint64_t traveler_bits;
+  uint64_t traveler_list;
+  uint64_t route_strings;
+  uint64_t string_offsets;
+  uint64_t string_routes;
+  uint64_t route_names;
+  uint64_t route_edge_offsets;
+  uint64_t route_edges;
+  uint64_t labels;
+  uint64_t routes;
+  uint64_t names;
+  uint64_t traveler_names;
+} tmg_snapshot_layout;
+
+// a file being written, with the position reached so far
+typedef struct tmg_snapshot_writer {
+  FILE *fp;
+  uint64_t pos;
+  int failed;
+} tmg_snapshot_writer;
+
+/*
+  Name of the snapshot of a .tmg file: the same name with a "b"
+  added to the .tmg extension, or ".tmgb" added to any other name.
+  Returns a newly allocated string.
+*/
+char *tmg_snapshot_name(char *filename) {
+
+  size_t len = strlen(filename);
+  char *name = (char *)malloc(len + 6);
+  if (!name) return NULL;
+  strcpy(name, filename);
+  if (len >= 4 && strcmp(filename + len - 4, ".tmg") == 0) {
+    strcat(name, "b");
+  }
+  else {
+    strcat(name, ".tmgb");
+  }
+  return name;
+}
+
+/* reserve an aligned section of size bytes, returning its offset */
+static uint64_t tmg_snapshot_place(tmg_snapshot_layout *l, size_t size) {
+
+  uint64_t offset = (l->end + TMG_SNAPSHOT_ALIGN - 1) &
+    ~(uint64_t)(TMG_SNAPSHOT_ALIGN - 1);
+  l->end = offset + size;
+  return offset;
+}
+
+/* the pointer stored for a location in the file */
+static void *tmg_snapshot_ptr(uint64_t offset) {
+
+  return (void *)(uintptr_t)(TMG_SNAPSHOT_BASE + offset);
+}
+
+/* write size bytes of data at offset, zero filling up to it */
+static void tmg_snapshot_write(tmg_snapshot_writer *w, uint64_t offset,
+			       const void *data, size_t size) {
+
+  static const char zeros[TMG_SNAPSHOT_ALIGN] = { 0 };
+  while (w->pos < offset) {
+    size_t pad = offset - w->pos;
+    if (pad > sizeof(zeros)) pad = sizeof(zeros);
+    if (fwrite(zeros, 1, pad, w->fp) != pad) w->failed = 1;
+    w->pos += pad;
+  }
+  if (size && fwrite(data, 1, size, w->fp) != size) w->failed = 1;
+  w->pos += size;
+}
+
+/*
+  Save a snapshot of g, loaded from the file source, to filename.
+  The snapshot is written to a temporary file that replaces filename
+  only once complete.  Returns 1 on success, 0 on failure.
+*/
+int tmg_save_snapshot(tmg_graph *g, char *filename, char *source) {
+
+  struct stat st;
+  if (stat(source, &st) < 0) {
+    fprintf(stderr, "Could not determine size of file %s\n", source);
+    return 0;
+  }
+
+  int n = g->num_vertices;
+  int m = g->num_edges;
+  int i;
+  tmg_route_dict *d = &(g->route_dict);
+  int ns = d->num_strings;
+  int nr = d->num_routes;
+  size_t string_routes = d->string_offsets[ns];
+  size_t route_edges = d->edge_offsets[nr];
+  size_t label_bytes = 0, route_bytes = 0, route_name_bytes = 0;
+  size_t name_bytes = 0;
+  for (i = 0; i < n; i++) {
+    label_bytes += strlen(g->vertices[i].w.label) + 1;
+  }
+  // where each distinct route string will be, for the edges
+  uint64_t *route_pos = (uint64_t *)malloc((ns + 1) * sizeof(uint64_t));
+  if (!route_pos) return 0;
+  for (i = 0; i < ns; i++) {
+    route_pos[i] = route_bytes;
+    route_bytes += strlen(d->strings[i]) + 1;
+  }
+  for (i = 0; i < nr; i++) {
+    route_name_bytes += strlen(d->names[i]) + 1;
+  }
+  for (i = 0; i < g->num_travelers; i++) {
+    if (g->traveler_list[i]) name_bytes += strlen(g->traveler_list[i]) + 1;
+  }
+
+  tmg_snapshot_layout l;
+  memset(&l, 0, sizeof(l));
+  tmg_snapshot_place(&l, sizeof(tmg_snapshot_header));
+  l.graph = tmg_snapshot_place(&l, sizeof(tmg_graph));
+  l.vertices = tmg_snapshot_place(&l, n*sizeof(tmg_vertex));
+  l.edges = tmg_snapshot_place(&l, m*sizeof(tmg_edge));
+  for (i = 0; i < 5; i++) {
+    l.table[i] = tmg_snapshot_place(&l, n*sizeof(double));
+  }
+  l.adj_offsets = tmg_snapshot_place(&l, (n+1)*sizeof(int));
+  l.adj_vertices = tmg_snapshot_place(&l, 2*m*sizeof(int));
+  l.adj_edges = tmg_snapshot_place(&l, 2*m*sizeof(int));
+  if (g->orig_vertex_num) {
+    l.orig_vertex_num = tmg_snapshot_place(&l, n*sizeof(int));
+    l.vertex_renumber = tmg_snapshot_place(&l, n*sizeof(int));
+  }
+  size_t num_shaping = g->num_shaping_points;
+  l.shaping_offsets = tmg_snapshot_place(&l, (m+1)*sizeof(int));
+  l.shaping_points = tmg_snapshot_place(&l, num_shaping*sizeof(tmg_latlng));
+  l.shaping_miles = tmg_snapshot_place(&l, num_shaping*sizeof(double));
+  size_t bits_words = g->traveler_bits ? (size_t)m * g->traveler_words : 0;
+  l.traveler_bits = tmg_snapshot_place(&l, bits_words*sizeof(uint64_t));
+  l.traveler_list = tmg_snapshot_place(&l, g->num_travelers*sizeof(char *));
+  l.route_strings = tmg_snapshot_place(&l, ns*sizeof(char *));
+  l.string_offsets = tmg_snapshot_place(&l, (ns+1)*sizeof(int));
+  l.string_routes = tmg_snapshot_place(&l, string_routes*sizeof(int));
+  l.route_names = tmg_snapshot_place(&l, nr*sizeof(char *));
+  l.route_edge_offsets = tmg_snapshot_place(&l, (nr+1)*sizeof(int));
+  l.route_edges = tmg_snapshot_place(&l, route_edges*sizeof(int));
+  l.labels = tmg_snapshot_place(&l, label_bytes);
+  l.routes = tmg_snapshot_place(&l, route_bytes);
+  l.names = tmg_snapshot_place(&l, route_name_bytes);
+  l.traveler_names = tmg_snapshot_place(&l, name_bytes);
+
+  // the graph itself, pointing at the sections
+  tmg_graph copy = *g;
+  memset(&(copy.arena), 0, sizeof(tmg_arena));
+  copy.file_map = NULL;
+  copy.file_map_size = 0;
+  copy.vertices = tmg_snapshot_ptr(l.vertices);
+  copy.edges = tmg_snapshot_ptr(l.edges);
+  copy.table.x = tmg_snapshot_ptr(l.table[0]);
+  copy.table.y = tmg_snapshot_ptr(l.table[1]);
+  copy.table.z = tmg_snapshot_ptr(l.table[2]);
+  copy.table.lat = tmg_snapshot_ptr(l.table[3]);
+  copy.table.lng = tmg_snapshot_ptr(l.table[4]);
+  copy.adj_offsets = tmg_snapshot_ptr(l.adj_offsets);
+  copy.adj_vertices = tmg_snapshot_ptr(l.adj_vertices);
+  copy.adj_edges = tmg_snapshot_ptr(l.adj_edges);
+  copy.orig_vertex_num = g->orig_vertex_num ?
+    tmg_snapshot_ptr(l.orig_vertex_num) : NULL;
+  copy.vertex_renumber = g->vertex_renumber ?
+    tmg_snapshot_ptr(l.vertex_renumber) : NULL;
+  copy.shaping_offsets = tmg_snapshot_ptr(l.shaping_offsets);
+  copy.shaping_points = tmg_snapshot_ptr(l.shaping_points);
+  copy.shaping_miles = tmg_snapshot_ptr(l.shaping_miles);
+  copy.shaping_capacity = num_shaping;
+  copy.shaping_mapped = 1;
+  copy.traveler_bits = g->traveler_bits ?
+    tmg_snapshot_ptr(l.traveler_bits) : NULL;
+  copy.traveler_list = g->traveler_list ?
+    tmg_snapshot_ptr(l.traveler_list) : NULL;
+  copy.route_dict.strings = tmg_snapshot_ptr(l.route_strings);
+  copy.route_dict.string_offsets = tmg_snapshot_ptr(l.string_offsets);
+  copy.route_dict.string_routes = tmg_snapshot_ptr(l.string_routes);
+  copy.route_dict.names = tmg_snapshot_ptr(l.route_names);
+  copy.route_dict.edge_offsets = tmg_snapshot_ptr(l.route_edge_offsets);
+  copy.route_dict.edges = tmg_snapshot_ptr(l.route_edges);
+  copy.route_dict.hash = NULL;
+  copy.route_dict.hash_size = 0;
+
+  tmg_snapshot_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, TMG_SNAPSHOT_MAGIC, 8);
+  h.version = TMG_SNAPSHOT_VERSION;
+  h.pointer_size = sizeof(void *);
+  h.graph_size = sizeof(tmg_graph);
+  h.vertex_size = sizeof(tmg_vertex);
+  h.edge_size = sizeof(tmg_edge);
+  h.base = TMG_SNAPSHOT_BASE;
+  h.file_size = l.end;
+  h.source_size = st.st_size;
+  h.source_mtime_sec = st.st_mtim.tv_sec;
+  h.source_mtime_nsec = st.st_mtim.tv_nsec;
+  h.graph_offset = l.graph;
+
+  char *tmpname = (char *)malloc(strlen(filename) + 5);
+  if (!tmpname) {
+    free(route_pos);
+    return 0;
+  }
+  sprintf(tmpname, "%s.tmp", filename);
+  tmg_snapshot_writer w;
+  w.fp = fopen(tmpname, "wb");
+  w.pos = 0;
+  w.failed = 0;
+  if (!w.fp) {
+    fprintf(stderr, "Could not open snapshot file %s for writing\n", tmpname);
+    free(route_pos);
+    free(tmpname);
+    return 0;
+  }
+
+  tmg_snapshot_write(&w, 0, &h, sizeof(h));
+  tmg_snapshot_write(&w, l.graph, &copy, sizeof(copy));
+
+  // vertices and edges a block at a time, with their pointers
+  // rewritten to where the things they point to are in the file
+  tmg_vertex *vblock =
+    (tmg_vertex *)malloc(TMG_SNAPSHOT_BLOCK*sizeof(tmg_vertex));
+  tmg_edge *eblock = (tmg_edge *)malloc(TMG_SNAPSHOT_BLOCK*sizeof(tmg_edge));
+  if (!vblock || !eblock) {
+    fprintf(stderr, "Could not allocate snapshot buffers\n");
+    free(vblock);
+    free(eblock);
+    free(route_pos);
+    fclose(w.fp);
+    unlink(tmpname);
+    free(tmpname);
+    return 0;
+  }
+  uint64_t label_pos = l.labels;
+  int first, count;
+  for (first = 0; first < n; first += count) {
+    count = (n - first < TMG_SNAPSHOT_BLOCK) ? n - first : TMG_SNAPSHOT_BLOCK;
+    for (i = 0; i < count; i++) {
+      vblock[i] = g->vertices[first + i];
+      vblock[i].w.label = tmg_snapshot_ptr(label_pos);
+      vblock[i].edges = NULL;
+      label_pos += strlen(g->vertices[first + i].w.label) + 1;
+    }
+    tmg_snapshot_write(&w, l.vertices + first*sizeof(tmg_vertex), vblock,
+		       count*sizeof(tmg_vertex));
+  }
+
+  for (first = 0; first < m; first += count) {
+    count = (m - first < TMG_SNAPSHOT_BLOCK) ? m - first : TMG_SNAPSHOT_BLOCK;
+    for (i = 0; i < count; i++) {
+      tmg_edge *e = &(g->edges[first + i]);
+      tmg_edge *s = &(eblock[i]);
+      *s = *e;
+      uint64_t end1 = l.vertices + (e->end1 - g->vertices)*sizeof(tmg_vertex);
+      uint64_t end2 = l.vertices + (e->end2 - g->vertices)*sizeof(tmg_vertex);
+      s->end1 = tmg_snapshot_ptr(end1);
+      s->end2 = tmg_snapshot_ptr(end2);
+      s->conn.end1 = tmg_snapshot_ptr(end1 + offsetof(tmg_vertex, w));
+      s->conn.end2 = tmg_snapshot_ptr(end2 + offsetof(tmg_vertex, w));
+      s->conn.routes = tmg_snapshot_ptr(l.routes + route_pos[e->conn.route_id]);
+      if (e->conn.trav.bits) {
+	s->conn.trav.bits = tmg_snapshot_ptr(l.traveler_bits +
+	  (e->conn.trav.bits - g->traveler_bits)*sizeof(uint64_t));
+      }
+      if (e->conn.num_shaping_points) {
+	s->conn.shaping_points = tmg_snapshot_ptr(l.shaping_points +
+	  (e->conn.shaping_points - g->shaping_points)*sizeof(tmg_latlng));
+	s->conn.shaping_miles = tmg_snapshot_ptr(l.shaping_miles +
+	  (e->conn.shaping_miles - g->shaping_miles)*sizeof(double));
+      }
+    }
+    tmg_snapshot_write(&w, l.edges + first*sizeof(tmg_edge), eblock,
+		       count*sizeof(tmg_edge));
+  }
+
+  free(vblock);
+  free(eblock);
+  free(route_pos);
+
+  double *columns[5] = { g->table.x, g->table.y, g->table.z,
+			 g->table.lat, g->table.lng };
+  for (i = 0; i < 5; i++) {
+    tmg_snapshot_write(&w, l.table[i], columns[i], n*sizeof(double));
+  }
+  tmg_snapshot_write(&w, l.adj_offsets, g->adj_offsets, (n+1)*sizeof(int));
+  tmg_snapshot_write(&w, l.adj_vertices, g->adj_vertices, 2*m*sizeof(int));
+  tmg_snapshot_write(&w, l.adj_edges, g->adj_edges, 2*m*sizeof(int));
+  if (g->orig_vertex_num) {
+    tmg_snapshot_write(&w, l.orig_vertex_num, g->orig_vertex_num,
+		       n*sizeof(int));
+    tmg_snapshot_write(&w, l.vertex_renumber, g->vertex_renumber,
+		       n*sizeof(int));
+  }
+  tmg_snapshot_write(&w, l.shaping_offsets, g->shaping_offsets,
+		     (m+1)*sizeof(int));
+  tmg_snapshot_write(&w, l.shaping_points, g->shaping_points,
+		     num_shaping*sizeof(tmg_latlng));
+  tmg_snapshot_write(&w, l.shaping_miles, g->shaping_miles,
+		     num_shaping*sizeof(double));
+  tmg_snapshot_write(&w, l.traveler_bits, g->traveler_bits,
+		     bits_words*sizeof(uint64_t));
+
+  uint64_t name_pos = l.traveler_names;
+  tmg_snapshot_write(&w, l.traveler_list, NULL, 0);
+  for (i = 0; i < g->num_travelers; i++) {
+    char *name = NULL;
+    if (g->traveler_list[i]) {
+      name = tmg_snapshot_ptr(name_pos);
+      name_pos += strlen(g->traveler_list[i]) + 1;
+    }
+    tmg_snapshot_write(&w, l.traveler_list + i*sizeof(char *), &name,
+		       sizeof(char *));
+  }
+
+  // the route dictionary, with its string pointers rewritten
+  uint64_t string_pos = l.routes;
+  tmg_snapshot_write(&w, l.route_strings, NULL, 0);
+  for (i = 0; i < ns; i++) {
+    char *ptr = tmg_snapshot_ptr(string_pos);
+    tmg_snapshot_write(&w, w.pos, &ptr, sizeof(char *));
+    string_pos += strlen(d->strings[i]) + 1;
+  }
+  tmg_snapshot_write(&w, l.string_offsets, d->string_offsets,
+		     (ns+1)*sizeof(int));
+  tmg_snapshot_write(&w, l.string_routes, d->string_routes,
+		     string_routes*sizeof(int));
+  string_pos = l.names;
+  tmg_snapshot_write(&w, l.route_names, NULL, 0);
+  for (i = 0; i < nr; i++) {
+    char *ptr = tmg_snapshot_ptr(string_pos);
+    tmg_snapshot_write(&w, w.pos, &ptr, sizeof(char *));
+    string_pos += strlen(d->names[i]) + 1;
+  }
+  tmg_snapshot_write(&w, l.route_edge_offsets, d->edge_offsets,
+		     (nr+1)*sizeof(int));
+  tmg_snapshot_write(&w, l.route_edges, d->edges, route_edges*sizeof(int));
+
+  // the strings, each section padded out to its start first
+  tmg_snapshot_write(&w, l.labels, NULL, 0);
+  for (i = 0; i < n; i++) {
+    char *label = g->vertices[i].w.label;
+    tmg_snapshot_write(&w, w.pos, label, strlen(label) + 1);
+  }
+  tmg_snapshot_write(&w, l.routes, NULL, 0);
+  for (i = 0; i < ns; i++) {
+    tmg_snapshot_write(&w, w.pos, d->strings[i], strlen(d->strings[i]) + 1);
+  }
+  tmg_snapshot_write(&w, l.names, NULL, 0);
+  for (i = 0; i < nr; i++) {
+    tmg_snapshot_write(&w, w.pos, d->names[i], strlen(d->names[i]) + 1);
+  }
+  tmg_snapshot_write(&w, l.traveler_names, NULL, 0);
+  for (i = 0; i < g->num_travelers; i++) {
+    char *name = g->traveler_list[i];
+    if (name) tmg_snapshot_write(&w, w.pos, name, strlen(name) + 1);
+  }
+
+  if (fclose(w.fp) != 0) w.failed = 1;
+  if (w.failed || rename(tmpname, filename) != 0) {
+    fprintf(stderr, "Could not write snapshot file %s\n", filename);
+    unlink(tmpname);
+    free(tmpname);
+    return 0;
+  }
+  free(tmpname);
+  return 1;
+}
+
+// move a pointer read from a snapshot by the distance between where
+// the file was mapped and where its pointers assume
+#define TMG_RELOCATE(p, delta) \
+  if (p) (p) = (void *)((char *)(p) + (delta))
+
+/*
+  Helper function for tmg_load_snapshot: fix up every pointer in a
+  graph mapped somewhere other than TMG_SNAPSHOT_BASE.
+*/
+static void tmg_snapshot_relocate(tmg_graph *g, ptrdiff_t delta) {
+
+  int i;
+  TMG_RELOCATE(g->vertices, delta);
+  TMG_RELOCATE(g->edges, delta);
+  TMG_RELOCATE(g->traveler_list, delta);
+  TMG_RELOCATE(g->traveler_bits, delta);
+  TMG_RELOCATE(g->shaping_offsets, delta);
+  TMG_RELOCATE(g->shaping_points, delta);
+  TMG_RELOCATE(g->shaping_miles, delta);
+  TMG_RELOCATE(g->table.x, delta);
+  TMG_RELOCATE(g->table.y, delta);
+  TMG_RELOCATE(g->table.z, delta);
+  TMG_RELOCATE(g->table.lat, delta);
+  TMG_RELOCATE(g->table.lng, delta);
+  TMG_RELOCATE(g->adj_offsets, delta);
+  TMG_RELOCATE(g->adj_vertices, delta);
+  TMG_RELOCATE(g->adj_edges, delta);
+  TMG_RELOCATE(g->orig_vertex_num, delta);
+  TMG_RELOCATE(g->vertex_renumber, delta);
+  TMG_RELOCATE(g->route_dict.strings, delta);
+  TMG_RELOCATE(g->route_dict.string_offsets, delta);
+  TMG_RELOCATE(g->route_dict.string_routes, delta);
+  TMG_RELOCATE(g->route_dict.names, delta);
+  TMG_RELOCATE(g->route_dict.edge_offsets, delta);
+  TMG_RELOCATE(g->route_dict.edges, delta);
+  for (i = 0; i < g->num_vertices; i++) {
+    TMG_RELOCATE(g->vertices[i].w.label, delta);
+  }
+  for (i = 0; i < g->num_edges; i++) {
+    tmg_edge *e = &(g->edges[i]);
+    TMG_RELOCATE(e->end1, delta);
+    TMG_RELOCATE(e->end2, delta);
+    TMG_RELOCATE(e->conn.end1, delta);
+    TMG_RELOCATE(e->conn.end2, delta);
+    TMG_RELOCATE(e->conn.routes, delta);
+    TMG_RELOCATE(e->conn.trav.bits, delta);
+    TMG_RELOCATE(e->conn.shaping_points, delta);
+    TMG_RELOCATE(e->conn.shaping_miles, delta);
+  }
+  for (i = 0; i < g->num_travelers; i++) {
+    TMG_RELOCATE(g->traveler_list[i], delta);
+  }
+  for (i = 0; i < g->route_dict.num_strings; i++) {
+    TMG_RELOCATE(g->route_dict.strings[i], delta);
+  }
+  for (i = 0; i < g->route_dict.num_routes; i++) {
+    TMG_RELOCATE(g->route_dict.names[i], delta);
+  }
+}
+
+/*
+  Load a graph from the snapshot file filename.  If source is not
+  NULL, the snapshot is only used if it was made from that file as it
+  is now.  Returns the graph, or NULL if the snapshot is missing,
+  stale, or not readable by this build.
+*/
+tmg_graph *tmg_load_snapshot(char *filename, char *source) {
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  tmg_snapshot_header h;
+  if (fstat(fd, &st) < 0 ||
+      pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+      memcmp(h.magic, TMG_SNAPSHOT_MAGIC, 8) != 0) {
+    close(fd);
+    return NULL;
+  }
+  if (h.version != TMG_SNAPSHOT_VERSION || h.pointer_size != sizeof(void *) ||
+      h.graph_size != sizeof(tmg_graph) || h.vertex_size != sizeof(tmg_vertex) ||
+      h.edge_size != sizeof(tmg_edge) || h.base != TMG_SNAPSHOT_BASE ||
+      h.file_size != (uint64_t)st.st_size ||
+      h.graph_offset + sizeof(tmg_graph) > h.file_size) {
+    fprintf(stderr, "Ignoring snapshot %s written by an incompatible version\n",
+	    filename);
+    close(fd);
+    return NULL;
+  }
+
+  if (source) {
+    struct stat src;
+    if (stat(source, &src) < 0 || (uint64_t)src.st_size != h.source_size ||
+	src.st_mtim.tv_sec != h.source_mtime_sec ||
+	src.st_mtim.tv_nsec != h.source_mtime_nsec) {
+      close(fd);
+      return NULL;
+    }
+  }
+
+  // private and writable, so the graph can still be changed (for
+  // example renumbered) without touching the file
+  void *want = (void *)(uintptr_t)TMG_SNAPSHOT_BASE;
+  int flags = MAP_PRIVATE;
+#ifdef MAP_FIXED_NOREPLACE
+  flags |= MAP_FIXED_NOREPLACE;
+#endif
+  char *map = mmap(want, h.file_size, PROT_READ|PROT_WRITE, flags, fd, 0);
+  if (map == MAP_FAILED) {
+    map = mmap(NULL, h.file_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Could not map snapshot %s\n", filename);
+    return NULL;
+  }
+
+  tmg_graph *g = (tmg_graph *)malloc(sizeof(tmg_graph));
+  if (!g) {
+    munmap(map, h.file_size);
+    return NULL;
+  }
+  memcpy(g, map + h.graph_offset, sizeof(tmg_graph));
+  tmg_arena_init(&(g->arena));
+  g->file_map = map;
+  g->file_map_size = h.file_size;
+  if (map != (char *)want) {
+    tmg_snapshot_relocate(g, map - (char *)want);
+  }
+  return g;
+}
+
+/*
+  Load the graph in filename, which may be a .tmg file or a snapshot.
+  For a .tmg file, its snapshot is used instead if one is fresh, and
+  if save is set and none is, a snapshot is saved after loading the
+  .tmg file.  Returns the graph, NULL if it could not be loaded.
+*/
+tmg_graph *tmg_load_graph_cached(char *filename, int save) {
+
+  // a snapshot named directly is used as is
+  tmg_graph *g = tmg_load_snapshot(filename, NULL);
+  if (g) return g;
+
+  char *name = tmg_snapshot_name(filename);
+  if (!name) return NULL;
+  g = tmg_load_snapshot(name, filename);
+  if (!g) {
+    g = tmg_load_graph_mmap(filename);
+    if (g && save) tmg_save_snapshot(g, name, filename);
+  }
+  free(name);
+  return g;
+}
@@ -0,0 +1,72 @@
+/*
+  Structure definitions and function prototypes for binary snapshots
+  of loaded METAL TMG graphs (.tmgb files), which are mapped back into
+  memory instead of parsing the .tmg file again.
+
+  A snapshot is the graph's own structures, written as they are in
+  memory with every pointer rewritten as if the file were mapped at
+  TMG_SNAPSHOT_BASE:
+
+    offset 0: tmg_snapshot_header
+    graph_offset: the tmg_graph
+    then, each starting on a TMG_SNAPSHOT_ALIGN byte boundary: the
+      vertices, edges, vertex table columns, adjacency arrays, any
+      vertex permutation, shaping point offsets, points and distances,
+      traveler bits and name pointers, the route dictionary, and the
+      label, route, route name and traveler name strings
+
+  Loading maps the file at TMG_SNAPSHOT_BASE when that address range
+  is free, so nothing needs to be touched before use; otherwise the
+  file is mapped wherever it fits and every pointer is relocated.
+  Snapshots are only read by builds with the same structure layout,
+  which the header records.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGSNAPSHOT_H
+#define _TMGSNAPSHOT_H
+
+#include <stdint.h>
+#include "tmggraph.h"
+
+#define TMG_SNAPSHOT_MAGIC "TMGSNAP\n"
+#define TMG_SNAPSHOT_VERSION 2
+
+// preferred address for snapshot mappings, far from where the
+// system places the heap and other mappings
+#define TMG_SNAPSHOT_BASE 0x300000000000ULL
+
+// sections start on this byte boundary
+#define TMG_SNAPSHOT_ALIGN 64
+
+// vertices and edges are rewritten for the file this many at a time
+#define TMG_SNAPSHOT_BLOCK 4096
+
+typedef struct tmg_snapshot_header {
+  char magic[8];
+  uint32_t version;
+  // sizes of the structures written, so a build with a different
+  // layout does not misread them
+  uint32_t pointer_size;
+  uint32_t graph_size;
+  uint32_t vertex_size;
+  uint32_t edge_size;
+  uint32_t reserved;
+  uint64_t base;  // address the stored pointers assume
+  uint64_t file_size;
+  // the .tmg file the snapshot was made from, to tell if it is fresh
+  uint64_t source_size;
+  int64_t source_mtime_sec;
+  int64_t source_mtime_nsec;
+  uint64_t graph_offset;
+} tmg_snapshot_header;
+
+// function prototypes
+extern char *tmg_snapshot_name(char *filename);
+extern int tmg_save_snapshot(tmg_graph *g, char *filename, char *source);
+extern tmg_graph *tmg_load_snapshot(char *filename, char *source);
+extern tmg_graph *tmg_load_graph_cached(char *filename, int save);
+
+#endif  // _TMGSNAPSHOT_H
@@ -0,0 +1,160 @@
+/*
+  Queries over the travelers of traveled format METAL TMG graphs.
+
+  Every edge's travelers are a row of g->traveler_words 64-bit words
+  in the single block g->traveler_bits, so each query is one
+  sequential pass over that block, building 64 edges' worth of the
+  result at a time with no branches on the data.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmgtravel.h"
+
+/*
+  The number of 64-bit words in an edge set of g.
+*/
+int tmg_edge_set_words(tmg_graph *g) {
+
+  return (g->num_edges + 63) / 64;
+}
+
+/*
+  Allocate an empty edge set for g, returns NULL if out of memory.
+*/
+uint64_t *tmg_edge_set_create(tmg_graph *g) {
+
+  // at least one word, so an empty graph still gets a set
+  uint64_t *set = (uint64_t *)calloc(tmg_edge_set_words(g) + 1,
+				     sizeof(uint64_t));
+  if (!set) {
+    fprintf(stderr, "Could not allocate set of %d edges\n", g->num_edges);
+  }
+  return set;
+}
+
+/*
+  The number of edges in set.
+*/
+int tmg_edge_set_count(tmg_graph *g, const uint64_t *set) {
+
+  int count = 0;
+  int words = tmg_edge_set_words(g);
+  for (int i = 0; i < words; i++) {
+    count += __builtin_popcountll(set[i]);
+  }
+  return count;
+}
+
+/*
+  Set marked[v] to 1 for every vertex v that is an endpoint of an
+  edge in set, leaving other entries alone.  Returns the number of
+  vertices newly marked.
+*/
+int tmg_edge_set_mark_vertices(tmg_graph *g, const uint64_t *set,
+			       unsigned char *marked) {
+
+  int count = 0;
+  int words = tmg_edge_set_words(g);
+  for (int i = 0; i < words; i++) {
+    uint64_t bits = set[i];
+    while (bits) {
+      tmg_edge *e = &(g->edges[i * 64 + __builtin_ctzll(bits)]);
+      bits &= bits - 1;
+      if (!marked[e->end1->vertex_num]) {
+	marked[e->end1->vertex_num] = 1;
+	count++;
+      }
+      if (!marked[e->end2->vertex_num]) {
+	marked[e->end2->vertex_num] = 1;
+	count++;
+      }
+    }
+  }
+  return count;
+}
+
+/*
+  The number of the traveler with the given name, or -1 if there is
+  none (or g is not a traveled graph).
+*/
+int tmg_traveler_from_name(tmg_graph *g, char *name) {
+
+  for (int t = 0; t < g->num_travelers; t++) {
+    if (g->traveler_list[t] && strcmp(g->traveler_list[t], name) == 0) {
+      return t;
+    }
+  }
+  return -1;
+}
+
+/*
+  Fill set with the edges traveler has traveled.
+*/
+void tmg_edges_traveled_by(tmg_graph *g, int traveler, uint64_t *set) {
+
+  int m = g->num_edges;
+  size_t stride = g->traveler_words;
+  const uint64_t *col = g->traveler_bits + traveler / 64;
+  int shift = traveler % 64;
+  for (int base = 0; base < m; base += 64) {
+    int count = (m - base < 64) ? m - base : 64;
+    uint64_t word = 0;
+    for (int b = 0; b < count; b++) {
+      word |= ((col[(base + b) * stride] >> shift) & 1) << b;
+    }
+    set[base / 64] = word;
+  }
+}
+
+/*
+  Fill set with the edges traveled by any of the travelers in the
+  traveler set travelers, which has g->traveler_words words with bit
+  t%64 of word t/64 set for traveler t.
+*/
+void tmg_edges_traveled_by_any(tmg_graph *g, const uint64_t *travelers,
+			       uint64_t *set) {
+
+  int m = g->num_edges;
+  int words = g->traveler_words;
+  const uint64_t *row = g->traveler_bits;
+  for (int base = 0; base < m; base += 64) {
+    int count = (m - base < 64) ? m - base : 64;
+    uint64_t word = 0;
+    for (int b = 0; b < count; b++, row += words) {
+      uint64_t any = 0;
+      for (int k = 0; k < words; k++) {
+	any |= row[k] & travelers[k];
+      }
+      word |= (uint64_t)(any != 0) << b;
+    }
+    set[base / 64] = word;
+  }
+}
+
+/*
+  Fill set with the edges traveled by at least min_count travelers.
+*/
+void tmg_edges_with_travelers(tmg_graph *g, int min_count, uint64_t *set) {
+
+  int m = g->num_edges;
+  int words = g->traveler_words;
+  const uint64_t *row = g->traveler_bits;
+  for (int base = 0; base < m; base += 64) {
+    int count = (m - base < 64) ? m - base : 64;
+    uint64_t word = 0;
+    for (int b = 0; b < count; b++, row += words) {
+      int travelers = 0;
+      for (int k = 0; k < words; k++) {
+	travelers += __builtin_popcountll(row[k]);
+      }
+      word |= (uint64_t)(travelers >= min_count) << b;
+    }
+    set[base / 64] = word;
+  }
+}
@@ -0,0 +1,30 @@
+/*
+  Function prototypes for queries over the travelers of traveled
+  format METAL TMG graphs.  Results are edge sets: bitsets with bit
+  e%64 of word e/64 set for each edge e in the set, which are cheap
+  to combine and to test.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGTRAVEL_H
+#define _TMGTRAVEL_H
+
+#include <stdint.h>
+#include "tmggraph.h"
+
+// function prototypes
+extern int tmg_edge_set_words(tmg_graph *g);
+extern uint64_t *tmg_edge_set_create(tmg_graph *g);
+extern int tmg_edge_set_count(tmg_graph *g, const uint64_t *set);
+extern int tmg_edge_set_mark_vertices(tmg_graph *g, const uint64_t *set,
+				      unsigned char *marked);
+extern int tmg_traveler_from_name(tmg_graph *g, char *name);
+extern void tmg_edges_traveled_by(tmg_graph *g, int traveler, uint64_t *set);
+extern void tmg_edges_traveled_by_any(tmg_graph *g, const uint64_t *travelers,
+				      uint64_t *set);
+extern void tmg_edges_with_travelers(tmg_graph *g, int min_count,
+				     uint64_t *set);
+
+#endif  // _TMGTRAVEL_H
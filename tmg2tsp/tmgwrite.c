@@ -0,0 +1,589 @@
+/*
+  Functions to write the TSP distance matrix files computed from a
+  METAL TMG graph, in the text format or the binary format of
+  tspmatrix.h.
+
+  A matrix too large to hold in memory is streamed instead: computed
+  a band of complete rows at a time, each band written as soon as it
+  is done.  When the output goes to a file, a checkpoint recording the
+  rows done and the length of the output through them is saved after
+  every band, so an interrupted run can be resumed from there.
+
+  Streaming is a pipeline: the calling thread and its helpers compute
+  bands into a ring of TMG_STREAM_BANDS buffers, while a writer thread
+  writes them in order, syncs them to disk and saves the checkpoints.
+  The computation waits only when every buffer is still waiting to be
+  written, so the time taken approaches the larger of computing and
+  writing rather than their sum, and memory use stays bounded.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tmgwrite.h"
+#include "tmgoutput.h"
+
+/*
+  Format the label of waypoint wp as tmg_waypoint_print would print it,
+  in *label, which holds *size bytes and is grown as needed.
+*/
+static char *tmg_write_label(tmg_waypoint *wp, char **label, size_t *size) {
+
+  size_t len = tmg_waypoint_format(wp, *label, *size);
+  if (len >= *size) {
+    *size = len + 1;
+    *label = (char *)realloc(*label, *size);
+    tmg_waypoint_format(wp, *label, *size);
+  }
+  return *label;
+}
+
+/*
+  Open the text output, outfile or stdout if it is NULL, returning the
+  file descriptor or -1.  The file is truncated unless keep is set.
+*/
+static int tmg_write_open_text(char *outfile, int keep) {
+
+  // anything already printed through stdio must come first
+  fflush(stdout);
+  if (!outfile) return STDOUT_FILENO;
+  int fd = open(outfile, O_WRONLY | O_CREAT | (keep ? 0 : O_TRUNC), 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Could not open file %s for writing\n", outfile);
+  }
+  return fd;
+}
+
+/*
+  Write what follows the matrix rows in the text format: a blank
+  line, the waypoints of the points and a line naming the .tmg file.
+*/
+static void tmg_write_text_trailer(tmg_output *out, tmg_graph *g,
+				   int *points, int num_points,
+				   char *filename) {
+
+  tmg_output_char(out, '\n');
+
+  // print the places and coordinates
+  char *label = NULL;
+  size_t label_size = 0;
+  for (int i = 0; i < num_points; i++) {
+    tmg_output_str(out, tmg_write_label(&(g->vertices[points[i]].w), &label,
+					&label_size));
+    tmg_output_char(out, '\n');
+  }
+  free(label);
+
+  tmg_output_str(out, "\nComputed from METAL .tmg file ");
+  tmg_output_str(out, filename);
+  tmg_output_char(out, '\n');
+}
+
+/* write the waypoints of the points as binary matrix labels */
+static int tmg_write_binary_labels(tsp_matrix_writer *w, tmg_graph *g,
+				   int *points, int num_points) {
+
+  char *label = NULL;
+  size_t label_size = 0;
+  int ok = 1;
+  for (int i = 0; ok && i < num_points; i++) {
+    ok = tsp_matrix_write_label(w, tmg_write_label(&(g->vertices[points[i]].w),
+						   &label, &label_size));
+  }
+  free(label);
+  return ok;
+}
+
+/*
+  Write the matrix in the text format: the number of points, the rows
+  of the matrix, then the trailer.  Returns 1 on success.
+*/
+static int tmg_write_text(tmg_graph *g, int *points, int *matrix,
+			  int num_points,
+			  char *filename, tmg_write_options *opts) {
+
+  int fd = tmg_write_open_text(opts->outfile, 0);
+  if (fd < 0) return 0;
+
+  // start by printing the number of points
+  tmg_output out;
+  tmg_output_init(&out, fd, TMG_OUTPUT_BUFFER_SIZE);
+  tmg_output_int(&out, num_points);
+  tmg_output_char(&out, '\n');
+  tmg_output_flush(&out);
+
+  int ok = tmg_output_matrix_text(fd, matrix, num_points, num_points,
+				  opts->nthreads);
+
+  tmg_write_text_trailer(&out, g, points, num_points, filename);
+  ok = tmg_output_close(&out) && ok;
+  if (opts->outfile && close(fd) != 0) ok = 0;
+  return ok;
+}
+
+/*
+  Write the matrix and the waypoints of its points in the binary
+  format of tspmatrix.h.  Entries are stored in 2 bytes when they all
+  fit.  Returns 1 on success.
+*/
+static int tmg_write_binary(tmg_graph *g, int *points, int *matrix,
+			    int num_points,
+			    tmg_write_options *opts) {
+
+  size_t size = (size_t)num_points * num_points;
+  int elem_size = 2;
+  for (size_t k = 0; k < size; k++) {
+    if (matrix[k] > 0xffff) {
+      elem_size = 4;
+      break;
+    }
+  }
+
+  tsp_matrix_writer *w = tsp_matrix_writer_open(opts->outfile, stdout,
+						num_points, elem_size,
+						opts->layout);
+  if (w == NULL) return 0;
+  int ok = 1;
+  for (int from = 0; ok && from < num_points; from++) {
+    ok = tsp_matrix_write_row(w, matrix + (size_t)from * num_points);
+  }
+  ok = ok && tmg_write_binary_labels(w, g, points, num_points);
+  return tsp_matrix_writer_close(w) && ok;
+}
+
+/*
+  Write the num_points x num_points matrix between the graph vertices
+  in points, computed from the .tmg file filename, as opts describes.
+  Returns 1 on success, 0 on failure.
+*/
+int tmg_write_matrix(tmg_graph *g, int *points, int *matrix, int num_points,
+		     char *filename, tmg_write_options *opts) {
+
+  if (opts->binary) {
+    return tmg_write_binary(g, points, matrix, num_points, opts);
+  }
+  return tmg_write_text(g, points, matrix, num_points, filename, opts);
+}
+
+/*
+  Write the k nearest neighbors of each of num_points points in the
+  neighbor list text format described in tmgwrite.h, to opts->outfile
+  or stdout.  Returns 1 on success, 0 on failure.
+*/
+int tmg_write_knn(tmg_graph *g, int *points, int num_points, int k,
+		  int *neighbors, int *tenths, char *filename,
+		  tmg_write_options *opts) {
+
+  int fd = tmg_write_open_text(opts->outfile, 0);
+  if (fd < 0) return 0;
+
+  tmg_output out;
+  tmg_output_init(&out, fd, TMG_OUTPUT_BUFFER_SIZE);
+  tmg_output_int(&out, num_points);
+  tmg_output_char(&out, ' ');
+  tmg_output_int(&out, k);
+  tmg_output_char(&out, '\n');
+  for (int p = 0; p < num_points; p++) {
+    for (int i = 0; i < k; i++) {
+      tmg_output_int(&out, neighbors[(size_t)p * k + i]);
+      tmg_output_char(&out, '\t');
+      tmg_output_int(&out, tenths[(size_t)p * k + i]);
+      tmg_output_char(&out, '\t');
+    }
+    tmg_output_char(&out, '\n');
+  }
+  tmg_write_text_trailer(&out, g, points, num_points, filename);
+  int ok = tmg_output_close(&out);
+  if (opts->outfile && close(fd) != 0) ok = 0;
+  return ok;
+}
+
+/*
+  Write a tour of the points in the text format described in
+  tmgwrite.h.  Returns 1 on success.
+*/
+int tmg_write_tour(tmg_graph *g, int *points, int num_points, int *tour,
+		   long length, char *filename, tmg_write_options *opts) {
+
+  int fd = tmg_write_open_text(opts->outfile, 0);
+  if (fd < 0) return 0;
+
+  tmg_output out;
+  tmg_output_init(&out, fd, TMG_OUTPUT_BUFFER_SIZE);
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%d %ld\n", num_points, length);
+  tmg_output_str(&out, buf);
+  char *label = NULL;
+  size_t label_size = 0;
+  for (int i = 0; i <= num_points; i++) {
+    int p = tour[i % num_points];
+    tmg_output_int(&out, p);
+    tmg_output_char(&out, '\t');
+    tmg_output_str(&out, tmg_write_label(&(g->vertices[points[p]].w), &label,
+					 &label_size));
+    tmg_output_char(&out, '\n');
+  }
+  free(label);
+  tmg_output_str(&out, "\nComputed from METAL .tmg file ");
+  tmg_output_str(&out, filename);
+  tmg_output_char(&out, '\n');
+  int ok = tmg_output_close(&out);
+  if (opts->outfile && close(fd) != 0) ok = 0;
+  return ok;
+}
+
+/* the checkpoint file name for outfile, newly allocated */
+static char *tmg_checkpoint_name(char *outfile) {
+
+  char *name = (char *)malloc(strlen(outfile) +
+			      strlen(TMG_CHECKPOINT_SUFFIX) + 1);
+  strcpy(name, outfile);
+  strcat(name, TMG_CHECKPOINT_SUFFIX);
+  return name;
+}
+
+/* read a checkpoint, 1 if one was found, 0 if not */
+static int tmg_checkpoint_load(char *name, tmg_checkpoint *c) {
+
+  FILE *fp = fopen(name, "rb");
+  if (!fp) return 0;
+  int ok = (fread(c, sizeof(tmg_checkpoint), 1, fp) == 1 &&
+	    memcmp(c->magic, TMG_CHECKPOINT_MAGIC, sizeof(c->magic)) == 0 &&
+	    c->version == TMG_CHECKPOINT_VERSION);
+  fclose(fp);
+  if (!ok) {
+    fprintf(stderr, "Ignoring invalid checkpoint file %s\n", name);
+  }
+  return ok;
+}
+
+/*
+  Save a checkpoint by writing a new file and renaming it over the old
+  one, so an interruption never leaves a partial checkpoint behind.
+*/
+static int tmg_checkpoint_save(char *name, tmg_checkpoint *c) {
+
+  char *tmp = (char *)malloc(strlen(name) + 5);
+  strcpy(tmp, name);
+  strcat(tmp, ".tmp");
+  FILE *fp = fopen(tmp, "wb");
+  int ok = (fp != NULL);
+  if (ok) {
+    ok = (fwrite(c, sizeof(tmg_checkpoint), 1, fp) == 1);
+    ok = (fflush(fp) == 0) && ok;
+    ok = (fsync(fileno(fp)) == 0) && ok;
+    ok = (fclose(fp) == 0) && ok;
+  }
+  if (ok && rename(tmp, name) != 0) ok = 0;
+  if (!ok) {
+    fprintf(stderr, "Could not save checkpoint file %s\n", name);
+    unlink(tmp);
+  }
+  free(tmp);
+  return ok;
+}
+
+// the state shared by the computing and writing sides of a streamed
+// matrix: band k of the output goes through buffer k % TMG_STREAM_BANDS
+typedef struct tmg_stream {
+  int num_points;
+  int *bands[TMG_STREAM_BANDS];
+  int band_first[TMG_STREAM_BANDS];
+  int band_count[TMG_STREAM_BANDS];
+  int computed;  // bands computed so far
+  int written;   // bands written so far
+  int done;      // set once no more bands will be computed
+  int failed;    // set if writing failed
+  pthread_mutex_t lock;
+  pthread_cond_t ready;    // signaled when a band is computed
+  pthread_cond_t emptied;  // signaled when a band is written
+  // where the bands go: w for binary output, fd for text
+  tsp_matrix_writer *w;
+  int fd;
+  int nthreads;
+  char *ckpt_name;  // NULL if no checkpoints are kept
+  tmg_checkpoint *c;
+} tmg_stream;
+
+/*
+  Write the band in buffer slot, and when checkpointing, make sure it
+  is on disk before saving the checkpoint that says it is.  Returns 1
+  on success, 0 on failure.
+*/
+static int tmg_stream_write_band(tmg_stream *s, int slot) {
+
+  int *band = s->bands[slot];
+  int count = s->band_count[slot];
+  int ok = 1;
+  if (s->w) {
+    for (int r = 0; ok && r < count; r++) {
+      ok = tsp_matrix_write_row(s->w, band + (size_t)r * s->num_points);
+    }
+    ok = ok && (fflush(s->w->fp) == 0);
+    s->c->output_offset = ftello(s->w->fp);
+    if (ok && s->ckpt_name) ok = (fsync(fileno(s->w->fp)) == 0);
+  }
+  else {
+    ok = tmg_output_matrix_text(s->fd, band, count, s->num_points,
+				s->nthreads);
+    s->c->output_offset = lseek(s->fd, 0, SEEK_CUR);
+    if (ok && s->ckpt_name) ok = (fsync(s->fd) == 0);
+  }
+  if (ok && s->ckpt_name) {
+    s->c->rows_done = s->band_first[slot] + count;
+    ok = tmg_checkpoint_save(s->ckpt_name, s->c);
+  }
+  return ok;
+}
+
+/*
+  Thread function: write bands in order as they are computed, until
+  there are no more or writing fails.
+*/
+static void *tmg_stream_writer(void *arg) {
+
+  tmg_stream *s = (tmg_stream *)arg;
+  for (;;) {
+    pthread_mutex_lock(&(s->lock));
+    while (s->written == s->computed && !s->done) {
+      pthread_cond_wait(&(s->ready), &(s->lock));
+    }
+    int more = (s->written < s->computed);
+    pthread_mutex_unlock(&(s->lock));
+    if (!more) break;
+
+    int ok = tmg_stream_write_band(s, s->written % TMG_STREAM_BANDS);
+
+    pthread_mutex_lock(&(s->lock));
+    if (!ok) s->failed = 1;
+    s->written++;
+    pthread_cond_signal(&(s->emptied));
+    pthread_mutex_unlock(&(s->lock));
+    if (!ok) break;
+  }
+  return NULL;
+}
+
+/*
+  Compute and write the num_points x num_points matrix between the
+  graph vertices in points, from the .tmg file filename, a band of
+  complete rows at a time, using about memory_budget bytes for all
+  bands in memory at once.  Road distances come from ch if it is not
+  NULL.  When writing to a file, a checkpoint is saved after
+  each band, and if resume is set and a matching checkpoint exists,
+  the run continues after its last completed band.  Binary output
+  always uses 4-byte entries, since the largest entry is not known
+  until the end.  Returns 1 on success, 0 on failure.
+*/
+int tmg_stream_matrix(tmg_graph *g, int *points, int num_points,
+		      char *filename, tmg_metric metric, tmg_ch *ch,
+		      size_t memory_budget, int resume,
+		      tmg_write_options *opts) {
+
+  size_t row_bytes = (size_t)num_points * sizeof(int);
+  int rows_per_band = memory_budget / TMG_STREAM_BANDS / row_bytes;
+  // whole tiles make the great circle bands most efficient
+  if (rows_per_band > TMG_MATRIX_TILE) {
+    rows_per_band -= rows_per_band % TMG_MATRIX_TILE;
+  }
+  if (rows_per_band < 1) rows_per_band = 1;
+  if (rows_per_band > num_points) rows_per_band = num_points;
+
+  // find where to start
+  tmg_checkpoint c;
+  memset(&c, 0, sizeof(tmg_checkpoint));
+  memcpy(c.magic, TMG_CHECKPOINT_MAGIC, sizeof(c.magic));
+  c.version = TMG_CHECKPOINT_VERSION;
+  c.num_points = num_points;
+  c.metric = metric;
+  c.uses_ch = (ch != NULL);
+  c.binary = opts->binary;
+  c.layout = opts->binary ? opts->layout : 0;
+  c.graph_hash = tmg_graph_hash(g);
+  c.points_hash = tmg_points_hash(points, num_points);
+  char *ckpt_name = NULL;
+  int start_row = 0;
+  uint64_t start_offset = 0;
+  if (opts->outfile) {
+    ckpt_name = tmg_checkpoint_name(opts->outfile);
+    tmg_checkpoint saved;
+    if (resume && tmg_checkpoint_load(ckpt_name, &saved)) {
+      if (saved.num_points != c.num_points || saved.metric != c.metric ||
+	  saved.uses_ch != c.uses_ch || saved.binary != c.binary ||
+	  saved.layout != c.layout || saved.graph_hash != c.graph_hash ||
+	  saved.points_hash != c.points_hash) {
+	fprintf(stderr, "Checkpoint %s is for a different graph or options\n",
+		ckpt_name);
+	free(ckpt_name);
+	return 0;
+      }
+      start_row = saved.rows_done;
+      start_offset = saved.output_offset;
+      fprintf(stderr, "Resuming %s after row %d of %d\n", opts->outfile,
+	      start_row, num_points);
+    }
+  }
+  else if (resume) {
+    fprintf(stderr, "Resuming requires an output file\n");
+    return 0;
+  }
+
+  // open the output, back at the end of the last completed band
+  int fd = -1;
+  tsp_matrix_writer *w = NULL;
+  if (opts->binary) {
+    if (start_row > 0) {
+      w = tsp_matrix_writer_resume(opts->outfile, num_points, 4,
+				   opts->layout, start_row);
+    }
+    else {
+      w = tsp_matrix_writer_open(opts->outfile, stdout, num_points, 4,
+				 opts->layout);
+    }
+    if (w == NULL) {
+      free(ckpt_name);
+      return 0;
+    }
+  }
+  else {
+    fd = tmg_write_open_text(opts->outfile, start_row > 0);
+    if (fd < 0) {
+      free(ckpt_name);
+      return 0;
+    }
+  }
+  tmg_output out;
+  tmg_output_init(&out, fd, TMG_OUTPUT_BUFFER_SIZE);
+  int ok = 1;
+  if (!opts->binary) {
+    if (start_row > 0) {
+      ok = (ftruncate(fd, start_offset) == 0 &&
+	    lseek(fd, start_offset, SEEK_SET) == (off_t)start_offset);
+    }
+    else {
+      tmg_output_int(&out, num_points);
+      tmg_output_char(&out, '\n');
+      tmg_output_flush(&out);
+      ok = !out.failed;
+    }
+  }
+
+  tmg_stream s;
+  memset(&s, 0, sizeof(tmg_stream));
+  s.num_points = num_points;
+  s.w = w;
+  s.fd = fd;
+  s.nthreads = opts->nthreads;
+  s.ckpt_name = ckpt_name;
+  s.c = &c;
+  for (int b = 0; b < TMG_STREAM_BANDS; b++) {
+    s.bands[b] = (int *)malloc((size_t)rows_per_band * row_bytes);
+    if (!s.bands[b]) {
+      fprintf(stderr, "Could not allocate a band of %d rows\n",
+	      rows_per_band);
+      ok = 0;
+    }
+  }
+  tmg_ch_query *q = NULL;
+  long unreachable = 0;
+  if (ok && ch && start_row < num_points) {
+    q = tmg_ch_query_create(ch, points, num_points, opts->nthreads);
+    if (!q) ok = 0;
+  }
+
+  pthread_t writer;
+  pthread_mutex_init(&(s.lock), NULL);
+  pthread_cond_init(&(s.ready), NULL);
+  pthread_cond_init(&(s.emptied), NULL);
+  int started = ok && (pthread_create(&writer, NULL, tmg_stream_writer,
+				      &s) == 0);
+  if (ok && !started) {
+    fprintf(stderr, "Could not start output thread\n");
+    ok = 0;
+  }
+
+  for (int first = start_row; ok && first < num_points;
+       first += rows_per_band) {
+    int count = rows_per_band;
+    if (first + count > num_points) count = num_points - first;
+
+    // wait for a buffer the writer is done with
+    pthread_mutex_lock(&(s.lock));
+    while (s.computed - s.written == TMG_STREAM_BANDS && !s.failed) {
+      pthread_cond_wait(&(s.emptied), &(s.lock));
+    }
+    ok = !s.failed;
+    pthread_mutex_unlock(&(s.lock));
+    if (!ok) break;
+
+    int slot = s.computed % TMG_STREAM_BANDS;
+    int *band = s.bands[slot];
+    if (q) {
+      ok = tmg_ch_query_rows(q, first, count, band, opts->nthreads);
+    }
+    else {
+      int u = tmg_matrix_compute_rows(g, points, num_points, first, count,
+				      metric, opts->nthreads, band);
+      if (u < 0) ok = 0;
+      else unreachable += u;
+    }
+    if (!ok) break;
+
+    // hand it to the writer
+    pthread_mutex_lock(&(s.lock));
+    s.band_first[slot] = first;
+    s.band_count[slot] = count;
+    s.computed++;
+    pthread_cond_signal(&(s.ready));
+    pthread_mutex_unlock(&(s.lock));
+  }
+
+  // let the writer finish the bands already computed
+  if (started) {
+    pthread_mutex_lock(&(s.lock));
+    s.done = 1;
+    pthread_cond_signal(&(s.ready));
+    pthread_mutex_unlock(&(s.lock));
+    pthread_join(writer, NULL);
+    if (s.failed) ok = 0;
+  }
+  pthread_mutex_destroy(&(s.lock));
+  pthread_cond_destroy(&(s.ready));
+  pthread_cond_destroy(&(s.emptied));
+
+  if (q) tmg_ch_query_destroy(q);
+  for (int b = 0; b < TMG_STREAM_BANDS; b++) {
+    free(s.bands[b]);
+  }
+  if (unreachable) {
+    fprintf(stderr, "Warning: %ld pairs of points have no road connection, "
+	    "using distance %d\n", (unreachable+1)/2, TMG_MATRIX_UNREACHABLE);
+  }
+
+  // then everything after the rows
+  if (opts->binary) {
+    ok = ok && tmg_write_binary_labels(w, g, points, num_points);
+    ok = tsp_matrix_writer_close(w) && ok;
+  }
+  else {
+    if (ok) tmg_write_text_trailer(&out, g, points, num_points, filename);
+    else out.len = 0;
+  }
+  ok = tmg_output_close(&out) && ok;
+  if (fd >= 0 && opts->outfile && close(fd) != 0) ok = 0;
+
+  // a finished run needs no checkpoint, a failed one keeps its last
+  if (ok && ckpt_name && unlink(ckpt_name) != 0 && errno != ENOENT) {
+    fprintf(stderr, "Could not remove checkpoint file %s\n", ckpt_name);
+  }
+  free(ckpt_name);
+  return ok;
+}
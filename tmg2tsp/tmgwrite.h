@@ -0,0 +1,84 @@
+/*
+  Structure definitions and function prototypes for writing the TSP
+  distance matrix files computed from a METAL TMG graph, either from a
+  matrix in memory or streamed a band of rows at a time.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TMGWRITE_H
+#define _TMGWRITE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tmggraph.h"
+#include "tmgmatrix.h"
+#include "tmgch.h"
+#include "tspmatrix.h"
+
+// A k-nearest-neighbor file is text: the number of points n and the
+// number of neighbors k, then a line for each point listing its k
+// nearest other points, closest first, as point number (counting
+// from 0, as the matrix rows do) and distance in tenths of a mile
+// pairs, each followed by a tab, then the same waypoint list and
+// footer as a matrix text file.
+
+// A tour file is text: the number of points and the tour's length in
+// tenths of a mile, then a line for each stop of the tour, starting
+// at point 0 and ending back there, with the point's number and its
+// waypoint separated by a tab, as tspsolve prints tours, then a blank
+// line and the same line naming the .tmg file as a matrix text file.
+
+// identifies a streaming checkpoint file, and its layout version
+#define TMG_CHECKPOINT_MAGIC "TMGCKPT\n"
+#define TMG_CHECKPOINT_VERSION 2
+
+// appended to the output file name to name its checkpoint file
+#define TMG_CHECKPOINT_SUFFIX ".ckpt"
+
+// bands of rows a streamed matrix keeps in memory: one can be written
+// while the next is computed
+#define TMG_STREAM_BANDS 2
+
+// where and how a matrix is written
+typedef struct tmg_write_options {
+  char *outfile;  // NULL for stdout
+  int binary;     // binary format of tspmatrix.h instead of text
+  tsp_layout layout;  // for binary output
+  int nthreads;
+} tmg_write_options;
+
+// the progress of a streamed matrix, saved after each completed band
+// so an interrupted run can pick up where it left off
+typedef struct tmg_checkpoint {
+  char magic[8];
+  uint32_t version;
+  int32_t num_points;
+  int32_t metric;
+  int32_t uses_ch;  // road distances from a contraction hierarchy?
+  int32_t binary;
+  int32_t layout;
+  int32_t rows_done;
+  int32_t pad;
+  uint64_t graph_hash;
+  uint64_t points_hash;  // tmg_points_hash of the selected points
+  uint64_t output_offset;  // bytes of output through the last row done
+} tmg_checkpoint;
+
+// function prototypes
+extern int tmg_write_matrix(tmg_graph *g, int *points, int *matrix,
+			    int num_points, char *filename,
+			    tmg_write_options *opts);
+extern int tmg_write_knn(tmg_graph *g, int *points, int num_points, int k,
+			 int *neighbors, int *tenths, char *filename,
+			 tmg_write_options *opts);
+extern int tmg_write_tour(tmg_graph *g, int *points, int num_points,
+			  int *tour, long length, char *filename,
+			  tmg_write_options *opts);
+extern int tmg_stream_matrix(tmg_graph *g, int *points, int num_points,
+			     char *filename, tmg_metric metric, tmg_ch *ch,
+			     size_t memory_budget, int resume,
+			     tmg_write_options *opts);
+
+#endif  // _TMGWRITE_H
@@ -0,0 +1,387 @@
+/*
+  An exact TSP solver: depth-first branch and bound over partial
+  tours starting at point 0, in parallel with pthreads.
+
+  Each thread keeps the partial tours it has yet to search in its own
+  deque.  It expands the deepest one, pushing its extensions nearest
+  point last so that is searched next, which finds good tours early.
+  A thread with nothing left steals the shallowest partial tour of
+  another thread, the one likely to have the most work under it.
+  The length of the best tour found so far is shared by all threads
+  in an atomic variable, read without locking to prune.
+
+  Two lower bounds on the completions of a partial tour are used,
+  whichever is larger.  Each point that must still be left (the last
+  point and every unvisited point) needs an edge out, so the cost can
+  grow by no less than the sum of their shortest edges out.  Counting
+  each edge still to come at both of its ends, it also grows by no
+  less than half of the shortest edge out of the last point, the
+  shortest into point 0, and for each unvisited point the two
+  shortest edges that can meet there: its two shortest to different
+  points if the matrix is symmetric, otherwise its shortest in and
+  shortest out.  The sums over the unvisited points are carried in
+  each partial tour and updated as points are added, so bounding an
+  extension costs a few additions.  The search starts from the
+  length of the tour it is given, so a good starting tour prunes from
+  the beginning, and ends as soon as it finds a tour no longer than a
+  known lower bound, if it is given one.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tspbnb.h"
+#include "tsptour.h"
+
+// the state shared by all threads of one search
+typedef struct tsp_bnb_search {
+  const int *dist;
+  int n;
+  int nthreads;
+  int *min_out;  // shortest edge out of each point
+  int *min_both;  // shortest two edges that can meet at each point
+  int min_in_start;  // shortest edge into point 0
+  int *order;    // for each point, all points from nearest to farthest
+  tsp_bnb_deque *deques;
+  tsp_bnb_stats *stats;  // for each thread
+  atomic_long best;
+  long lower;  // no tour is shorter, so one this long is optimal
+  atomic_long pending;  // partial tours pushed but not yet expanded
+  atomic_int failed;
+  pthread_mutex_t best_lock;
+  int *best_tour;
+} tsp_bnb_search;
+
+// what each thread is given
+typedef struct tsp_bnb_thread {
+  tsp_bnb_search *search;
+  int id;
+} tsp_bnb_thread;
+
+/* add node at the tail of d, 0 if out of memory */
+static int tsp_bnb_push(tsp_bnb_deque *d, tsp_bnb_node *node) {
+
+  int ok = 1;
+  pthread_mutex_lock(&(d->lock));
+  if (d->head == d->tail) {
+    d->head = d->tail = 0;
+  }
+  if (d->tail == d->size) {
+    int size = d->size ? 2 * d->size : 256;
+    tsp_bnb_node *nodes =
+      (tsp_bnb_node *)realloc(d->nodes, size * sizeof(tsp_bnb_node));
+    if (nodes) {
+      d->nodes = nodes;
+      d->size = size;
+    }
+    else {
+      ok = 0;
+    }
+  }
+  if (ok) d->nodes[d->tail++] = *node;
+  pthread_mutex_unlock(&(d->lock));
+  return ok;
+}
+
+/* take the node at the tail of d into node, 0 if it is empty */
+static int tsp_bnb_pop(tsp_bnb_deque *d, tsp_bnb_node *node) {
+
+  int found = 0;
+  pthread_mutex_lock(&(d->lock));
+  if (d->head < d->tail) {
+    *node = d->nodes[--d->tail];
+    found = 1;
+  }
+  pthread_mutex_unlock(&(d->lock));
+  return found;
+}
+
+/*
+  Take the node at the head of the first other thread's deque that
+  has one into node, 0 if none do.
+*/
+static int tsp_bnb_steal(tsp_bnb_search *s, int self, tsp_bnb_node *node) {
+
+  for (int i = 1; i < s->nthreads; i++) {
+    tsp_bnb_deque *d = &(s->deques[(self + i) % s->nthreads]);
+    int found = 0;
+    pthread_mutex_lock(&(d->lock));
+    if (d->head < d->tail) {
+      *node = d->nodes[d->head++];
+      found = 1;
+    }
+    pthread_mutex_unlock(&(d->lock));
+    if (found) return 1;
+  }
+  return 0;
+}
+
+/*
+  Record the tour that completes node by going to point last, of the
+  given length, if it is still the best.
+*/
+static void tsp_bnb_improve(tsp_bnb_search *s, tsp_bnb_stats *stats,
+			    tsp_bnb_node *node, int last, long length) {
+
+  pthread_mutex_lock(&(s->best_lock));
+  if (length < atomic_load(&(s->best))) {
+    for (int i = 0; i < node->depth; i++) {
+      s->best_tour[i] = node->points[i];
+    }
+    s->best_tour[node->depth] = last;
+    atomic_store(&(s->best), length);
+    stats->improvements++;
+  }
+  pthread_mutex_unlock(&(s->best_lock));
+}
+
+/*
+  Expand a partial tour: complete it if only one point is left,
+  otherwise push each extension whose bound beats the best tour onto
+  deque d.  Counts what it does in stats.
+*/
+static void tsp_bnb_expand(tsp_bnb_search *s, tsp_bnb_deque *d,
+			   tsp_bnb_stats *stats, tsp_bnb_node *node) {
+
+  int n = s->n;
+  int last = node->points[node->depth - 1];
+  const int *row = s->dist + (size_t)last * n;
+  long best = atomic_load_explicit(&(s->best), memory_order_relaxed);
+  stats->nodes++;
+
+  if (node->depth == n - 1) {
+    uint64_t all = (n == 64) ? ~0ULL : (1ULL << n) - 1;
+    int c = __builtin_ctzll(all & ~node->visited);
+    long length = node->cost + row[c] + s->dist[(size_t)c * n];
+    if (length < best) tsp_bnb_improve(s, stats, node, c, length);
+    return;
+  }
+
+  // farthest first, so the nearest is on top
+  const int *order = s->order + (size_t)last * n;
+  tsp_bnb_node child;
+  for (int k = n - 1; k >= 0; k--) {
+    int c = order[k];
+    if (node->visited & (1ULL << c)) continue;
+    long cost = node->cost + row[c];
+    // rest_out already counts an edge out of c
+    if (cost + node->rest_out >= best) continue;
+    long both = node->rest_both - s->min_both[c];
+    if (cost + (s->min_out[c] + both + s->min_in_start + 1) / 2 >= best) {
+      continue;
+    }
+    memcpy(&child, node, sizeof(tsp_bnb_node));
+    child.visited |= 1ULL << c;
+    child.cost = cost;
+    child.rest_out -= s->min_out[c];
+    child.rest_both = both;
+    child.points[child.depth++] = c;
+    atomic_fetch_add(&(s->pending), 1);
+    if (!tsp_bnb_push(d, &child)) {
+      atomic_store(&(s->failed), 1);
+      return;
+    }
+  }
+}
+
+/* thread function: search until no partial tours are left anywhere */
+static void *tsp_bnb_worker(void *arg) {
+
+  tsp_bnb_thread *t = (tsp_bnb_thread *)arg;
+  tsp_bnb_search *s = t->search;
+  tsp_bnb_node node;
+  // counted here rather than in the shared array, so threads do not
+  // write to the same cache lines for every node
+  tsp_bnb_stats stats;
+  memset(&stats, 0, sizeof(tsp_bnb_stats));
+  for (;;) {
+    if (atomic_load_explicit(&(s->best), memory_order_relaxed) <= s->lower) {
+      break;
+    }
+    if (!tsp_bnb_pop(&(s->deques[t->id]), &node)) {
+      if (!tsp_bnb_steal(s, t->id, &node)) {
+	// others may still push work, unless all of it is done
+	if (atomic_load(&(s->pending)) == 0 || atomic_load(&(s->failed))) {
+	  break;
+	}
+	sched_yield();
+	continue;
+      }
+      stats.steals++;
+    }
+    tsp_bnb_expand(s, &(s->deques[t->id]), &stats, &node);
+    atomic_fetch_sub(&(s->pending), 1);
+  }
+  s->stats[t->id] = stats;
+  return NULL;
+}
+
+/*
+  Find an optimal tour of the n points whose distances are in dist,
+  using nthreads threads.  On entry, tour holds a tour whose length
+  is the starting bound, and on return it holds an optimal one.  lower
+  is a lower bound on the length of any tour (0 if none is known), at
+  which the search stops.  Statistics are summed over all threads into
+  stats.  Returns the optimal length, -1 if there are too many points
+  or not enough memory.
+*/
+long tsp_bnb_solve(const int *dist, int n, int nthreads, long lower,
+		   int *tour, tsp_bnb_stats *stats) {
+
+  int i, j, k;
+  memset(stats, 0, sizeof(tsp_bnb_stats));
+  if (n > TSP_BNB_MAX_POINTS) {
+    fprintf(stderr, "Branch and bound is limited to %d points\n",
+	    TSP_BNB_MAX_POINTS);
+    return -1;
+  }
+  long length = tsp_tour_length(dist, n, tour);
+  // there is only one tour of fewer than 3 points, and none shorter
+  // than the lower bound
+  if (n < 3 || length <= lower) return length;
+  if (nthreads < 1) nthreads = 1;
+
+  tsp_bnb_search s;
+  s.dist = dist;
+  s.n = n;
+  s.nthreads = nthreads;
+  s.lower = lower;
+  s.min_out = (int *)malloc(n * sizeof(int));
+  s.min_both = (int *)malloc(n * sizeof(int));
+  s.order = (int *)malloc((size_t)n * n * sizeof(int));
+  s.deques = (tsp_bnb_deque *)calloc(nthreads, sizeof(tsp_bnb_deque));
+  s.stats = (tsp_bnb_stats *)calloc(nthreads, sizeof(tsp_bnb_stats));
+  s.best_tour = (int *)malloc(n * sizeof(int));
+  tsp_bnb_thread *threads =
+    (tsp_bnb_thread *)malloc(nthreads * sizeof(tsp_bnb_thread));
+  pthread_t *tids = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+  if (!s.min_out || !s.min_both || !s.order || !s.deques || !s.stats || !s.best_tour ||
+      !threads || !tids) {
+    fprintf(stderr, "Could not allocate search of %d points\n", n);
+    free(s.min_out);
+    free(s.min_both);
+    free(s.order);
+    free(s.deques);
+    free(s.stats);
+    free(s.best_tour);
+    free(threads);
+    free(tids);
+    return -1;
+  }
+
+  // the points by distance from each point, sorted by insertion
+  // since there are few
+  int symmetric = 1;
+  for (i = 0; i < n; i++) {
+    const int *row = dist + (size_t)i * n;
+    int *order = s.order + (size_t)i * n;
+    for (j = 0; j < n; j++) {
+      if (row[j] != dist[(size_t)j * n + i]) symmetric = 0;
+      for (k = j; k > 0 && row[order[k - 1]] > row[j]; k--) {
+	order[k] = order[k - 1];
+      }
+      order[k] = j;
+    }
+  }
+
+  // the shortest edges at each point, and their sums over the points
+  // other than 0
+  long rest_out = 0;
+  long rest_both = 0;
+  s.min_in_start = -1;
+  for (i = 0; i < n; i++) {
+    int *order = s.order + (size_t)i * n;
+    // the nearest two points other than i itself
+    int near[2], count = 0;
+    for (j = 0; count < 2 && j < n; j++) {
+      if (order[j] != i) near[count++] = order[j];
+    }
+    const int *row = dist + (size_t)i * n;
+    s.min_out[i] = row[near[0]];
+    int min_in = -1;
+    for (j = 0; j < n; j++) {
+      int d = dist[(size_t)j * n + i];
+      if (j != i && (min_in < 0 || d < min_in)) min_in = d;
+    }
+    if (symmetric) {
+      s.min_both[i] = row[near[0]] + row[near[1]];
+    }
+    else {
+      s.min_both[i] = s.min_out[i] + min_in;
+    }
+    if (i == 0) {
+      s.min_in_start = min_in;
+    }
+    else {
+      rest_out += s.min_out[i];
+      rest_both += s.min_both[i];
+    }
+  }
+
+  memcpy(s.best_tour, tour, n * sizeof(int));
+  atomic_init(&(s.best), length);
+  atomic_init(&(s.pending), 1);
+  atomic_init(&(s.failed), 0);
+  pthread_mutex_init(&(s.best_lock), NULL);
+  for (i = 0; i < nthreads; i++) {
+    pthread_mutex_init(&(s.deques[i].lock), NULL);
+    threads[i].search = &s;
+    threads[i].id = i;
+  }
+
+  // everything starts under thread 0, the calling thread, and the
+  // others steal from it
+  tsp_bnb_node root;
+  memset(&root, 0, sizeof(tsp_bnb_node));
+  root.visited = 1;
+  root.rest_out = rest_out;
+  root.rest_both = rest_both;
+  root.depth = 1;
+  int ok = tsp_bnb_push(&(s.deques[0]), &root);
+  if (ok) {
+    // the deques of any threads that could not be started stay empty,
+    // and the others never wait for them
+    int started = 1;
+    while (started < nthreads &&
+	   pthread_create(&tids[started], NULL, tsp_bnb_worker,
+			  &threads[started]) == 0) {
+      started++;
+    }
+    tsp_bnb_worker(&threads[0]);
+    for (i = 1; i < started; i++) {
+      pthread_join(tids[i], NULL);
+    }
+    ok = !atomic_load(&(s.failed));
+  }
+  if (!ok) {
+    fprintf(stderr, "Could not allocate partial tours for search of %d points\n",
+	    n);
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    stats->nodes += s.stats[i].nodes;
+    stats->steals += s.stats[i].steals;
+    stats->improvements += s.stats[i].improvements;
+    pthread_mutex_destroy(&(s.deques[i].lock));
+    free(s.deques[i].nodes);
+  }
+  pthread_mutex_destroy(&(s.best_lock));
+  length = atomic_load(&(s.best));
+  memcpy(tour, s.best_tour, n * sizeof(int));
+
+  free(s.min_out);
+  free(s.min_both);
+  free(s.order);
+  free(s.deques);
+  free(s.stats);
+  free(s.best_tour);
+  free(threads);
+  free(tids);
+  return ok ? length : -1;
+}
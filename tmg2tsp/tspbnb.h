@@ -0,0 +1,53 @@
+/*
+  Structure definitions and function prototypes for an exact TSP
+  solver: a parallel depth-first branch-and-bound search of partial
+  tours, like the tree search programs of Pacheco, Ch. 6.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TSPBNB_H
+#define _TSPBNB_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+// the visited points of a partial tour are the bits of one word
+#define TSP_BNB_MAX_POINTS 64
+
+// a partial tour: points[0..depth-1], starting at point 0
+typedef struct tsp_bnb_node {
+  uint64_t visited;
+  long cost;  // of the edges between the points so far
+  // sums over the unvisited points of the shortest edge out of each,
+  // and of the shortest two edges that could meet at each
+  long rest_out;
+  long rest_both;
+  int depth;
+  unsigned char points[TSP_BNB_MAX_POINTS];
+} tsp_bnb_node;
+
+// the partial tours waiting to be searched by one thread: the thread
+// itself takes the deepest from the tail, a thief the shallowest,
+// with the largest subtree, from the head
+typedef struct tsp_bnb_deque {
+  pthread_mutex_t lock;
+  tsp_bnb_node *nodes;
+  int head;
+  int tail;
+  int size;
+} tsp_bnb_deque;
+
+// what a search did
+typedef struct tsp_bnb_stats {
+  long nodes;   // partial tours expanded
+  long steals;  // partial tours taken from other threads
+  long improvements;  // times a better tour was found
+} tsp_bnb_stats;
+
+// function prototypes
+extern long tsp_bnb_solve(const int *dist, int n, int nthreads, long lower,
+			  int *tour, tsp_bnb_stats *stats);
+
+#endif  // _TSPBNB_H
@@ -0,0 +1,149 @@
+/*
+  Compute lower bounds on the length of tours of a TSP instance in
+  the distance matrix formats of tspmatrix.h, and write them as a
+  bound certificate that tspsolve --bound can load.
+
+  The bounds are for the symmetric instance with the shorter of the
+  two distances between each pair of points, which no tour of the
+  instance itself can beat either way around.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "tspmatrix.h"
+#include "tspheuristic.h"
+#include "tsplowerbound.h"
+
+static void usage(char *progname) {
+
+  fprintf(stderr, "Usage: %s [-j nthreads] [--iterations N] [--knn K] [-o certfile]\n       file\n", progname);
+}
+
+// the matrix, and whether it can be read either way around
+typedef struct bound_matrix {
+  tsp_matrix *m;
+  int symmetric;
+} bound_matrix;
+
+/* tsp_bound_distance: the shorter of the distances between a and b */
+static int bound_distance(void *data, int a, int b) {
+
+  bound_matrix *bm = (bound_matrix *)data;
+  int d = tsp_matrix_get(bm->m, a, b);
+  if (bm->symmetric) return d;
+  int back = tsp_matrix_get(bm->m, b, a);
+  return (back < d) ? back : d;
+}
+
+int main(int argc, char *argv[]) {
+
+  long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+  int nthreads = (nprocs < 1) ? 1 : (int)nprocs;
+  int iterations = TSP_BOUND_ITERATIONS;
+  int knn = 0;
+  char *outfile = NULL;
+  int opt;
+
+  static struct option long_options[] = {
+    { "iterations", required_argument, NULL, 'i' },
+    { "knn", required_argument, NULL, 'k' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  while ((opt = getopt_long(argc, argv, "j:o:", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'j':
+      nthreads = atoi(optarg);
+      if (nthreads < 1) {
+	fprintf(stderr, "Number of threads must be at least 1\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'i':
+      iterations = atoi(optarg);
+      if (iterations < 1) {
+	fprintf(stderr, "Number of iterations must be at least 1\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'k':
+      // build trees from edges to this many nearest neighbors only, an
+      // estimate for instances too large to bound over all pairs
+      knn = atoi(optarg);
+      if (knn < 2) {
+	fprintf(stderr, "Number of neighbors must be at least 2\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'o':
+      outfile = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  if (argc - optind != 1) {
+    usage(argv[0]);
+    exit(1);
+  }
+  char *filename = argv[optind];
+  tsp_matrix *m = tsp_matrix_load(filename);
+  if (m == NULL) exit(1);
+  int n = m->n;
+  if (knn >= n) {
+    fprintf(stderr, "Number of neighbors must be less than number of points\n");
+    tsp_matrix_close(m);
+    exit(1);
+  }
+
+  // a good tour for the subgradient steps to aim at
+  int *tour = (int *)malloc(n * sizeof(int));
+  int *neighbors = knn ? (int *)malloc((size_t)n * knn * sizeof(int)) : NULL;
+  bound_matrix bm = { m, tsp_matrix_is_symmetric(m) };
+  tsp_heur_stats stats;
+  tsp_bound *b = NULL;
+  long length = -1;
+  int ok = tour && (!knn || neighbors);
+  if (!ok) {
+    fprintf(stderr, "Could not allocate bounds for %d points\n", n);
+  }
+  if (ok) {
+    length = tsp_heur_matrix_tour(m, TSP_HEUR_GREEDY, TSP_HEUR_NEIGHBORS,
+				  nthreads, tour, &stats);
+    ok = (length >= 0);
+  }
+  if (ok && knn) {
+    ok = tsp_heur_neighbors(bound_distance, &bm, n, knn, nthreads, neighbors);
+  }
+  if (ok) {
+    tsp_bound_instance inst = { n, bound_distance, &bm, knn, neighbors };
+    b = tsp_bound_compute(&inst, length, iterations, nthreads);
+    ok = (b != NULL);
+  }
+  if (ok) {
+    long best = tsp_bound_best(b);
+    fprintf(stderr, "%s: %d points, spanning tree bound %ld, 1-tree bound %ld after %d iterations%s\n",
+	    filename, n, b->mst, b->one_tree, b->iterations,
+	    b->exact ? "" : " (estimated from nearest neighbors)");
+    fprintf(stderr, "Tour of length %ld is within %.2f%% of the bound\n",
+	    length, best > 0 ? 100.0 * (length - best) / best : 0.0);
+    ok = tsp_bound_write(outfile, b, filename);
+  }
+
+  if (b) tsp_bound_destroy(b);
+  free(tour);
+  free(neighbors);
+  tsp_matrix_close(m);
+  return ok ? 0 : 1;
+}
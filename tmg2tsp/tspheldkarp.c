@@ -0,0 +1,358 @@
+/*
+  The Held-Karp dynamic program for exact TSP tours of small
+  instances, in parallel with pthreads.
+
+  With point 0 as the start, the cost of the cheapest path from point
+  0 through every point of a subset S of the other points, ending at
+  point j of S, is the smallest, over the other points i of S, of the
+  cost for S without j ending at i, plus the distance from i to j.
+  The costs for subsets of size k need only those of size k-1, so the
+  table is laid out a layer per subset size, in the order of the
+  combinatorial number system (which is the numeric order of the
+  subsets' bitmasks), each subset holding just the costs of ending at
+  its own points.  Only two layers of costs are kept at once, with a
+  byte per entry recording the best i, from which the tour is traced
+  back at the end.
+
+  The subsets of a layer are independent, so threads claim chunks of
+  them from a shared counter and wait at a barrier before the next
+  layer.  The minimum over i for one entry is the minimum of two
+  contiguous arrays added together: the costs of S without j, and the
+  distances into j from its points, gathered once.  It is computed 8
+  (AVX2) or 4 (SSE2) at a time, falling back to scalar code for the
+  remainder or when neither is available.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "tspheldkarp.h"
+#include "tsptour.h"
+
+// the state shared by all threads working on one table
+typedef struct tsp_hk_work {
+  int n;
+  int m;  // points other than point 0, numbered from 0 in subsets
+  // dist_in[j*m + i] is the distance into point j+1 from point i+1
+  int *dist_in;
+  size_t *binom;  // binom[a*(m+1) + b] is a choose b
+  int *layers[2];  // costs for subsets of the current size and the last
+  unsigned char *parents;  // the best i of every entry of every layer
+  size_t *parent_offsets;  // where each layer starts in parents
+  atomic_size_t *next;  // next subset to claim in each layer
+  // held while threads are started, so none reaches the barrier
+  // before it is set up for the number that actually started
+  pthread_mutex_t start;
+  pthread_barrier_t barrier;
+} tsp_hk_work;
+
+/* a choose b */
+static size_t tsp_hk_binom(tsp_hk_work *w, int a, int b) {
+
+  return w->binom[a * (w->m + 1) + b];
+}
+
+/* the rank of subset s among those of its size */
+static size_t tsp_hk_rank(tsp_hk_work *w, uint32_t s) {
+
+  size_t rank = 0;
+  int t = 0;
+  while (s) {
+    int b = __builtin_ctz(s);
+    rank += tsp_hk_binom(w, b, ++t);
+    s &= s - 1;
+  }
+  return rank;
+}
+
+/* the subset of size k of the given rank */
+static uint32_t tsp_hk_unrank(tsp_hk_work *w, size_t rank, int k) {
+
+  uint32_t s = 0;
+  int b = w->m - 1;
+  for (int t = k; t > 0; t--) {
+    // the largest b with b choose t at most what is left
+    while (tsp_hk_binom(w, b, t) > rank) b--;
+    s |= 1U << b;
+    rank -= tsp_hk_binom(w, b, t);
+    b--;
+  }
+  return s;
+}
+
+/*
+  The smallest of vals[t] + dist[t] for t < count, count at least 1,
+  setting arg to the first t where it occurs.  The sums are left in
+  sums.
+*/
+static int tsp_hk_min(const int *vals, const int *dist, int count,
+		      int *sums, int *arg) {
+
+  int best = INT_MAX;
+  int t = 0;
+
+#if defined(__AVX2__)
+  int lanes[8];
+  __m256i vbest = _mm256_set1_epi32(INT_MAX);
+  for (; t + 8 <= count; t += 8) {
+    __m256i s = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(vals+t)),
+				 _mm256_loadu_si256((const __m256i *)(dist+t)));
+    _mm256_storeu_si256((__m256i *)(sums+t), s);
+    vbest = _mm256_min_epi32(vbest, s);
+  }
+  _mm256_storeu_si256((__m256i *)lanes, vbest);
+  for (int l = 0; l < 8; l++) {
+    if (lanes[l] < best) best = lanes[l];
+  }
+#elif defined(__SSE2__)
+  int lanes[4];
+  __m128i vbest = _mm_set1_epi32(INT_MAX);
+  for (; t + 4 <= count; t += 4) {
+    __m128i s = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(vals+t)),
+			      _mm_loadu_si128((const __m128i *)(dist+t)));
+    _mm_storeu_si128((__m128i *)(sums+t), s);
+    // SSE2 has no integer minimum, so select by comparison
+    __m128i less = _mm_cmplt_epi32(s, vbest);
+    vbest = _mm_or_si128(_mm_and_si128(less, s),
+			 _mm_andnot_si128(less, vbest));
+  }
+  _mm_storeu_si128((__m128i *)lanes, vbest);
+  for (int l = 0; l < 4; l++) {
+    if (lanes[l] < best) best = lanes[l];
+  }
+#endif
+  for (; t < count; t++) {
+    sums[t] = vals[t] + dist[t];
+    if (sums[t] < best) best = sums[t];
+  }
+
+  for (t = 0; sums[t] != best; t++);
+  *arg = t;
+  return best;
+}
+
+/*
+  Compute the entries of the count subsets of size k starting at rank
+  first, from those of size k-1.
+*/
+static void tsp_hk_subsets(tsp_hk_work *w, int k, size_t first,
+			   size_t count) {
+
+  int *cur = w->layers[k % 2];
+  int *prev = w->layers[(k - 1) % 2];
+  unsigned char *parents = w->parents + w->parent_offsets[k];
+  int members[32];
+  size_t before[32];  // rank contributed by the members before each
+  size_t after[32];   // rank contributed by those after, shifted down
+  int in[32];
+  int sums[32];
+
+  uint32_t s = tsp_hk_unrank(w, first, k);
+  for (size_t r = first; r < first + count; r++) {
+    int t = 0;
+    for (uint32_t bits = s; bits; bits &= bits - 1) {
+      members[t++] = __builtin_ctz(bits);
+    }
+    before[0] = 0;
+    for (t = 1; t < k; t++) {
+      before[t] = before[t-1] + tsp_hk_binom(w, members[t-1], t);
+    }
+    after[k-1] = 0;
+    for (t = k - 2; t >= 0; t--) {
+      after[t] = after[t+1] + tsp_hk_binom(w, members[t+1], t+1);
+    }
+
+    for (int p = 0; p < k; p++) {
+      int j = members[p];
+      const int *dist = w->dist_in + (size_t)j * w->m;
+      const int *vals = prev + (before[p] + after[p]) * (k - 1);
+      for (t = 0; t < p; t++) in[t] = dist[members[t]];
+      for (t = p + 1; t < k; t++) in[t-1] = dist[members[t]];
+      int arg;
+      cur[r * k + p] = tsp_hk_min(vals, in, k - 1, sums, &arg);
+      parents[r * k + p] = members[arg < p ? arg : arg + 1];
+    }
+
+    // the next subset of the same size, in numeric order
+    uint32_t low = s & -s;
+    uint32_t ripple = s + low;
+    s = (((ripple ^ s) >> 2) / low) | ripple;
+  }
+}
+
+/*
+  Thread function: compute layers 2 through m, claiming chunks of
+  subsets of each until none are left, then waiting for the others.
+*/
+static void *tsp_hk_worker(void *arg) {
+
+  tsp_hk_work *w = (tsp_hk_work *)arg;
+  pthread_mutex_lock(&(w->start));
+  pthread_mutex_unlock(&(w->start));
+  for (int k = 2; k <= w->m; k++) {
+    size_t total = tsp_hk_binom(w, w->m, k);
+    size_t first;
+    while ((first = atomic_fetch_add(&(w->next[k]), TSP_HK_CHUNK)) < total) {
+      size_t count = total - first;
+      if (count > TSP_HK_CHUNK) count = TSP_HK_CHUNK;
+      tsp_hk_subsets(w, k, first, count);
+    }
+    pthread_barrier_wait(&(w->barrier));
+  }
+  return NULL;
+}
+
+/*
+  Find an optimal tour of the n points whose distances are in dist,
+  at most TSP_HK_MAX_POINTS of them, using nthreads threads.  The
+  tour is stored in tour, and what it took in stats.  Returns the
+  optimal length, -1 if there are too many points, distances too
+  large to sum in an int, or not enough memory.
+*/
+long tsp_held_karp_solve(const int *dist, int n, int nthreads, int *tour,
+			 tsp_hk_stats *stats) {
+
+  int i, j, k;
+  memset(stats, 0, sizeof(tsp_hk_stats));
+  if (n > TSP_HK_MAX_POINTS) {
+    fprintf(stderr, "Held-Karp is limited to %d points\n", TSP_HK_MAX_POINTS);
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    tour[i] = i;
+  }
+  if (n < 3) return tsp_tour_length(dist, n, tour);
+
+  // every sum the table holds is at most n of the largest distance
+  long largest = 0;
+  for (size_t e = 0; e < (size_t)n * n; e++) {
+    if (dist[e] < 0) {
+      fprintf(stderr, "Held-Karp needs distances that are not negative\n");
+      return -1;
+    }
+    if (dist[e] > largest) largest = dist[e];
+  }
+  if (largest * n >= INT_MAX) {
+    fprintf(stderr, "Distances are too large for Held-Karp\n");
+    return -1;
+  }
+
+  tsp_hk_work w;
+  int m = n - 1;
+  w.n = n;
+  w.m = m;
+  w.dist_in = (int *)malloc((size_t)m * m * sizeof(int));
+  w.binom = (size_t *)calloc((m + 1) * (m + 1), sizeof(size_t));
+  w.parent_offsets = (size_t *)malloc((m + 2) * sizeof(size_t));
+  w.next = (atomic_size_t *)malloc((m + 1) * sizeof(atomic_size_t));
+  w.layers[0] = w.layers[1] = NULL;
+  w.parents = NULL;
+  int ok = (w.dist_in && w.binom && w.parent_offsets && w.next);
+  if (ok) {
+    for (i = 0; i < m; i++) {
+      for (j = 0; j < m; j++) {
+	w.dist_in[(size_t)j * m + i] = dist[(size_t)(i + 1) * n + j + 1];
+      }
+    }
+    for (i = 0; i <= m; i++) {
+      w.binom[i * (m + 1)] = 1;
+      for (j = 1; j <= i; j++) {
+	w.binom[i * (m + 1) + j] = w.binom[(i - 1) * (m + 1) + j - 1] +
+	  (j < i ? w.binom[(i - 1) * (m + 1) + j] : 0);
+      }
+    }
+
+    // the largest layer sets the size of both cost buffers
+    size_t widest = 0;
+    w.parent_offsets[0] = w.parent_offsets[1] = 0;
+    for (k = 1; k <= m; k++) {
+      size_t entries = tsp_hk_binom(&w, m, k) * k;
+      if (entries > widest) widest = entries;
+      w.parent_offsets[k + 1] = w.parent_offsets[k] + entries;
+      atomic_init(&(w.next[k]), 0);
+    }
+    stats->states = w.parent_offsets[m + 1];
+    stats->bytes = 2 * widest * sizeof(int) + stats->states;
+    w.layers[0] = (int *)malloc(widest * sizeof(int));
+    w.layers[1] = (int *)malloc(widest * sizeof(int));
+    w.parents = (unsigned char *)malloc(stats->states);
+    ok = (w.layers[0] && w.layers[1] && w.parents);
+  }
+  if (!ok) {
+    fprintf(stderr, "Could not allocate Held-Karp table for %d points\n", n);
+  }
+
+  long length = -1;
+  if (ok) {
+    // paths of one edge, from point 0
+    for (j = 0; j < m; j++) {
+      w.layers[1][j] = dist[j + 1];
+      w.parents[w.parent_offsets[1] + j] = 0;
+    }
+
+    // the calling thread is worker 0, and does all of the work if no
+    // others can be started; the barrier waits for those that were
+    if (nthreads < 1) nthreads = 1;
+    pthread_t *threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    pthread_mutex_init(&(w.start), NULL);
+    pthread_mutex_lock(&(w.start));
+    int started = 1;
+    while (threads && started < nthreads &&
+	   pthread_create(&threads[started], NULL, tsp_hk_worker, &w) == 0) {
+      started++;
+    }
+    pthread_barrier_init(&(w.barrier), NULL, started);
+    pthread_mutex_unlock(&(w.start));
+    tsp_hk_worker(&w);
+    for (i = 1; i < started; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_barrier_destroy(&(w.barrier));
+    pthread_mutex_destroy(&(w.start));
+
+    // close the cheapest path through everything, then trace back
+    // from its last point
+    const int *full = w.layers[m % 2];
+    int last = 0;
+    for (j = 0; j < m; j++) {
+      long len = (long)full[j] + dist[(size_t)(j + 1) * n];
+      if (length < 0 || len < length) {
+	length = len;
+	last = j;
+      }
+    }
+    uint32_t s = (m == 32) ? ~0U : (1U << m) - 1;
+    for (k = m; k >= 1; k--) {
+      tour[k] = last + 1;
+      size_t rank = tsp_hk_rank(&w, s);
+      int pos = __builtin_popcount(s & ((1U << last) - 1));
+      int prev = w.parents[w.parent_offsets[k] + rank * k + pos];
+      s &= ~(1U << last);
+      last = prev;
+    }
+    tour[0] = 0;
+  }
+
+  free(w.dist_in);
+  free(w.binom);
+  free(w.parent_offsets);
+  free(w.next);
+  free(w.layers[0]);
+  free(w.layers[1]);
+  free(w.parents);
+  return length;
+}
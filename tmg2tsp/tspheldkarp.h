@@ -0,0 +1,32 @@
+/*
+  Structure definitions and function prototypes for an exact TSP
+  solver for small instances: the Held-Karp dynamic program over
+  subsets of the points.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TSPHELDKARP_H
+#define _TSPHELDKARP_H
+
+#include <stddef.h>
+
+// the table for 25 points takes about 460MB: two layers of ints and
+// a byte for every state
+#define TSP_HK_MAX_POINTS 25
+
+// subsets handed to a thread at a time
+#define TSP_HK_CHUNK 256
+
+// what a solution took
+typedef struct tsp_hk_stats {
+  size_t states;  // (subset, last point) pairs computed
+  size_t bytes;   // of the table
+} tsp_hk_stats;
+
+// function prototypes
+extern long tsp_held_karp_solve(const int *dist, int n, int nthreads,
+				int *tour, tsp_hk_stats *stats);
+
+#endif  // _TSPHELDKARP_H
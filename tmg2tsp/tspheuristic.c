@@ -0,0 +1,707 @@
+/*
+  Heuristic TSP tours: greedy and nearest neighbor construction, and
+  improvement by 2-opt and Or-opt moves toward each point's nearest
+  neighbors, with don't-look bits.
+
+  The tour being improved is an array of points, with each point's
+  position in a second array, so the points before and after any
+  point are found in constant time.  A 2-opt move reverses the points
+  between the two edges it replaces, and since reversing either side
+  of the tour gives the same cycle, the shorter side is reversed.  An
+  Or-opt move, taking a run of up to TSP_HEUR_SEGMENT points out of
+  the tour and putting it back between two other points, is done as
+  two or three such reversals.
+
+  Every point starts out in a queue of points to look at.  A point is
+  looked at by trying each move that would add an edge from it to one
+  of its neighbors.  The endpoints of the edges a move changes go back
+  into the queue, and a point where no move helps is left alone
+  ("don't look") until a later move touches it.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tspheuristic.h"
+
+char *tsp_heur_start_names[] = { "greedy", "nearest" };
+
+// rows handed to a thread at a time when finding neighbors
+#define TSP_HEUR_CHUNK 64
+
+/*
+  Look up a way to build a starting tour by its name, returns 1 and
+  sets start if found, 0 if not.
+*/
+int tsp_heur_start_from_name(char *name, tsp_heur_start *start) {
+
+  int i;
+  for (i = TSP_HEUR_GREEDY; i <= TSP_HEUR_NEAREST; i++) {
+    if (strcmp(name, tsp_heur_start_names[i]) == 0) {
+      *start = (tsp_heur_start)i;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// the state shared by the threads finding neighbors
+typedef struct tsp_heur_neighbor_work {
+  tsp_heur_distance dist;
+  void *data;
+  int n;
+  int k;
+  int *neighbors;
+  atomic_int next;  // next point to claim
+} tsp_heur_neighbor_work;
+
+/*
+  Thread function: find the k nearest neighbors of chunks of points
+  until none are left, by looking at every other point and keeping
+  the best k in order by insertion.
+*/
+static void *tsp_heur_neighbor_worker(void *arg) {
+
+  tsp_heur_neighbor_work *w = (tsp_heur_neighbor_work *)arg;
+  int k = w->k;
+  int *d = (int *)malloc(k * sizeof(int));
+  int first;
+  while ((first = atomic_fetch_add(&(w->next), TSP_HEUR_CHUNK)) < w->n) {
+    int last = first + TSP_HEUR_CHUNK;
+    if (last > w->n) last = w->n;
+    for (int p = first; p < last; p++) {
+      int *best = w->neighbors + (size_t)p * k;
+      int found = 0;
+      for (int q = 0; q < w->n; q++) {
+	if (q == p) continue;
+	int dq = w->dist(w->data, p, q);
+	if (found == k && dq >= d[k-1]) continue;
+	// ties go to the lower numbered point, already in place
+	int i = (found < k) ? found++ : k - 1;
+	while (i > 0 && d[i-1] > dq) {
+	  d[i] = d[i-1];
+	  best[i] = best[i-1];
+	  i--;
+	}
+	d[i] = dq;
+	best[i] = q;
+      }
+    }
+  }
+  free(d);
+  return NULL;
+}
+
+/*
+  Find the k nearest other points of each of the n points by checking
+  all pairs, using nthreads threads, for instances like matrix files
+  where there is no better way.  neighbors has room for n*k points, k
+  less than n.  Returns 1 on success, 0 if out of memory.
+*/
+int tsp_heur_neighbors(tsp_heur_distance dist, void *data, int n, int k,
+		       int nthreads, int *neighbors) {
+
+  if (k < 1) return 1;
+  tsp_heur_neighbor_work w;
+  w.dist = dist;
+  w.data = data;
+  w.n = n;
+  w.k = k;
+  w.neighbors = neighbors;
+  atomic_init(&(w.next), 0);
+
+  // the calling thread is worker 0
+  if (nthreads < 1) nthreads = 1;
+  pthread_t *threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+  if (!threads) {
+    fprintf(stderr, "Could not allocate threads\n");
+    return 0;
+  }
+  // points are claimed from a shared counter, so the calling thread
+  // takes up the work of any threads that could not be started
+  int started = 1;
+  while (started < nthreads &&
+	 pthread_create(&threads[started], NULL, tsp_heur_neighbor_worker,
+			&w) == 0) {
+    started++;
+  }
+  tsp_heur_neighbor_worker(&w);
+  for (int i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  return 1;
+}
+
+/* the length of tour, including the return to its start */
+long tsp_heur_length(tsp_heur_instance *inst, const int *tour) {
+
+  long length = 0;
+  for (int i = 0; i < inst->n; i++) {
+    int next = (i + 1 < inst->n) ? tour[i + 1] : tour[0];
+    length += inst->dist(inst->data, tour[i], next);
+  }
+  return length;
+}
+
+/* instances this small have only one tour */
+static long tsp_heur_trivial(tsp_heur_instance *inst, int *tour) {
+
+  for (int i = 0; i < inst->n; i++) {
+    tour[i] = i;
+  }
+  return tsp_heur_length(inst, tour);
+}
+
+// a candidate edge for the greedy tour
+typedef struct tsp_heur_edge {
+  int length;
+  int a;
+  int b;
+} tsp_heur_edge;
+
+/* qsort comparison: shorter edges first, ties by their points */
+static int tsp_heur_edge_compare(const void *x, const void *y) {
+
+  const tsp_heur_edge *e = (const tsp_heur_edge *)x;
+  const tsp_heur_edge *f = (const tsp_heur_edge *)y;
+  if (e->length != f->length) return (e->length < f->length) ? -1 : 1;
+  if (e->a != f->a) return (e->a < f->a) ? -1 : 1;
+  return (e->b > f->b) - (e->b < f->b);
+}
+
+/* the representative of p's path, with path halving */
+static int tsp_heur_find(int *parent, int p) {
+
+  while (parent[p] != p) {
+    parent[p] = parent[parent[p]];
+    p = parent[p];
+  }
+  return p;
+}
+
+/* join points a and b by an edge of the paths in adj */
+static void tsp_heur_link(int *adj, int *degree, int a, int b) {
+
+  adj[2*a + degree[a]++] = b;
+  adj[2*b + degree[b]++] = a;
+}
+
+/*
+  Fill tour with a greedy tour: the candidate edges (between points
+  and their neighbors) are taken shortest first, skipping any that
+  would give a point a third edge or close a cycle.  What is left is
+  a set of paths, which are joined into a tour by going from the end
+  of each to the nearest end of a path not yet joined.  Returns the
+  length, -1 if out of memory.
+*/
+long tsp_heur_greedy(tsp_heur_instance *inst, int *tour) {
+
+  int n = inst->n;
+  int k = inst->k;
+  if (n < 4) return tsp_heur_trivial(inst, tour);
+
+  tsp_heur_edge *edges = (tsp_heur_edge *)malloc((size_t)n * k *
+						 sizeof(tsp_heur_edge));
+  int *adj = (int *)malloc(2 * (size_t)n * sizeof(int));
+  int *degree = (int *)calloc(n, sizeof(int));
+  int *parent = (int *)malloc(n * sizeof(int));
+  // each path's two ends (the same point for a path of one point)
+  int *ends = (int *)malloc(2 * (size_t)n * sizeof(int));
+  if (!edges || !adj || !degree || !parent || !ends) {
+    fprintf(stderr, "Could not allocate greedy tour of %d points\n", n);
+    free(edges);
+    free(adj);
+    free(degree);
+    free(parent);
+    free(ends);
+    return -1;
+  }
+
+  // each edge once, even when both its points list the other
+  size_t num_edges = 0;
+  for (int p = 0; p < n; p++) {
+    parent[p] = p;
+    for (int i = 0; i < k; i++) {
+      int q = inst->neighbors[(size_t)p * k + i];
+      if (q < p) {
+	int j;
+	for (j = 0; j < k && inst->neighbors[(size_t)q * k + j] != p; j++);
+	if (j < k) continue;
+      }
+      edges[num_edges].length = inst->dist(inst->data, p, q);
+      edges[num_edges].a = (p < q) ? p : q;
+      edges[num_edges].b = (p < q) ? q : p;
+      num_edges++;
+    }
+  }
+  qsort(edges, num_edges, sizeof(tsp_heur_edge), tsp_heur_edge_compare);
+
+  int joined = 0;
+  for (size_t e = 0; e < num_edges && joined < n - 1; e++) {
+    int a = edges[e].a;
+    int b = edges[e].b;
+    if (degree[a] == 2 || degree[b] == 2) continue;
+    int ra = tsp_heur_find(parent, a);
+    int rb = tsp_heur_find(parent, b);
+    if (ra == rb) continue;
+    parent[ra] = rb;
+    tsp_heur_link(adj, degree, a, b);
+    joined++;
+  }
+  free(edges);
+
+  // find the ends of each path, walking each path from one end
+  int num_paths = 0;
+  memset(parent, 0, n * sizeof(int));  // now marks ends already found
+  for (int p = 0; p < n; p++) {
+    if (degree[p] == 2 || parent[p]) continue;
+    int prev = p;
+    int cur = p;
+    if (degree[p] == 1) {
+      cur = adj[2*p];
+      while (degree[cur] == 2) {
+	int next = (adj[2*cur] == prev) ? adj[2*cur+1] : adj[2*cur];
+	prev = cur;
+	cur = next;
+      }
+    }
+    parent[p] = parent[cur] = 1;
+    ends[2*num_paths] = p;
+    ends[2*num_paths+1] = cur;
+    num_paths++;
+  }
+
+  // join the paths, nearest end next, and close the tour
+  int first = ends[0];
+  int cur = ends[1];
+  int left = num_paths - 1;
+  while (left > 0) {
+    int best = 0;
+    int best_end = 0;
+    int best_dist = INT_MAX;
+    for (int i = 1; i <= left; i++) {
+      for (int e = 0; e < 2; e++) {
+	int d = inst->dist(inst->data, cur, ends[2*i+e]);
+	if (d < best_dist) {
+	  best = i;
+	  best_end = e;
+	  best_dist = d;
+	}
+      }
+    }
+    tsp_heur_link(adj, degree, cur, ends[2*best+best_end]);
+    cur = ends[2*best+1-best_end];
+    // the last path not yet joined takes the place of this one
+    ends[2*best] = ends[2*left];
+    ends[2*best+1] = ends[2*left+1];
+    left--;
+  }
+  tsp_heur_link(adj, degree, cur, first);
+
+  int prev = -1;
+  cur = 0;
+  for (int i = 0; i < n; i++) {
+    tour[i] = cur;
+    int next = (adj[2*cur] != prev) ? adj[2*cur] : adj[2*cur+1];
+    prev = cur;
+    cur = next;
+  }
+
+  free(adj);
+  free(degree);
+  free(parent);
+  free(ends);
+  return tsp_heur_length(inst, tour);
+}
+
+/*
+  Fill tour with the tour that starts at point 0 and always goes to
+  the nearest point not yet visited.  That is the first unvisited
+  neighbor, if any are, and otherwise found by checking every point
+  not yet visited.  Returns the length, -1 if out of memory.
+*/
+long tsp_heur_nearest(tsp_heur_instance *inst, int *tour) {
+
+  int n = inst->n;
+  int k = inst->k;
+  if (n < 4) return tsp_heur_trivial(inst, tour);
+
+  // the points not yet visited are unvisited[0..left-1], and point p
+  // is at unvisited[where[p]] until visited, then where[p] is -1
+  int *unvisited = (int *)malloc(n * sizeof(int));
+  int *where = (int *)malloc(n * sizeof(int));
+  if (!unvisited || !where) {
+    fprintf(stderr, "Could not allocate nearest neighbor tour of %d points\n",
+	    n);
+    free(unvisited);
+    free(where);
+    return -1;
+  }
+  for (int p = 0; p < n; p++) {
+    unvisited[p] = p;
+    where[p] = p;
+  }
+
+  int left = n;
+  int cur = 0;
+  for (int i = 0; i < n; i++) {
+    tour[i] = cur;
+    left--;
+    unvisited[where[cur]] = unvisited[left];
+    where[unvisited[left]] = where[cur];
+    where[cur] = -1;
+    if (left == 0) break;
+
+    int next = -1;
+    for (int j = 0; j < k && next < 0; j++) {
+      int q = inst->neighbors[(size_t)cur * k + j];
+      if (where[q] >= 0) next = q;
+    }
+    if (next < 0) {
+      int best_dist = INT_MAX;
+      for (int j = 0; j < left; j++) {
+	int d = inst->dist(inst->data, cur, unvisited[j]);
+	if (d < best_dist || (d == best_dist && unvisited[j] < next)) {
+	  next = unvisited[j];
+	  best_dist = d;
+	}
+      }
+    }
+    cur = next;
+  }
+
+  free(unvisited);
+  free(where);
+  return tsp_heur_length(inst, tour);
+}
+
+// a tour being improved, and the queue of points to look at
+typedef struct tsp_heur_search {
+  tsp_heur_instance *inst;
+  int n;
+  int *tour;
+  int *pos;  // where each point is in tour
+  int *queue;  // circular, holding each point at most once
+  unsigned char *queued;
+  int head;
+  int count;
+  tsp_heur_stats *stats;
+} tsp_heur_search;
+
+/* the distance between points a and b */
+static int tsp_heur_d(tsp_heur_search *s, int a, int b) {
+
+  return s->inst->dist(s->inst->data, a, b);
+}
+
+/* the point after p in the tour */
+static int tsp_heur_succ(tsp_heur_search *s, int p) {
+
+  int i = s->pos[p] + 1;
+  return s->tour[i == s->n ? 0 : i];
+}
+
+/* the point before p in the tour */
+static int tsp_heur_pred(tsp_heur_search *s, int p) {
+
+  int i = s->pos[p];
+  return s->tour[i == 0 ? s->n - 1 : i - 1];
+}
+
+/* put p in the queue of points to look at, unless it is there */
+static void tsp_heur_push(tsp_heur_search *s, int p) {
+
+  if (s->queued[p]) return;
+  s->queued[p] = 1;
+  s->queue[(s->head + s->count) % s->n] = p;
+  s->count++;
+}
+
+/* reverse the points in positions i through j, wrapping around */
+static void tsp_heur_reverse(tsp_heur_search *s, int i, int j) {
+
+  int n = s->n;
+  int len = (j - i + n) % n + 1;
+  for (int t = 0; t < len / 2; t++) {
+    int a = s->tour[i];
+    int b = s->tour[j];
+    s->tour[i] = b;
+    s->pos[b] = i;
+    s->tour[j] = a;
+    s->pos[a] = j;
+    i = (i + 1 == n) ? 0 : i + 1;
+    j = (j == 0) ? n - 1 : j - 1;
+  }
+}
+
+/*
+  Replace edges (a,b) and (c,d) with (a,c) and (b,d), where b follows
+  a and d follows c in the same direction around the tour, by
+  reversing the shorter of the paths between them.
+*/
+static void tsp_heur_exchange(tsp_heur_search *s, int a, int b, int c,
+			      int d) {
+
+  if (tsp_heur_succ(s, a) != b) {
+    // the tour runs the other way: d, c, ..., b, a
+    int t = a;
+    a = b;
+    b = t;
+    t = c;
+    c = d;
+    d = t;
+  }
+  int inner = (s->pos[c] - s->pos[b] + s->n) % s->n + 1;
+  if (2 * inner <= s->n) {
+    tsp_heur_reverse(s, s->pos[b], s->pos[c]);
+  }
+  else {
+    tsp_heur_reverse(s, s->pos[d], s->pos[a]);
+  }
+}
+
+/*
+  Try the 2-opt moves that add an edge from a to one of its
+  neighbors, replacing an edge at a and one at the neighbor, making
+  the first that shortens the tour.  Returns 1 if one was made.
+*/
+static int tsp_heur_two_opt(tsp_heur_search *s, int a) {
+
+  int k = s->inst->k;
+  const int *neighbors = s->inst->neighbors + (size_t)a * k;
+  for (int dir = 0; dir < 2; dir++) {
+    int b = dir ? tsp_heur_pred(s, a) : tsp_heur_succ(s, a);
+    int ab = tsp_heur_d(s, a, b);
+    for (int i = 0; i < k; i++) {
+      int c = neighbors[i];
+      int gain = ab - tsp_heur_d(s, a, c);
+      // neighbors only get farther, so no later one can help
+      if (gain <= 0) break;
+      int d = dir ? tsp_heur_pred(s, c) : tsp_heur_succ(s, c);
+      if (c == b || d == a) continue;
+      gain += tsp_heur_d(s, c, d) - tsp_heur_d(s, b, d);
+      if (gain > 0) {
+	tsp_heur_exchange(s, a, b, c, d);
+	tsp_heur_push(s, a);
+	tsp_heur_push(s, b);
+	tsp_heur_push(s, c);
+	tsp_heur_push(s, d);
+	s->stats->two_opt_moves++;
+	return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* is p one of the len points from first on? */
+static int tsp_heur_in_segment(tsp_heur_search *s, int p, int first,
+			       int len) {
+
+  return (s->pos[p] - s->pos[first] + s->n) % s->n < len;
+}
+
+/*
+  Try the Or-opt moves that take a run of up to TSP_HEUR_SEGMENT
+  points starting or ending at a out of the tour and put it between
+  a neighbor of a and the point before or after that neighbor, either
+  way around, making the first that shortens the tour.  Returns 1 if
+  one was made.
+*/
+static int tsp_heur_or_opt(tsp_heur_search *s, int a) {
+
+  int k = s->inst->k;
+  const int *neighbors = s->inst->neighbors + (size_t)a * k;
+  for (int len = 1; len <= TSP_HEUR_SEGMENT && len + 3 <= s->n; len++) {
+    for (int back = 0; back < (len == 1 ? 1 : 2); back++) {
+      // the run is s1 through s2, between p and nx
+      int s1 = a;
+      int s2 = a;
+      for (int i = 1; i < len; i++) {
+	if (back) s1 = tsp_heur_pred(s, s1);
+	else s2 = tsp_heur_succ(s, s2);
+      }
+      int p = tsp_heur_pred(s, s1);
+      int nx = tsp_heur_succ(s, s2);
+      int removed = tsp_heur_d(s, p, s1) + tsp_heur_d(s, s2, nx) -
+	tsp_heur_d(s, p, nx);
+      for (int i = 0; i < k; i++) {
+	int c = neighbors[i];
+	if (tsp_heur_d(s, a, c) >= removed) break;
+	if (tsp_heur_in_segment(s, c, s1, len)) continue;
+	// the edges at c: (pred c, c) and (c, succ c)
+	for (int side = 0; side < 2; side++) {
+	  int x = side ? c : tsp_heur_pred(s, c);
+	  int y = side ? tsp_heur_succ(s, c) : c;
+	  if (y == p || tsp_heur_in_segment(s, x, s1, len) ||
+	      tsp_heur_in_segment(s, y, s1, len)) continue;
+	  int xy = tsp_heur_d(s, x, y);
+	  int straight = removed + xy - tsp_heur_d(s, x, s1) -
+	    tsp_heur_d(s, s2, y);
+	  int reversed = removed + xy - tsp_heur_d(s, x, s2) -
+	    tsp_heur_d(s, s1, y);
+	  if (straight <= 0 && reversed <= 0) continue;
+	  // p, s1..s2, nx, ..., x, y becomes p, nx, ..., x, s2..s1, y
+	  tsp_heur_exchange(s, p, s1, x, y);
+	  tsp_heur_exchange(s, p, x, nx, s2);
+	  if (straight > reversed) {
+	    // then x, s1..s2, y
+	    tsp_heur_exchange(s, x, s2, s1, y);
+	  }
+	  tsp_heur_push(s, p);
+	  tsp_heur_push(s, nx);
+	  tsp_heur_push(s, s1);
+	  tsp_heur_push(s, s2);
+	  tsp_heur_push(s, x);
+	  tsp_heur_push(s, y);
+	  s->stats->or_opt_moves++;
+	  return 1;
+	}
+      }
+    }
+  }
+  return 0;
+}
+
+/*
+  Improve tour with 2-opt and Or-opt moves until none toward any
+  point's neighbors shortens it, then rotate it to start at point 0.
+  stats->start_length is left alone and the moves made are counted.
+  Returns the new length, -1 if out of memory.
+*/
+long tsp_heur_improve(tsp_heur_instance *inst, int *tour,
+		      tsp_heur_stats *stats) {
+
+  int n = inst->n;
+  stats->two_opt_moves = 0;
+  stats->or_opt_moves = 0;
+  if (n < 4) return tsp_heur_trivial(inst, tour);
+
+  tsp_heur_search s;
+  s.inst = inst;
+  s.n = n;
+  s.tour = tour;
+  s.stats = stats;
+  s.pos = (int *)malloc(n * sizeof(int));
+  s.queue = (int *)malloc(n * sizeof(int));
+  s.queued = (unsigned char *)calloc(n, 1);
+  if (!s.pos || !s.queue || !s.queued) {
+    fprintf(stderr, "Could not allocate tour improvement of %d points\n", n);
+    free(s.pos);
+    free(s.queue);
+    free(s.queued);
+    return -1;
+  }
+  s.head = 0;
+  s.count = 0;
+  for (int i = 0; i < n; i++) {
+    s.pos[tour[i]] = i;
+    tsp_heur_push(&s, tour[i]);
+  }
+
+  while (s.count > 0) {
+    int a = s.queue[s.head];
+    s.head = (s.head + 1) % n;
+    s.count--;
+    s.queued[a] = 0;
+    // a goes back in the queue if either move is made
+    if (!tsp_heur_two_opt(&s, a)) tsp_heur_or_opt(&s, a);
+  }
+
+  // start at point 0, using the queue as scratch space
+  int zero = s.pos[0];
+  for (int i = 0; i < n; i++) {
+    s.queue[i] = tour[(zero + i) % n];
+  }
+  memcpy(tour, s.queue, n * sizeof(int));
+
+  free(s.pos);
+  free(s.queue);
+  free(s.queued);
+  return tsp_heur_length(inst, tour);
+}
+
+/*
+  Build a tour as start says and improve it, filling tour and stats.
+  Returns its length, -1 if out of memory.
+*/
+long tsp_heur_tour(tsp_heur_instance *inst, tsp_heur_start start, int *tour,
+		   tsp_heur_stats *stats) {
+
+  memset(stats, 0, sizeof(tsp_heur_stats));
+  stats->start_length = (start == TSP_HEUR_NEAREST) ?
+    tsp_heur_nearest(inst, tour) : tsp_heur_greedy(inst, tour);
+  if (stats->start_length < 0) return -1;
+  return tsp_heur_improve(inst, tour, stats);
+}
+
+// distances for the heuristic, read from a matrix as needed, and made
+// symmetric by adding the two directions if the matrix is not
+typedef struct tsp_heur_matrix {
+  tsp_matrix *m;
+  int symmetric;
+} tsp_heur_matrix;
+
+/* tsp_heur_distance for a matrix */
+static int tsp_heur_matrix_distance(void *data, int a, int b) {
+
+  tsp_heur_matrix *hm = (tsp_heur_matrix *)data;
+  if (hm->symmetric) return tsp_matrix_get(hm->m, a, b);
+  return tsp_matrix_get(hm->m, a, b) + tsp_matrix_get(hm->m, b, a);
+}
+
+/* reverse the direction of tour, still starting at the same point */
+static void tsp_heur_turn_around(int *tour, int n) {
+
+  for (int i = 1, j = n - 1; i < j; i++, j--) {
+    int p = tour[i];
+    tour[i] = tour[j];
+    tour[j] = p;
+  }
+}
+
+/*
+  Fill tour with a heuristic tour of the points of matrix m, built as
+  start says and improved by moves toward each point's k nearest
+  neighbors, found with nthreads threads.  If m is not symmetric, the
+  tour is improved on the sums of distances both ways, and whichever
+  direction around it is shorter is kept.  Returns its length, -1 on
+  failure.
+*/
+long tsp_heur_matrix_tour(tsp_matrix *m, tsp_heur_start start, int k,
+			  int nthreads, int *tour, tsp_heur_stats *stats) {
+
+  int n = m->n;
+  if (k > n - 1) k = n - 1;
+  int *neighbors = (int *)malloc((size_t)n * (k > 0 ? k : 1) * sizeof(int));
+  if (!neighbors) {
+    fprintf(stderr, "Could not allocate %d neighbor lists\n", n);
+    return -1;
+  }
+  tsp_heur_matrix hm = { m, tsp_matrix_is_symmetric(m) };
+  tsp_heur_instance inst = { n, tsp_heur_matrix_distance, &hm, k, neighbors };
+  long length = -1;
+  if (tsp_heur_neighbors(tsp_heur_matrix_distance, &hm, n, k, nthreads,
+			 neighbors) &&
+      tsp_heur_tour(&inst, start, tour, stats) >= 0) {
+    int symmetric = hm.symmetric;
+    hm.symmetric = 1;  // for the real length
+    length = tsp_heur_length(&inst, tour);
+    if (!symmetric) {
+      tsp_heur_turn_around(tour, n);
+      long reversed = tsp_heur_length(&inst, tour);
+      if (reversed < length) length = reversed;
+      else tsp_heur_turn_around(tour, n);
+    }
+  }
+  free(neighbors);
+  return length;
+}
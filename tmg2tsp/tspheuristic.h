@@ -0,0 +1,70 @@
+/*
+  Structure definitions and function prototypes for heuristic TSP
+  tours of instances too large to solve exactly: a greedy or nearest
+  neighbor tour, improved by 2-opt and Or-opt moves.
+
+  Distances come from a function rather than a matrix, so the points
+  can be those of a matrix file or graph vertices whose distances are
+  computed as needed.  Moves are only tried toward each point's k
+  nearest neighbors, listed in the instance, which is what keeps the
+  work close to linear in the number of points.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TSPHEURISTIC_H
+#define _TSPHEURISTIC_H
+
+#include "tspmatrix.h"
+
+// neighbors per point to try moves toward, when not specified
+#define TSP_HEUR_NEIGHBORS 10
+
+// longest run of points an Or-opt move relocates
+#define TSP_HEUR_SEGMENT 3
+
+// the distance between points a and b, which must be the same as
+// between b and a
+typedef int (*tsp_heur_distance)(void *data, int a, int b);
+
+// how the tour to be improved is built: adding the shortest candidate
+// edges that keep it a set of paths, or always going to the nearest
+// point not yet visited
+typedef enum tsp_heur_start { TSP_HEUR_GREEDY, TSP_HEUR_NEAREST
+} tsp_heur_start;
+extern char *tsp_heur_start_names[];
+
+typedef struct tsp_heur_instance {
+  int n;
+  tsp_heur_distance dist;
+  void *data;  // passed to dist
+  int k;
+  // the k nearest other points of point p, nearest first, are
+  // neighbors[p*k] through neighbors[p*k+k-1]
+  const int *neighbors;
+} tsp_heur_instance;
+
+// what building and improving a tour did
+typedef struct tsp_heur_stats {
+  long start_length;  // of the tour before improvement
+  long two_opt_moves;
+  long or_opt_moves;
+} tsp_heur_stats;
+
+// function prototypes
+extern int tsp_heur_start_from_name(char *name, tsp_heur_start *start);
+extern int tsp_heur_neighbors(tsp_heur_distance dist, void *data, int n,
+			      int k, int nthreads, int *neighbors);
+extern long tsp_heur_length(tsp_heur_instance *inst, const int *tour);
+extern long tsp_heur_greedy(tsp_heur_instance *inst, int *tour);
+extern long tsp_heur_nearest(tsp_heur_instance *inst, int *tour);
+extern long tsp_heur_improve(tsp_heur_instance *inst, int *tour,
+			     tsp_heur_stats *stats);
+extern long tsp_heur_tour(tsp_heur_instance *inst, tsp_heur_start start,
+			  int *tour, tsp_heur_stats *stats);
+extern long tsp_heur_matrix_tour(tsp_matrix *m, tsp_heur_start start, int k,
+				 int nthreads, int *tour,
+				 tsp_heur_stats *stats);
+
+#endif  // _TSPHEURISTIC_H
@@ -0,0 +1,659 @@
+/*
+  Check TSP distance matrix files, in the text or binary formats of
+  tspmatrix.h, for problems a solver would otherwise trust its input
+  not to have: text files whose layout does not match the number of
+  points on their first line, entries on the diagonal that are not 0,
+  negative entries, distances that differ in the two directions, and
+  distances longer than a path through some other point, a violation
+  of the triangle inequality.
+
+  Every problem is reported, with the labels of the points involved.
+  How a text file's lines are laid out beyond their entries, such as
+  blank lines, mixed separators or some labels missing, is noted in
+  warnings, which are not problems.
+  The triangle inequality check looks at every triple of points, so
+  it is done in blocks: for a block of rows i and a block of columns
+  k, the shortest path from each i through any j to each k is the
+  minimum, over all j, of d[i][j] added to row j of the block.  The
+  rows j are taken a block at a time too, so they stay in cache while
+  every row i reuses them, and the minimums for 16 columns stay in
+  registers across a block of rows j, computed 8 (AVX2) or 4 (SSE2)
+  at a time when available.  Threads claim blocks of rows i from a
+  shared counter.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "tspmatrix.h"
+
+// rows and columns of the triangle inequality check at a time: a
+// block of shortest paths fits in the L1 cache
+#define TSP_LINT_BLOCK 64
+
+// columns whose shortest detours are kept in registers at once, and
+// for matrices whose detours fit in 16 bits
+#define TSP_LINT_LANES 16
+#define TSP_LINT_LANES16 32
+
+// a pair of points farther apart than by way of point j
+typedef struct lint_violation {
+  int i, j, k;
+  int direct;  // d[i][k]
+  int detour;  // d[i][j] + d[j][k]
+} lint_violation;
+
+// the violations found in one block of rows
+typedef struct lint_violations {
+  lint_violation *v;
+  int count;
+  int size;
+} lint_violations;
+
+// the state shared by the threads checking the triangle inequality
+typedef struct lint_triangle {
+  int n;
+  const int **rows;
+  const int16_t **rows16;  // a 16-bit copy of rows, or NULL
+  int block;
+  int symmetric;  // check only pairs i < k
+  int nblocks;
+  atomic_int next;  // next block of rows to claim
+  atomic_int failed;
+  lint_violations *found;  // for each block of rows
+} lint_triangle;
+
+// a file being checked, and how its problems are reported
+typedef struct lint_file {
+  char *filename;
+  tsp_matrix *m;
+  long max;  // problems of each kind to print, 0 for all
+  long problems;
+  long warnings;  // layout notes, not counted as problems
+} lint_file;
+
+static void usage(char *progname) {
+
+  fprintf(stderr, "Usage: %s [-j nthreads] [--block B] [--max N] [--asymmetric]\n       [--no-triangle] file...\n", progname);
+}
+
+/*
+  Count a problem of a kind seen count times so far, including this
+  one.  Should it be printed?
+*/
+static int lint_show(lint_file *f, long count) {
+
+  f->problems++;
+  return f->max == 0 || count <= f->max;
+}
+
+/* report how many problems of a kind were not printed */
+static void lint_hidden(lint_file *f, long count, char *kind) {
+
+  if (f->max > 0 && count > f->max) {
+    printf("%s: ... and %ld more %s\n", f->filename, count - f->max, kind);
+  }
+}
+
+/* a point, with its label if it has one, in a static buffer */
+static const char *lint_point(lint_file *f, int i, int which) {
+
+  static char buf[3][256];
+  const char *label = tsp_matrix_label(f->m, i);
+  if (label) snprintf(buf[which], sizeof(buf[which]), "%d (%s)", i, label);
+  else snprintf(buf[which], sizeof(buf[which]), "%d", i);
+  return buf[which];
+}
+
+/*
+  Report what reading a text file found about its layout: entries
+  that do not fit the number of points are problems, and the rest
+  are warnings.
+*/
+static void lint_text(lint_file *f, tsp_text_check *c) {
+
+  int n = f->m->n;
+  char *name = f->filename;
+  if (c->extra_entries > 0) {
+    f->problems++;
+    printf("%s: %d more integers after the %d x %d matrix the first line calls for\n",
+	   name, c->extra_entries, n, n);
+  }
+  if (c->extra_rows > 0) {
+    f->problems++;
+    printf("%s: %d lines of integers follow the matrix, is the number of points %d wrong?\n",
+	   name, c->extra_rows, n);
+  }
+  if (c->bad_rows > 0) {
+    f->problems++;
+    printf("%s: %d of %d matrix lines do not have %d entries, the first is line %d with %d\n",
+	   name, c->bad_rows, c->matrix_lines, n, c->bad_row_line,
+	   c->bad_row_count);
+  }
+  if (c->blank_lines > 0) {
+    f->warnings++;
+    printf("%s: warning: %d blank lines among the matrix rows\n", name,
+	   c->blank_lines);
+  }
+  // tmg2tsp ends every row with a tab, so only note whitespace that
+  // some matrix lines end in and others do not
+  if (c->trailing_space_lines > 0 &&
+      c->trailing_space_lines < c->matrix_lines) {
+    f->warnings++;
+    printf("%s: warning: %d of the first %d lines end in whitespace\n", name,
+	   c->trailing_space_lines, c->lines);
+  }
+  if (c->tab_lines > 0 && c->space_lines > 0) {
+    f->warnings++;
+    printf("%s: warning: entries are separated by tabs on %d lines and spaces on %d\n",
+	   name, c->tab_lines, c->space_lines);
+  }
+  if (c->crlf_lines > 0 && c->lf_lines > 0) {
+    f->warnings++;
+    printf("%s: warning: %d lines end in CRLF and %d in LF\n", name,
+	   c->crlf_lines, c->lf_lines);
+  }
+  // files often have no labels at all, but some and not others
+  // suggests labels were lost
+  if (c->labels > 0 && c->labels < n) {
+    f->warnings++;
+    printf("%s: warning: labels for only %d of %d points\n", name, c->labels,
+	   n);
+  }
+}
+
+/*
+  For the count columns starting at k, at most TSP_LINT_LANES, make
+  best[t] the smaller of itself and d[i][j] + d[j][k+t] over rows j
+  from j0 to j1, where di is row i.
+*/
+static void lint_relax(int *best, const int **rows, const int *di, int j0,
+		       int j1, int k, int count) {
+
+#if defined(__AVX2__)
+  if (count == TSP_LINT_LANES) {
+    __m256i b0 = _mm256_loadu_si256((const __m256i *)best);
+    __m256i b1 = _mm256_loadu_si256((const __m256i *)(best+8));
+    for (int j = j0; j < j1; j++) {
+      __m256i dij = _mm256_set1_epi32(di[j]);
+      const int *row = rows[j] + k;
+      b0 = _mm256_min_epi32(b0, _mm256_add_epi32(dij,
+	_mm256_loadu_si256((const __m256i *)row)));
+      b1 = _mm256_min_epi32(b1, _mm256_add_epi32(dij,
+	_mm256_loadu_si256((const __m256i *)(row+8))));
+    }
+    _mm256_storeu_si256((__m256i *)best, b0);
+    _mm256_storeu_si256((__m256i *)(best+8), b1);
+    return;
+  }
+#elif defined(__SSE2__)
+  if (count == TSP_LINT_LANES) {
+    __m128i b[4];
+    for (int l = 0; l < 4; l++) {
+      b[l] = _mm_loadu_si128((const __m128i *)(best+4*l));
+    }
+    for (int j = j0; j < j1; j++) {
+      __m128i dij = _mm_set1_epi32(di[j]);
+      const int *row = rows[j] + k;
+      for (int l = 0; l < 4; l++) {
+	__m128i s = _mm_add_epi32(dij,
+				  _mm_loadu_si128((const __m128i *)(row+4*l)));
+	// SSE2 has no 32-bit integer minimum, so select by comparison
+	__m128i less = _mm_cmplt_epi32(s, b[l]);
+	b[l] = _mm_or_si128(_mm_and_si128(less, s),
+			    _mm_andnot_si128(less, b[l]));
+      }
+    }
+    for (int l = 0; l < 4; l++) {
+      _mm_storeu_si128((__m128i *)(best+4*l), b[l]);
+    }
+    return;
+  }
+#endif
+  for (int j = j0; j < j1; j++) {
+    const int *row = rows[j] + k;
+    for (int t = 0; t < count; t++) {
+      int s = di[j] + row[t];
+      if (s < best[t]) best[t] = s;
+    }
+  }
+}
+
+/*
+  lint_relax for a matrix whose detours fit in 16 bits, twice as many
+  columns at a time, at most TSP_LINT_LANES16.
+*/
+static void lint_relax16(int16_t *best, const int16_t **rows,
+			 const int16_t *di, int j0, int j1, int k,
+			 int count) {
+
+#if defined(__AVX2__)
+  if (count == TSP_LINT_LANES16) {
+    __m256i b0 = _mm256_loadu_si256((const __m256i *)best);
+    __m256i b1 = _mm256_loadu_si256((const __m256i *)(best+16));
+    for (int j = j0; j < j1; j++) {
+      __m256i dij = _mm256_set1_epi16(di[j]);
+      const int16_t *row = rows[j] + k;
+      b0 = _mm256_min_epi16(b0, _mm256_add_epi16(dij,
+	_mm256_loadu_si256((const __m256i *)row)));
+      b1 = _mm256_min_epi16(b1, _mm256_add_epi16(dij,
+	_mm256_loadu_si256((const __m256i *)(row+16))));
+    }
+    _mm256_storeu_si256((__m256i *)best, b0);
+    _mm256_storeu_si256((__m256i *)(best+16), b1);
+    return;
+  }
+#elif defined(__SSE2__)
+  if (count == TSP_LINT_LANES16) {
+    __m128i b[4];
+    for (int l = 0; l < 4; l++) {
+      b[l] = _mm_loadu_si128((const __m128i *)(best+8*l));
+    }
+    for (int j = j0; j < j1; j++) {
+      __m128i dij = _mm_set1_epi16(di[j]);
+      const int16_t *row = rows[j] + k;
+      for (int l = 0; l < 4; l++) {
+	b[l] = _mm_min_epi16(b[l], _mm_add_epi16(dij,
+	  _mm_loadu_si128((const __m128i *)(row+8*l))));
+      }
+    }
+    for (int l = 0; l < 4; l++) {
+      _mm_storeu_si128((__m128i *)(best+8*l), b[l]);
+    }
+    return;
+  }
+#endif
+  for (int j = j0; j < j1; j++) {
+    const int16_t *row = rows[j] + k;
+    for (int t = 0; t < count; t++) {
+      int16_t s = di[j] + row[t];
+      if (s < best[t]) best[t] = s;
+    }
+  }
+}
+
+/* add a violation to a list, 0 if there is no room for it */
+static int lint_add(lint_violations *l, lint_violation *v) {
+
+  if (l->count == l->size) {
+    int size = l->size ? 2 * l->size : 64;
+    lint_violation *more =
+      (lint_violation *)realloc(l->v, size * sizeof(lint_violation));
+    if (!more) return 0;
+    l->v = more;
+    l->size = size;
+  }
+  l->v[l->count++] = *v;
+  return 1;
+}
+
+/* check blocks of rows for triangle inequality violations */
+static void *lint_triangle_worker(void *arg) {
+
+  lint_triangle *t = (lint_triangle *)arg;
+  int n = t->n;
+  int b = t->block;
+  const int **rows = t->rows;
+  const int16_t **rows16 = t->rows16;
+  int *best = (int *)malloc((size_t)b * b * sizeof(int));
+  int16_t *best16 = (int16_t *)malloc((size_t)b * b * sizeof(int16_t));
+  if (!best || !best16) {
+    free(best);
+    free(best16);
+    atomic_store(&(t->failed), 1);
+    return NULL;
+  }
+
+  int block;
+  while ((block = atomic_fetch_add(&(t->next), 1)) < t->nblocks) {
+    int i0 = block * b;
+    int i1 = (i0 + b < n) ? i0 + b : n;
+    lint_violations *found = &(t->found[block]);
+    for (int k0 = t->symmetric ? i0 : 0; k0 < n; k0 += b) {
+      int width = (k0 + b < n) ? b : n - k0;
+      for (int x = 0; x < b * b; x++) {
+	best[x] = INT_MAX;
+	best16[x] = INT16_MAX;
+      }
+      // a block of rows j at a time, whose columns k0 on are reused
+      // from cache for every row i
+      for (int j0 = 0; j0 < n; j0 += b) {
+	int j1 = (j0 + b < n) ? j0 + b : n;
+	for (int i = i0; i < i1; i++) {
+	  if (rows16) {
+	    for (int c = 0; c < width; c += TSP_LINT_LANES16) {
+	      int count = (width - c < TSP_LINT_LANES16) ? width - c :
+		TSP_LINT_LANES16;
+	      lint_relax16(best16 + (i - i0) * b + c, rows16, rows16[i], j0,
+			   j1, k0 + c, count);
+	    }
+	    continue;
+	  }
+	  for (int c = 0; c < width; c += TSP_LINT_LANES) {
+	    int count = (width - c < TSP_LINT_LANES) ? width - c :
+	      TSP_LINT_LANES;
+	    lint_relax(best + (i - i0) * b + c, rows, rows[i], j0, j1,
+		       k0 + c, count);
+	  }
+	}
+      }
+
+      // the diagonal entries are not negative, so a detour shorter
+      // than the direct distance must go through some other point
+      for (int i = i0; i < i1; i++) {
+	for (int k = k0; k < k0 + width; k++) {
+	  if (k == i || (t->symmetric && k < i)) continue;
+	  int x = (i - i0) * b + (k - k0);
+	  int detour = rows16 ? best16[x] : best[x];
+	  if (detour >= rows[i][k]) continue;
+	  lint_violation v = { i, 0, k, rows[i][k], detour };
+	  while (rows[i][v.j] + rows[v.j][k] != detour) v.j++;
+	  if (!lint_add(found, &v)) {
+	    atomic_store(&(t->failed), 1);
+	    free(best);
+	    free(best16);
+	    return NULL;
+	  }
+	}
+      }
+    }
+  }
+  free(best);
+  free(best16);
+  return NULL;
+}
+
+/* qsort comparator for violations, by i and then k */
+static int lint_violation_compare(const void *a, const void *b) {
+
+  const lint_violation *va = (const lint_violation *)a;
+  const lint_violation *vb = (const lint_violation *)b;
+  if (va->i != vb->i) return (va->i < vb->i) ? -1 : 1;
+  if (va->k != vb->k) return (va->k < vb->k) ? -1 : 1;
+  return 0;
+}
+
+/*
+  Report every pair of points farther apart than by way of some other
+  point, each with the shortest such path.  When no detour can exceed
+  16 bits, no larger than largest entry doubled, the check runs on a
+  16-bit copy of the matrix, twice as many columns at a time.  0 if
+  the check could not be done.
+*/
+static int lint_triangle_check(lint_file *f, const int **rows, int largest,
+			       int symmetric, int block, int nthreads) {
+
+  lint_triangle t;
+  t.n = f->m->n;
+  t.rows = rows;
+  t.rows16 = NULL;
+  int16_t *values16 = NULL;
+  if (largest <= INT16_MAX / 2) {
+    values16 = (int16_t *)malloc((size_t)t.n * t.n * sizeof(int16_t));
+    t.rows16 = (const int16_t **)malloc(t.n * sizeof(int16_t *));
+    // without room for the copy, check the matrix as it is
+    if (!values16 || !t.rows16) {
+      free(values16);
+      free(t.rows16);
+      values16 = NULL;
+      t.rows16 = NULL;
+    }
+  }
+  if (values16) {
+    for (int i = 0; i < t.n; i++) {
+      int16_t *row = values16 + (size_t)i * t.n;
+      for (int j = 0; j < t.n; j++) row[j] = rows[i][j];
+      t.rows16[i] = row;
+    }
+  }
+  t.block = block;
+  t.symmetric = symmetric;
+  t.nblocks = (t.n + block - 1) / block;
+  atomic_init(&(t.next), 0);
+  atomic_init(&(t.failed), 0);
+  t.found = (lint_violations *)calloc(t.nblocks, sizeof(lint_violations));
+  pthread_t *tids = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+  if (!t.found || !tids) {
+    fprintf(stderr, "Could not allocate triangle inequality check\n");
+    free(t.found);
+    free(tids);
+    free(t.rows16);
+    free(values16);
+    return 0;
+  }
+
+  int started;
+  for (started = 0; started < nthreads; started++) {
+    if (pthread_create(&tids[started], NULL, lint_triangle_worker, &t) != 0) {
+      break;
+    }
+  }
+  // with no threads at all, do the work here
+  if (started == 0) lint_triangle_worker(&t);
+  for (int i = 0; i < started; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  free(tids);
+  free(t.rows16);
+  free(values16);
+
+  int ok = !atomic_load(&(t.failed));
+  long count = 0;
+  for (int block = 0; block < t.nblocks; block++) {
+    lint_violations *l = &(t.found[block]);
+    if (ok) {
+      qsort(l->v, l->count, sizeof(lint_violation), lint_violation_compare);
+    }
+    for (int x = 0; ok && x < l->count; x++) {
+      lint_violation *v = &(l->v[x]);
+      if (lint_show(f, ++count)) {
+	printf("%s: d[%d][%d] = %d is longer than d[%d][%d] + d[%d][%d] = %d, from %s to %s by way of %s\n",
+	       f->filename, v->i, v->k, v->direct, v->i, v->j, v->j, v->k,
+	       v->detour, lint_point(f, v->i, 0), lint_point(f, v->k, 1),
+	       lint_point(f, v->j, 2));
+      }
+    }
+    free(l->v);
+  }
+  free(t.found);
+  if (!ok) {
+    fprintf(stderr, "Could not allocate triangle inequality violations\n");
+    return 0;
+  }
+  lint_hidden(f, count, "triangle inequality violations");
+  return 1;
+}
+
+/*
+  Check one file, printing its problems.  The number of problems, or
+  -1 if the file could not be read or checked.
+*/
+static long lint_file_check(char *filename, int nthreads, int block,
+			    long max, int asymmetric, int triangle) {
+
+  lint_file f = { filename, NULL, max, 0, 0 };
+  tsp_text_check c;
+  int binary = tsp_file_is_binary(filename);
+  f.m = binary ? tsp_matrix_open_binary(filename) :
+    tsp_matrix_load_text_checked(filename, &c);
+  if (!f.m) return -1;
+  int n = f.m->n;
+  printf("%s: %d points, %s\n", filename, n,
+	 binary ? tsp_layout_names[f.m->layout] : "text");
+  if (!binary) lint_text(&f, &c);
+
+  // rows that can be indexed directly, copying the matrix only if
+  // its layout does not allow that
+  const int **rows = (const int **)malloc(n * sizeof(int *));
+  int *copy = NULL;
+  if (!rows) {
+    fprintf(stderr, "Could not allocate %d rows\n", n);
+    tsp_matrix_close(f.m);
+    return -1;
+  }
+  int i, j;
+  for (i = 0; i < n && (rows[i] = tsp_matrix_row(f.m, i)); i++);
+  if (i < n) {
+    copy = tsp_matrix_to_ints(f.m);
+    if (!copy) {
+      free(rows);
+      tsp_matrix_close(f.m);
+      return -1;
+    }
+    for (i = 0; i < n; i++) rows[i] = copy + (size_t)i * n;
+  }
+
+  long diagonal = 0, negative = 0, asymmetric_pairs = 0;
+  int largest = 0;
+  for (i = 0; i < n; i++) {
+    if (rows[i][i] != 0 && lint_show(&f, ++diagonal)) {
+      printf("%s: d[%d][%d] = %d is not 0, at %s\n", filename, i, i,
+	     rows[i][i], lint_point(&f, i, 0));
+    }
+    for (j = 0; j < n; j++) {
+      if (rows[i][j] > largest) largest = rows[i][j];
+      if (rows[i][j] < 0 && lint_show(&f, ++negative)) {
+	printf("%s: d[%d][%d] = %d is negative, from %s to %s\n", filename,
+	       i, j, rows[i][j], lint_point(&f, i, 0), lint_point(&f, j, 1));
+      }
+    }
+  }
+  lint_hidden(&f, diagonal, "diagonal entries that are not 0");
+  lint_hidden(&f, negative, "negative entries");
+
+  // the two sides of the diagonal, a block at a time so the columns
+  // being read stay in cache
+  int b = block;
+  for (int i0 = 0; i0 < n; i0 += b) {
+    for (int j0 = i0; j0 < n; j0 += b) {
+      for (i = i0; i < i0 + b && i < n; i++) {
+	for (j = (j0 > i + 1) ? j0 : i + 1; j < j0 + b && j < n; j++) {
+	  if (rows[i][j] == rows[j][i]) continue;
+	  asymmetric_pairs++;
+	  if (!asymmetric && lint_show(&f, asymmetric_pairs)) {
+	    printf("%s: d[%d][%d] = %d but d[%d][%d] = %d, between %s and %s\n",
+		   filename, i, j, rows[i][j], j, i, rows[j][i],
+		   lint_point(&f, i, 0), lint_point(&f, j, 1));
+	  }
+	}
+      }
+    }
+  }
+  if (!asymmetric) lint_hidden(&f, asymmetric_pairs, "asymmetric pairs");
+
+  int ok = 1;
+  if (triangle && negative > 0) {
+    printf("%s: not checking the triangle inequality with negative entries\n",
+	   filename);
+  }
+  else if (triangle && largest > INT_MAX / 2) {
+    printf("%s: not checking the triangle inequality with entries over %d\n",
+	   filename, INT_MAX / 2);
+  }
+  else if (triangle) {
+    ok = lint_triangle_check(&f, rows, largest, asymmetric_pairs == 0,
+			     block, nthreads);
+  }
+
+  printf("%s: %ld problem%s", filename, f.problems,
+	 (f.problems == 1) ? "" : "s");
+  if (f.warnings > 0) {
+    printf(", %ld warning%s", f.warnings, (f.warnings == 1) ? "" : "s");
+  }
+  printf("\n");
+  free(rows);
+  free(copy);
+  tsp_matrix_close(f.m);
+  return ok ? f.problems : -1;
+}
+
+int main(int argc, char *argv[]) {
+
+  long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+  int nthreads = (nprocs < 1) ? 1 : (int)nprocs;
+  int block = TSP_LINT_BLOCK;
+  long max = 0;
+  int asymmetric = 0;
+  int triangle = 1;
+  int opt;
+
+  static struct option long_options[] = {
+    { "block", required_argument, NULL, 'b' },
+    { "max", required_argument, NULL, 'm' },
+    { "asymmetric", no_argument, NULL, 'a' },
+    { "no-triangle", no_argument, NULL, 't' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  while ((opt = getopt_long(argc, argv, "j:", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'j':
+      nthreads = atoi(optarg);
+      if (nthreads < 1) {
+	fprintf(stderr, "Number of threads must be at least 1\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'b':
+      block = atoi(optarg);
+      if (block < 1 || block > 4096) {
+	fprintf(stderr, "Block size must be from 1 to 4096\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'm':
+      // print at most this many problems of each kind, still counting
+      // them all
+      max = atol(optarg);
+      if (max < 1) {
+	fprintf(stderr, "Number of problems to print must be at least 1\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'a':
+      // the files are meant to be asymmetric, so don't report it
+      asymmetric = 1;
+      break;
+    case 't':
+      triangle = 0;
+      break;
+    default:
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  if (optind == argc) {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  // exit status 1 if any file has problems or could not be checked,
+  // but not for warnings alone
+  int status = 0;
+  for (int arg = optind; arg < argc; arg++) {
+    if (lint_file_check(argv[arg], nthreads, block, max, asymmetric,
+			triangle) != 0) {
+      status = 1;
+    }
+  }
+  return status;
+}
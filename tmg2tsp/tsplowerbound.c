@@ -0,0 +1,596 @@
+/*
+  Lower bounds on TSP tour lengths, and the certificate files that
+  record them.
+
+  Removing an edge from a tour leaves a spanning tree, so no tour is
+  shorter than a minimum spanning tree.  Better, a tour is a 1-tree:
+  a spanning tree of the points other than point 0, plus two edges at
+  point 0.  Adding a penalty pi[p] to the length of every edge at each
+  point p adds exactly twice the sum of the penalties to every tour,
+  but changes which 1-tree is shortest, so the shortest 1-tree under
+  the penalties, less twice their sum, is a lower bound for any
+  penalties at all.  Subgradient optimization searches for penalties
+  that make that bound large, raising the penalties of points where
+  the 1-tree has more than two edges and lowering them where it has
+  only one, by a step that shrinks as the bound stops improving.
+
+  Trees are found by Prim's algorithm over all pairs of points, with
+  the points divided among threads: each round, every thread updates
+  the distances to the tree of its own points from the point just
+  added and finds its nearest one, then the nearest of those joins
+  the tree.  Or, for instances too large for that, by Kruskal's
+  algorithm over the edges between points and their nearest
+  neighbors, which gives an estimate rather than a bound, since the
+  shortest trees may use other edges.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tsplowerbound.h"
+
+// the state shared by the threads building one tree with Prim's
+// algorithm, over the points first through n-1
+typedef struct tsp_bound_prim {
+  tsp_bound_instance *inst;
+  const double *pi;  // penalties, or NULL for none
+  int first;
+  int nthreads;
+  double *key;  // distance of each point from the tree
+  int *from;  // the tree point it is that distance from
+  unsigned char *in_tree;
+  double *cand_key;  // for each thread, its nearest point to the tree
+  int *cand;
+  int next;  // the point added to the tree last
+  double weight;  // of the tree so far
+  int *degree;  // of each point in the tree
+  // held while threads are started, so none divides up the points or
+  // reaches the barrier before both are set for the number that
+  // actually started
+  pthread_mutex_t start;
+  pthread_barrier_t barrier;
+} tsp_bound_prim;
+
+// what each thread is given
+typedef struct tsp_bound_thread {
+  tsp_bound_prim *prim;
+  int id;
+} tsp_bound_thread;
+
+// an edge between a point and one of its neighbors
+typedef struct tsp_bound_edge {
+  double weight;  // with penalties
+  int length;  // without
+  int a;
+  int b;
+} tsp_bound_edge;
+
+// what the trees of one computation are built from
+typedef struct tsp_bound_graph {
+  tsp_bound_instance *inst;
+  int nthreads;
+  // for instances with neighbor lists, each edge once
+  tsp_bound_edge *edges;
+  size_t num_edges;
+  int *parent;  // for Kruskal's algorithm
+} tsp_bound_graph;
+
+/* the length of the edge between a and b, with penalties pi if any */
+static double tsp_bound_weight(tsp_bound_instance *inst, const double *pi,
+			       int a, int b) {
+
+  double w = inst->dist(inst->data, a, b);
+  if (pi) w += pi[a] + pi[b];
+  return w;
+}
+
+/*
+  Thread function: add points to the tree one at a time until all of
+  them are in it, working on a slice of the points.
+*/
+static void *tsp_bound_prim_worker(void *arg) {
+
+  tsp_bound_thread *th = (tsp_bound_thread *)arg;
+  tsp_bound_prim *t = th->prim;
+  pthread_mutex_lock(&(t->start));
+  pthread_mutex_unlock(&(t->start));
+  int n = t->inst->n;
+  int count = n - t->first;
+  int per = (count + t->nthreads - 1) / t->nthreads;
+  int lo = t->first + th->id * per;
+  int hi = lo + per;
+  if (lo > n) lo = n;
+  if (hi > n) hi = n;
+
+  for (int added = 1; added < count; added++) {
+    int v = t->next;
+    double best = DBL_MAX;
+    int nearest = -1;
+    for (int j = lo; j < hi; j++) {
+      if (t->in_tree[j]) continue;
+      double w = tsp_bound_weight(t->inst, t->pi, v, j);
+      if (w < t->key[j]) {
+	t->key[j] = w;
+	t->from[j] = v;
+      }
+      if (t->key[j] < best) {
+	best = t->key[j];
+	nearest = j;
+      }
+    }
+    t->cand_key[th->id] = best;
+    t->cand[th->id] = nearest;
+    pthread_barrier_wait(&(t->barrier));
+
+    // thread 0 adds the nearest point of all, the lowest numbered if
+    // there is a tie, while the others wait
+    if (th->id == 0) {
+      int c = -1;
+      for (int i = 0; i < t->nthreads; i++) {
+	if (t->cand[i] >= 0 && (c < 0 || t->cand_key[i] < t->cand_key[c])) {
+	  c = i;
+	}
+      }
+      int p = t->cand[c];
+      t->in_tree[p] = 1;
+      t->weight += t->key[p];
+      t->degree[p]++;
+      t->degree[t->from[p]]++;
+      t->next = p;
+    }
+    pthread_barrier_wait(&(t->barrier));
+  }
+  return NULL;
+}
+
+/*
+  Find a minimum spanning tree of points first through n-1 over all
+  pairs of them, under penalties pi if not NULL, by Prim's algorithm
+  in parallel.  Adds each point's degree in the tree to degree and
+  sets *weight to the tree's weight.  Returns 1 on success, 0 if out
+  of memory.
+*/
+static int tsp_bound_prim_tree(tsp_bound_graph *g, const double *pi,
+			       int first, int *degree, double *weight) {
+
+  int n = g->inst->n;
+  int nthreads = g->nthreads;
+  tsp_bound_prim t;
+  t.inst = g->inst;
+  t.pi = pi;
+  t.first = first;
+  t.nthreads = nthreads;
+  t.key = (double *)malloc(n * sizeof(double));
+  t.from = (int *)malloc(n * sizeof(int));
+  t.in_tree = (unsigned char *)calloc(n, 1);
+  t.cand_key = (double *)malloc(nthreads * sizeof(double));
+  t.cand = (int *)malloc(nthreads * sizeof(int));
+  tsp_bound_thread *threads =
+    (tsp_bound_thread *)malloc(nthreads * sizeof(tsp_bound_thread));
+  pthread_t *tids = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+  int ok = (t.key && t.from && t.in_tree && t.cand_key && t.cand &&
+	    threads && tids);
+  if (ok) {
+    for (int i = 0; i < n; i++) {
+      t.key[i] = DBL_MAX;
+    }
+    t.next = first;
+    t.in_tree[first] = 1;
+    t.weight = 0.0;
+    t.degree = degree;
+    for (int i = 0; i < nthreads; i++) {
+      threads[i].prim = &t;
+      threads[i].id = i;
+    }
+    // the calling thread is thread 0, and builds the whole tree if no
+    // others can be started
+    pthread_mutex_init(&(t.start), NULL);
+    pthread_mutex_lock(&(t.start));
+    int started = 1;
+    while (started < nthreads &&
+	   pthread_create(&tids[started], NULL, tsp_bound_prim_worker,
+			  &threads[started]) == 0) {
+      started++;
+    }
+    t.nthreads = started;
+    pthread_barrier_init(&(t.barrier), NULL, started);
+    pthread_mutex_unlock(&(t.start));
+    tsp_bound_prim_worker(&threads[0]);
+    for (int i = 1; i < started; i++) {
+      pthread_join(tids[i], NULL);
+    }
+    pthread_barrier_destroy(&(t.barrier));
+    pthread_mutex_destroy(&(t.start));
+    *weight = t.weight;
+  }
+  else {
+    fprintf(stderr, "Could not allocate spanning tree of %d points\n", n);
+  }
+  free(t.key);
+  free(t.from);
+  free(t.in_tree);
+  free(t.cand_key);
+  free(t.cand);
+  free(threads);
+  free(tids);
+  return ok;
+}
+
+/* qsort comparison: lighter edges first, ties by their points */
+static int tsp_bound_edge_compare(const void *x, const void *y) {
+
+  const tsp_bound_edge *e = (const tsp_bound_edge *)x;
+  const tsp_bound_edge *f = (const tsp_bound_edge *)y;
+  if (e->weight != f->weight) return (e->weight < f->weight) ? -1 : 1;
+  if (e->a != f->a) return (e->a < f->a) ? -1 : 1;
+  return (e->b > f->b) - (e->b < f->b);
+}
+
+/* the representative of p's tree, with path halving */
+static int tsp_bound_find(int *parent, int p) {
+
+  while (parent[p] != p) {
+    parent[p] = parent[parent[p]];
+    p = parent[p];
+  }
+  return p;
+}
+
+/*
+  As tsp_bound_prim_tree, but over only the edges between points and
+  their neighbors, by Kruskal's algorithm.  Returns 0 if those edges
+  do not connect the points.
+*/
+static int tsp_bound_kruskal_tree(tsp_bound_graph *g, const double *pi,
+				  int first, int *degree, double *weight) {
+
+  int n = g->inst->n;
+  for (size_t e = 0; e < g->num_edges; e++) {
+    tsp_bound_edge *edge = &(g->edges[e]);
+    edge->weight = edge->length;
+    if (pi) edge->weight += pi[edge->a] + pi[edge->b];
+  }
+  qsort(g->edges, g->num_edges, sizeof(tsp_bound_edge),
+	tsp_bound_edge_compare);
+
+  for (int p = 0; p < n; p++) {
+    g->parent[p] = p;
+  }
+  int joined = 0;
+  *weight = 0.0;
+  for (size_t e = 0; e < g->num_edges && joined < n - first - 1; e++) {
+    tsp_bound_edge *edge = &(g->edges[e]);
+    if (edge->a < first) continue;
+    int ra = tsp_bound_find(g->parent, edge->a);
+    int rb = tsp_bound_find(g->parent, edge->b);
+    if (ra == rb) continue;
+    g->parent[ra] = rb;
+    *weight += edge->weight;
+    degree[edge->a]++;
+    degree[edge->b]++;
+    joined++;
+  }
+  if (joined < n - first - 1) {
+    fprintf(stderr, "The edges to %d nearest neighbors do not connect the points, try more\n",
+	    g->inst->k);
+    return 0;
+  }
+  return 1;
+}
+
+/* a minimum spanning tree of points first through n-1, either way */
+static int tsp_bound_tree(tsp_bound_graph *g, const double *pi, int first,
+			  int *degree, double *weight) {
+
+  memset(degree, 0, g->inst->n * sizeof(int));
+  if (g->edges) return tsp_bound_kruskal_tree(g, pi, first, degree, weight);
+  return tsp_bound_prim_tree(g, pi, first, degree, weight);
+}
+
+/*
+  Find a shortest 1-tree under penalties pi, setting degree to the
+  degree of each point in it and *value to its weight less twice the
+  sum of the penalties, the bound it gives.  Returns 1 on success.
+*/
+static int tsp_bound_one_tree(tsp_bound_graph *g, const double *pi,
+			      int *degree, double *value) {
+
+  int n = g->inst->n;
+  double weight;
+  if (!tsp_bound_tree(g, pi, 1, degree, &weight)) return 0;
+
+  // the two shortest edges at point 0
+  double best[2] = { DBL_MAX, DBL_MAX };
+  int near[2] = { -1, -1 };
+  for (int i = 0; i < (g->edges ? g->inst->k : n - 1); i++) {
+    int p = g->edges ? g->inst->neighbors[i] : i + 1;
+    double w = tsp_bound_weight(g->inst, pi, 0, p);
+    if (w < best[0]) {
+      best[1] = best[0];
+      near[1] = near[0];
+      best[0] = w;
+      near[0] = p;
+    }
+    else if (w < best[1]) {
+      best[1] = w;
+      near[1] = p;
+    }
+  }
+  if (near[1] < 0) {
+    fprintf(stderr, "Point 0 needs at least 2 neighbors\n");
+    return 0;
+  }
+  degree[0] = 2;
+  degree[near[0]]++;
+  degree[near[1]]++;
+  weight += best[0] + best[1];
+  for (int p = 0; p < n; p++) {
+    weight -= 2 * pi[p];
+  }
+  *value = weight;
+  return 1;
+}
+
+/* the smallest whole number that value, computed in floating point,
+   could be */
+static long tsp_bound_round_up(double value) {
+
+  return (long)ceil(value - 1e-9 * fabs(value) - 1e-6);
+}
+
+/*
+  Compute the lower bounds on tours of the points of inst, running up
+  to iterations rounds of subgradient optimization with nthreads
+  threads.  tour is the length of a known tour, or -1, which the
+  subgradient steps aim at, and which ends the search if the bound
+  reaches it.  Returns the newly allocated bounds, NULL on failure.
+*/
+tsp_bound *tsp_bound_compute(tsp_bound_instance *inst, long tour,
+			     int iterations, int nthreads) {
+
+  int n = inst->n;
+  if (nthreads < 1) nthreads = 1;
+  tsp_bound *b = (tsp_bound *)calloc(1, sizeof(tsp_bound));
+  double *pi = (double *)calloc(n, sizeof(double));
+  int *degree = (int *)malloc(n * sizeof(int));
+  tsp_bound_graph g;
+  memset(&g, 0, sizeof(tsp_bound_graph));
+  g.inst = inst;
+  g.nthreads = nthreads;
+  int ok = (b && pi && degree);
+  if (ok) {
+    b->n = n;
+    b->exact = (inst->neighbors == NULL);
+    b->tour = tour;
+    b->pi = (double *)calloc(n, sizeof(double));
+    ok = (b->pi != NULL);
+  }
+
+  // the only tour of fewer than 3 points is twice the only edge
+  if (ok && n < 3) {
+    b->mst = (n == 2) ? inst->dist(inst->data, 0, 1) : 0;
+    b->one_tree = 2 * b->mst;
+    free(pi);
+    free(degree);
+    return b;
+  }
+
+  if (ok && inst->neighbors) {
+    int k = inst->k;
+    g.edges = (tsp_bound_edge *)malloc((size_t)n * k *
+				       sizeof(tsp_bound_edge));
+    g.parent = (int *)malloc(n * sizeof(int));
+    ok = (g.edges && g.parent);
+    // each edge once, even when both its points list the other
+    for (int p = 0; ok && p < n; p++) {
+      for (int i = 0; i < k; i++) {
+	int q = inst->neighbors[(size_t)p * k + i];
+	if (q < p) {
+	  int j;
+	  for (j = 0; j < k && inst->neighbors[(size_t)q * k + j] != p; j++);
+	  if (j < k) continue;
+	}
+	g.edges[g.num_edges].a = (p < q) ? p : q;
+	g.edges[g.num_edges].b = (p < q) ? q : p;
+	g.edges[g.num_edges].length = inst->dist(inst->data, p, q);
+	g.num_edges++;
+      }
+    }
+  }
+  if (!ok) {
+    fprintf(stderr, "Could not allocate bounds for %d points\n", n);
+  }
+
+  // the spanning tree bound needs no penalties, and has whole weight
+  double weight;
+  ok = ok && tsp_bound_tree(&g, NULL, 0, degree, &weight);
+  if (ok) b->mst = (long)(weight + 0.5);
+
+  double best = -DBL_MAX;
+  double lambda = 2.0;
+  int stalled = 0;
+  for (int it = 0; ok && it < iterations; it++) {
+    double value;
+    ok = tsp_bound_one_tree(&g, pi, degree, &value);
+    if (!ok) break;
+    b->iterations = it + 1;
+    if (value > best) {
+      best = value;
+      memcpy(b->pi, pi, n * sizeof(double));
+      stalled = 0;
+    }
+    else if (++stalled == TSP_BOUND_PATIENCE) {
+      lambda /= 2.0;
+      stalled = 0;
+    }
+
+    // a 1-tree where every point has two edges is a tour, and no
+    // bound can pass a known tour
+    long norm = 0;
+    for (int p = 0; p < n; p++) {
+      norm += (long)(degree[p] - 2) * (degree[p] - 2);
+    }
+    if (norm == 0 || (tour >= 0 && tsp_bound_round_up(best) >= tour)) break;
+
+    // aim at the known tour, or just past the bound if there is none
+    double target = (tour >= 0 && tour > value) ? tour :
+      value + 0.01 * fabs(value) + 1.0;
+    double step = lambda * (target - value) / norm;
+    for (int p = 0; p < n; p++) {
+      pi[p] += step * (degree[p] - 2);
+    }
+  }
+  if (ok) b->one_tree = tsp_bound_round_up(best);
+
+  free(pi);
+  free(degree);
+  free(g.edges);
+  free(g.parent);
+  if (!ok) {
+    tsp_bound_destroy(b);
+    return NULL;
+  }
+  return b;
+}
+
+/*
+  Check bounds loaded from a certificate against the instance they
+  are said to be for, which must be over all pairs of points: the
+  spanning tree bound and the 1-tree bound under the certificate's
+  penalties are computed again with nthreads threads, and must be the
+  ones the certificate gives.  Takes about as long as one subgradient
+  iteration.  Returns 1 if they are, 0 if not or if out of memory.
+*/
+int tsp_bound_verify(tsp_bound_instance *inst, tsp_bound *b, int nthreads) {
+
+  int n = inst->n;
+  if (b->n != n) return 0;
+  if (n < 3) {
+    long mst = (n == 2) ? inst->dist(inst->data, 0, 1) : 0;
+    return b->mst == mst && b->one_tree == 2 * mst;
+  }
+  for (int p = 0; p < n; p++) {
+    if (!isfinite(b->pi[p])) return 0;
+  }
+
+  int *degree = (int *)malloc(n * sizeof(int));
+  if (!degree) {
+    fprintf(stderr, "Could not allocate bounds for %d points\n", n);
+    return 0;
+  }
+  tsp_bound_graph g;
+  memset(&g, 0, sizeof(tsp_bound_graph));
+  g.inst = inst;
+  g.nthreads = (nthreads < 1) ? 1 : nthreads;
+  double weight, value;
+  int ok = tsp_bound_tree(&g, NULL, 0, degree, &weight) &&
+    tsp_bound_one_tree(&g, b->pi, degree, &value);
+  free(degree);
+  return ok && b->mst == (long)(weight + 0.5) &&
+    b->one_tree == tsp_bound_round_up(value);
+}
+
+/* the better of the bounds */
+long tsp_bound_best(tsp_bound *b) {
+
+  return (b->one_tree > b->mst) ? b->one_tree : b->mst;
+}
+
+/*
+  Write bounds to a certificate file, or to stdout if filename is
+  NULL, naming source as the instance they are for.  Returns 1 on
+  success.
+*/
+int tsp_bound_write(char *filename, tsp_bound *b, const char *source) {
+
+  FILE *fp = filename ? fopen(filename, "w") : stdout;
+  if (!fp) {
+    fprintf(stderr, "Could not open file %s for writing\n", filename);
+    return 0;
+  }
+  fprintf(fp, "%s\n", TSP_BOUND_MAGIC);
+  fprintf(fp, "source %s\n", source);
+  fprintf(fp, "points %d\n", b->n);
+  fprintf(fp, "exact %d\n", b->exact);
+  fprintf(fp, "mst %ld\n", b->mst);
+  fprintf(fp, "one-tree %ld\n", b->one_tree);
+  fprintf(fp, "tour %ld\n", b->tour);
+  fprintf(fp, "iterations %d\n", b->iterations);
+  fprintf(fp, "penalties\n");
+  for (int p = 0; p < b->n; p++) {
+    fprintf(fp, "%.17g\n", b->pi[p]);
+  }
+  int ok = !ferror(fp);
+  if (filename) ok = (fclose(fp) == 0) && ok;
+  else ok = (fflush(fp) == 0) && ok;
+  if (!ok) {
+    fprintf(stderr, "Could not write bound certificate %s\n",
+	    filename ? filename : "to standard output");
+  }
+  return ok;
+}
+
+/*
+  Read a certificate file written by tsp_bound_write.  Returns the
+  newly allocated bounds, NULL if the file could not be read or is
+  not a certificate.
+*/
+tsp_bound *tsp_bound_load(char *filename) {
+
+  FILE *fp = fopen(filename, "r");
+  if (!fp) {
+    fprintf(stderr, "Could not open bound certificate %s\n", filename);
+    return NULL;
+  }
+  tsp_bound *b = (tsp_bound *)calloc(1, sizeof(tsp_bound));
+  char line[1024];
+  int ok = (b != NULL) && fgets(line, sizeof(line), fp) &&
+    strncmp(line, TSP_BOUND_MAGIC, strlen(TSP_BOUND_MAGIC)) == 0;
+  if (ok) {
+    b->tour = -1;
+    b->n = -1;
+  }
+  while (ok && fgets(line, sizeof(line), fp)) {
+    char key[64];
+    long value;
+    if (strncmp(line, "penalties", 9) == 0) {
+      ok = (b->n > 0);
+      if (ok) b->pi = (double *)malloc(b->n * sizeof(double));
+      ok = ok && (b->pi != NULL);
+      for (int p = 0; ok && p < b->n; p++) {
+	ok = (fscanf(fp, "%lf", &(b->pi[p])) == 1);
+      }
+      break;
+    }
+    if (strncmp(line, "source ", 7) == 0) continue;
+    ok = (sscanf(line, "%63s %ld", key, &value) == 2);
+    if (!ok) break;
+    if (strcmp(key, "points") == 0) b->n = (int)value;
+    else if (strcmp(key, "exact") == 0) b->exact = (int)value;
+    else if (strcmp(key, "mst") == 0) b->mst = value;
+    else if (strcmp(key, "one-tree") == 0) b->one_tree = value;
+    else if (strcmp(key, "tour") == 0) b->tour = value;
+    else if (strcmp(key, "iterations") == 0) b->iterations = (int)value;
+  }
+  fclose(fp);
+  if (!ok || b->n < 1 || !b->pi) {
+    fprintf(stderr, "File %s is not a valid bound certificate\n", filename);
+    if (b) tsp_bound_destroy(b);
+    return NULL;
+  }
+  return b;
+}
+
+/* free all memory of bounds */
+void tsp_bound_destroy(tsp_bound *b) {
+
+  free(b->pi);
+  free(b);
+}
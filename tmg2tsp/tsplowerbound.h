@@ -0,0 +1,71 @@
+/*
+  Structure definitions and function prototypes for lower bounds on
+  the length of TSP tours: the minimum spanning tree, and the
+  Held-Karp bound, the best 1-tree bound found by subgradient
+  optimization of penalties on the points.
+
+  A bound certificate file is text: a first line of
+  TSP_BOUND_MAGIC, then lines of a keyword and a value, for the
+  instance the bound is for ("source", informational only), its
+  number of points ("points"), whether the bound holds for certain
+  ("exact", 1 if computed over all pairs of points, 0 if only over
+  nearest neighbor lists, which makes it an estimate), the minimum
+  spanning tree bound ("mst"), the 1-tree bound ("one-tree"), the
+  length of a tour found along the way, -1 if none ("tour"), and the
+  number of subgradient iterations run ("iterations").  A line
+  "penalties" ends them, followed by the penalty of each point, one
+  per line, with which the 1-tree bound can be checked, as
+  tsp_bound_verify does before a solver trusts the bound.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TSPLOWERBOUND_H
+#define _TSPLOWERBOUND_H
+
+#define TSP_BOUND_MAGIC "TSP bound certificate"
+
+// subgradient iterations, when not specified
+#define TSP_BOUND_ITERATIONS 100
+
+// iterations without a better bound before the step size is halved
+#define TSP_BOUND_PATIENCE 5
+
+// the distance between points a and b, which must be the same as
+// between b and a
+typedef int (*tsp_bound_distance)(void *data, int a, int b);
+
+typedef struct tsp_bound_instance {
+  int n;
+  tsp_bound_distance dist;
+  void *data;  // passed to dist
+  // if neighbors is not NULL, trees are only built from the edges
+  // between each point and its k nearest others, listed at
+  // neighbors[p*k] through neighbors[p*k+k-1]
+  int k;
+  const int *neighbors;
+} tsp_bound_instance;
+
+// bounds computed or loaded from a certificate
+typedef struct tsp_bound {
+  int n;
+  int exact;
+  long mst;
+  long one_tree;
+  long tour;
+  int iterations;
+  double *pi;  // n penalties
+} tsp_bound;
+
+// function prototypes
+extern tsp_bound *tsp_bound_compute(tsp_bound_instance *inst, long tour,
+				    int iterations, int nthreads);
+extern int tsp_bound_verify(tsp_bound_instance *inst, tsp_bound *b,
+			    int nthreads);
+extern long tsp_bound_best(tsp_bound *b);
+extern int tsp_bound_write(char *filename, tsp_bound *b, const char *source);
+extern tsp_bound *tsp_bound_load(char *filename);
+extern void tsp_bound_destroy(tsp_bound *b);
+
+#endif  // _TSPLOWERBOUND_H
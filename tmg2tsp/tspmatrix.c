@@ -0,0 +1,701 @@
+/*
+  Functions for reading and writing TSP distance matrix files, in the
+  repository's text format or the memory-mappable binary format
+  described in tspmatrix.h.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tspmatrix.h"
+
+// define the array that's externed in the header file
+char *tsp_layout_names[] = { "full", "upper" };
+
+/* decode little-endian integers of each supported width */
+static int tsp_get_le(const unsigned char *p, int elem_size) {
+
+  if (elem_size == 2) {
+    return p[0] | (p[1] << 8);
+  }
+  return (int)((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	       ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+/* encode a little-endian integer of the given width */
+static void tsp_put_le(unsigned char *p, int value, int elem_size) {
+
+  uint32_t v = (uint32_t)value;
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  if (elem_size == 4) {
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+  }
+}
+
+/* is this a little-endian host, so mapped rows can be used directly? */
+static int tsp_host_is_little_endian() {
+
+  const uint16_t one = 1;
+  return *(const unsigned char *)&one == 1;
+}
+
+/* round up to a multiple of align, a power of 2 */
+static uint64_t tsp_align(uint64_t x, uint64_t align) {
+
+  return (x + align - 1) & ~(align - 1);
+}
+
+/*
+  Fill in the size and offset fields of a header for an n x n matrix
+  with the given element size and layout.
+*/
+static void tsp_header_init(tsp_matrix_file_header *h, int n, int elem_size,
+			    tsp_layout layout) {
+
+  memset(h, 0, sizeof(tsp_matrix_file_header));
+  memcpy(h->magic, TSP_MATRIX_MAGIC, sizeof(h->magic));
+  h->version = TSP_MATRIX_VERSION;
+  h->n = n;
+  h->elem_size = elem_size;
+  h->layout = layout;
+  h->data_offset = sizeof(tsp_matrix_file_header);
+  if (layout == TSP_LAYOUT_FULL) {
+    h->row_stride = tsp_align((uint64_t)n * elem_size, TSP_ROW_ALIGN);
+    h->data_size = (uint64_t)n * h->row_stride;
+  }
+  else {
+    h->row_stride = 0;
+    h->data_size = (uint64_t)n * (n + 1) / 2 * elem_size;
+  }
+  h->labels_offset = tsp_align(h->data_offset + h->data_size, 8);
+}
+
+/*
+  Encode a header field by field into buf, so the file is little-endian
+  whatever the host.
+*/
+static void tsp_header_encode(tsp_matrix_file_header *h, unsigned char *buf) {
+
+  memset(buf, 0, sizeof(tsp_matrix_file_header));
+  memcpy(buf, h->magic, sizeof(h->magic));
+  tsp_put_le(buf + 8, h->version, 4);
+  tsp_put_le(buf + 12, h->n, 4);
+  tsp_put_le(buf + 16, h->elem_size, 4);
+  tsp_put_le(buf + 20, h->layout, 4);
+  uint64_t fields[4] = { h->row_stride, h->data_offset, h->data_size,
+			 h->labels_offset };
+  int i;
+  for (i = 0; i < 4; i++) {
+    tsp_put_le(buf + 24 + 8*i, (int)(fields[i] & 0xffffffff), 4);
+    tsp_put_le(buf + 28 + 8*i, (int)(fields[i] >> 32), 4);
+  }
+}
+
+/*
+  Does the named file start with the binary matrix magic number?
+*/
+int tsp_file_is_binary(char *filename) {
+
+  char magic[8];
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) return 0;
+  int is_binary = (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+		   memcmp(magic, TSP_MATRIX_MAGIC, sizeof(magic)) == 0);
+  fclose(fp);
+  return is_binary;
+}
+
+/*
+  Load a matrix from either a binary or a text file, NULL on failure.
+*/
+tsp_matrix *tsp_matrix_load(char *filename) {
+
+  if (tsp_file_is_binary(filename)) {
+    return tsp_matrix_open_binary(filename);
+  }
+  return tsp_matrix_load_text(filename);
+}
+
+/*
+  Map a binary matrix file, NULL if it can't be opened or is not
+  valid.  The matrix data is not copied or converted.
+*/
+tsp_matrix *tsp_matrix_open_binary(char *filename) {
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Could not open file %s for reading\n", filename);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(tsp_matrix_file_header)) {
+    fprintf(stderr, "File %s is too small to be a binary matrix\n", filename);
+    close(fd);
+    return NULL;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Could not map file %s\n", filename);
+    return NULL;
+  }
+
+  // the header is read through its byte encoding so this also works
+  // on big-endian hosts
+  tsp_matrix_file_header h;
+  const unsigned char *p = (const unsigned char *)map;
+  memcpy(h.magic, p, sizeof(h.magic));
+  h.version = tsp_get_le(p + 8, 4);
+  h.n = tsp_get_le(p + 12, 4);
+  h.elem_size = tsp_get_le(p + 16, 4);
+  h.layout = tsp_get_le(p + 20, 4);
+  tsp_matrix_file_header expect;
+  if (memcmp(h.magic, TSP_MATRIX_MAGIC, sizeof(h.magic)) != 0 ||
+      h.version != TSP_MATRIX_VERSION ||
+      (h.elem_size != 2 && h.elem_size != 4) ||
+      (h.layout != TSP_LAYOUT_FULL && h.layout != TSP_LAYOUT_UPPER) ||
+      h.n < 1 || h.n > 0x7fffffff) {
+    fprintf(stderr, "File %s is not a valid binary matrix file\n", filename);
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  tsp_header_init(&expect, h.n, h.elem_size, h.layout);
+  if ((uint64_t)st.st_size < expect.labels_offset) {
+    fprintf(stderr, "Binary matrix file %s is truncated\n", filename);
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  tsp_matrix *m = (tsp_matrix *)calloc(1, sizeof(tsp_matrix));
+  m->n = h.n;
+  m->layout = h.layout;
+  m->elem_size = h.elem_size;
+  m->row_stride = expect.row_stride;
+  m->data = p + expect.data_offset;
+  m->map = map;
+  m->map_size = st.st_size;
+
+  // find the labels, which run through the end of the file
+  m->labels = (char **)calloc(m->n, sizeof(char *));
+  const char *label = (const char *)p + expect.labels_offset;
+  const char *end = (const char *)p + st.st_size;
+  int i;
+  for (i = 0; i < m->n && label < end; i++) {
+    const char *nul = memchr(label, '\0', end - label);
+    if (!nul) break;
+    m->labels[i] = (char *)label;
+    label = nul + 1;
+  }
+  return m;
+}
+
+/* can c separate the entries of a text matrix, within a line? */
+static int tsp_text_space(char c) {
+
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/*
+  Parse the integer at p, which must be followed by whitespace or the
+  end of the text, into *value.  Returns the first character after it,
+  or NULL if there is no integer there or it does not fit in an int.
+  This is the inner loop of reading a large text matrix, so digits
+  are converted directly rather than with strtol.
+*/
+static char *tsp_text_int(char *p, int *value) {
+
+  int negative = (*p == '-');
+  if (negative || *p == '+') p++;
+  if ((unsigned)(*p - '0') > 9) return NULL;
+  long v = 0;
+  while ((unsigned)(*p - '0') <= 9) {
+    v = v * 10 + (*p++ - '0');
+    if (v > 0x7fffffff) return NULL;
+  }
+  if (*p && *p != '\n' && !tsp_text_space(*p)) return NULL;
+  *value = (int)(negative ? -v : v);
+  return p;
+}
+
+/*
+  Read the integers on the line starting at p, storing up to room of
+  them in values and the number stored in *count, and counting any
+  more in *extra.  How the line is laid out is added to c.  Returns
+  the start of the next line, or NULL if the line holds anything
+  other than integers.
+*/
+static char *tsp_text_line(char *p, int *values, size_t room, int *count,
+			   int *extra, tsp_text_check *c) {
+
+  int stored = 0, more = 0;
+  int space = 0;  // whitespace since the last entry: 1 tab, 2 other
+  int tabs = 0, spaces = 0, crlf = 0;
+  while (*p && *p != '\n') {
+    if (*p == '\r' && p[1] == '\n') {
+      crlf = 1;
+      p++;
+      continue;
+    }
+    if (tsp_text_space(*p)) {
+      space |= (*p == '\t') ? 1 : 2;
+      p++;
+      continue;
+    }
+    int v;
+    char *after = tsp_text_int(p, &v);
+    if (!after) return NULL;
+    if (stored + more > 0) {
+      tabs |= space & 1;
+      spaces |= space & 2;
+    }
+    space = 0;
+    if ((size_t)stored < room) values[stored++] = v;
+    else more++;
+    p = after;
+  }
+
+  if (space) c->trailing_space_lines++;
+  if (tabs) c->tab_lines++;
+  if (spaces) c->space_lines++;
+  if (*p) {
+    p++;
+    if (crlf) c->crlf_lines++;
+    else c->lf_lines++;
+  }
+  *count = stored;
+  *extra = more;
+  return p;
+}
+
+/*
+  Parse a matrix in the text format: the number of points n, then n*n
+  whitespace-separated integers, then optionally a label for each
+  point, one per line.  Blank lines and a heading line ending in ':'
+  (like "Cities in order:") before the labels are skipped.  Returns
+  NULL on failure.
+*/
+tsp_matrix *tsp_matrix_load_text(char *filename) {
+
+  return tsp_matrix_load_text_checked(filename, NULL);
+}
+
+/*
+  tsp_matrix_load_text, also describing in check, unless it is NULL,
+  how the file is laid out: rows split or run together across lines,
+  blank lines, trailing whitespace, mixed separators or line endings,
+  entries beyond the n*n the first line calls for, and how many
+  labels there are.  None of these stop the matrix from loading, but
+  a linter can report them.
+*/
+tsp_matrix *tsp_matrix_load_text_checked(char *filename,
+					 tsp_text_check *check) {
+
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "Could not open file %s for reading\n", filename);
+    return NULL;
+  }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  char *text = (char *)malloc(size + 1);
+  if (!text || fread(text, 1, size, fp) != (size_t)size) {
+    fprintf(stderr, "Could not read file %s\n", filename);
+    free(text);
+    fclose(fp);
+    return NULL;
+  }
+  fclose(fp);
+  text[size] = '\0';
+
+  tsp_text_check c;
+  memset(&c, 0, sizeof(c));
+  char *p = text;
+  int lineno = 1;
+  while (isspace((unsigned char)*p)) {
+    if (*p++ == '\n') lineno++;
+  }
+  int first_line = lineno;
+  int n;
+  char *after = tsp_text_int(p, &n);
+  if (!after || n < 1) {
+    fprintf(stderr, "File %s does not start with a number of points\n",
+	    filename);
+    free(text);
+    return NULL;
+  }
+  p = after;
+
+  tsp_matrix *m = (tsp_matrix *)calloc(1, sizeof(tsp_matrix));
+  m->n = n;
+  m->layout = TSP_LAYOUT_FULL;
+  m->elem_size = 4;
+  m->row_stride = (size_t)n * sizeof(int);
+  m->values = (int *)malloc((size_t)n * n * sizeof(int));
+  m->labels = (char **)calloc(n, sizeof(char *));
+  m->label_text = text;
+  if (!m->values || !m->labels) {
+    fprintf(stderr, "Could not allocate %d x %d matrix\n", n, n);
+    tsp_matrix_close(m);
+    return NULL;
+  }
+  m->data = (const unsigned char *)m->values;
+
+  // entries a line at a time, starting with any after the number of
+  // points on the first line, which only the line counts depend on:
+  // the entries are read the same however they are split into lines
+  size_t k = 0, total = (size_t)n * n;
+  int count, extra;
+  char *next = tsp_text_line(p, m->values, total, &count, &extra, &c);
+  while (next) {
+    if (count + extra > 0) {
+      c.matrix_lines++;
+      if (count + extra != n) {
+	if (c.bad_rows++ == 0) {
+	  c.bad_row_line = lineno;
+	  c.bad_row_count = count + extra;
+	}
+      }
+    }
+    else if (lineno > first_line) {
+      c.blank_lines++;
+    }
+    k += count;
+    c.extra_entries += extra;
+    p = next;
+    if (k == total || !*p) break;
+    lineno++;
+    next = tsp_text_line(p, m->values + k, total - k, &count, &extra, &c);
+  }
+  c.lines = lineno;
+  if (!next) {
+    fprintf(stderr, "Line %d of file %s has something other than integer entries\n",
+	    lineno, filename);
+    tsp_matrix_close(m);
+    return NULL;
+  }
+  if (k < total) {
+    fprintf(stderr, "File %s has only %zu of %zu matrix entries\n",
+	    filename, k, total);
+    tsp_matrix_close(m);
+    return NULL;
+  }
+
+  // lines of nothing but integers right after the matrix, which are
+  // more likely rows than labels: the first line has too few points
+  tsp_text_check after_matrix;
+  memset(&after_matrix, 0, sizeof(after_matrix));
+  char *q = p;
+  while ((q = tsp_text_line(q, NULL, 0, &count, &extra, &after_matrix))
+	 && extra > 0) {
+    c.extra_rows++;
+  }
+
+  // the rest of the file is lines that may contain labels: terminate
+  // each line in place and trim trailing whitespace
+  count = 0;
+  while (*p && count < n) {
+    char *line = p;
+    while (*p && *p != '\n') p++;
+    if (*p) *p++ = '\0';
+    char *e = line + strlen(line);
+    while (e > line && isspace((unsigned char)e[-1])) *--e = '\0';
+    while (isspace((unsigned char)*line)) line++;
+    if (*line == '\0') continue;
+    if (count == 0 && e[-1] == ':') continue;
+    m->labels[count++] = line;
+  }
+  c.labels = count;
+  if (check) *check = c;
+  return m;
+}
+
+/* get the entry at row i, column j */
+int tsp_matrix_get(tsp_matrix *m, int i, int j) {
+
+  const unsigned char *p;
+  if (m->layout == TSP_LAYOUT_FULL) {
+    p = m->data + (size_t)i * m->row_stride + (size_t)j * m->elem_size;
+  }
+  else {
+    if (i > j) {
+      int tmp = i;
+      i = j;
+      j = tmp;
+    }
+    size_t index = (size_t)i * m->n - (size_t)i * (i - 1) / 2 + (j - i);
+    p = m->data + index * m->elem_size;
+  }
+  if (m->values) return *(const int *)p;
+  return tsp_get_le(p, m->elem_size);
+}
+
+/*
+  Get a pointer to row i that can be indexed directly, without any
+  copying, when the matrix layout allows it: full rows of 4-byte
+  elements on a little-endian host, or any text matrix.  NULL
+  otherwise, in which case use tsp_matrix_get or tsp_matrix_to_ints.
+*/
+const int32_t *tsp_matrix_row(tsp_matrix *m, int i) {
+
+  if (m->layout != TSP_LAYOUT_FULL || m->elem_size != 4) return NULL;
+  if (!m->values && !tsp_host_is_little_endian()) return NULL;
+  return (const int32_t *)(m->data + (size_t)i * m->row_stride);
+}
+
+/*
+  Copy the matrix into a newly allocated full n x n array of ints,
+  NULL if it could not be allocated.
+*/
+int *tsp_matrix_to_ints(tsp_matrix *m) {
+
+  int *a = (int *)malloc((size_t)m->n * m->n * sizeof(int));
+  if (!a) {
+    fprintf(stderr, "Could not allocate %d x %d matrix\n", m->n, m->n);
+    return NULL;
+  }
+  int i, j;
+  for (i = 0; i < m->n; i++) {
+    const int32_t *row = tsp_matrix_row(m, i);
+    if (row) {
+      memcpy(a + (size_t)i * m->n, row, m->n * sizeof(int));
+      continue;
+    }
+    for (j = 0; j < m->n; j++) {
+      a[(size_t)i * m->n + j] = tsp_matrix_get(m, i, j);
+    }
+  }
+  return a;
+}
+
+/* is the matrix the same across its diagonal? */
+int tsp_matrix_is_symmetric(tsp_matrix *m) {
+
+  if (m->layout == TSP_LAYOUT_UPPER) return 1;
+  for (int i = 0; i < m->n; i++) {
+    for (int j = i + 1; j < m->n; j++) {
+      if (tsp_matrix_get(m, i, j) != tsp_matrix_get(m, j, i)) return 0;
+    }
+  }
+  return 1;
+}
+
+/* the label of point i, NULL if it has none */
+const char *tsp_matrix_label(tsp_matrix *m, int i) {
+
+  return m->labels[i];
+}
+
+/* release a matrix and everything it holds */
+void tsp_matrix_close(tsp_matrix *m) {
+
+  if (m->map) munmap(m->map, m->map_size);
+  free(m->values);
+  free(m->label_text);
+  free(m->labels);
+  free(m);
+}
+
+/*
+  Start writing an n x n binary matrix file, either to the named file
+  or, if filename is NULL, to the already open fp.  The header is
+  written immediately, since every offset depends only on n, the
+  element size and the layout.  NULL on failure.
+*/
+tsp_matrix_writer *tsp_matrix_writer_open(char *filename, FILE *fp, int n,
+					  int elem_size, tsp_layout layout) {
+
+  if (elem_size != 2 && elem_size != 4) {
+    fprintf(stderr, "Binary matrix elements must be 2 or 4 bytes\n");
+    return NULL;
+  }
+  tsp_matrix_writer *w = (tsp_matrix_writer *)calloc(1, sizeof(tsp_matrix_writer));
+  if (filename) {
+    w->fp = fopen(filename, "wb");
+    if (!w->fp) {
+      fprintf(stderr, "Could not open file %s for writing\n", filename);
+      free(w);
+      return NULL;
+    }
+    w->close_fp = 1;
+  }
+  else {
+    w->fp = fp;
+  }
+  tsp_header_init(&(w->h), n, elem_size, layout);
+  w->buf = (unsigned char *)calloc(1, tsp_align((uint64_t)n * elem_size,
+						 TSP_ROW_ALIGN));
+
+  unsigned char hbuf[sizeof(tsp_matrix_file_header)];
+  tsp_header_encode(&(w->h), hbuf);
+  if (!w->buf || fwrite(hbuf, sizeof(hbuf), 1, w->fp) != 1) {
+    fprintf(stderr, "Could not write binary matrix header\n");
+    if (w->close_fp) fclose(w->fp);
+    free(w->buf);
+    free(w);
+    return NULL;
+  }
+  return w;
+}
+
+/* pad out to the labels after the last row, 1 on success */
+static int tsp_matrix_writer_pad(tsp_matrix_writer *w) {
+
+  uint64_t end = w->h.data_offset + w->h.data_size;
+  static const char zeros[8];
+  if (w->h.labels_offset > end &&
+      fwrite(zeros, 1, w->h.labels_offset - end, w->fp) !=
+      w->h.labels_offset - end) {
+    fprintf(stderr, "Could not write binary matrix padding\n");
+    return 0;
+  }
+  return 1;
+}
+
+/*
+  Reopen the partly written binary matrix file filename, which must
+  have the header tsp_matrix_writer_open would write for the same n,
+  elem_size and layout, to continue writing after its first
+  rows_written rows.  Anything after those rows is discarded.  NULL on
+  failure.
+*/
+tsp_matrix_writer *tsp_matrix_writer_resume(char *filename, int n,
+					    int elem_size, tsp_layout layout,
+					    int rows_written) {
+
+  tsp_matrix_writer *w = (tsp_matrix_writer *)calloc(1, sizeof(tsp_matrix_writer));
+  tsp_header_init(&(w->h), n, elem_size, layout);
+  unsigned char expect[sizeof(tsp_matrix_file_header)];
+  unsigned char found[sizeof(tsp_matrix_file_header)];
+  tsp_header_encode(&(w->h), expect);
+
+  w->fp = fopen(filename, "r+b");
+  if (!w->fp) {
+    fprintf(stderr, "Could not open file %s to resume writing\n", filename);
+    free(w);
+    return NULL;
+  }
+  w->close_fp = 1;
+  if (fread(found, sizeof(found), 1, w->fp) != 1 ||
+      memcmp(found, expect, sizeof(found)) != 0) {
+    fprintf(stderr, "File %s is not the binary matrix being resumed\n",
+	    filename);
+    fclose(w->fp);
+    free(w);
+    return NULL;
+  }
+
+  uint64_t offset = w->h.data_offset;
+  if (layout == TSP_LAYOUT_FULL) {
+    offset += (uint64_t)rows_written * w->h.row_stride;
+  }
+  else {
+    offset += ((uint64_t)rows_written * n -
+	       (uint64_t)rows_written * (rows_written - 1) / 2) * elem_size;
+  }
+  w->buf = (unsigned char *)calloc(1, w->h.row_stride ? w->h.row_stride :
+				   (size_t)n * elem_size);
+  if (!w->buf || fflush(w->fp) != 0 ||
+      ftruncate(fileno(w->fp), offset) != 0 ||
+      fseeko(w->fp, offset, SEEK_SET) != 0) {
+    fprintf(stderr, "Could not resume writing file %s\n", filename);
+    fclose(w->fp);
+    free(w->buf);
+    free(w);
+    return NULL;
+  }
+  w->rows_written = rows_written;
+  if (rows_written == n && !tsp_matrix_writer_pad(w)) {
+    fclose(w->fp);
+    free(w->buf);
+    free(w);
+    return NULL;
+  }
+  return w;
+}
+
+/*
+  Write the next row of the matrix, given as all n of its entries
+  (only the upper triangle part is used for the packed layout).
+  Returns 1 on success, 0 on failure.
+*/
+int tsp_matrix_write_row(tsp_matrix_writer *w, const int *row) {
+
+  int n = w->h.n;
+  int i = w->rows_written;
+  int es = w->h.elem_size;
+  int first = (w->h.layout == TSP_LAYOUT_UPPER) ? i : 0;
+  size_t bytes = (w->h.layout == TSP_LAYOUT_UPPER) ?
+    (size_t)(n - i) * es : w->h.row_stride;
+  int j;
+
+  if (i >= n) {
+    fprintf(stderr, "Too many rows written to binary matrix\n");
+    return 0;
+  }
+  for (j = first; j < n; j++) {
+    if (row[j] < 0 || (es == 2 && row[j] > 0xffff)) {
+      fprintf(stderr, "Matrix entry %d does not fit in %d bytes\n",
+	      row[j], es);
+      return 0;
+    }
+    tsp_put_le(w->buf + (size_t)(j - first) * es, row[j], es);
+  }
+  if (fwrite(w->buf, 1, bytes, w->fp) != bytes) {
+    fprintf(stderr, "Could not write binary matrix row %d\n", i);
+    return 0;
+  }
+  w->rows_written++;
+
+  if (w->rows_written == n) return tsp_matrix_writer_pad(w);
+  return 1;
+}
+
+/*
+  Write the label of the next point, after all rows are written.
+  Returns 1 on success, 0 on failure.
+*/
+int tsp_matrix_write_label(tsp_matrix_writer *w, const char *label) {
+
+  if (w->rows_written != (int)w->h.n || w->labels_written >= (int)w->h.n) {
+    fprintf(stderr, "Binary matrix labels must follow all rows\n");
+    return 0;
+  }
+  if (fwrite(label, 1, strlen(label) + 1, w->fp) != strlen(label) + 1) {
+    fprintf(stderr, "Could not write binary matrix label\n");
+    return 0;
+  }
+  w->labels_written++;
+  return 1;
+}
+
+/*
+  Finish a binary matrix file: any points without labels get empty
+  ones.  Returns 1 if the complete file was written successfully.
+*/
+int tsp_matrix_writer_close(tsp_matrix_writer *w) {
+
+  int ok = (w->rows_written == (int)w->h.n);
+  if (!ok) {
+    fprintf(stderr, "Binary matrix closed after %d of %d rows\n",
+	    w->rows_written, w->h.n);
+  }
+  while (ok && w->labels_written < (int)w->h.n) {
+    ok = tsp_matrix_write_label(w, "");
+  }
+  if (fflush(w->fp) != 0) ok = 0;
+  if (w->close_fp && fclose(w->fp) != 0) ok = 0;
+  free(w->buf);
+  free(w);
+  return ok;
+}
@@ -0,0 +1,125 @@
+/*
+  Structure definitions and function prototypes for reading and
+  writing TSP distance matrix files: the text format of the datasets
+  in this repository and of tmg2tsp's output, and a binary format
+  that can be memory mapped so programs can start using a large
+  matrix without parsing it.
+
+  Binary format, all integers little-endian:
+
+    offset 0: tsp_matrix_file_header (64 bytes)
+    data_offset: the matrix, either
+      TSP_LAYOUT_FULL: n rows of n elements, each row starting
+	row_stride bytes after the previous one (rows are padded to
+	a multiple of TSP_ROW_ALIGN bytes), or
+      TSP_LAYOUT_UPPER: the upper triangle including the diagonal,
+	packed: n elements of row 0, then n-1 of row 1 starting at
+	column 1, and so on
+    labels_offset: n '\0'-terminated labels, one per point, through
+      the end of the file
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TSPMATRIX_H
+#define _TSPMATRIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TSP_MATRIX_MAGIC "TSPMAT\r\n"
+#define TSP_MATRIX_VERSION 1
+
+// full rows start on this byte boundary
+#define TSP_ROW_ALIGN 64
+
+typedef enum tsp_layout { TSP_LAYOUT_FULL, TSP_LAYOUT_UPPER } tsp_layout;
+extern char *tsp_layout_names[];
+
+typedef struct tsp_matrix_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t n;
+  uint32_t elem_size;  // bytes per element: 2 or 4
+  uint32_t layout;
+  uint64_t row_stride;  // bytes between full rows, 0 if packed
+  uint64_t data_offset;
+  uint64_t data_size;
+  uint64_t labels_offset;
+  uint64_t reserved;
+} tsp_matrix_file_header;
+
+// a matrix read from a file, either mapped from a binary file or
+// parsed from text into an owned full int matrix
+typedef struct tsp_matrix {
+  int n;
+  tsp_layout layout;
+  int elem_size;
+  size_t row_stride;
+  const unsigned char *data;
+  char **labels;  // n labels, NULL entries if the file has none
+  // for binary files, the mapping the data and labels point into
+  void *map;
+  size_t map_size;
+  // for text files, the owned matrix and label storage
+  int *values;
+  char *label_text;
+} tsp_matrix;
+
+// how the lines of a text matrix file are laid out, beyond the
+// entries themselves, as found while reading it
+typedef struct tsp_text_check {
+  int lines;  // through the last matrix entry
+  int matrix_lines;  // lines holding entries
+  int bad_rows;  // matrix lines without exactly n entries
+  int bad_row_line;  // the first of them, and its number of entries
+  int bad_row_count;
+  int blank_lines;  // among the matrix lines
+  int trailing_space_lines;
+  int tab_lines;  // entries separated by tabs
+  int space_lines;  // entries separated by spaces
+  int crlf_lines;
+  int lf_lines;
+  int extra_entries;  // after the last entry, on its line
+  int extra_rows;  // lines of integers right after the matrix
+  int labels;
+} tsp_text_check;
+
+// a binary matrix file being written, row by row
+typedef struct tsp_matrix_writer {
+  FILE *fp;
+  int close_fp;  // did the writer open fp?
+  tsp_matrix_file_header h;
+  int rows_written;
+  int labels_written;
+  unsigned char *buf;  // one row, encoded
+} tsp_matrix_writer;
+
+// function prototypes
+extern tsp_matrix *tsp_matrix_load(char *filename);
+extern tsp_matrix *tsp_matrix_open_binary(char *filename);
+extern tsp_matrix *tsp_matrix_load_text(char *filename);
+extern tsp_matrix *tsp_matrix_load_text_checked(char *filename,
+						tsp_text_check *check);
+extern int tsp_matrix_get(tsp_matrix *m, int i, int j);
+extern const int32_t *tsp_matrix_row(tsp_matrix *m, int i);
+extern int *tsp_matrix_to_ints(tsp_matrix *m);
+extern int tsp_matrix_is_symmetric(tsp_matrix *m);
+extern const char *tsp_matrix_label(tsp_matrix *m, int i);
+extern void tsp_matrix_close(tsp_matrix *m);
+extern int tsp_file_is_binary(char *filename);
+
+extern tsp_matrix_writer *tsp_matrix_writer_open(char *filename, FILE *fp,
+						 int n, int elem_size,
+						 tsp_layout layout);
+extern tsp_matrix_writer *tsp_matrix_writer_resume(char *filename, int n,
+						   int elem_size,
+						   tsp_layout layout,
+						   int rows_written);
+extern int tsp_matrix_write_row(tsp_matrix_writer *w, const int *row);
+extern int tsp_matrix_write_label(tsp_matrix_writer *w, const char *label);
+extern int tsp_matrix_writer_close(tsp_matrix_writer *w);
+
+#endif  // _TSPMATRIX_H
@@ -0,0 +1,286 @@
+/*
+  Solve TSP instances in the distance matrix formats of tspmatrix.h:
+  the datasets in this repository, or tmg2tsp's output.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "tspmatrix.h"
+#include "tsptour.h"
+#include "tspbnb.h"
+#include "tspheldkarp.h"
+#include "tspheuristic.h"
+#include "tsplowerbound.h"
+
+// how instances are solved: Held-Karp up to its size limit and
+// branch and bound beyond it, or always one of them, or only as well
+// as 2-opt and Or-opt moves can for instances too large for either
+typedef enum solve_method { METHOD_AUTO, METHOD_BNB, METHOD_HELD_KARP,
+			    METHOD_HEURISTIC
+} solve_method;
+static char *method_names[] = { "auto", "bnb", "held-karp", "heuristic" };
+
+static void usage(char *progname) {
+
+  fprintf(stderr, "Usage: %s [-j nthreads] [--method auto|bnb|held-karp|heuristic]\n       [--start greedy|nearest] [--neighbors K] [--speedup maxthreads]\n       [--bound certfile] file...\n", progname);
+}
+
+/*
+  tsp_bound_distance over a matrix: the shorter of the distances
+  between a and b, the same as tspbound computes its bounds with
+*/
+static int solve_bound_distance(void *data, int a, int b) {
+
+  tsp_matrix *m = (tsp_matrix *)data;
+  int d = tsp_matrix_get(m, a, b);
+  int back = tsp_matrix_get(m, b, a);
+  return (back < d) ? back : d;
+}
+
+/*
+  Solve the instance in filename by method with nthreads threads,
+  printing an optimal (or for the heuristic, a good) tour, or if
+  max_threads is positive, solve it with 1 through max_threads threads
+  and print a line of timings for each.  Heuristic tours start as
+  start says and use k neighbors per point.  If bound is not NULL, it
+  is the instance's bound certificate: if it is exact, it is first
+  checked against the matrix, then branch and bound stops once it
+  finds a tour that meets it, and how far the tour is from it is
+  reported.  Returns 1 on success, 0 on failure.
+*/
+static int solve_file(char *filename, solve_method method,
+		      tsp_heur_start start_with, int k, tsp_bound *bound,
+		      int nthreads, int max_threads) {
+
+  tsp_matrix *m = tsp_matrix_load(filename);
+  if (m == NULL) return 0;
+  int n = m->n;
+  if (bound && bound->n != n) {
+    fprintf(stderr, "Bound certificate is for %d points, %s has %d\n",
+	    bound->n, filename, n);
+    tsp_matrix_close(m);
+    return 0;
+  }
+  // a bound that is not really the matrix's could end a search before
+  // the optimal tour is found, so one that can must be checked first
+  if (bound && bound->exact) {
+    tsp_bound_instance inst = { n, solve_bound_distance, m, 0, NULL };
+    if (!tsp_bound_verify(&inst, bound, nthreads)) {
+      fprintf(stderr, "Bound certificate does not match %s: its bounds are not those of this matrix under its penalties\n",
+	      filename);
+      tsp_matrix_close(m);
+      return 0;
+    }
+  }
+  // only a bound over all pairs of points can end a search
+  long lower = (bound && bound->exact) ? tsp_bound_best(bound) : 0;
+
+  if (method == METHOD_AUTO) {
+    method = (n <= TSP_HK_MAX_POINTS) ? METHOD_HELD_KARP : METHOD_BNB;
+  }
+
+  // the exact methods need all the distances at hand, and start from
+  // a heuristic tour, the shorter the better for branch and bound
+  int *dist = NULL;
+  int *start = (int *)malloc(n * sizeof(int));
+  int *tour = (int *)malloc(n * sizeof(int));
+  tsp_heur_stats heur;
+  int ok = (start && tour);
+  if (ok && method != METHOD_HEURISTIC) {
+    dist = tsp_matrix_to_ints(m);
+    ok = dist && tsp_heur_matrix_tour(m, start_with, k, nthreads, start,
+				      &heur) >= 0;
+  }
+  if (!ok) {
+    free(dist);
+    free(start);
+    free(tour);
+    tsp_matrix_close(m);
+    return 0;
+  }
+
+  int first = max_threads ? 1 : nthreads;
+  int last = max_threads ? max_threads : nthreads;
+  double one_thread = 0.0;
+  for (int t = first; ok && t <= last; t++) {
+    tsp_bnb_stats stats;
+    tsp_hk_stats hk;
+    long length;
+    memcpy(tour, start, n * sizeof(int));
+    double begin = tsp_seconds();
+    if (method == METHOD_HELD_KARP) {
+      length = tsp_held_karp_solve(dist, n, t, tour, &hk);
+    }
+    else if (method == METHOD_HEURISTIC) {
+      length = tsp_heur_matrix_tour(m, start_with, k, t, tour, &heur);
+    }
+    else {
+      length = tsp_bnb_solve(dist, n, t, lower, tour, &stats);
+    }
+    double seconds = tsp_seconds() - begin;
+    // the work done: partial tours expanded, table entries computed or
+    // moves made
+    long work;
+    if (method == METHOD_HELD_KARP) work = (long)hk.states;
+    else if (method == METHOD_HEURISTIC) {
+      work = heur.two_opt_moves + heur.or_opt_moves;
+    }
+    else work = stats.nodes;
+    if (length < 0) {
+      ok = 0;
+      break;
+    }
+    if (t == 1) one_thread = seconds;
+    // checked already, so this should not happen, but no tour is
+    // printed as optimal that contradicts the bound
+    if (bound && bound->exact && length < tsp_bound_best(bound)) {
+      fprintf(stderr, "Tour is shorter than the certified bound: the certificate is not for %s\n",
+	      filename);
+      ok = 0;
+      break;
+    }
+
+    if (max_threads) {
+      printf("%-40s %6d %-9s %7d %10.4f %8.2f %12ld %8ld\n", filename, n,
+	     method_names[method], t, seconds,
+	     seconds > 0.0 ? one_thread / seconds : 0.0, work, length);
+    }
+    else {
+      printf("%s: %d points, %s tour length %ld\n", filename, n,
+	     method == METHOD_HEURISTIC ? "heuristic" : "optimal", length);
+      tsp_tour_print(stdout, m, tour);
+      if (method == METHOD_HELD_KARP) {
+	fprintf(stderr, "%zu table entries in %zu bytes, %.3fs on %d threads\n",
+		hk.states, hk.bytes, seconds, t);
+      }
+      else if (method == METHOD_HEURISTIC) {
+	fprintf(stderr, "%s tour %ld, %ld 2-opt and %ld Or-opt moves, %.3fs on %d threads\n",
+		tsp_heur_start_names[start_with], heur.start_length,
+		heur.two_opt_moves, heur.or_opt_moves, seconds, t);
+      }
+      else {
+	fprintf(stderr, "%ld partial tours expanded, %ld stolen, %ld improvements, %.3fs on %d threads\n",
+		stats.nodes, stats.steals, stats.improvements, seconds, t);
+      }
+      if (bound) {
+	long best = tsp_bound_best(bound);
+	fprintf(stderr, "%s lower bound %ld, tour is %.2f%% above it\n",
+		bound->exact ? "Certified" : "Estimated", best,
+		best > 0 ? 100.0 * (length - best) / best : 0.0);
+      }
+    }
+  }
+
+  free(dist);
+  free(start);
+  free(tour);
+  tsp_matrix_close(m);
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+
+  long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+  int nthreads = (nprocs < 1) ? 1 : (int)nprocs;
+  int max_threads = 0;
+  solve_method method = METHOD_AUTO;
+  tsp_heur_start start = TSP_HEUR_GREEDY;
+  int k = TSP_HEUR_NEIGHBORS;
+  char *bound_file = NULL;
+  int opt;
+
+  static struct option long_options[] = {
+    { "speedup", required_argument, NULL, 'S' },
+    { "method", required_argument, NULL, 'm' },
+    { "start", required_argument, NULL, 's' },
+    { "neighbors", required_argument, NULL, 'k' },
+    { "bound", required_argument, NULL, 'b' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  while ((opt = getopt_long(argc, argv, "j:", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'j':
+      nthreads = atoi(optarg);
+      if (nthreads < 1) {
+	fprintf(stderr, "Number of threads must be at least 1\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'S':
+      // time each file with 1 up to this many threads
+      max_threads = atoi(optarg);
+      if (max_threads < 1) {
+	fprintf(stderr, "Number of threads must be at least 1\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'm':
+      for (method = METHOD_AUTO; method <= METHOD_HEURISTIC; method++) {
+	if (strcmp(optarg, method_names[method]) == 0) break;
+      }
+      if (method > METHOD_HEURISTIC) {
+	fprintf(stderr, "Unknown method %s\n", optarg);
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 's':
+      if (!tsp_heur_start_from_name(optarg, &start)) {
+	fprintf(stderr, "Unknown starting tour %s\n", optarg);
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'k':
+      // heuristic moves are tried toward this many neighbors of a point
+      k = atoi(optarg);
+      if (k < 1) {
+	fprintf(stderr, "Number of neighbors must be at least 1\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 'b':
+      // a bound certificate for the instance, from tspbound
+      bound_file = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  if (argc - optind < 1 || (bound_file && argc - optind != 1)) {
+    usage(argv[0]);
+    exit(1);
+  }
+  tsp_bound *bound = NULL;
+  if (bound_file) {
+    bound = tsp_bound_load(bound_file);
+    if (!bound) exit(1);
+  }
+
+  if (max_threads) {
+    printf("%-40s %6s %-9s %7s %10s %8s %12s %8s\n", "file", "points",
+	   "method", "threads", "seconds", "speedup", "work", "length");
+  }
+  int failed = 0;
+  for (int i = optind; i < argc; i++) {
+    if (!solve_file(argv[i], method, start, k, bound, nthreads,
+		    max_threads)) {
+      failed++;
+    }
+  }
+  if (bound) tsp_bound_destroy(bound);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+/*
+  Functions for TSP tours over a distance matrix, shared by the
+  solvers.  See tsptour.h for how tours and distances are stored.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tsptour.h"
+
+/* the length of tour, including the return to its start */
+long tsp_tour_length(const int *dist, int n, const int *tour) {
+
+  long length = 0;
+  for (int i = 0; i < n; i++) {
+    int next = (i + 1 < n) ? tour[i + 1] : tour[0];
+    length += dist[(size_t)tour[i] * n + next];
+  }
+  return length;
+}
+
+/*
+  Is tour a tour of n points: each point listed once, starting at
+  point 0?
+*/
+int tsp_tour_is_valid(const int *tour, int n) {
+
+  if (n < 1 || tour[0] != 0) return 0;
+  unsigned char *seen = (unsigned char *)calloc(n, 1);
+  if (!seen) return 0;
+  int ok = 1;
+  for (int i = 0; ok && i < n; i++) {
+    ok = (tour[i] >= 0 && tour[i] < n && !seen[tour[i]]);
+    if (ok) seen[tour[i]] = 1;
+  }
+  free(seen);
+  return ok;
+}
+
+/*
+  Print tour of the points of m, one stop per line: the point's
+  number, then its label if m has one, ending back at the start.
+*/
+void tsp_tour_print(FILE *fp, tsp_matrix *m, const int *tour) {
+
+  for (int i = 0; i <= m->n; i++) {
+    int p = tour[i % m->n];
+    const char *label = tsp_matrix_label(m, p);
+    if (label) {
+      fprintf(fp, "%d\t%s\n", p, label);
+    }
+    else {
+      fprintf(fp, "%d\n", p);
+    }
+  }
+}
+
+/* seconds on a clock that only moves forward, for timing solvers */
+double tsp_seconds() {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,24 @@
+/*
+  Function prototypes for working with TSP tours over a distance
+  matrix: n points numbered from 0, distances in a row-major n x n
+  array of ints (the row of a point lists the distances from it), and
+  a tour an array listing each point once, starting with point 0,
+  with the return to point 0 implied.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#ifndef _TSPTOUR_H
+#define _TSPTOUR_H
+
+#include <stdio.h>
+#include "tspmatrix.h"
+
+// function prototypes
+extern long tsp_tour_length(const int *dist, int n, const int *tour);
+extern int tsp_tour_is_valid(const int *tour, int n);
+extern void tsp_tour_print(FILE *fp, tsp_matrix *m, const int *tour);
+extern double tsp_seconds();
+
+#endif  // _TSPTOUR_H
@@ -0,0 +1,157 @@
+/*
+  Convert a TSP distance matrix text file, like the datasets in this
+  repository or the output of tmg2tsp, to the binary format described
+  in tspmatrix.h, or convert a binary matrix back to text.
+
+  Jim Teresco, Fall 2021
+  Siena College
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "tspmatrix.h"
+
+static void usage(char *progname) {
+
+  fprintf(stderr, "Usage: %s [--packed] [--width 2|4] input.txt output.bin\n", progname);
+  fprintf(stderr, "       %s --to-text input.bin output.txt\n", progname);
+}
+
+/*
+  Write m in the text format: the number of points, the rows of the
+  matrix, then the labels.
+*/
+static int write_text(tsp_matrix *m, char *filename) {
+
+  FILE *fp = fopen(filename, "w");
+  if (!fp) {
+    fprintf(stderr, "Could not open file %s for writing\n", filename);
+    return 0;
+  }
+  fprintf(fp, "%d\n", m->n);
+  for (int i = 0; i < m->n; i++) {
+    for (int j = 0; j < m->n; j++) {
+      fprintf(fp, "%d\t", tsp_matrix_get(m, i, j));
+    }
+    fprintf(fp, "\n");
+  }
+  fprintf(fp, "\n");
+  for (int i = 0; i < m->n; i++) {
+    const char *label = tsp_matrix_label(m, i);
+    fprintf(fp, "%s\n", label ? label : "");
+  }
+  return fclose(fp) == 0;
+}
+
+int main(int argc, char *argv[]) {
+
+  tsp_layout layout = TSP_LAYOUT_FULL;
+  int elem_size = 0;  // 0: 2 bytes if every entry fits, otherwise 4
+  int to_text = 0;
+  int opt;
+
+  static struct option long_options[] = {
+    { "packed", no_argument, NULL, 'p' },
+    { "width", required_argument, NULL, 'w' },
+    { "to-text", no_argument, NULL, 't' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'p':
+      layout = TSP_LAYOUT_UPPER;
+      break;
+    case 'w':
+      elem_size = atoi(optarg);
+      if (elem_size != 2 && elem_size != 4) {
+	fprintf(stderr, "Element width must be 2 or 4 bytes\n");
+	usage(argv[0]);
+	exit(1);
+      }
+      break;
+    case 't':
+      to_text = 1;
+      break;
+    default:
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  if (argc - optind != 2) {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  tsp_matrix *m = tsp_matrix_load(argv[optind]);
+  if (m == NULL) {
+    exit(1);
+  }
+
+  if (to_text) {
+    int ok = write_text(m, argv[optind+1]);
+    tsp_matrix_close(m);
+    return ok ? 0 : 1;
+  }
+
+  // check that the entries can be stored as requested
+  int fits_short = 1;
+  for (int i = 0; i < m->n; i++) {
+    for (int j = 0; j < m->n; j++) {
+      int v = tsp_matrix_get(m, i, j);
+      if (v < 0) {
+	fprintf(stderr, "Negative matrix entry %d at row %d, column %d\n",
+		v, i, j);
+	tsp_matrix_close(m);
+	exit(1);
+      }
+      if (v > 0xffff) fits_short = 0;
+      if (layout == TSP_LAYOUT_UPPER && v != tsp_matrix_get(m, j, i)) {
+	fprintf(stderr, "Matrix is not symmetric at row %d, column %d, so it cannot be packed\n",
+		i, j);
+	tsp_matrix_close(m);
+	exit(1);
+      }
+    }
+  }
+  if (elem_size == 0) {
+    elem_size = fits_short ? 2 : 4;
+  }
+  else if (elem_size == 2 && !fits_short) {
+    fprintf(stderr, "Matrix entries do not fit in 2 bytes\n");
+    tsp_matrix_close(m);
+    exit(1);
+  }
+
+  tsp_matrix_writer *w = tsp_matrix_writer_open(argv[optind+1], NULL, m->n,
+						elem_size, layout);
+  if (w == NULL) {
+    tsp_matrix_close(m);
+    exit(1);
+  }
+  int *row = (int *)malloc(m->n * sizeof(int));
+  int ok = 1;
+  for (int i = 0; ok && i < m->n; i++) {
+    for (int j = 0; j < m->n; j++) {
+      row[j] = tsp_matrix_get(m, i, j);
+    }
+    ok = tsp_matrix_write_row(w, row);
+  }
+  for (int i = 0; ok && i < m->n; i++) {
+    const char *label = tsp_matrix_label(m, i);
+    ok = tsp_matrix_write_label(w, label ? label : "");
+  }
+  ok = tsp_matrix_writer_close(w) && ok;
+  free(row);
+
+  if (ok) {
+    printf("%s: %d points, %d-byte %s layout\n", argv[optind+1], m->n,
+	   elem_size, tsp_layout_names[layout]);
+  }
+  tsp_matrix_close(m);
+  return ok ? 0 : 1;
+}